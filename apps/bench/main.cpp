@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <fmt/std.h>
+#include <magic_enum/magic_enum.hpp>
+#include <mlang/eval.hpp>
+#include <mlang/exec.hpp>
+#include <mlang/feedback.hpp>
+#include <mlang/optimizer.hpp>
+#include <mlang/parser.hpp>
+#include <new>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+std::size_t allocations = 0;
+}  // namespace
+
+auto operator new(std::size_t size) -> void*
+{
+    ++allocations;
+    if (auto* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+struct Options
+{
+    std::vector<mlang::Engine> engines;
+    int iterations = 5;
+    bool feedback = false;
+    bool optimize = false;
+    std::size_t parse_mib = 0;
+    std::size_t dispatch_millions = 0;
+    std::vector<fs::path> files;
+};
+
+auto parse_options(int argc, char* argv[]) -> Options
+{
+    constexpr auto iterations_prefix = std::string_view("--iterations=");
+    constexpr auto parse_prefix = std::string_view("--parse=");
+    constexpr auto dispatch_prefix = std::string_view("--dispatch=");
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const auto arg = std::string_view(argv[i]);
+        if (const auto engine = mlang::parse_engine_arg(arg))
+        {
+            options.engines.push_back(*engine);
+        }
+        else if (arg == "--feedback")
+        {
+            options.feedback = true;
+        }
+        else if (arg == "--optimize")
+        {
+            options.optimize = true;
+        }
+        else if (arg.starts_with(iterations_prefix))
+        {
+            const auto value = arg.substr(iterations_prefix.size());
+            std::from_chars(value.data(), value.data() + value.size(), options.iterations);
+        }
+        else if (arg.starts_with(parse_prefix))
+        {
+            const auto value = arg.substr(parse_prefix.size());
+            std::from_chars(value.data(), value.data() + value.size(), options.parse_mib);
+        }
+        else if (arg.starts_with(dispatch_prefix))
+        {
+            const auto value = arg.substr(dispatch_prefix.size());
+            std::from_chars(value.data(), value.data() + value.size(), options.dispatch_millions);
+        }
+        else
+        {
+            options.files.emplace_back(arg);
+        }
+    }
+    if (options.engines.empty())
+    {
+        const auto all = magic_enum::enum_values<mlang::Engine>();
+        options.engines.assign(std::begin(all), std::end(all));
+    }
+    return options;
+}
+
+auto spell(std::size_t i) -> std::string
+{
+    std::string res;
+    do
+    {
+        res += static_cast<char>('a' + i % 26);
+        i /= 26;
+    } while (i != 0);
+    return res;
+}
+
+auto generate_script(std::size_t bytes) -> std::string
+{
+    std::string script;
+    for (std::size_t i = 0; script.size() < bytes; ++i)
+    {
+        script += fmt::format("let fun_{0} = fn(a, b) {{ let c = a * {1} + b; if (c > 10) {{ return [c, \"s{0}\", {{\"k\": c}}][0]; }} else {{ c - 1 }} }};\n"
+                              "let val_{0} = fun_{0}({1}, -{1}) + len(\"abc\");\n"
+                              "while (val_{0} < {1}) {{ let val_{0} = val_{0} + 1; }}\n",
+                              spell(i), i);
+    }
+    return script;
+}
+
+void bench_parse(const Options& options)
+{
+    const auto script = generate_script(options.parse_mib * 1024 * 1024);
+    std::vector<double> parse_timings;
+    std::vector<double> teardown_timings;
+    std::size_t parse_allocations = 0;
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        auto parser = std::make_unique<mlang::Parser>(std::make_unique<mlang::Lexer>(script));
+        const auto allocations_before = allocations;
+        const auto start = std::chrono::steady_clock::now();
+        auto program = parser->parse_program();
+        const auto parsed = std::chrono::steady_clock::now();
+        parse_allocations = allocations - allocations_before;
+        if (!parser->get_errors().empty() || !program)
+        {
+            fmt::println("generated script: parser errors");
+            return;
+        }
+        program.reset();
+        parser.reset();
+        const auto stop = std::chrono::steady_clock::now();
+        parse_timings.push_back(std::chrono::duration<double, std::milli>(parsed - start).count());
+        teardown_timings.push_back(std::chrono::duration<double, std::milli>(stop - parsed).count());
+    }
+    std::sort(std::begin(parse_timings), std::end(parse_timings));
+    std::sort(std::begin(teardown_timings), std::end(teardown_timings));
+    fmt::println("{:<24} {:<16} min {:>10.3f} ms  median {:>10.3f} ms  teardown {:>10.3f} ms  allocations {}",
+                 fmt::format("parse {} bytes", script.size()), "Parser", parse_timings.front(), parse_timings[parse_timings.size() / 2],
+                 teardown_timings[teardown_timings.size() / 2], parse_allocations);
+}
+
+template <typename Check>
+void bench_dispatch_loop(std::string_view name, const Options& options, std::size_t size, Check&& check)
+{
+    const auto rounds = (options.dispatch_millions * 1000000 + size - 1) / size;
+    const auto checks = rounds * size;
+    std::vector<double> timings;
+    std::size_t hits = 0;
+    for (int i = 0; i < options.iterations; ++i)
+    {
+        hits = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t round = 0; round < rounds; ++round)
+        {
+            for (std::size_t j = 0; j < size; ++j)
+            {
+                hits += check(j);
+            }
+        }
+        const auto stop = std::chrono::steady_clock::now();
+        timings.push_back(std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(checks));
+    }
+    std::sort(std::begin(timings), std::end(timings));
+    fmt::println("{:<24} {:<16} min {:>10.3f} ns  median {:>10.3f} ns  hits {}",
+                 fmt::format("dispatch {}M", options.dispatch_millions), name, timings.front(), timings[timings.size() / 2], hits);
+}
+
+// Times the type checks every engine performs on values and nodes, over a working set
+// that stays in cache so that only the dispatch itself is measured.
+void bench_dispatch(const Options& options)
+{
+    std::vector<mlang::Value> values;
+    for (std::size_t i = 0; i < 1024; ++i)
+    {
+        switch (i % 4)
+        {
+        case 0:
+            values.push_back(mlang::make_ref<mlang::StringObj>("s"));
+            break;
+        case 1:
+            values.push_back(mlang::make_ref<mlang::ArrayObj>(std::vector<mlang::Value>{}));
+            break;
+        case 2:
+            values.push_back(mlang::make_ref<mlang::HashObj>());
+            break;
+        default:
+            values.push_back(mlang::make_ref<mlang::ErrorObj>("e"));
+            break;
+        }
+    }
+    std::shuffle(std::begin(values), std::end(values), std::minstd_rand(42));
+    bench_dispatch_loop("Value", options, values.size(), [&](std::size_t i)
+                        { return values[i].get_type() == mlang::ObjectType::STRING; });
+
+    const auto script = generate_script(16 * 1024);
+    mlang::Parser parser(std::make_unique<mlang::Lexer>(script));
+    const auto program = parser.parse_program();
+    std::vector<mlang::Node*> nodes;
+    const auto collect = [&](auto&& self, mlang::Node* node) -> void
+    {
+        if (node)
+        {
+            nodes.push_back(node);
+            mlang::detail::for_each_child(node, [&](mlang::Node* child)
+                                          { self(self, child); });
+        }
+    };
+    collect(collect, program.get());
+    bench_dispatch_loop("Node", options, nodes.size(), [&](std::size_t i)
+                        { return nodes[i]->get_type() == mlang::NodeType::InfixExpression; });
+}
+
+void bench_file(const fs::path& file, const Options& options)
+{
+    const auto input = mlang::detail::read_file(file);
+    mlang::Parser parser(std::make_unique<mlang::Lexer>(input));
+    const auto program = parser.parse_program();
+    if (!parser.get_errors().empty() || !program)
+    {
+        fmt::println("{}: parser errors", file);
+        return;
+    }
+    if (options.optimize)
+    {
+        fmt::println("{:<24} optimizer {}", file.filename().string(), mlang::format_optimizer_stats(mlang::optimize(*program)));
+    }
+    for (const auto engine : options.engines)
+    {
+        std::vector<double> timings;
+        std::string result;
+        for (int i = 0; i < options.iterations; ++i)
+        {
+            auto env = mlang::make_ref<mlang::Context>();
+            const auto start = std::chrono::steady_clock::now();
+            const auto evaluated = mlang::eval(program.get(), env, engine);
+            const auto stop = std::chrono::steady_clock::now();
+            timings.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+            result = evaluated ? evaluated.inspect() : "nil";
+        }
+        std::sort(std::begin(timings), std::end(timings));
+        fmt::println("{:<24} {:<16} min {:>10.3f} ms  median {:>10.3f} ms  result {}",
+                     file.filename().string(), magic_enum::enum_name(engine), timings.front(), timings[timings.size() / 2], result);
+    }
+    if (options.feedback)
+    {
+        fmt::println("{:<24} feedback {}", file.filename().string(), mlang::format_feedback(mlang::collect_feedback(program.get())));
+    }
+}
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+    const auto options = parse_options(argc, argv);
+    if ((options.files.empty() && options.parse_mib == 0 && options.dispatch_millions == 0) || options.iterations < 1)
+    {
+        fmt::println("usage: bench [--engine=<name>]... [--iterations=<n>] [--feedback] [--optimize] [--parse=<MiB>] [--dispatch=<millions>] files...");
+        return 1;
+    }
+    if (options.parse_mib != 0)
+    {
+        bench_parse(options);
+    }
+    if (options.dispatch_millions != 0)
+    {
+        bench_dispatch(options);
+    }
+    for (const auto& file : options.files)
+    {
+        bench_file(file, options);
+    }
+}
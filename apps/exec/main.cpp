@@ -1,9 +1,22 @@
 #include <mlang/exec.hpp>
+#include <string_view>
 
 auto main(int argc, char* argv[]) -> int
 {
+    auto engine = mlang::Engine::TreeWalker;
+    auto optimize = false;
     for (int i = 1; i < argc; ++i)
     {
-        mlang::exec(argv[i]);
+        if (const auto selected = mlang::parse_engine_arg(argv[i]))
+        {
+            engine = *selected;
+            continue;
+        }
+        if (std::string_view(argv[i]) == "--optimize")
+        {
+            optimize = true;
+            continue;
+        }
+        mlang::exec(argv[i], engine, optimize);
     }
 }
@@ -1,6 +1,12 @@
+#include <mlang/exec.hpp>
 #include <mlang/repl.hpp>
 
-int main()
+int main(int argc, char* argv[])
 {
-    mlang::repl_interactive();
+    auto engine = mlang::Engine::TreeWalker;
+    if (argc > 1)
+    {
+        engine = mlang::parse_engine_arg(argv[1]).value_or(engine);
+    }
+    mlang::repl_interactive(engine);
 }
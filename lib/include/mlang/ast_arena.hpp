@@ -0,0 +1,320 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mlang
+{
+struct ArenaStats
+{
+    std::size_t m_chunks = 0;
+    std::size_t m_bytes = 0;
+    std::size_t m_nodes = 0;
+    std::size_t m_finalizers = 0;
+};
+
+// Owning edge to a node in an AstArena, the arena frees the memory.
+template <typename T>
+class NodePtr
+{
+public:
+    NodePtr() = default;
+
+    NodePtr(std::nullptr_t)
+    {
+    }
+
+    explicit NodePtr(T* node)
+        : m_node(node)
+    {
+    }
+
+    NodePtr(const NodePtr&) = delete;
+
+    NodePtr(NodePtr&& other) noexcept
+        : m_node(std::exchange(other.m_node, nullptr))
+    {
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    NodePtr(NodePtr<U>&& other) noexcept
+        : m_node(other.release())
+    {
+    }
+
+    auto operator=(const NodePtr&) -> NodePtr& = delete;
+
+    auto operator=(NodePtr&& other) noexcept -> NodePtr&
+    {
+        m_node = std::exchange(other.m_node, nullptr);
+        return *this;
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    auto operator=(NodePtr<U>&& other) noexcept -> NodePtr&
+    {
+        m_node = other.release();
+        return *this;
+    }
+
+    auto get() const -> T*
+    {
+        return m_node;
+    }
+
+    auto release() -> T*
+    {
+        return std::exchange(m_node, nullptr);
+    }
+
+    void reset()
+    {
+        m_node = nullptr;
+    }
+
+    auto operator*() const -> T&
+    {
+        return *m_node;
+    }
+
+    auto operator->() const -> T*
+    {
+        return m_node;
+    }
+
+    explicit operator bool() const
+    {
+        return m_node != nullptr;
+    }
+
+    friend auto operator==(const NodePtr& lhs, std::nullptr_t) -> bool
+    {
+        return lhs.m_node == nullptr;
+    }
+
+private:
+    T* m_node = nullptr;
+};
+
+// Bump allocator for the nodes of one program, released all at once.
+class AstArena : public std::enable_shared_from_this<AstArena>
+{
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    auto operator=(const AstArena&) -> AstArena& = delete;
+    ~AstArena();
+
+    auto allocate(std::size_t size, std::size_t align) -> void*
+    {
+        auto cursor = (reinterpret_cast<std::uintptr_t>(m_cursor) + align - 1) & ~(align - 1);
+        if (cursor + size > reinterpret_cast<std::uintptr_t>(m_end))
+        {
+            refill(size + align);
+            cursor = (reinterpret_cast<std::uintptr_t>(m_cursor) + align - 1) & ~(align - 1);
+        }
+        m_cursor = reinterpret_cast<std::byte*>(cursor + size);
+        m_stats.m_bytes += size;
+        return reinterpret_cast<void*>(cursor);
+    }
+
+    template <typename T, typename... Args>
+    auto make(Args&&... args) -> NodePtr<T>
+    {
+        auto* node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+        {
+            m_finalizers.push_back({node, [](void* ptr)
+                                    { static_cast<T*>(ptr)->~T(); }});
+        }
+        ++m_stats.m_nodes;
+        return NodePtr<T>(node);
+    }
+
+    auto intern(std::string_view str) -> std::string_view;
+
+    // Keeps the arena alive through a pointer to one of its nodes.
+    template <typename T>
+    auto share(T* node) -> std::shared_ptr<T>
+    {
+        return std::shared_ptr<T>(shared_from_this(), node);
+    }
+
+    auto stats() const -> ArenaStats;
+
+private:
+    struct Chunk
+    {
+        Chunk* m_next;
+    };
+
+    struct Finalizer
+    {
+        void* m_node;
+        void (*m_finalize)(void*);
+    };
+
+    void refill(std::size_t size);
+
+private:
+    std::byte* m_cursor = nullptr;
+    std::byte* m_end = nullptr;
+    Chunk* m_chunks = nullptr;
+    std::size_t m_next_chunk_size = 0;
+    std::vector<Finalizer> m_finalizers;
+    ArenaStats m_stats;
+};
+
+// Growable array allocated from an AstArena, trivially destructible.
+template <typename T>
+class ArenaVector
+{
+    static_assert(std::is_trivially_destructible_v<T>);
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    ArenaVector() = default;
+
+    explicit ArenaVector(AstArena& arena)
+        : m_arena(&arena)
+    {
+    }
+
+    ArenaVector(const ArenaVector&) = delete;
+
+    ArenaVector(ArenaVector&& other) noexcept
+        : m_arena(other.m_arena)
+        , m_data(std::exchange(other.m_data, nullptr))
+        , m_size(std::exchange(other.m_size, 0))
+        , m_capacity(std::exchange(other.m_capacity, 0))
+    {
+    }
+
+    auto operator=(const ArenaVector&) -> ArenaVector& = delete;
+
+    auto operator=(ArenaVector&& other) noexcept -> ArenaVector&
+    {
+        m_arena = other.m_arena;
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_capacity = std::exchange(other.m_capacity, 0);
+        return *this;
+    }
+
+    template <typename... Args>
+    auto emplace_back(Args&&... args) -> T&
+    {
+        if (m_size == m_capacity)
+        {
+            grow();
+        }
+        return *new (m_data + m_size++) T(std::forward<Args>(args)...);
+    }
+
+    void push_back(T&& value)
+    {
+        emplace_back(std::move(value));
+    }
+
+    void clear()
+    {
+        m_size = 0;
+    }
+
+    auto size() const -> std::size_t
+    {
+        return m_size;
+    }
+
+    auto empty() const -> bool
+    {
+        return m_size == 0;
+    }
+
+    auto operator[](std::size_t i) -> T&
+    {
+        return m_data[i];
+    }
+
+    auto operator[](std::size_t i) const -> const T&
+    {
+        return m_data[i];
+    }
+
+    auto at(std::size_t i) const -> const T&
+    {
+        if (i >= m_size)
+        {
+            throw std::out_of_range("ArenaVector::at");
+        }
+        return m_data[i];
+    }
+
+    auto front() const -> const T&
+    {
+        return m_data[0];
+    }
+
+    auto back() -> T&
+    {
+        return m_data[m_size - 1];
+    }
+
+    auto back() const -> const T&
+    {
+        return m_data[m_size - 1];
+    }
+
+    auto begin() -> T*
+    {
+        return m_data;
+    }
+
+    auto end() -> T*
+    {
+        return m_data + m_size;
+    }
+
+    auto begin() const -> const T*
+    {
+        return m_data;
+    }
+
+    auto end() const -> const T*
+    {
+        return m_data + m_size;
+    }
+
+private:
+    void grow()
+    {
+        const auto capacity = m_capacity == 0 ? std::uint32_t{4} : m_capacity * 2;
+        auto* data = static_cast<T*>(m_arena->allocate(capacity * sizeof(T), alignof(T)));
+        for (std::uint32_t i = 0; i < m_size; ++i)
+        {
+            new (data + i) T(std::move(m_data[i]));
+        }
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+private:
+    AstArena* m_arena = nullptr;
+    T* m_data = nullptr;
+    std::uint32_t m_size = 0;
+    std::uint32_t m_capacity = 0;
+};
+
+template <typename T>
+using NodeList = ArenaVector<NodePtr<T>>;
+}  // namespace mlang
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <fmt/format.h>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace mlang
+{
+namespace detail
+{
+struct AtomEntry
+{
+    std::size_t m_hash;
+    std::string m_text;
+};
+}  // namespace detail
+
+// Interned string, compared by pointer and never freed.
+class Atom
+{
+public:
+    Atom() = default;
+
+    static auto intern(std::string_view text) -> Atom;
+
+    auto view() const -> std::string_view
+    {
+        return m_entry ? std::string_view(m_entry->m_text) : std::string_view();
+    }
+
+    auto hash() const -> std::size_t
+    {
+        return m_entry ? m_entry->m_hash : std::hash<std::string_view>{}({});
+    }
+
+    auto empty() const -> bool
+    {
+        return m_entry == nullptr;
+    }
+
+    operator std::string_view() const
+    {
+        return view();
+    }
+
+    friend auto operator==(Atom lhs, Atom rhs) -> bool
+    {
+        return lhs.m_entry == rhs.m_entry;
+    }
+
+    friend auto operator==(Atom lhs, std::string_view rhs) -> bool
+    {
+        return lhs.view() == rhs;
+    }
+
+    friend auto operator<<(std::ostream& out, Atom atom) -> std::ostream&
+    {
+        return out << atom.view();
+    }
+
+private:
+    explicit Atom(const detail::AtomEntry* entry)
+        : m_entry(entry)
+    {
+    }
+
+private:
+    const detail::AtomEntry* m_entry = nullptr;
+};
+
+struct atom_hash
+{
+    std::size_t operator()(Atom atom) const
+    {
+        return atom.hash();
+    }
+};
+
+auto atom_count() -> std::size_t;
+}  // namespace mlang
+
+template <>
+struct fmt::formatter<::mlang::Atom> : fmt::formatter<std::string_view>
+{
+    template <typename FormatContext>
+    auto format(::mlang::Atom atom, FormatContext& ctx) const
+    {
+        return fmt::formatter<std::string_view>::format(atom.view(), ctx);
+    }
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <memory>
+#include <mlang/node.hpp>
+#include <mlang/object.hpp>
+#include <vector>
+
+namespace mlang
+{
+auto compile_closures(Node* node) -> Thunk;
+
+namespace detail
+{
+auto apply_thunk_function(const ThunkFnObj& fn, const std::vector<Value>& args) -> Value;
+}  // namespace detail
+}  // namespace mlang
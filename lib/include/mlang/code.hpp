@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlang
+{
+using Instructions = std::vector<std::uint8_t>;
+
+enum class OpCode : std::uint8_t
+{
+    Constant,
+    Pop,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Equal,
+    NotEqual,
+    GreaterThan,
+    LessThan,
+    Minus,
+    Bang,
+    True,
+    False,
+    Null,
+    Jump,
+    JumpNotTruthy,
+    GetGlobal,
+    SetGlobal,
+    GetLocal,
+    SetLocal,
+    GetFree,
+    CurrentClosure,
+    Array,
+    Hash,
+    Index,
+    Call,
+    ReturnValue,
+    Closure,
+    TailCall,
+};
+
+struct OpDefinition
+{
+    std::string_view name;
+    std::array<std::uint8_t, 2> operand_widths;
+    std::uint8_t operand_count;
+};
+
+auto lookup(OpCode op) -> const OpDefinition&;
+auto make(OpCode op, std::initializer_list<std::size_t> operands = {}) -> Instructions;
+auto disassemble(const Instructions& instructions) -> std::string;
+
+inline auto read_u32(const std::uint8_t* ptr) -> std::uint32_t
+{
+    return (static_cast<std::uint32_t>(ptr[0]) << 24) | (static_cast<std::uint32_t>(ptr[1]) << 16) | (static_cast<std::uint32_t>(ptr[2]) << 8) | ptr[3];
+}
+
+inline auto read_u16(const std::uint8_t* ptr) -> std::uint16_t
+{
+    return static_cast<std::uint16_t>((ptr[0] << 8) | ptr[1]);
+}
+
+inline auto read_u8(const std::uint8_t* ptr) -> std::uint8_t
+{
+    return *ptr;
+}
+
+inline void write_u32(std::uint8_t* ptr, std::size_t value)
+{
+    ptr[0] = static_cast<std::uint8_t>((value >> 24) & 0xFF);
+    ptr[1] = static_cast<std::uint8_t>((value >> 16) & 0xFF);
+    ptr[2] = static_cast<std::uint8_t>((value >> 8) & 0xFF);
+    ptr[3] = static_cast<std::uint8_t>(value & 0xFF);
+}
+
+inline void write_u16(std::uint8_t* ptr, std::size_t value)
+{
+    ptr[0] = static_cast<std::uint8_t>((value >> 8) & 0xFF);
+    ptr[1] = static_cast<std::uint8_t>(value & 0xFF);
+}
+}  // namespace mlang
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mlang/code.hpp>
+#include <mlang/node.hpp>
+#include <mlang/object.hpp>
+#include <mlang/string_hash.hpp>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mlang
+{
+enum class SymbolScope : std::uint8_t
+{
+    Global,
+    Local,
+    Free,
+    Function,
+};
+
+struct Symbol
+{
+    SymbolScope scope;
+    std::size_t index;
+};
+
+class Compiler
+{
+    struct CompilationScope
+    {
+        Instructions m_instructions;
+        std::vector<Value> m_constants;
+        std::vector<Atom> m_names;
+        std::unordered_map<std::string, std::size_t, string_hash, std::equal_to<>> m_name_indices;
+        std::unordered_map<std::string, Symbol, string_hash, std::equal_to<>> m_symbols;
+        std::vector<std::string> m_local_names;
+        std::vector<Capture> m_captures;
+        std::vector<std::size_t> m_local_fallbacks;
+        std::string m_self_name;
+        // Parameters and lets of the function, whether or not compiled yet.
+        std::shared_ptr<const std::vector<Atom>> m_declared;
+    };
+
+public:
+    Compiler();
+    auto compile(Node* node) -> Ref<CompiledFnObj>;
+    auto get_errors() const -> const std::vector<std::string>&;
+
+private:
+    void compile_node(Node* node);
+    void compile_statements(const NodeList<Statement>& statements, bool keep_value);
+    void compile_fn(FnLiteral& fn, std::string_view self_name);
+    void compile_let(LetStatement& let);
+    void compile_while(WhileStatement& stmt);
+    void compile_if(IfExpression& expr);
+    void compile_infix(InfixExpression& expr);
+    void compile_prefix(PrefixExpression& expr);
+
+    auto emit(OpCode op, std::initializer_list<std::size_t> operands = {}) -> std::size_t;
+    void patch_jump(std::size_t pos, std::size_t target);
+    auto add_constant(Value obj) -> std::size_t;
+    auto add_name(std::string_view name) -> std::size_t;
+    auto define(std::string_view name) -> Symbol;
+    auto define_local(CompilationScope& curr, std::string_view name) -> Symbol;
+    auto resolve(std::string_view name, std::size_t level) -> Symbol;
+    auto fallback(std::size_t level, const Symbol& symbol, std::string_view name) -> std::size_t;
+    void resolve_fallbacks(std::size_t num_parameters);
+    void load_symbol(const Symbol& symbol, std::string_view name);
+    auto scope() -> CompilationScope&;
+    void enter_scope();
+    auto leave_scope() -> CompilationScope;
+
+private:
+    std::vector<CompilationScope> m_scopes;
+    std::vector<std::string> m_errors;
+};
+}  // namespace mlang
@@ -0,0 +1,7 @@
+#pragma once
+
+#if defined(ENABLE_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define MLANG_THREADED_DISPATCH 1
+#else
+#define MLANG_THREADED_DISPATCH 0
+#endif
@@ -1,48 +1,96 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mlang/node.hpp>
 #include <mlang/object.hpp>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace mlang
 {
-auto eval(Node* node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>;
+enum class Engine : std::uint8_t
+{
+    TreeWalker,
+    StackVm,
+    RegisterVm,
+    ClosureCompiler,
+    FlatWalker,
+};
+
+constexpr std::size_t DEFAULT_MAX_CALL_DEPTH = 1 << 20;
+
+auto eval(Node* node, const Ref<Context>& env) -> Value;
+auto eval(Node* node, const Ref<Context>& env, Engine engine) -> Value;
+auto eval(Node* node, const Ref<Context>& env, Engine engine, std::size_t max_call_depth) -> Value;
 
 namespace detail
 {
-extern const std::shared_ptr<BooleanObj> TRUE;
-extern const std::shared_ptr<BooleanObj> FALSE;
-extern const std::shared_ptr<NullObj> NIL;
-
-extern const std::unordered_map<std::string_view, std::shared_ptr<Object>> BUILTINS;
-extern const std::shared_ptr<BuiltInObj> LEN;
-extern const std::shared_ptr<BuiltInObj> REST;
-extern const std::shared_ptr<BuiltInObj> PUTS;
-extern const std::shared_ptr<BuiltInObj> PUSH;
-extern const std::shared_ptr<BuiltInObj> ERASE;
-extern const std::shared_ptr<BuiltInObj> FIRST;
-extern const std::shared_ptr<BuiltInObj> LAST;
-
-auto is_truth(const std::shared_ptr<Object>& obj) -> bool;
-
-auto eval_len(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>;
-auto eval_puts(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>;
-auto eval_rest(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>;
-auto eval_push(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>;
-auto eval_erase(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>;
-auto eval_program(Program& prog, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>;
-auto eval_block_statement(BlockStatement& stmt, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>;
-auto eval_identifier(Identifier& node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>;
-auto eval_expressions(const std::vector<std::unique_ptr<Expression>>& nodes, const std::shared_ptr<Context>& env) -> std::vector<std::shared_ptr<Object>>;
-auto apply_function(const std::shared_ptr<FunctionObj>& fn, const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>;
-auto eval_int_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>;
-auto eval_string_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>;
-auto eval_bool_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>;
-auto eval_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>;
-auto eval_if_expression(IfExpression& expr, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>;
-auto eval_minus_prefix_operator(const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>;
-auto eval_bang_expression(const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>;
-auto eval_prefix_expression(const std::string& op, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>;
-auto eval_index_expression(const std::shared_ptr<Object>& obj, const std::shared_ptr<Object>& index) -> std::shared_ptr<Object>;
+// Native stack kept free below the deepest interpreter call.
+constexpr std::size_t NATIVE_STACK_MARGIN = 256 << 10;
+// Assumed thread stack size where the platform cannot report it.
+constexpr std::size_t FALLBACK_NATIVE_STACK_SIZE = 1 << 20;
+
+inline const Value TRUE = Value::boolean(true);
+inline const Value FALSE = Value::boolean(false);
+inline const Value NIL = Value::nil();
+
+extern const std::unordered_map<std::string_view, Value> BUILTINS;
+extern const std::vector<std::pair<std::string_view, Value>> BUILTIN_TABLE;
+extern const Ref<BuiltInObj> LEN;
+extern const Ref<BuiltInObj> REST;
+extern const Ref<BuiltInObj> PUTS;
+extern const Ref<BuiltInObj> PUSH;
+extern const Ref<BuiltInObj> ERASE;
+extern const Ref<BuiltInObj> SLICE;
+extern const Ref<BuiltInObj> GC_STATS;
+extern const Ref<BuiltInObj> FIRST;
+extern const Ref<BuiltInObj> LAST;
+
+// Pending tail call, run in a loop by the caller.
+template <typename Fn>
+struct TailCall
+{
+    Ref<Fn> m_fn;
+    std::vector<Value> m_args;
+};
+
+inline auto is_truth(const Value& obj) -> bool
+{
+    return obj != FALSE && obj != NIL;
+}
+
+auto enter_call() -> Value;
+void leave_call();
+auto stack_overflow_error(std::size_t max_call_depth) -> Value;
+auto builtin_index(std::string_view name) -> std::optional<std::size_t>;
+
+auto eval_len(const std::vector<Value>& args) -> Value;
+auto eval_puts(const std::vector<Value>& args) -> Value;
+auto eval_rest(const std::vector<Value>& args) -> Value;
+auto eval_push(const std::vector<Value>& args) -> Value;
+auto eval_erase(const std::vector<Value>& args) -> Value;
+auto eval_slice(const std::vector<Value>& args) -> Value;
+auto eval_gc_stats(const std::vector<Value>& args) -> Value;
+auto eval_program(Program& prog, const Ref<Context>& env) -> Value;
+auto eval_block_statement(BlockStatement& stmt, const Ref<Context>& env) -> Value;
+auto eval_identifier(Identifier& node, const Ref<Context>& env) -> Value;
+auto eval_expressions(const NodeList<Expression>& nodes, const Ref<Context>& env) -> std::vector<Value>;
+auto apply_function(const Ref<FunctionObj>& fn, const std::vector<Value>& args) -> Value;
+auto eval_tail_position(Node* node, const Ref<Context>& env, TailCall<FunctionObj>& call, bool tail) -> Value;
+auto eval_infix_expression(Operator op, const Value& left, const Value& right) -> Value;
+auto eval_if_expression(IfExpression& expr, const Ref<Context>& env) -> Value;
+// Calls a builtin whose result is stored into binding, which stops holding the first argument
+// during the call so that `let a = push(a, x)` can update a in place.
+auto call_rebinding_builtin(const BuiltInObj& builtin, const std::vector<Value>& args, Value* binding) -> Value;
+// target is the name a let statement binds the result to, nullptr for other calls.
+auto eval_call_expression(CallExpression& expr, const Ref<Context>& env, const Identifier* target) -> Value;
+auto eval_minus_prefix_operator(const Value& right) -> Value;
+auto eval_bang_expression(const Value& right) -> Value;
+auto eval_prefix_expression(Operator op, const Value& right) -> Value;
+auto eval_index_expression(const Value& obj, const Value& index) -> Value;
 }  // namespace detail
 }  // namespace mlang
@@ -1,9 +1,13 @@
 #pragma once
 #include <fs.hpp>
+#include <mlang/eval.hpp>
+#include <optional>
+#include <string_view>
 
 namespace mlang
 {
-void exec(const fs::path& file_path);
+void exec(const fs::path& file_path, Engine engine = Engine::TreeWalker, bool optimize = false);
+auto parse_engine_arg(std::string_view arg) -> std::optional<Engine>;
 
 namespace detail
 {
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mlang/node.hpp>
+#include <mlang/object.hpp>
+#include <string>
+
+namespace mlang
+{
+constexpr std::uint32_t MAX_SPECIALIZATIONS = 4;
+
+struct FeedbackStats
+{
+    std::size_t m_sites = 0;
+    std::size_t m_monomorphic = 0;
+    std::size_t m_polymorphic = 0;
+    std::size_t m_megamorphic = 0;
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+};
+
+auto collect_feedback(Node* node) -> FeedbackStats;
+auto format_feedback(const FeedbackStats& stats) -> std::string;
+
+namespace detail
+{
+auto specialize_infix(TypeFeedback<InfixHandler>& site, Operator op, ObjectType left_type, ObjectType right_type) -> InfixHandler;
+auto specialize_index(TypeFeedback<IndexHandler>& site, ObjectType left_type, ObjectType index_type) -> IndexHandler;
+
+inline auto eval_quickened_infix(InfixExpression& expr, const Value& left, const Value& right) -> Value
+{
+    auto& site = expr.m_feedback;
+    const auto left_type = left.get_type();
+    const auto right_type = right.get_type();
+    if (site.m_megamorphic || (site.m_left_type == static_cast<int>(left_type) && site.m_right_type == static_cast<int>(right_type)))
+    {
+        ++site.m_hits;
+        return site.m_handler(expr.m_operator, left, right);
+    }
+    return specialize_infix(site, expr.m_operator, left_type, right_type)(expr.m_operator, left, right);
+}
+
+inline auto eval_quickened_index(IndexExpression& expr, const Value& obj, const Value& index) -> Value
+{
+    auto& site = expr.m_feedback;
+    const auto obj_type = obj.get_type();
+    const auto index_type = index.get_type();
+    if (site.m_megamorphic || (site.m_left_type == static_cast<int>(obj_type) && site.m_right_type == static_cast<int>(index_type)))
+    {
+        ++site.m_hits;
+        return site.m_handler(obj, index);
+    }
+    return specialize_index(site, obj_type, index_type)(obj, index);
+}
+
+// Looks up the constant string key through the cached shape, nullptr on a miss.
+inline auto find_by_shape(ShapeCache& cache, const Value& obj, Atom key) -> const Value*
+{
+    if (obj.get_type() != ObjectType::HASH)
+    {
+        return nullptr;
+    }
+    const auto& pairs = obj.as<HashObj>().m_pairs;
+    const auto* shape = pairs.shape();
+    if (!shape)
+    {
+        return nullptr;
+    }
+    if (shape != cache.m_shape)
+    {
+        const auto slot = shape->slot(key);
+        if (slot == shape->size())
+        {
+            return nullptr;
+        }
+        cache = {shape, slot};
+    }
+    return &pairs.at_slot(cache.m_slot);
+}
+}  // namespace detail
+}  // namespace mlang
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mlang/ast_arena.hpp>
+#include <mlang/node.hpp>
+#include <mlang/operator.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlang
+{
+using FlatIndex = std::uint32_t;
+
+constexpr FlatIndex NO_NODE = ~FlatIndex{0};
+
+struct FlatChildren
+{
+    FlatIndex m_first = NO_NODE;
+    FlatIndex m_second = NO_NODE;
+};
+
+struct FlatIdentifier
+{
+    Atom m_name;
+    std::optional<LexicalAddress> m_address;
+    std::optional<std::size_t> m_builtin;
+};
+
+struct FlatFunction
+{
+    FlatIndex m_parameters;
+    FlatIndex m_arity;
+    FlatIndex m_body;
+    std::shared_ptr<const std::vector<Atom>> m_slot_names;
+};
+
+// Struct-of-arrays form of a resolved program. Node i is m_kinds[i], m_payloads[i] and
+// m_children[i]:
+//
+//   Program, BlockStatement, ArrayLiteral   first: offset into m_lists, payload: count
+//   HashLiteral                             first: offset into m_lists, payload: pairs
+//   CallExpression                          first: callee, second: m_lists offset, payload: count
+//   LetStatement                            first: Identifier node, second: value
+//   Return-, ExpressionStatement            first: expression
+//   IfExpression                            first: condition, second: consequence, payload: alternative
+//   WhileStatement, IndexExpression         first, second: the two operands
+//   PrefixExpression                        first: operand, payload: Operator
+//   InfixExpression                         first, second: operands, payload: Operator
+//   IntegerLiteral                          payload: m_integers, first: m_strings (spelling)
+//   StringLiteral                           payload: m_atoms
+//   BooleanLiteral                          payload: 0 or 1
+//   Identifier                              payload: m_identifiers
+//   FnLiteral                               payload: m_functions
+struct FlatAst
+{
+    auto size() const -> std::size_t
+    {
+        return m_kinds.size();
+    }
+
+    auto list(FlatIndex offset) const -> const FlatIndex*
+    {
+        return m_lists.data() + offset;
+    }
+
+    auto to_string() const -> std::string;
+    auto to_string(FlatIndex node) const -> std::string;
+
+    FlatIndex m_root = NO_NODE;
+    std::vector<NodeType> m_kinds;
+    std::vector<std::uint32_t> m_payloads;
+    std::vector<FlatChildren> m_children;
+    std::vector<FlatIndex> m_lists;
+    std::vector<std::int64_t> m_integers;
+    std::vector<std::string_view> m_strings;
+    std::vector<Atom> m_atoms;
+    std::vector<FlatIdentifier> m_identifiers;
+    std::vector<FlatFunction> m_functions;
+    std::shared_ptr<AstArena> m_arena;
+};
+
+auto flatten(Node* node) -> FlatAst;
+}  // namespace mlang
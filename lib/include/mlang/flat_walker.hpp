@@ -0,0 +1,16 @@
+#pragma once
+
+#include <memory>
+#include <mlang/flat_ast.hpp>
+#include <mlang/object.hpp>
+#include <vector>
+
+namespace mlang
+{
+auto eval_flat(const std::shared_ptr<const FlatAst>& ast, const Ref<Context>& env) -> Value;
+
+namespace detail
+{
+auto apply_flat_function(const FlatFnObj& fn, const std::vector<Value>& args) -> Value;
+}  // namespace detail
+}  // namespace mlang
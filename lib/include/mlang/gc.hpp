@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mlang/heap.hpp>
+#include <vector>
+
+namespace mlang
+{
+struct GcStats
+{
+    std::size_t m_collections = 0;
+    std::size_t m_collected = 0;
+    std::size_t m_candidates = 0;
+    std::size_t m_tracked = 0;
+};
+
+namespace detail
+{
+class CycleCollector;
+}  // namespace detail
+
+class Collectable
+{
+public:
+    Collectable(const Collectable& other);
+    auto operator=(const Collectable&) -> Collectable&
+    {
+        return *this;
+    }
+    virtual ~Collectable();
+
+#ifndef ENABLE_ATOMIC_REFCOUNT
+    static auto operator new(std::size_t size) -> void*
+    {
+        return detail::heap_allocate(size);
+    }
+
+    static void operator delete(void* ptr, std::size_t size)
+    {
+        detail::heap_deallocate(ptr, size);
+    }
+#endif
+
+    void retain() const
+    {
+        if (is_immortal())
+        {
+            return;
+        }
+#ifdef ENABLE_ATOMIC_REFCOUNT
+        m_refs.fetch_add(1, std::memory_order_relaxed);
+#else
+        ++m_refs;
+#endif
+    }
+
+    void release() const
+    {
+        if (is_immortal())
+        {
+            return;
+        }
+#ifdef ENABLE_ATOMIC_REFCOUNT
+        if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+#else
+        if (--m_refs == 0)
+        {
+            destroy();
+        }
+        else if (m_traced && !m_buffered)
+        {
+            buffer_root();
+        }
+#endif
+    }
+
+    auto ref_count() const -> std::uint32_t
+    {
+        return m_refs;
+    }
+
+    // Pins the count so that the object is never freed and can be shared by every thread.
+    void make_immortal() const
+    {
+        m_refs = IMMORTAL;
+    }
+
+    virtual void trace(std::vector<Collectable*>& children);
+    virtual void clear_refs();
+
+protected:
+    explicit Collectable(bool traced = false);
+
+private:
+    friend class detail::CycleCollector;
+
+    static constexpr std::uint32_t IMMORTAL = 1u << 31;
+
+    auto is_immortal() const -> bool
+    {
+#ifdef ENABLE_ATOMIC_REFCOUNT
+        return m_refs.load(std::memory_order_relaxed) >= IMMORTAL;
+#else
+        return m_refs >= IMMORTAL;
+#endif
+    }
+
+#ifndef ENABLE_ATOMIC_REFCOUNT
+    enum class Color : std::uint8_t
+    {
+        Black,
+        Gray,
+        White,
+        Purple,
+    };
+
+    void destroy() const
+    {
+        if (m_buffered)
+        {
+            unbuffer_root();
+        }
+        delete this;
+    }
+
+    void buffer_root() const;
+    void unbuffer_root() const;
+#endif
+
+private:
+#ifdef ENABLE_ATOMIC_REFCOUNT
+    mutable std::atomic<std::uint32_t> m_refs = 0;
+#else
+    mutable std::uint32_t m_refs = 0;
+    mutable std::uint32_t m_root_index = 0;
+    mutable Color m_color = Color::Black;
+    mutable bool m_buffered = false;
+#endif
+    const bool m_traced;
+};
+
+auto gc_stats() -> GcStats;
+void collect_cycles();
+}  // namespace mlang
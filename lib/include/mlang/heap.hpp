@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mlang
+{
+struct HeapStats
+{
+    std::size_t m_chunks = 0;
+    std::size_t m_live = 0;
+    std::size_t m_recycled = 0;
+    std::size_t m_bumped = 0;
+};
+
+auto heap_stats() -> HeapStats;
+
+namespace detail
+{
+auto heap_allocate(std::size_t size) -> void*;
+void heap_deallocate(void* ptr, std::size_t size);
+}  // namespace detail
+}  // namespace mlang
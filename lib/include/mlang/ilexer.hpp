@@ -4,6 +4,7 @@
 
 namespace mlang
 {
+// Identifier, integer, string and illegal tokens may refer to the lexer input.
 class ILexer
 {
 public:
@@ -11,14 +11,14 @@ public:
     Token next_token() override;
 
 private:
-    auto read_identifier() -> std::string;
-    auto read_number() -> std::string;
-    auto read_string() -> std::string;
+    auto read_identifier() -> std::string_view;
+    auto read_number() -> std::string_view;
+    auto read_string() -> std::string_view;
     void skip_whitespaces();
     void read_char();
     auto peek_char() -> char;
     auto is_letter(char ch) -> bool;
-    auto lookup_ident(std::string_view ident) const -> TokenType;
+    auto lookup_ident(std::string_view ident) const -> Token;
 
 private:
     std::string_view m_input;
@@ -1,8 +1,15 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <mlang/ast_arena.hpp>
+#include <mlang/atom.hpp>
+#include <mlang/operator.hpp>
+#include <mlang/shape.hpp>
 #include <mlang/token.hpp>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace mlang
@@ -29,111 +36,152 @@ enum class NodeType : std::uint8_t
     WhileStatement,
 };
 
+class Value;
+
+template <typename Handler>
+struct TypeFeedback
+{
+    Handler m_handler = nullptr;
+    int m_left_type = -1;
+    int m_right_type = -1;
+    bool m_megamorphic = false;
+    std::uint32_t m_specializations = 0;
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+};
+
+using InfixHandler = auto (*)(Operator op, const Value& left, const Value& right) -> Value;
+using IndexHandler = auto (*)(const Value& obj, const Value& index) -> Value;
+
 class Node
 {
 public:
     virtual auto token_literal() -> std::string = 0;
     virtual auto to_string() -> std::string = 0;
-    virtual auto get_type() -> NodeType = 0;
-    virtual ~Node() = 0;
+
+    auto get_type() const -> NodeType
+    {
+        return m_type;
+    }
+
+protected:
+    explicit Node(NodeType type)
+        : m_type(type)
+    {
+    }
+    ~Node() = default;
+
+private:
+    const NodeType m_type;
 };
 
 class Statement : public Node
 {
-public:
-    virtual ~Statement() = 0;
+protected:
+    using Node::Node;
+    ~Statement() = default;
 };
 
 class Expression : public Node
 {
-public:
-    virtual ~Expression() = 0;
+protected:
+    using Node::Node;
+    ~Expression() = default;
 };
 
+// Every other node lives in m_arena and is released together with it.
 class Program : public Node
 {
 public:
+    explicit Program(std::shared_ptr<AstArena> arena);
     ~Program() = default;
 
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
-    std::vector<std::unique_ptr<Statement>> m_statements;
+    std::shared_ptr<AstArena> m_arena;
+    NodeList<Statement> m_statements;
+};
+
+struct LexicalAddress
+{
+    std::size_t m_depth;
+    std::size_t m_slot;
 };
 
 class Identifier : public Expression
 {
 public:
+    Identifier();
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::string m_value;
+    Atom m_value;
+    std::optional<LexicalAddress> m_address;
+    std::optional<std::size_t> m_builtin;
 };
 
 class LetStatement : public Statement
 {
 public:
+    LetStatement();
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Identifier> m_name;
-    std::unique_ptr<Expression> m_value;
+    NodePtr<Identifier> m_name;
+    NodePtr<Expression> m_value;
 };
 
 class ReturnStatement : public Statement
 {
 public:
+    ReturnStatement();
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Expression> m_return_value;
+    NodePtr<Expression> m_return_value;
 };
 
 class BlockStatement : public Statement
 {
 public:
+    explicit BlockStatement(AstArena& arena);
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::vector<std::unique_ptr<Statement>> m_statements;
+    NodeList<Statement> m_statements;
 };
 
 class ExpressionStatement : public Statement
 {
 public:
+    ExpressionStatement();
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Expression> m_expression;
+    NodePtr<Expression> m_expression;
 };
 
 class IntegerLiteral : public Expression
 {
 public:
-    IntegerLiteral() = default;
+    IntegerLiteral();
     IntegerLiteral(std::int64_t val);
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
@@ -143,25 +191,24 @@ public:
 class StringLiteral : public Expression
 {
 public:
-    StringLiteral() = default;
-    StringLiteral(std::string_view str);
+    StringLiteral();
+    StringLiteral(Atom str);
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::string m_value;
+    Atom m_value;
 };
 
 class BooleanLiteral : public Expression
 {
 public:
+    BooleanLiteral();
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
@@ -171,126 +218,213 @@ public:
 class IfExpression : public Expression
 {
 public:
+    IfExpression();
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Expression> m_condition;
-    std::unique_ptr<BlockStatement> m_consequence;
-    std::unique_ptr<BlockStatement> m_alternative;
+    NodePtr<Expression> m_condition;
+    NodePtr<BlockStatement> m_consequence;
+    NodePtr<BlockStatement> m_alternative;
 };
 
 class WhileStatement : public Statement
 {
 public:
+    WhileStatement();
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Expression> m_condition;
-    std::unique_ptr<BlockStatement> m_loop_body;
+    NodePtr<Expression> m_condition;
+    NodePtr<BlockStatement> m_loop_body;
 };
 
 class PrefixExpression : public Expression
 {
 public:
+    PrefixExpression();
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::string m_operator;
-    std::unique_ptr<Expression> m_right;
+    Operator m_operator = Operator::Bang;
+    NodePtr<Expression> m_right;
 };
 
 class InfixExpression : public Expression
 {
 public:
+    InfixExpression();
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Expression> m_left;
-    std::string m_operator;
-    std::unique_ptr<Expression> m_right;
+    NodePtr<Expression> m_left;
+    Operator m_operator = Operator::Plus;
+    NodePtr<Expression> m_right;
+    TypeFeedback<InfixHandler> m_feedback;
 };
 
 class FnLiteral : public Expression
 {
 public:
+    explicit FnLiteral(AstArena& arena);
     auto token_literal() -> std::string override;
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::vector<std::shared_ptr<Identifier>> m_parameters;
-    std::shared_ptr<BlockStatement> m_body;
+    NodeList<Identifier> m_parameters;
+    NodePtr<BlockStatement> m_body;
+    std::shared_ptr<const std::vector<Atom>> m_slot_names;
+    AstArena* m_arena;
 };
 
 class ArrayLiteral : public Expression
 {
 public:
+    explicit ArrayLiteral(AstArena& arena);
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::vector<std::unique_ptr<Expression>> m_expressions;
+    NodeList<Expression> m_expressions;
 };
 
 class IndexExpression : public Expression
 {
 public:
+    IndexExpression();
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Expression> m_left;
-    std::unique_ptr<Expression> m_index;
+    NodePtr<Expression> m_left;
+    NodePtr<Expression> m_index;
+    TypeFeedback<IndexHandler> m_feedback;
+    ShapeCache m_shape_cache;
 };
 
 class CallExpression : public Expression
 {
 public:
+    explicit CallExpression(AstArena& arena);
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
-    std::unique_ptr<Expression> m_function;
-    std::vector<std::unique_ptr<Expression>> m_arguments;
+    NodePtr<Expression> m_function;
+    NodeList<Expression> m_arguments;
 };
 
 class HashLiteral : public Expression
 {
 public:
-    using ExprHashMap = std::vector<std::pair<std::shared_ptr<Expression>, std::shared_ptr<Expression>>>;
+    using ExprHashMap = ArenaVector<std::pair<NodePtr<Expression>, NodePtr<Expression>>>;
 
 public:
+    explicit HashLiteral(AstArena& arena);
     auto token_literal() -> std::string override;
 
     auto to_string() -> std::string override;
-    auto get_type() -> NodeType override;
 
 public:
     Token m_token;
     ExprHashMap m_pairs;
 };
+
+namespace detail
+{
+template <typename Callable>
+void for_each_child(Node* node, Callable&& callable)
+{
+    if (!node)
+    {
+        return;
+    }
+    switch (node->get_type())
+    {
+    case NodeType::Program:
+        for (const auto& stmt : static_cast<Program*>(node)->m_statements)
+        {
+            callable(stmt.get());
+        }
+        break;
+    case NodeType::BlockStatement:
+        for (const auto& stmt : static_cast<BlockStatement*>(node)->m_statements)
+        {
+            callable(stmt.get());
+        }
+        break;
+    case NodeType::LetStatement:
+        callable(static_cast<LetStatement*>(node)->m_value.get());
+        break;
+    case NodeType::ReturnStatement:
+        callable(static_cast<ReturnStatement*>(node)->m_return_value.get());
+        break;
+    case NodeType::ExpressionStatement:
+        callable(static_cast<ExpressionStatement*>(node)->m_expression.get());
+        break;
+    case NodeType::WhileStatement:
+        callable(static_cast<WhileStatement*>(node)->m_condition.get());
+        callable(static_cast<WhileStatement*>(node)->m_loop_body.get());
+        break;
+    case NodeType::IfExpression:
+        callable(static_cast<IfExpression*>(node)->m_condition.get());
+        callable(static_cast<IfExpression*>(node)->m_consequence.get());
+        callable(static_cast<IfExpression*>(node)->m_alternative.get());
+        break;
+    case NodeType::PrefixExpression:
+        callable(static_cast<PrefixExpression*>(node)->m_right.get());
+        break;
+    case NodeType::InfixExpression:
+        callable(static_cast<InfixExpression*>(node)->m_left.get());
+        callable(static_cast<InfixExpression*>(node)->m_right.get());
+        break;
+    case NodeType::CallExpression:
+        callable(static_cast<CallExpression*>(node)->m_function.get());
+        for (const auto& arg : static_cast<CallExpression*>(node)->m_arguments)
+        {
+            callable(arg.get());
+        }
+        break;
+    case NodeType::ArrayLiteral:
+        for (const auto& expr : static_cast<ArrayLiteral*>(node)->m_expressions)
+        {
+            callable(expr.get());
+        }
+        break;
+    case NodeType::IndexExpression:
+        callable(static_cast<IndexExpression*>(node)->m_left.get());
+        callable(static_cast<IndexExpression*>(node)->m_index.get());
+        break;
+    case NodeType::HashLiteral:
+        for (const auto& [key, val] : static_cast<HashLiteral*>(node)->m_pairs)
+        {
+            callable(key.get());
+            callable(val.get());
+        }
+        break;
+    case NodeType::FnLiteral:
+    case NodeType::Identifier:
+    case NodeType::IntegerLiteral:
+    case NodeType::BooleanLiteral:
+    case NodeType::StringLiteral:
+        break;
+    }
+}
+}  // namespace detail
 }  // namespace mlang
@@ -1,10 +1,18 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mlang/atom.hpp>
+#include <mlang/code.hpp>
+#include <mlang/flat_ast.hpp>
 #include <mlang/fmt_enum.hpp>
 #include <mlang/node.hpp>
-#include <mlang/string_hash.hpp>
+#include <mlang/persistent_map.hpp>
+#include <mlang/persistent_vector.hpp>
+#include <mlang/register_code.hpp>
+#include <mlang/value.hpp>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -13,172 +21,347 @@ namespace mlang
 {
 class Context;
 
-enum class ObjectType
+// Text lives in the atom, in m_text, or in a range of another string's m_text.
+// Appending to a range that ends at its owner's end grows m_text in place.
+class StringObj : public Object
 {
-    INTEGER,
-    BOOLEAN,
-    NIL,
-    RETURN,
-    ERROR,
-    FUNCTION,
-    STRING,
-    BUILTIN,
-    ARRAY,
-    HASH,
+public:
+    StringObj(std::string_view value);
+    StringObj(Atom atom);
+    StringObj(Ref<StringObj> owner, std::size_t offset, std::size_t length);
+    StringObj(const StringObj&) = delete;
+    auto operator=(const StringObj&) -> StringObj& = delete;
+    ~StringObj() override;
+    auto inspect() -> std::string override;
+
+    auto view() const -> std::string_view
+    {
+        if (m_storage == Storage::Range)
+        {
+            return {m_range.m_owner->view().data() + m_range.m_offset, m_length};
+        }
+        if (m_storage == Storage::Atom)
+        {
+            return m_atom.view();
+        }
+        return {m_text.data(), m_length};
+    }
+
+    auto size() const -> std::size_t
+    {
+        return m_length;
+    }
+
+    auto atom() const -> Atom
+    {
+        return m_storage == Storage::Atom ? m_atom : Atom();
+    }
+
+    auto hash() const -> std::size_t
+    {
+        return m_storage == Storage::Atom ? m_atom.hash() : std::hash<std::string_view>{}(view());
+    }
+
+    static auto concat(const Ref<StringObj>& left, const StringObj& right) -> Ref<StringObj>;
+    static auto slice(const Ref<StringObj>& str, std::size_t start, std::size_t end) -> Ref<StringObj>;
+
+private:
+    enum class Storage : std::uint8_t
+    {
+        Atom,
+        Owned,
+        Range,
+    };
+
+    struct Range
+    {
+        Ref<StringObj> m_owner;
+        std::size_t m_offset;
+    };
+
+private:
+    Storage m_storage;
+    std::size_t m_length;
+    union
+    {
+        Atom m_atom;
+        std::string m_text;
+        Range m_range;
+    };
 };
 
-class Object
+class ReturnValueObj : public Object
 {
 public:
-    virtual auto get_type() -> ObjectType = 0;
-    virtual auto inspect() -> std::string = 0;
-    virtual ~Object() = 0;
+    ReturnValueObj(Value value);
+    auto inspect() -> std::string override;
+
+public:
+    Value m_value;
 };
 
-class IntegerObj : public Object
+class BuiltInObj : public Object
 {
 public:
-    IntegerObj(std::int64_t value);
-    auto get_type() -> ObjectType override;
+    using BuiltInFn = std::function<Value(const std::vector<Value>&)>;
+    BuiltInObj(const BuiltInFn&);
     auto inspect() -> std::string override;
 
 public:
-    std::int64_t m_value;
+    BuiltInFn m_value;
+};
+
+// Persistent vector plus the range of it that the array exposes.
+class ArrayObj : public Object
+{
+public:
+    ArrayObj(const std::vector<Value>& values);
+    ArrayObj(PersistentVector values, std::size_t offset, std::size_t length);
+    auto inspect() -> std::string override;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
+
+    auto size() const -> std::size_t
+    {
+        return m_length;
+    }
+
+    auto at(std::size_t index) const -> const Value&
+    {
+        return m_values[m_offset + index];
+    }
+
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        m_values.for_each(m_offset, m_offset + m_length, std::forward<F>(f));
+    }
+
+    auto push(Value value) const -> Ref<ArrayObj>;
+    // Pushes onto this array itself, for arrays that nothing else refers to.
+    void append(Value value);
+    static auto slice(const Ref<ArrayObj>& array, std::size_t start, std::size_t end) -> Ref<ArrayObj>;
+
+private:
+    PersistentVector m_values;
+    std::size_t m_offset = 0;
+    std::size_t m_length = 0;
 };
 
-class BooleanObj : public Object
+class ErrorObj : public Object
 {
 public:
-    BooleanObj(bool value);
-    auto get_type() -> ObjectType override;
+    ErrorObj(std::string what);
     auto inspect() -> std::string override;
 
 public:
-    bool m_value;
+    std::string m_what;
 };
 
-class StringObj : public Object
+class FunctionObj : public Object
 {
 public:
-    StringObj(std::string_view value);
-    auto get_type() -> ObjectType override;
+    FunctionObj(std::shared_ptr<FnLiteral> literal, const Ref<Context>& env);
     auto inspect() -> std::string override;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
+
+public:
+    std::shared_ptr<FnLiteral> m_literal;
+    Ref<Context> m_env;
+};
+
+// Variable captured by bytecode closures, open on its frame's slot until that frame returns.
+class Upvalue : public Collectable
+{
+public:
+    explicit Upvalue(std::size_t slot);
+    void close(const std::vector<Value>& slots);
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
+
+    auto get(const std::vector<Value>& slots) const -> const Value&
+    {
+        return m_open ? slots[m_slot] : m_value;
+    }
 
 public:
-    std::string m_value;
+    std::size_t m_slot;
+    bool m_open = true;
+    Value m_value;
 };
 
-class NullObj : public Object
+// Where a new closure takes an upvalue from, m_fallback is read while it is unset.
+struct Capture
+{
+    static constexpr std::size_t GLOBAL = static_cast<std::size_t>(-1);
+
+    bool m_local;
+    std::size_t m_index;
+    std::string m_name;
+    std::size_t m_fallback = GLOBAL;
+};
+
+class CompiledFnObj : public Object
 {
 public:
-    auto get_type() -> ObjectType override;
+    CompiledFnObj(Instructions instructions,
+                  std::vector<Value> constants,
+                  std::vector<Atom> names,
+                  std::vector<std::string> local_names,
+                  std::size_t num_parameters,
+                  std::vector<Capture> captures = {},
+                  std::vector<std::size_t> local_fallbacks = {});
     auto inspect() -> std::string override;
+
+public:
+    Instructions m_instructions;
+    std::vector<Value> m_constants;
+    std::vector<Atom> m_names;
+    std::vector<std::string> m_local_names;
+    std::size_t m_num_parameters;
+    std::vector<Capture> m_captures;
+    // Upvalue read instead of each local while it is unset, or Capture::GLOBAL.
+    std::vector<std::size_t> m_local_fallbacks;
+    std::vector<const void*> m_handlers;
 };
 
-class ReturnValueObj : public Object
+class ClosureObj : public Object
 {
 public:
-    ReturnValueObj(std::shared_ptr<Object> obj);
-    auto get_type() -> ObjectType override;
+    ClosureObj(const Ref<CompiledFnObj>& fn, std::vector<Ref<Upvalue>> free);
     auto inspect() -> std::string override;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
 
 public:
-    std::shared_ptr<Object> m_value;
+    Ref<CompiledFnObj> m_fn;
+    std::vector<Ref<Upvalue>> m_free;
 };
 
-class BuiltInObj : public Object
+class RegisterFnObj : public Object
 {
 public:
-    using BuiltInFn = std::function<std::shared_ptr<Object>(const std::vector<std::shared_ptr<Object>>&)>;
-    BuiltInObj(const BuiltInFn&);
-    auto get_type() -> ObjectType override;
+    RegisterFnObj(std::vector<RegInstruction> code,
+                  std::vector<Value> constants,
+                  std::vector<Atom> names,
+                  std::vector<std::string> local_names,
+                  std::size_t num_parameters,
+                  std::size_t num_registers,
+                  std::vector<Capture> captures = {},
+                  std::vector<std::size_t> local_fallbacks = {});
     auto inspect() -> std::string override;
 
 public:
-    BuiltInFn m_value;
+    std::vector<RegInstruction> m_code;
+    std::vector<Value> m_constants;
+    std::vector<Atom> m_names;
+    std::vector<std::string> m_local_names;
+    std::size_t m_num_parameters;
+    std::size_t m_num_registers;
+    std::vector<Capture> m_captures;
+    // Upvalue read instead of each local while it is unset, or Capture::GLOBAL.
+    std::vector<std::size_t> m_local_fallbacks;
+    std::vector<const void*> m_handlers;
+    // Shape caches of Index instructions with a constant string key, by pc.
+    std::vector<ShapeCache> m_shape_caches;
 };
 
-class ArrayObj : public Object
+class RegisterClosureObj : public Object
 {
 public:
-    ArrayObj(const std::vector<std::shared_ptr<Object>>& values);
-    auto get_type() -> ObjectType override;
+    RegisterClosureObj(const Ref<RegisterFnObj>& fn, std::vector<Ref<Upvalue>> free);
     auto inspect() -> std::string override;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
 
 public:
-    std::vector<std::shared_ptr<Object>> m_values;
+    Ref<RegisterFnObj> m_fn;
+    std::vector<Ref<Upvalue>> m_free;
 };
 
-class ErrorObj : public Object
+using Thunk = std::function<Value(const Ref<Context>&)>;
+
+struct ThunkFnProto
+{
+    std::vector<Atom> m_parameters;
+    std::vector<std::optional<std::size_t>> m_parameter_slots;
+    std::shared_ptr<const std::vector<Atom>> m_slot_names;
+    Thunk m_body;
+};
+
+class ThunkFnObj : public Object
 {
 public:
-    ErrorObj(std::string what);
-    auto get_type() -> ObjectType override;
+    ThunkFnObj(const std::shared_ptr<const ThunkFnProto>& proto, const Ref<Context>& env);
     auto inspect() -> std::string override;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
 
 public:
-    std::string m_what;
+    std::shared_ptr<const ThunkFnProto> m_proto;
+    Ref<Context> m_env;
 };
 
-class FunctionObj : public Object
+class FlatFnObj : public Object
 {
 public:
-    FunctionObj(const std::vector<std::shared_ptr<Identifier>>& parameters,
-                const std::shared_ptr<BlockStatement>& body,
-                const std::shared_ptr<Context>& env);
-    auto get_type() -> ObjectType override;
+    FlatFnObj(const std::shared_ptr<const FlatAst>& ast, FlatIndex function, const Ref<Context>& env);
     auto inspect() -> std::string override;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
 
 public:
-    std::vector<std::shared_ptr<Identifier>> m_parameters;
-    std::shared_ptr<BlockStatement> m_body;
-    std::shared_ptr<Context> m_env;
+    std::shared_ptr<const FlatAst> m_ast;
+    FlatIndex m_function;
+    Ref<Context> m_env;
 };
 
 namespace detail
 {
-struct object_hash
+struct value_hash
 {
-    std::size_t operator()(const std::shared_ptr<Object>& expr) const
+    std::size_t operator()(const Value& value) const
     {
-        const auto expr_type = expr->get_type();
-        if (expr_type == ObjectType::INTEGER)
+        const auto value_type = value.get_type();
+        if (value_type == ObjectType::INTEGER)
         {
-            return std::hash<decltype(static_cast<IntegerObj&>(*expr).m_value)>()(static_cast<IntegerObj&>(*expr).m_value);
+            return std::hash<std::int64_t>()(value.as_integer());
         }
-        if (expr_type == ObjectType::STRING)
+        if (value_type == ObjectType::STRING)
         {
-            return std::hash<decltype(static_cast<StringObj&>(*expr).m_value)>()(static_cast<StringObj&>(*expr).m_value);
+            return value.as<StringObj>().hash();
         }
-        if (expr_type == ObjectType::BOOLEAN)
+        if (value_type == ObjectType::BOOLEAN)
         {
-            return std::hash<decltype(static_cast<BooleanObj&>(*expr).m_value)>()(static_cast<BooleanObj&>(*expr).m_value);
+            return std::hash<bool>()(value.as_boolean());
         }
-        throw std::runtime_error(fmt::format("object of type {} is not hashable", expr_type));
+        throw std::runtime_error(fmt::format("object of type {} is not hashable", value_type));
     }
 };
 
-struct object_eq
+struct value_eq
 {
-    std::size_t operator()(const std::shared_ptr<Object>& lhs, const std::shared_ptr<Object>& rhs) const
+    bool operator()(const Value& lhs, const Value& rhs) const
     {
-        const auto l_type = lhs->get_type();
-        const auto r_type = rhs->get_type();
-        if (l_type != r_type)
+        const auto l_type = lhs.get_type();
+        if (l_type != rhs.get_type())
         {
             return false;
         }
-        if (l_type == ObjectType::INTEGER)
-        {
-            return static_cast<IntegerObj&>(*lhs).m_value == static_cast<IntegerObj&>(*rhs).m_value;
-        }
         if (l_type == ObjectType::STRING)
         {
-            return static_cast<StringObj&>(*lhs).m_value == static_cast<StringObj&>(*rhs).m_value;
+            const auto& left = lhs.as<StringObj>();
+            const auto& right = rhs.as<StringObj>();
+            if (const auto left_atom = left.atom(), right_atom = right.atom(); !left_atom.empty() && !right_atom.empty())
+            {
+                return left_atom == right_atom;
+            }
+            return left.view() == right.view();
         }
-        if (l_type == ObjectType::BOOLEAN)
+        if (l_type == ObjectType::INTEGER || l_type == ObjectType::BOOLEAN)
         {
-            return static_cast<BooleanObj&>(*lhs).m_value == static_cast<BooleanObj&>(*rhs).m_value;
+            return lhs == rhs;
         }
         return false;
     }
@@ -188,29 +371,41 @@ struct object_eq
 class HashObj : public Object
 {
 public:
-    using ObjHashMap = std::unordered_map<std::shared_ptr<Object>, std::shared_ptr<Object>, detail::object_hash, detail::object_eq>;
-    HashObj() = default;
-    HashObj(ObjHashMap&& objects);
-    HashObj(const ObjHashMap& objects);
-    auto get_type() -> ObjectType override;
+    HashObj();
+    HashObj(PersistentMap pairs);
     auto inspect() -> std::string override;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
 
 public:
-    ObjHashMap m_pairs;
+    PersistentMap m_pairs;
 };
 
-class Context
+class Context : public Collectable
 {
-    using ObjectsMap = std::unordered_map<std::string, std::shared_ptr<Object>, string_hash, std::equal_to<>>;
+    using ObjectsMap = std::unordered_map<Atom, Value, atom_hash>;
 
 public:
-    Context() = default;
-    Context(const std::shared_ptr<Context>& parent_env);
-    auto get_obj(std::string_view name) -> std::shared_ptr<Object>;
-    void set_obj(std::string_view name, const std::shared_ptr<Object>& obj);
+    Context();
+    Context(const Ref<Context>& parent_env);
+    Context(const Ref<Context>& parent_env, const std::shared_ptr<const std::vector<Atom>>& slot_names);
+    auto get_obj(Atom name) -> Value;
+    void set_obj(Atom name, const Value& obj);
+    auto get_slot(std::size_t depth, std::size_t slot) -> Value;
+    void set_slot(std::size_t slot, const Value& obj);
+    // Storage that a let of name in this context writes to, nullptr before the first one.
+    auto find_binding(Atom name) -> Value*;
+    auto slot(std::size_t slot) -> Value&;
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
+
+private:
+    auto find_slot(Atom name) const -> std::optional<std::size_t>;
 
 private:
     ObjectsMap m_objects;
-    std::shared_ptr<Context> m_parent_env;
+    Ref<Context> m_parent_env;
+    std::vector<Value> m_slots;
+    std::shared_ptr<const std::vector<Atom>> m_slot_names;
 };
 }  // namespace mlang
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <mlang/token.hpp>
+#include <optional>
+#include <string_view>
+
+namespace mlang
+{
+enum class Operator : std::uint8_t
+{
+    Plus,
+    Minus,
+    Multiply,
+    Divide,
+    Bang,
+    Less,
+    Greater,
+    Equal,
+    NotEqual,
+};
+
+constexpr auto to_string(Operator op) -> std::string_view
+{
+    switch (op)
+    {
+    case Operator::Plus:
+        return "+";
+    case Operator::Minus:
+        return "-";
+    case Operator::Multiply:
+        return "*";
+    case Operator::Divide:
+        return "/";
+    case Operator::Bang:
+        return "!";
+    case Operator::Less:
+        return "<";
+    case Operator::Greater:
+        return ">";
+    case Operator::Equal:
+        return "==";
+    case Operator::NotEqual:
+        return "!=";
+    }
+    return {};
+}
+
+constexpr auto to_operator(TokenType type) -> std::optional<Operator>
+{
+    switch (type)
+    {
+    case TokenType::PLUS:
+        return Operator::Plus;
+    case TokenType::MINUS:
+        return Operator::Minus;
+    case TokenType::ASTERISK:
+        return Operator::Multiply;
+    case TokenType::SLASH:
+        return Operator::Divide;
+    case TokenType::BANG:
+        return Operator::Bang;
+    case TokenType::LT:
+        return Operator::Less;
+    case TokenType::GT:
+        return Operator::Greater;
+    case TokenType::EQ:
+        return Operator::Equal;
+    case TokenType::NOT_EQ:
+        return Operator::NotEqual;
+    default:
+        return std::nullopt;
+    }
+}
+}  // namespace mlang
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <memory>
+#include <mlang/node.hpp>
+#include <mlang/object.hpp>
+#include <mlang/operator.hpp>
+
+namespace mlang
+{
+namespace detail
+{
+using PrefixHandler = auto (*)(Operator op, const Value& right) -> Value;
+
+auto infix_handler(Operator op, ObjectType left_type, ObjectType right_type) -> InfixHandler;
+auto prefix_handler(Operator op, ObjectType right_type) -> PrefixHandler;
+}  // namespace detail
+}  // namespace mlang
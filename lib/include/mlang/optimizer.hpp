@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <mlang/node.hpp>
+#include <string>
+
+namespace mlang
+{
+struct OptimizerStats
+{
+    std::size_t m_folded = 0;
+    std::size_t m_propagated = 0;
+    std::size_t m_pruned = 0;
+};
+
+auto optimize(Program& program) -> OptimizerStats;
+auto format_optimizer_stats(const OptimizerStats& stats) -> std::string;
+}  // namespace mlang
@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <memory>
+#include <mlang/flat_ast.hpp>
 #include <mlang/lexer.hpp>
 #include <mlang/node.hpp>
 #include <mlang/token.hpp>
@@ -23,50 +24,55 @@ enum class Precedence : std::uint8_t
 
 class Parser
 {
-    using PrefixParseFn = std::function<std::unique_ptr<Expression>()>;
-    using InfixParseFn = std::function<std::unique_ptr<Expression>(std::unique_ptr<Expression>&&)>;
+    using PrefixParseFn = std::function<NodePtr<Expression>()>;
+    using InfixParseFn = std::function<NodePtr<Expression>(NodePtr<Expression>&&)>;
 
 public:
     Parser(std::unique_ptr<ILexer>&& lexer);
     auto get_errors() const -> const std::vector<std::string>&;
     auto parse_program() -> std::unique_ptr<Program>;
+    auto parse_flat_program() -> std::shared_ptr<const FlatAst>;
 
 private:
-    auto parse_statement() -> std::unique_ptr<Statement>;
-    auto parse_let_statement() -> std::unique_ptr<LetStatement>;
-    auto parse_return_statement() -> std::unique_ptr<ReturnStatement>;
-    auto parse_expression_statement() -> std::unique_ptr<ExpressionStatement>;
-    auto parse_block_statement() -> std::unique_ptr<BlockStatement>;
-    auto parse_while_statement() -> std::unique_ptr<WhileStatement>;
+    auto parse_statement() -> NodePtr<Statement>;
+    auto parse_let_statement() -> NodePtr<LetStatement>;
+    auto parse_return_statement() -> NodePtr<ReturnStatement>;
+    auto parse_expression_statement() -> NodePtr<ExpressionStatement>;
+    auto parse_block_statement() -> NodePtr<BlockStatement>;
+    auto parse_while_statement() -> NodePtr<WhileStatement>;
 
-    auto parse_expression(Precedence precedence) -> std::unique_ptr<Expression>;
-    auto parse_prefix_expression() -> std::unique_ptr<PrefixExpression>;
-    auto parse_grouped_expression() -> std::unique_ptr<Expression>;
-    auto parse_if_expression() -> std::unique_ptr<IfExpression>;
-    auto parse_infix_expression(std::unique_ptr<Expression>&& left) -> std::unique_ptr<InfixExpression>;
-    auto parse_call_expression(std::unique_ptr<Expression>&& function) -> std::unique_ptr<CallExpression>;
-    auto parse_index_expression(std::unique_ptr<Expression>&& left) -> std::unique_ptr<IndexExpression>;
+    auto parse_expression(Precedence precedence) -> NodePtr<Expression>;
+    auto parse_prefix_expression() -> NodePtr<PrefixExpression>;
+    auto parse_grouped_expression() -> NodePtr<Expression>;
+    auto parse_if_expression() -> NodePtr<IfExpression>;
+    auto parse_infix_expression(NodePtr<Expression>&& left) -> NodePtr<InfixExpression>;
+    auto parse_call_expression(NodePtr<Expression>&& function) -> NodePtr<CallExpression>;
+    auto parse_index_expression(NodePtr<Expression>&& left) -> NodePtr<IndexExpression>;
 
-    auto parse_identifier() -> std::unique_ptr<Identifier>;
-    auto parse_int() -> std::unique_ptr<IntegerLiteral>;
-    auto parse_bool() -> std::unique_ptr<BooleanLiteral>;
-    auto parse_fn() -> std::unique_ptr<FnLiteral>;
-    auto parse_string() -> std::unique_ptr<StringLiteral>;
-    auto parse_array() -> std::unique_ptr<ArrayLiteral>;
-    auto parse_hash() -> std::unique_ptr<HashLiteral>;
-    auto parse_call_arguments() -> std::vector<std::unique_ptr<Expression>>;
-    auto parse_fn_parameters() -> std::vector<std::shared_ptr<Identifier>>;
+    auto parse_identifier() -> NodePtr<Identifier>;
+    auto parse_int() -> NodePtr<IntegerLiteral>;
+    auto parse_bool() -> NodePtr<BooleanLiteral>;
+    auto parse_fn() -> NodePtr<FnLiteral>;
+    auto parse_string() -> NodePtr<StringLiteral>;
+    auto parse_array() -> NodePtr<ArrayLiteral>;
+    auto parse_hash() -> NodePtr<HashLiteral>;
+    auto parse_call_arguments() -> NodeList<Expression>;
+    auto parse_fn_parameters() -> NodeList<Identifier>;
 
     auto expect_peek(TokenType type) -> bool;
     auto peek_token() -> Token;
     void next_token();
+    auto curr_atom() const -> Atom;
     void peek_error(TokenType unwanted_token);
     auto get_precedence(TokenType type) -> Precedence;
 
 private:
     std::unique_ptr<ILexer> m_lexer;
+    std::shared_ptr<AstArena> m_arena;
     Token m_curr;
     Token m_next;
+    Atom m_curr_atom;
+    Atom m_next_atom;
     std::unordered_map<TokenType, PrefixParseFn> m_prefix_parse_fns;
     std::unordered_map<TokenType, InfixParseFn> m_infix_parse_fns;
     std::vector<std::string> m_errors;
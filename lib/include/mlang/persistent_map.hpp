@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mlang/gc.hpp>
+#include <mlang/ref.hpp>
+#include <mlang/shape.hpp>
+#include <mlang/value.hpp>
+#include <vector>
+
+namespace mlang
+{
+namespace detail
+{
+constexpr std::uint32_t MAP_BITS = 5;
+constexpr std::uint32_t MAP_MASK = (1u << MAP_BITS) - 1;
+constexpr std::uint32_t MAP_HASH_BITS = sizeof(std::size_t) * 8;
+constexpr std::size_t SMALL_MAP_CAPACITY = 8;
+
+// Node of a hash array mapped trie, or a collision list once the hash bits run out.
+class MapNode final : public Collectable
+{
+public:
+    struct Entry
+    {
+        std::size_t m_hash = 0;
+        Value m_key;
+        Value m_value;
+    };
+
+    MapNode()
+        : Collectable(true)
+    {
+    }
+
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
+
+public:
+    std::uint32_t m_entry_map = 0;
+    std::uint32_t m_child_map = 0;
+    std::vector<Entry> m_entries;
+    std::vector<Ref<MapNode>> m_children;
+};
+}  // namespace detail
+
+// Persistent hash array mapped trie, small maps keep their entries inline with one
+// control byte per entry.
+class PersistentMap
+{
+public:
+    PersistentMap() = default;
+
+    auto size() const -> std::size_t
+    {
+        return m_size;
+    }
+
+    auto find(const Value& key) const -> const Value*;
+    void set(Value key, Value value);
+    auto erase(const Value& key) -> bool;
+
+    // Shape of the keys while they are inline and all interned strings, nullptr otherwise.
+    auto shape() const -> const Shape*
+    {
+        return m_shape;
+    }
+
+    auto at_slot(std::size_t slot) const -> const Value&
+    {
+        return m_inline[slot].m_value;
+    }
+
+    // Calls f(key, value) on every entry.
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        if (m_root)
+        {
+            for_each_in(*m_root, f);
+            return;
+        }
+        for (std::size_t i = 0; i < m_size; ++i)
+        {
+            f(m_inline[i].m_key, m_inline[i].m_value);
+        }
+    }
+
+    void trace(std::vector<Collectable*>& children) const;
+
+private:
+    auto find_inline(std::size_t hash, const Value& key) const -> std::size_t;
+    void erase_inline(std::size_t index);
+    void spill();
+
+    template <typename F>
+    static void for_each_in(const detail::MapNode& node, F& f)
+    {
+        for (const auto& entry : node.m_entries)
+        {
+            f(entry.m_key, entry.m_value);
+        }
+        for (const auto& child : node.m_children)
+        {
+            for_each_in(*child, f);
+        }
+    }
+
+private:
+    std::uint64_t m_control = 0;
+    std::array<detail::MapNode::Entry, detail::SMALL_MAP_CAPACITY> m_inline;
+    const Shape* m_shape = nullptr;
+    Ref<detail::MapNode> m_root;
+    std::size_t m_size = 0;
+};
+}  // namespace mlang
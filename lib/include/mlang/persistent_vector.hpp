@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mlang/gc.hpp>
+#include <mlang/ref.hpp>
+#include <mlang/value.hpp>
+#include <vector>
+
+namespace mlang
+{
+namespace detail
+{
+constexpr std::uint32_t VECTOR_BITS = 5;
+constexpr std::uint32_t VECTOR_WIDTH = 1u << VECTOR_BITS;
+constexpr std::uint32_t VECTOR_MASK = VECTOR_WIDTH - 1;
+
+// Nodes are traced like objects, vectors share them.
+class VectorNode : public Collectable
+{
+protected:
+    VectorNode()
+        : Collectable(true)
+    {
+    }
+};
+
+class VectorLeaf final : public VectorNode
+{
+public:
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
+
+public:
+    std::array<Value, VECTOR_WIDTH> m_values;
+};
+
+class VectorBranch final : public VectorNode
+{
+public:
+    void trace(std::vector<Collectable*>& children) override;
+    void clear_refs() override;
+
+public:
+    std::array<Ref<VectorNode>, VECTOR_WIDTH> m_children;
+};
+}  // namespace detail
+
+// Persistent 32-way trie plus a tail leaf, nodes are only written while uniquely owned.
+class PersistentVector
+{
+public:
+    PersistentVector() = default;
+
+    auto size() const -> std::size_t
+    {
+        return m_size;
+    }
+
+    auto operator[](std::size_t index) const -> const Value&
+    {
+        return leaf_for(index).m_values[index & detail::VECTOR_MASK];
+    }
+
+    // Calls f on the elements in [begin, end), one leaf at a time.
+    template <typename F>
+    void for_each(std::size_t begin, std::size_t end, F&& f) const
+    {
+        while (begin < end)
+        {
+            const auto& leaf = leaf_for(begin);
+            const auto stop = std::min<std::size_t>(end, (begin | detail::VECTOR_MASK) + 1);
+            for (; begin < stop; ++begin)
+            {
+                f(leaf.m_values[begin & detail::VECTOR_MASK]);
+            }
+        }
+    }
+
+    void push_back(Value value);
+    void assign(std::size_t index, Value value);
+
+    void trace(std::vector<Collectable*>& children) const;
+
+private:
+    auto tail_offset() const -> std::uint32_t
+    {
+        return m_size < detail::VECTOR_WIDTH ? 0 : ((m_size - 1) >> detail::VECTOR_BITS) << detail::VECTOR_BITS;
+    }
+
+    auto leaf_for(std::size_t index) const -> const detail::VectorLeaf&
+    {
+        if (index >= tail_offset())
+        {
+            return *m_tail;
+        }
+        const detail::VectorNode* node = m_root.get();
+        for (auto level = m_shift; level > 0; level -= detail::VECTOR_BITS)
+        {
+            node = static_cast<const detail::VectorBranch*>(node)->m_children[(index >> level) & detail::VECTOR_MASK].get();
+        }
+        return *static_cast<const detail::VectorLeaf*>(node);
+    }
+
+    auto push_tail(std::uint32_t level, Ref<detail::VectorNode> parent, Ref<detail::VectorNode> tail) const -> Ref<detail::VectorNode>;
+    static auto assign_in_tree(std::uint32_t level, Ref<detail::VectorNode> node, std::size_t index, Value value) -> Ref<detail::VectorNode>;
+
+private:
+    Ref<detail::VectorNode> m_root;
+    Ref<detail::VectorLeaf> m_tail;
+    std::uint32_t m_size = 0;
+    std::uint32_t m_shift = detail::VECTOR_BITS;
+};
+}  // namespace mlang
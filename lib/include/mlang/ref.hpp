@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace mlang
+{
+template <typename T>
+class Ref
+{
+public:
+    Ref() = default;
+
+    Ref(std::nullptr_t)
+    {
+    }
+
+    explicit Ref(T* ptr)
+        : m_ptr(ptr)
+    {
+        if (m_ptr)
+        {
+            m_ptr->retain();
+        }
+    }
+
+    Ref(const Ref& other)
+        : Ref(other.m_ptr)
+    {
+    }
+
+    Ref(Ref&& other) noexcept
+        : m_ptr(std::exchange(other.m_ptr, nullptr))
+    {
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    Ref(const Ref<U>& other)
+        : Ref(other.get())
+    {
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    Ref(Ref<U>&& other) noexcept
+        : m_ptr(other.detach())
+    {
+    }
+
+    ~Ref()
+    {
+        if (m_ptr)
+        {
+            m_ptr->release();
+        }
+    }
+
+    auto operator=(Ref other) noexcept -> Ref&
+    {
+        std::swap(m_ptr, other.m_ptr);
+        return *this;
+    }
+
+    auto get() const -> T*
+    {
+        return m_ptr;
+    }
+
+    auto operator*() const -> T&
+    {
+        return *m_ptr;
+    }
+
+    auto operator->() const -> T*
+    {
+        return m_ptr;
+    }
+
+    explicit operator bool() const
+    {
+        return m_ptr != nullptr;
+    }
+
+    // Hands the reference over to the caller without releasing it.
+    auto detach() -> T*
+    {
+        return std::exchange(m_ptr, nullptr);
+    }
+
+    // Takes over a reference previously handed out by detach().
+    static auto adopt(T* ptr) -> Ref
+    {
+        Ref res;
+        res.m_ptr = ptr;
+        return res;
+    }
+
+    friend auto operator==(const Ref& lhs, const Ref& rhs) -> bool
+    {
+        return lhs.m_ptr == rhs.m_ptr;
+    }
+
+    friend auto operator==(const Ref& lhs, std::nullptr_t) -> bool
+    {
+        return lhs.m_ptr == nullptr;
+    }
+
+private:
+    T* m_ptr = nullptr;
+};
+
+template <typename T, typename... Args>
+auto make_ref(Args&&... args) -> Ref<T>
+{
+    return Ref<T>(new T(std::forward<Args>(args)...));
+}
+
+template <typename T, typename U>
+auto static_ref_cast(const Ref<U>& ref) -> Ref<T>
+{
+    return Ref<T>(static_cast<T*>(ref.get()));
+}
+}  // namespace mlang
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlang
+{
+enum class RegOpCode : std::uint8_t
+{
+    LoadConst,
+    LoadBool,
+    LoadNull,
+    Move,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Equal,
+    NotEqual,
+    GreaterThan,
+    LessThan,
+    Minus,
+    Bang,
+    Jump,
+    JumpIfFalse,
+    GetGlobal,
+    SetGlobal,
+    GetLocal,
+    GetFree,
+    CurrentClosure,
+    Array,
+    Hash,
+    Index,
+    Call,
+    TailCall,
+    RebindingCall,
+    Return,
+    Closure,
+    Arg,
+};
+
+enum class OperandKind : std::uint8_t
+{
+    None,
+    RegDef,
+    RegUse,
+    RegOrConst,
+    Const,
+    Name,
+    Target,
+    Immediate,
+};
+
+struct RegInstruction
+{
+    RegOpCode op;
+    std::uint16_t a = 0;
+    std::uint16_t b = 0;
+    std::uint16_t c = 0;
+};
+
+struct RegOpDefinition
+{
+    std::string_view name;
+    std::array<OperandKind, 3> operands;
+};
+
+constexpr std::uint16_t CONST_OPERAND_BIT = 0x8000;
+
+auto lookup(RegOpCode op) -> const RegOpDefinition&;
+auto disassemble(const std::vector<RegInstruction>& code) -> std::string;
+}  // namespace mlang
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mlang/compiler.hpp>
+#include <mlang/node.hpp>
+#include <mlang/object.hpp>
+#include <mlang/register_code.hpp>
+#include <mlang/string_hash.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mlang
+{
+class RegisterCompiler
+{
+    using Reg = std::uint16_t;
+
+    struct RegSymbol
+    {
+        SymbolScope scope;
+        std::size_t index;
+        bool maybe_unset;
+    };
+
+    struct FunctionScope
+    {
+        std::vector<RegInstruction> m_code;
+        std::vector<Value> m_constants;
+        std::vector<Atom> m_names;
+        std::unordered_map<std::string, std::size_t, string_hash, std::equal_to<>> m_name_indices;
+        std::unordered_map<std::string, Reg, string_hash, std::equal_to<>> m_local_slots;
+        std::unordered_map<std::string, RegSymbol, string_hash, std::equal_to<>> m_symbols;
+        std::vector<std::string> m_local_names;
+        std::vector<Capture> m_captures;
+        std::vector<std::size_t> m_local_fallbacks;
+        std::string m_self_name;
+        std::size_t m_next_temp = 0;
+        // Locals plus the most temporaries in use at once.
+        std::size_t m_num_temps = 0;
+        std::size_t m_block_depth = 0;
+    };
+
+public:
+    RegisterCompiler();
+    auto compile(Node* node) -> Ref<RegisterFnObj>;
+    auto get_errors() const -> const std::vector<std::string>&;
+
+private:
+    auto compile_expr(Node* node, std::optional<Reg> dest) -> Reg;
+    auto compile_operand(Node* node, bool allow_const) -> Reg;
+    auto compile_operands(const std::vector<Node*>& nodes) -> std::vector<Reg>;
+    auto compile_statement(Statement* stmt, std::optional<Reg> dest, bool want_value) -> std::optional<Reg>;
+    auto compile_block(const NodeList<Statement>& statements, std::optional<Reg> dest, bool want_value) -> std::optional<Reg>;
+    auto compile_fn(FnLiteral& fn, std::string_view self_name, std::optional<Reg> dest) -> Reg;
+    auto compile_if(IfExpression& expr, std::optional<Reg> dest) -> Reg;
+    void compile_let(LetStatement& let);
+    void compile_while(WhileStatement& stmt);
+    auto compile_infix(InfixExpression& expr, std::optional<Reg> dest) -> Reg;
+    auto compile_call(CallExpression& expr, std::optional<Reg> dest, RegOpCode op) -> Reg;
+    auto compile_identifier(std::string_view name, std::optional<Reg> dest) -> Reg;
+    auto load_symbol(const RegSymbol& symbol, std::string_view name, std::optional<Reg> dest) -> Reg;
+
+    auto emit(RegOpCode op, std::uint16_t a = 0, std::uint16_t b = 0, std::uint16_t c = 0) -> std::size_t;
+    void emit_args(const std::vector<Reg>& regs);
+    auto temp() -> Reg;
+    auto target(std::optional<Reg> dest) -> Reg;
+    auto add_constant(Value obj) -> Reg;
+    auto add_name(std::string_view name) -> Reg;
+    void define(std::string_view name);
+    auto resolve(std::string_view name, std::size_t level) -> RegSymbol;
+    auto fallback(std::size_t level, const RegSymbol& symbol, std::string_view name) -> std::size_t;
+    void resolve_fallbacks(std::size_t num_parameters);
+    auto scope() -> FunctionScope&;
+    void enter_scope(const FnLiteral* fn);
+    auto leave_scope() -> FunctionScope;
+    void allocate_registers(FunctionScope& fn_scope, std::size_t& num_registers);
+
+private:
+    std::vector<FunctionScope> m_scopes;
+    std::vector<std::string> m_errors;
+};
+}  // namespace mlang
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mlang/object.hpp>
+#include <string_view>
+#include <vector>
+
+namespace mlang
+{
+class RegisterVm
+{
+    struct Frame
+    {
+        Ref<RegisterClosureObj> m_closure;
+        std::size_t m_pc;
+        std::size_t m_base;
+        std::uint16_t m_result;
+    };
+
+public:
+    RegisterVm(const Ref<Context>& env, std::size_t max_call_depth);
+    auto run(const Ref<RegisterFnObj>& main) -> Value;
+
+private:
+    auto load_global(Atom name) -> Value;
+    auto load_unset(const RegisterClosureObj& closure, std::size_t fallback, std::string_view name) -> Value;
+    auto capture_upvalue(std::size_t slot) -> Ref<Upvalue>;
+    void close_upvalues(std::size_t first_slot);
+
+private:
+    Ref<Context> m_env;
+    std::size_t m_max_call_depth;
+    std::vector<Value> m_registers;
+    std::vector<Frame> m_frames;
+    // Upvalues of running frames by ascending register.
+    std::vector<Ref<Upvalue>> m_open_upvalues;
+};
+}  // namespace mlang
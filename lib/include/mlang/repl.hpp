@@ -1,12 +1,13 @@
 #pragma once
+#include <mlang/eval.hpp>
 #include <mlang/object.hpp>
 
 namespace mlang
 {
-void repl_interactive();
+void repl_interactive(Engine engine = Engine::TreeWalker);
 
 namespace detail
 {
-void exec(std::string_view input, const std::shared_ptr<Context>& env);
+void exec(std::string_view input, const Ref<Context>& env, Engine engine = Engine::TreeWalker);
 }
 }  // namespace mlang
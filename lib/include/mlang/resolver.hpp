@@ -0,0 +1,8 @@
+#pragma once
+
+#include <mlang/node.hpp>
+
+namespace mlang
+{
+void resolve(Program& program);
+}  // namespace mlang
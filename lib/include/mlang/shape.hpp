@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mlang/atom.hpp>
+#include <vector>
+
+namespace mlang
+{
+// Keys of a small hash of interned strings, in insertion order. Never freed.
+class Shape
+{
+public:
+    static auto empty() -> const Shape*;
+
+    auto size() const -> std::size_t
+    {
+        return m_keys.size();
+    }
+
+    auto key(std::size_t slot) const -> Atom
+    {
+        return m_keys[slot];
+    }
+
+    // Slot of key, or size() when the shape does not have it.
+    auto slot(Atom key) const -> std::size_t
+    {
+        std::size_t slot = 0;
+        while (slot < m_keys.size() && m_keys[slot] != key)
+        {
+            ++slot;
+        }
+        return slot;
+    }
+
+    // Shape after appending key, which must not be in this shape yet.
+    auto add(Atom key) const -> const Shape*;
+    // Shape after removing the key at slot; the keys after it move down one slot.
+    auto remove(std::size_t slot) const -> const Shape*;
+
+private:
+    struct Transition
+    {
+        Atom m_key;
+        const Shape* m_shape;
+        const Transition* m_next;
+    };
+
+    Shape() = default;
+
+private:
+    std::vector<Atom> m_keys;
+    // Prepend-only list, so following a transition that exists takes no lock.
+    mutable std::atomic<const Transition*> m_transitions = nullptr;
+};
+
+// Inline cache of an index site whose key is a constant string.
+struct ShapeCache
+{
+    const Shape* m_shape = nullptr;
+    std::size_t m_slot = 0;
+};
+}  // namespace mlang
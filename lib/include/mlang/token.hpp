@@ -4,7 +4,7 @@
 #include <fmt/core.h>
 #include <mlang/fmt_enum.hpp>
 #include <stdexcept>
-#include <string>
+#include <string_view>
 
 namespace mlang
 {
@@ -51,7 +51,7 @@ enum class TokenType : std::uint8_t
 struct Token
 {
     TokenType type = TokenType::ILLEGAL;
-    std::string literal;
+    std::string_view literal;
 };
 
 inline bool operator==(const Token& lhs, const Token& rhs)
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <mlang/fmt_enum.hpp>
+#include <mlang/gc.hpp>
+#include <mlang/ref.hpp>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mlang
+{
+enum class ObjectType : std::uint8_t
+{
+    INTEGER,
+    BOOLEAN,
+    NIL,
+    RETURN,
+    ERROR,
+    FUNCTION,
+    STRING,
+    BUILTIN,
+    ARRAY,
+    HASH,
+    COMPILED_FUNCTION,
+    CLOSURE,
+    REGISTER_FUNCTION,
+    REGISTER_CLOSURE,
+    THUNK_FUNCTION,
+    FLAT_FUNCTION,
+};
+
+// Fits in the tail padding of Collectable.
+class Object : public Collectable
+{
+public:
+    auto get_type() const -> ObjectType
+    {
+        return m_type;
+    }
+
+    virtual auto inspect() -> std::string = 0;
+    virtual ~Object() = 0;
+
+protected:
+    explicit Object(ObjectType type, bool traced = false)
+        : Collectable(traced)
+        , m_type(type)
+    {
+    }
+
+private:
+    const ObjectType m_type;
+};
+
+class Value
+{
+    enum class Tag : std::uint8_t
+    {
+        None,
+        Nil,
+        Boolean,
+        Integer,
+        Boxed,
+    };
+
+public:
+    Value() = default;
+
+    Value(std::nullptr_t)
+    {
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_convertible_v<T*, Object*>>>
+    Value(Ref<T> obj)
+        : m_tag(obj ? Tag::Boxed : Tag::None)
+        , m_object(obj.detach())
+    {
+    }
+
+    Value(const Value& other)
+        : m_tag(other.m_tag)
+        , m_integer(other.m_integer)
+    {
+        if (m_tag == Tag::Boxed)
+        {
+            m_object->retain();
+        }
+    }
+
+    Value(Value&& other) noexcept
+        : m_tag(std::exchange(other.m_tag, Tag::None))
+        , m_integer(other.m_integer)
+    {
+    }
+
+    ~Value()
+    {
+        if (m_tag == Tag::Boxed)
+        {
+            m_object->release();
+        }
+    }
+
+    auto operator=(Value other) noexcept -> Value&
+    {
+        std::swap(m_tag, other.m_tag);
+        std::swap(m_integer, other.m_integer);
+        return *this;
+    }
+
+    static auto nil() -> Value
+    {
+        return Value(Tag::Nil);
+    }
+
+    static auto boolean(bool value) -> Value
+    {
+        auto res = Value(Tag::Boolean);
+        res.m_boolean = value;
+        return res;
+    }
+
+    static auto integer(std::int64_t value) -> Value
+    {
+        auto res = Value(Tag::Integer);
+        res.m_integer = value;
+        return res;
+    }
+
+    explicit operator bool() const
+    {
+        return m_tag != Tag::None;
+    }
+
+    auto get_type() const -> ObjectType
+    {
+        switch (m_tag)
+        {
+        case Tag::Integer:
+            return ObjectType::INTEGER;
+        case Tag::Boolean:
+            return ObjectType::BOOLEAN;
+        case Tag::Boxed:
+            return m_object->get_type();
+        default:
+            return ObjectType::NIL;
+        }
+    }
+
+    auto inspect() const -> std::string
+    {
+        switch (m_tag)
+        {
+        case Tag::Integer:
+            return fmt::format("{}", m_integer);
+        case Tag::Boolean:
+            return fmt::format("{}", m_boolean);
+        case Tag::Boxed:
+            return m_object->inspect();
+        default:
+            return "null";
+        }
+    }
+
+    auto is_integer() const -> bool
+    {
+        return m_tag == Tag::Integer;
+    }
+
+    auto as_integer() const -> std::int64_t
+    {
+        return m_integer;
+    }
+
+    auto as_boolean() const -> bool
+    {
+        return m_boolean;
+    }
+
+    auto object() const -> Object*
+    {
+        return m_tag == Tag::Boxed ? m_object : nullptr;
+    }
+
+    void trace(std::vector<Collectable*>& children) const
+    {
+        if (m_tag == Tag::Boxed)
+        {
+            children.push_back(m_object);
+        }
+    }
+
+    template <typename T>
+    auto as() const -> T&
+    {
+        return static_cast<T&>(*m_object);
+    }
+
+    template <typename T>
+    auto cast() const -> Ref<T>
+    {
+        return Ref<T>(static_cast<T*>(m_object));
+    }
+
+    friend auto operator==(const Value& lhs, const Value& rhs) -> bool
+    {
+        if (lhs.m_tag != rhs.m_tag)
+        {
+            return false;
+        }
+        switch (lhs.m_tag)
+        {
+        case Tag::Integer:
+            return lhs.m_integer == rhs.m_integer;
+        case Tag::Boolean:
+            return lhs.m_boolean == rhs.m_boolean;
+        case Tag::Boxed:
+            return lhs.m_object == rhs.m_object;
+        default:
+            return true;
+        }
+    }
+
+private:
+    explicit Value(Tag tag)
+        : m_tag(tag)
+    {
+    }
+
+private:
+    Tag m_tag = Tag::None;
+    union
+    {
+        std::int64_t m_integer = 0;
+        bool m_boolean;
+        Object* m_object;
+    };
+};
+}  // namespace mlang
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mlang/object.hpp>
+#include <string_view>
+#include <vector>
+
+namespace mlang
+{
+class Vm
+{
+    struct Frame
+    {
+        Ref<ClosureObj> m_closure;
+        std::size_t m_ip;
+        std::size_t m_base;
+    };
+
+public:
+    Vm(const Ref<Context>& env, std::size_t max_call_depth);
+    auto run(const Ref<CompiledFnObj>& main) -> Value;
+
+private:
+    auto load_global(Atom name) -> Value;
+    auto load_unset(const ClosureObj& closure, std::size_t fallback, std::string_view name) -> Value;
+    auto call(std::size_t argc, bool tail) -> Value;
+    auto rebinding() -> Value*;
+    auto capture_upvalue(std::size_t slot) -> Ref<Upvalue>;
+    void close_upvalues(std::size_t first_slot);
+    auto pop() -> Value;
+
+private:
+    Ref<Context> m_env;
+    std::size_t m_max_call_depth;
+    std::vector<Value> m_stack;
+    std::vector<Frame> m_frames;
+    // Upvalues of running frames by ascending stack slot.
+    std::vector<Ref<Upvalue>> m_open_upvalues;
+};
+}  // namespace mlang
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <cstring>
+#include <mlang/ast_arena.hpp>
+
+namespace mlang
+{
+namespace
+{
+constexpr std::size_t MIN_CHUNK_SIZE = 4 * 1024;
+constexpr std::size_t MAX_CHUNK_SIZE = 1024 * 1024;
+}  // namespace
+
+AstArena::~AstArena()
+{
+    for (const auto& finalizer : m_finalizers)
+    {
+        finalizer.m_finalize(finalizer.m_node);
+    }
+    while (m_chunks)
+    {
+        auto* next = m_chunks->m_next;
+        ::operator delete(m_chunks);
+        m_chunks = next;
+    }
+}
+
+void AstArena::refill(std::size_t size)
+{
+    m_next_chunk_size = std::clamp(m_next_chunk_size * 2, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+    const auto chunk_size = std::max(m_next_chunk_size, size + sizeof(Chunk));
+    auto* chunk = static_cast<Chunk*>(::operator new(chunk_size));
+    chunk->m_next = m_chunks;
+    m_chunks = chunk;
+    m_cursor = reinterpret_cast<std::byte*>(chunk + 1);
+    m_end = reinterpret_cast<std::byte*>(chunk) + chunk_size;
+    ++m_stats.m_chunks;
+}
+
+auto AstArena::intern(std::string_view str) -> std::string_view
+{
+    if (str.empty())
+    {
+        return {};
+    }
+    auto* data = static_cast<char*>(allocate(str.size(), 1));
+    std::memcpy(data, str.data(), str.size());
+    return {data, str.size()};
+}
+
+auto AstArena::stats() const -> ArenaStats
+{
+    auto res = m_stats;
+    res.m_finalizers = m_finalizers.size();
+    return res;
+}
+}  // namespace mlang
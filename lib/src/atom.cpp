@@ -0,0 +1,49 @@
+#include <deque>
+#include <mlang/atom.hpp>
+#include <mutex>
+#include <unordered_map>
+
+namespace mlang
+{
+namespace
+{
+// Leaked so that atoms outlive static destruction.
+struct AtomTable
+{
+    std::mutex m_mutex;
+    std::deque<detail::AtomEntry> m_entries;
+    std::unordered_map<std::string_view, const detail::AtomEntry*> m_index;
+};
+
+auto atom_table() -> AtomTable&
+{
+    static auto* table = new AtomTable;
+    return *table;
+}
+}  // namespace
+
+auto Atom::intern(std::string_view text) -> Atom
+{
+    if (text.empty())
+    {
+        return Atom();
+    }
+    const auto hash = std::hash<std::string_view>{}(text);
+    auto& table = atom_table();
+    const auto lock = std::lock_guard(table.m_mutex);
+    if (const auto it = table.m_index.find(text); it != std::end(table.m_index))
+    {
+        return Atom(it->second);
+    }
+    const auto& entry = table.m_entries.emplace_back(detail::AtomEntry{hash, std::string(text)});
+    table.m_index.emplace(entry.m_text, &entry);
+    return Atom(&entry);
+}
+
+auto atom_count() -> std::size_t
+{
+    auto& table = atom_table();
+    const auto lock = std::lock_guard(table.m_mutex);
+    return table.m_entries.size();
+}
+}  // namespace mlang
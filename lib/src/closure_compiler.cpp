@@ -0,0 +1,637 @@
+#include <cassert>
+#include <mlang/closure_compiler.hpp>
+#include <mlang/eval.hpp>
+#include <mlang/feedback.hpp>
+#include <mlang/raii_wrapper.hpp>
+#include <utility>
+
+namespace mlang
+{
+namespace
+{
+auto is_error(const Value& obj) -> bool
+{
+    return obj.get_type() == ObjectType::ERROR;
+}
+
+// Tail call left for apply_thunk_function() to run.
+thread_local detail::TailCall<ThunkFnObj> pending_tail_call;
+
+auto compile_node(Node* node) -> Thunk;
+auto compile_tail(Node* node) -> Thunk;
+
+template <typename Nodes>
+auto compile_all(const Nodes& nodes) -> std::vector<Thunk>
+{
+    std::vector<Thunk> thunks;
+    thunks.reserve(nodes.size());
+    for (const auto& node : nodes)
+    {
+        thunks.push_back(compile_node(node.get()));
+    }
+    return thunks;
+}
+
+auto eval_all(const std::vector<Thunk>& thunks, const Ref<Context>& env, std::vector<Value>& out) -> Value
+{
+    out.reserve(thunks.size());
+    for (const auto& thunk : thunks)
+    {
+        auto obj = thunk(env);
+        if (is_error(obj))
+        {
+            return obj;
+        }
+        out.push_back(std::move(obj));
+    }
+    return nullptr;
+}
+
+template <typename IntOp>
+auto compile_infix(Thunk left, Thunk right, Operator op, IntOp int_op) -> Thunk
+{
+    return [left = std::move(left), right = std::move(right), op, int_op](const Ref<Context>& env) -> Value
+    {
+        auto left_obj = left(env);
+        if (is_error(left_obj))
+        {
+            return left_obj;
+        }
+        auto right_obj = right(env);
+        if (is_error(right_obj))
+        {
+            return right_obj;
+        }
+        if (left_obj.is_integer() && right_obj.is_integer())
+        {
+            return int_op(left_obj.as_integer(), right_obj.as_integer());
+        }
+        return detail::eval_infix_expression(op, left_obj, right_obj);
+    };
+}
+
+auto compile_infix(InfixExpression& expr) -> Thunk
+{
+    auto left = compile_node(expr.m_left.get());
+    auto right = compile_node(expr.m_right.get());
+    const auto op = expr.m_operator;
+    const auto boolean = [](bool value) -> Value
+    {
+        return value ? detail::TRUE : detail::FALSE;
+    };
+    switch (op)
+    {
+    case Operator::Plus:
+        return compile_infix(std::move(left), std::move(right), op, [](std::int64_t l, std::int64_t r) -> Value
+                             { return Value::integer(l + r); });
+    case Operator::Minus:
+        return compile_infix(std::move(left), std::move(right), op, [](std::int64_t l, std::int64_t r) -> Value
+                             { return Value::integer(l - r); });
+    case Operator::Multiply:
+        return compile_infix(std::move(left), std::move(right), op, [](std::int64_t l, std::int64_t r) -> Value
+                             { return Value::integer(l * r); });
+    case Operator::Divide:
+        return compile_infix(std::move(left), std::move(right), op, [](std::int64_t l, std::int64_t r) -> Value
+                             { return Value::integer(l / r); });
+    case Operator::Less:
+        return compile_infix(std::move(left), std::move(right), op, [boolean](std::int64_t l, std::int64_t r)
+                             { return boolean(l < r); });
+    case Operator::Greater:
+        return compile_infix(std::move(left), std::move(right), op, [boolean](std::int64_t l, std::int64_t r)
+                             { return boolean(l > r); });
+    case Operator::Equal:
+        return compile_infix(std::move(left), std::move(right), op, [boolean](std::int64_t l, std::int64_t r)
+                             { return boolean(l == r); });
+    case Operator::NotEqual:
+        return compile_infix(std::move(left), std::move(right), op, [boolean](std::int64_t l, std::int64_t r)
+                             { return boolean(l != r); });
+    default:
+        return compile_infix(std::move(left), std::move(right), op, [op](std::int64_t, std::int64_t) -> Value
+                             { return make_ref<ErrorObj>(fmt::format("unknown operator: {} {} {}", ObjectType::INTEGER, to_string(op), ObjectType::INTEGER)); });
+    }
+}
+
+auto compile_prefix(PrefixExpression& expr) -> Thunk
+{
+    auto right = compile_node(expr.m_right.get());
+    if (expr.m_operator == Operator::Bang)
+    {
+        return [right = std::move(right)](const Ref<Context>& env) -> Value
+        {
+            auto obj = right(env);
+            if (is_error(obj))
+            {
+                return obj;
+            }
+            return detail::eval_bang_expression(obj);
+        };
+    }
+    if (expr.m_operator == Operator::Minus)
+    {
+        return [right = std::move(right)](const Ref<Context>& env) -> Value
+        {
+            auto obj = right(env);
+            if (is_error(obj))
+            {
+                return obj;
+            }
+            if (obj.is_integer())
+            {
+                return Value::integer(-obj.as_integer());
+            }
+            return detail::eval_minus_prefix_operator(obj);
+        };
+    }
+    return [right = std::move(right), op = expr.m_operator](const Ref<Context>& env) -> Value
+    {
+        auto obj = right(env);
+        if (is_error(obj))
+        {
+            return obj;
+        }
+        return detail::eval_prefix_expression(op, obj);
+    };
+}
+
+auto compile_identifier(Identifier& ident) -> Thunk
+{
+    Value builtin;
+    if (ident.m_builtin)
+    {
+        builtin = detail::BUILTIN_TABLE[*ident.m_builtin].second;
+    }
+    else if (const auto it = detail::BUILTINS.find(ident.m_value); it != std::end(detail::BUILTINS))
+    {
+        builtin = it->second;
+    }
+    auto lookup = [name = ident.m_value, builtin = std::move(builtin)](const Ref<Context>& env) -> Value
+    {
+        if (auto val = env->get_obj(name))
+        {
+            return val;
+        }
+        if (builtin)
+        {
+            return builtin;
+        }
+        return make_ref<ErrorObj>(fmt::format("identifier not found: {}", name));
+    };
+    if (!ident.m_address)
+    {
+        return lookup;
+    }
+    return [address = *ident.m_address, lookup = std::move(lookup)](const Ref<Context>& env) -> Value
+    {
+        if (auto val = env->get_slot(address.m_depth, address.m_slot))
+        {
+            return val;
+        }
+        return lookup(env);
+    };
+}
+
+auto compile_block(const NodeList<Statement>& statements, bool tail = false) -> Thunk
+{
+    if (statements.empty())
+    {
+        return [](const Ref<Context>&) -> Value
+        {
+            return detail::NIL;
+        };
+    }
+    if (statements.size() == 1)
+    {
+        return tail ? compile_tail(statements.front().get()) : compile_node(statements.front().get());
+    }
+    std::vector<Thunk> thunks;
+    thunks.reserve(statements.size());
+    for (std::size_t i = 0; i < statements.size(); ++i)
+    {
+        thunks.push_back(tail && i + 1 == statements.size() ? compile_tail(statements[i].get()) : compile_node(statements[i].get()));
+    }
+    return [thunks = std::move(thunks)](const Ref<Context>& env) -> Value
+    {
+        Value res;
+        for (const auto& thunk : thunks)
+        {
+            res = thunk(env);
+            const auto res_type = res.get_type();
+            if (res_type == ObjectType::RETURN || res_type == ObjectType::ERROR)
+            {
+                return res;
+            }
+        }
+        return res;
+    };
+}
+
+auto compile_if(IfExpression& expr, bool tail = false) -> Thunk
+{
+    auto condition = compile_node(expr.m_condition.get());
+    auto consequence = compile_block(expr.m_consequence->m_statements, tail);
+    Thunk alternative;
+    if (expr.m_alternative)
+    {
+        alternative = compile_block(expr.m_alternative->m_statements, tail);
+    }
+    return [condition = std::move(condition), consequence = std::move(consequence), alternative = std::move(alternative)](const Ref<Context>& env) -> Value
+    {
+        auto cond = condition(env);
+        if (is_error(cond))
+        {
+            return cond;
+        }
+        if (detail::is_truth(cond))
+        {
+            return consequence(env);
+        }
+        if (alternative)
+        {
+            return alternative(env);
+        }
+        return detail::NIL;
+    };
+}
+
+auto compile_while(WhileStatement& stmt) -> Thunk
+{
+    return [condition = compile_node(stmt.m_condition.get()), body = compile_block(stmt.m_loop_body->m_statements)](const Ref<Context>& env) -> Value
+    {
+        while (true)
+        {
+            auto cond = condition(env);
+            if (is_error(cond))
+            {
+                return cond;
+            }
+            if (!detail::is_truth(cond))
+            {
+                return detail::NIL;
+            }
+            auto res = body(env);
+            if (res.get_type() == ObjectType::RETURN || is_error(res))
+            {
+                return res;
+            }
+        }
+    };
+}
+
+auto compile_fn(FnLiteral& fn) -> Thunk
+{
+    auto proto = std::make_shared<ThunkFnProto>();
+    for (const auto& param : fn.m_parameters)
+    {
+        proto->m_parameters.emplace_back(param->m_value);
+        proto->m_parameter_slots.push_back(param->m_address ? std::optional(param->m_address->m_slot) : std::nullopt);
+    }
+    proto->m_slot_names = fn.m_slot_names;
+    proto->m_body = compile_block(fn.m_body->m_statements, true);
+    return [proto = std::shared_ptr<const ThunkFnProto>(std::move(proto))](const Ref<Context>& env) -> Value
+    {
+        return make_ref<ThunkFnObj>(proto, env);
+    };
+}
+
+// target is the name a let statement binds the result to, nullptr for other calls.
+auto compile_call(CallExpression& expr, const Identifier* target, bool tail = false) -> Thunk
+{
+    return [function = compile_node(expr.m_function.get()), arguments = compile_all(expr.m_arguments), rebinds = target != nullptr, tail,
+            address = target ? target->m_address : std::nullopt, name = target ? target->m_value : Atom()](const Ref<Context>& env) -> Value
+    {
+        auto func = function(env);
+        if (is_error(func))
+        {
+            return func;
+        }
+        std::vector<Value> args;
+        if (auto err = eval_all(arguments, env, args))
+        {
+            return err;
+        }
+        const auto func_type = func.get_type();
+        if (func_type == ObjectType::THUNK_FUNCTION)
+        {
+            if (tail)
+            {
+                pending_tail_call = detail::TailCall<ThunkFnObj>{func.cast<ThunkFnObj>(), std::move(args)};
+                return nullptr;
+            }
+            return detail::apply_thunk_function(func.as<ThunkFnObj>(), args);
+        }
+        if (func_type == ObjectType::BUILTIN)
+        {
+            if (rebinds)
+            {
+                auto* binding = address ? &env->slot(address->m_slot) : env->find_binding(name);
+                return detail::call_rebinding_builtin(func.as<BuiltInObj>(), args, binding);
+            }
+            return func.as<BuiltInObj>().m_value(args);
+        }
+        if (func_type == ObjectType::FUNCTION)
+        {
+            return detail::apply_function(func.cast<FunctionObj>(), args);
+        }
+        return make_ref<ErrorObj>(fmt::format("not a function: {}", func_type));
+    };
+}
+
+auto compile_hash(HashLiteral& hash) -> Thunk
+{
+    std::vector<std::pair<Thunk, Thunk>> pairs;
+    for (const auto& [key, val] : hash.m_pairs)
+    {
+        pairs.emplace_back(compile_node(key.get()), compile_node(val.get()));
+    }
+    return [pairs = std::move(pairs)](const Ref<Context>& env) -> Value
+    {
+        auto hash_obj = make_ref<HashObj>();
+        for (const auto& [key, val] : pairs)
+        {
+            auto key_obj = key(env);
+            if (is_error(key_obj))
+            {
+                return key_obj;
+            }
+            auto val_obj = val(env);
+            if (is_error(val_obj))
+            {
+                return val_obj;
+            }
+            hash_obj->m_pairs.set(std::move(key_obj), std::move(val_obj));
+        }
+        return hash_obj;
+    };
+}
+
+auto compile_node(Node* node) -> Thunk
+{
+    assert(node);
+    const auto node_type = node->get_type();
+    if (node_type == NodeType::Program)
+    {
+        return [thunks = compile_all(static_cast<Program*>(node)->m_statements)](const Ref<Context>& env) -> Value
+        {
+            Value res;
+            for (const auto& thunk : thunks)
+            {
+                res = thunk(env);
+                if (res.get_type() == ObjectType::RETURN)
+                {
+                    return res.as<ReturnValueObj>().m_value;
+                }
+                if (is_error(res))
+                {
+                    return res;
+                }
+            }
+            return res;
+        };
+    }
+    else if (node_type == NodeType::ExpressionStatement)
+    {
+        return compile_node(static_cast<ExpressionStatement*>(node)->m_expression.get());
+    }
+    else if (node_type == NodeType::BlockStatement)
+    {
+        return compile_block(static_cast<BlockStatement*>(node)->m_statements);
+    }
+    else if (node_type == NodeType::PrefixExpression)
+    {
+        return compile_prefix(*static_cast<PrefixExpression*>(node));
+    }
+    else if (node_type == NodeType::InfixExpression)
+    {
+        return compile_infix(*static_cast<InfixExpression*>(node));
+    }
+    else if (node_type == NodeType::IfExpression)
+    {
+        return compile_if(*static_cast<IfExpression*>(node));
+    }
+    else if (node_type == NodeType::WhileStatement)
+    {
+        return compile_while(*static_cast<WhileStatement*>(node));
+    }
+    else if (node_type == NodeType::IntegerLiteral || node_type == NodeType::StringLiteral || node_type == NodeType::BooleanLiteral)
+    {
+        Value constant;
+        if (node_type == NodeType::IntegerLiteral)
+        {
+            constant = Value::integer(static_cast<IntegerLiteral*>(node)->m_value);
+        }
+        else if (node_type == NodeType::StringLiteral)
+        {
+            constant = make_ref<StringObj>(static_cast<StringLiteral*>(node)->m_value);
+        }
+        else
+        {
+            constant = static_cast<BooleanLiteral*>(node)->m_value ? detail::TRUE : detail::FALSE;
+        }
+        return [constant = std::move(constant)](const Ref<Context>&)
+        {
+            return constant;
+        };
+    }
+    else if (node_type == NodeType::Identifier)
+    {
+        return compile_identifier(*static_cast<Identifier*>(node));
+    }
+    else if (node_type == NodeType::LetStatement)
+    {
+        auto* nd = static_cast<LetStatement*>(node);
+        auto* value_node = nd->m_value.get();
+        auto value = value_node->get_type() == NodeType::CallExpression
+                         ? compile_call(*static_cast<CallExpression*>(value_node), nd->m_name.get())
+                         : compile_node(value_node);
+        if (nd->m_name->m_address)
+        {
+            return [slot = nd->m_name->m_address->m_slot, value = std::move(value)](const Ref<Context>& env) -> Value
+            {
+                auto val = value(env);
+                if (is_error(val))
+                {
+                    return val;
+                }
+                env->set_slot(slot, val);
+                return detail::NIL;
+            };
+        }
+        return [name = nd->m_name->m_value, value = std::move(value)](const Ref<Context>& env) -> Value
+        {
+            auto val = value(env);
+            if (is_error(val))
+            {
+                return val;
+            }
+            env->set_obj(name, val);
+            return detail::NIL;
+        };
+    }
+    else if (node_type == NodeType::ReturnStatement)
+    {
+        return [value = compile_node(static_cast<ReturnStatement*>(node)->m_return_value.get())](const Ref<Context>& env) -> Value
+        {
+            auto val = value(env);
+            if (is_error(val))
+            {
+                return val;
+            }
+            return make_ref<ReturnValueObj>(std::move(val));
+        };
+    }
+    else if (node_type == NodeType::FnLiteral)
+    {
+        return compile_fn(*static_cast<FnLiteral*>(node));
+    }
+    else if (node_type == NodeType::CallExpression)
+    {
+        return compile_call(*static_cast<CallExpression*>(node), nullptr);
+    }
+    else if (node_type == NodeType::ArrayLiteral)
+    {
+        return [elements = compile_all(static_cast<ArrayLiteral*>(node)->m_expressions)](const Ref<Context>& env) -> Value
+        {
+            std::vector<Value> values;
+            if (auto err = eval_all(elements, env, values))
+            {
+                return err;
+            }
+            return make_ref<ArrayObj>(std::move(values));
+        };
+    }
+    else if (node_type == NodeType::IndexExpression)
+    {
+        auto* nd = static_cast<IndexExpression*>(node);
+        if (nd->m_index->get_type() == NodeType::StringLiteral)
+        {
+            return [left = compile_node(nd->m_left.get()), index = compile_node(nd->m_index.get()),
+                    key = static_cast<StringLiteral*>(nd->m_index.get())->m_value, cache = ShapeCache()](const Ref<Context>& env) mutable -> Value
+            {
+                auto left_obj = left(env);
+                if (is_error(left_obj))
+                {
+                    return left_obj;
+                }
+                if (const auto* value = detail::find_by_shape(cache, left_obj, key))
+                {
+                    return *value;
+                }
+                return detail::eval_index_expression(left_obj, index(env));
+            };
+        }
+        return [left = compile_node(nd->m_left.get()), index = compile_node(nd->m_index.get())](const Ref<Context>& env) -> Value
+        {
+            auto left_obj = left(env);
+            if (is_error(left_obj))
+            {
+                return left_obj;
+            }
+            auto index_obj = index(env);
+            if (is_error(index_obj))
+            {
+                return index_obj;
+            }
+            return detail::eval_index_expression(left_obj, index_obj);
+        };
+    }
+    else if (node_type == NodeType::HashLiteral)
+    {
+        return compile_hash(*static_cast<HashLiteral*>(node));
+    }
+    return [](const Ref<Context>&) -> Value
+    {
+        return nullptr;
+    };
+}
+
+// Compiles the last node a function body evaluates, where calls become tail calls.
+auto compile_tail(Node* node) -> Thunk
+{
+    assert(node);
+    const auto node_type = node->get_type();
+    if (node_type == NodeType::ExpressionStatement)
+    {
+        return compile_tail(static_cast<ExpressionStatement*>(node)->m_expression.get());
+    }
+    else if (node_type == NodeType::BlockStatement)
+    {
+        return compile_block(static_cast<BlockStatement*>(node)->m_statements, true);
+    }
+    else if (node_type == NodeType::IfExpression)
+    {
+        return compile_if(*static_cast<IfExpression*>(node), true);
+    }
+    else if (node_type == NodeType::CallExpression)
+    {
+        return compile_call(*static_cast<CallExpression*>(node), nullptr, true);
+    }
+    else if (node_type == NodeType::ReturnStatement)
+    {
+        return [value = compile_tail(static_cast<ReturnStatement*>(node)->m_return_value.get())](const Ref<Context>& env) -> Value
+        {
+            auto val = value(env);
+            if (pending_tail_call.m_fn || is_error(val))
+            {
+                return val;
+            }
+            return make_ref<ReturnValueObj>(std::move(val));
+        };
+    }
+    return compile_node(node);
+}
+}  // namespace
+
+auto compile_closures(Node* node) -> Thunk
+{
+    return compile_node(node);
+}
+
+namespace detail
+{
+auto apply_thunk_function(const ThunkFnObj& fn, const std::vector<Value>& args) -> Value
+{
+    if (auto err = enter_call())
+    {
+        return err;
+    }
+    const auto leave = RaiiWrapper(&leave_call);
+    // Tail calls made by the body come back here and run in this native frame.
+    const ThunkFnObj* callee = &fn;
+    const std::vector<Value>* callee_args = &args;
+    TailCall<ThunkFnObj> current;
+    while (true)
+    {
+        const auto& proto = *callee->m_proto;
+        if (proto.m_parameters.size() != callee_args->size())
+        {
+            return make_ref<ErrorObj>(fmt::format("invalid number of args expected {} got {}", proto.m_parameters.size(), callee_args->size()));
+        }
+        auto extended_env = make_ref<Context>(callee->m_env, proto.m_slot_names);
+        for (std::size_t i = 0; i < callee_args->size(); ++i)
+        {
+            if (const auto slot = proto.m_parameter_slots[i])
+            {
+                extended_env->set_slot(*slot, (*callee_args)[i]);
+            }
+            else
+            {
+                extended_env->set_obj(proto.m_parameters[i], (*callee_args)[i]);
+            }
+        }
+        auto evaluated = proto.m_body(extended_env);
+        if (pending_tail_call.m_fn)
+        {
+            current = std::exchange(pending_tail_call, TailCall<ThunkFnObj>{});
+            callee = current.m_fn.get();
+            callee_args = &current.m_args;
+            continue;
+        }
+        if (evaluated.get_type() == ObjectType::RETURN)
+        {
+            return evaluated.as<ReturnValueObj>().m_value;
+        }
+        return evaluated;
+    }
+}
+}  // namespace detail
+}  // namespace mlang
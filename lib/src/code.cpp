@@ -0,0 +1,96 @@
+#include <cassert>
+#include <fmt/core.h>
+#include <mlang/code.hpp>
+
+namespace mlang
+{
+namespace
+{
+constexpr auto OP_DEFINITIONS = std::array{
+    OpDefinition{"OpConstant",       {4, 0}, 1},
+    OpDefinition{"OpPop",            {0, 0}, 0},
+    OpDefinition{"OpAdd",            {0, 0}, 0},
+    OpDefinition{"OpSub",            {0, 0}, 0},
+    OpDefinition{"OpMul",            {0, 0}, 0},
+    OpDefinition{"OpDiv",            {0, 0}, 0},
+    OpDefinition{"OpEqual",          {0, 0}, 0},
+    OpDefinition{"OpNotEqual",       {0, 0}, 0},
+    OpDefinition{"OpGreaterThan",    {0, 0}, 0},
+    OpDefinition{"OpLessThan",       {0, 0}, 0},
+    OpDefinition{"OpMinus",          {0, 0}, 0},
+    OpDefinition{"OpBang",           {0, 0}, 0},
+    OpDefinition{"OpTrue",           {0, 0}, 0},
+    OpDefinition{"OpFalse",          {0, 0}, 0},
+    OpDefinition{"OpNull",           {0, 0}, 0},
+    OpDefinition{"OpJump",           {4, 0}, 1},
+    OpDefinition{"OpJumpNotTruthy",  {4, 0}, 1},
+    OpDefinition{"OpGetGlobal",      {4, 0}, 1},
+    OpDefinition{"OpSetGlobal",      {4, 0}, 1},
+    OpDefinition{"OpGetLocal",       {2, 0}, 1},
+    OpDefinition{"OpSetLocal",       {2, 0}, 1},
+    OpDefinition{"OpGetFree",        {2, 0}, 1},
+    OpDefinition{"OpCurrentClosure", {0, 0}, 0},
+    OpDefinition{"OpArray",          {4, 0}, 1},
+    OpDefinition{"OpHash",           {4, 0}, 1},
+    OpDefinition{"OpIndex",          {0, 0}, 0},
+    OpDefinition{"OpCall",           {2, 0}, 1},
+    OpDefinition{"OpReturnValue",    {0, 0}, 0},
+    OpDefinition{"OpClosure",        {4, 2}, 2},
+    OpDefinition{"OpTailCall",       {2, 0}, 1},
+};
+static_assert(std::size(OP_DEFINITIONS) == static_cast<std::size_t>(OpCode::TailCall) + 1);
+}  // namespace
+
+auto lookup(OpCode op) -> const OpDefinition&
+{
+    return OP_DEFINITIONS[static_cast<std::size_t>(op)];
+}
+
+auto make(OpCode op, std::initializer_list<std::size_t> operands) -> Instructions
+{
+    const auto& def = lookup(op);
+    assert(std::size(operands) == def.operand_count);
+    Instructions instruction{static_cast<std::uint8_t>(op)};
+    std::size_t i = 0;
+    for (const auto operand : operands)
+    {
+        const auto width = def.operand_widths[i++];
+        if (width == 4)
+        {
+            instruction.resize(instruction.size() + 4);
+            write_u32(&instruction[instruction.size() - 4], operand);
+        }
+        else if (width == 2)
+        {
+            instruction.resize(instruction.size() + 2);
+            write_u16(&instruction[instruction.size() - 2], operand);
+        }
+        else if (width == 1)
+        {
+            instruction.push_back(static_cast<std::uint8_t>(operand));
+        }
+    }
+    return instruction;
+}
+
+auto disassemble(const Instructions& instructions) -> std::string
+{
+    std::string out;
+    std::size_t ip = 0;
+    while (ip < instructions.size())
+    {
+        const auto& def = lookup(static_cast<OpCode>(instructions[ip]));
+        out += fmt::format("{:04} {}", ip, def.name);
+        ++ip;
+        for (std::size_t i = 0; i < def.operand_count; ++i)
+        {
+            const auto width = def.operand_widths[i];
+            const std::size_t operand = width == 4 ? read_u32(&instructions[ip]) : width == 2 ? read_u16(&instructions[ip]) : read_u8(&instructions[ip]);
+            out += fmt::format(" {}", operand);
+            ip += width;
+        }
+        out += '\n';
+    }
+    return out;
+}
+}  // namespace mlang
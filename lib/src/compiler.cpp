@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <fmt/core.h>
+#include <limits>
+#include <mlang/compiler.hpp>
+
+namespace mlang
+{
+namespace
+{
+constexpr std::size_t MAX_U32_OPERAND = std::numeric_limits<std::uint32_t>::max();
+constexpr std::size_t MAX_U16_OPERAND = std::numeric_limits<std::uint16_t>::max();
+
+// Calls whose result is returned right away become TailCall.
+void mark_tail_calls(Instructions& instructions)
+{
+    for (std::size_t offset = 0; offset < instructions.size();)
+    {
+        const auto op = static_cast<OpCode>(instructions[offset]);
+        const auto& def = lookup(op);
+        const auto next = offset + 1 + def.operand_widths[0] + def.operand_widths[1];
+        if (op == OpCode::Call)
+        {
+            auto target = next;
+            while (target < instructions.size() && static_cast<OpCode>(instructions[target]) == OpCode::Jump)
+            {
+                target = read_u32(&instructions[target + 1]);
+            }
+            if (target < instructions.size() && static_cast<OpCode>(instructions[target]) == OpCode::ReturnValue)
+            {
+                instructions[offset] = static_cast<std::uint8_t>(OpCode::TailCall);
+            }
+        }
+        offset = next;
+    }
+}
+}  // namespace
+
+Compiler::Compiler()
+{
+    m_scopes.emplace_back();
+}
+
+auto Compiler::compile(Node* node) -> Ref<CompiledFnObj>
+{
+    if (node->get_type() == NodeType::Program)
+    {
+        // An empty program compiles to no code.
+        auto& statements = static_cast<Program*>(node)->m_statements;
+        if (!statements.empty())
+        {
+            compile_statements(statements, true);
+            emit(OpCode::ReturnValue);
+        }
+    }
+    else
+    {
+        compile_node(node);
+        emit(OpCode::ReturnValue);
+    }
+    auto main_scope = leave_scope();
+    m_scopes.emplace_back();
+    return make_ref<CompiledFnObj>(std::move(main_scope.m_instructions),
+                                   std::move(main_scope.m_constants),
+                                   std::move(main_scope.m_names),
+                                   std::move(main_scope.m_local_names),
+                                   0);
+}
+
+auto Compiler::get_errors() const -> const std::vector<std::string>&
+{
+    return m_errors;
+}
+
+void Compiler::compile_statements(const NodeList<Statement>& statements, bool keep_value)
+{
+    if (statements.empty())
+    {
+        if (keep_value)
+        {
+            emit(OpCode::Null);
+        }
+        return;
+    }
+    for (std::size_t i = 0; i < statements.size(); ++i)
+    {
+        compile_node(statements[i].get());
+        if (i + 1 != statements.size() || !keep_value)
+        {
+            emit(OpCode::Pop);
+        }
+    }
+}
+
+void Compiler::compile_node(Node* node)
+{
+    if (!node)
+    {
+        m_errors.push_back("unable to compile empty node");
+        return;
+    }
+    switch (node->get_type())
+    {
+    case NodeType::Program:
+    {
+        compile_statements(static_cast<Program*>(node)->m_statements, true);
+        break;
+    }
+    case NodeType::ExpressionStatement:
+    {
+        compile_node(static_cast<ExpressionStatement*>(node)->m_expression.get());
+        break;
+    }
+    case NodeType::BlockStatement:
+    {
+        compile_statements(static_cast<BlockStatement*>(node)->m_statements, true);
+        break;
+    }
+    case NodeType::LetStatement:
+    {
+        compile_let(*static_cast<LetStatement*>(node));
+        break;
+    }
+    case NodeType::ReturnStatement:
+    {
+        compile_node(static_cast<ReturnStatement*>(node)->m_return_value.get());
+        emit(OpCode::ReturnValue);
+        break;
+    }
+    case NodeType::WhileStatement:
+    {
+        compile_while(*static_cast<WhileStatement*>(node));
+        break;
+    }
+    case NodeType::IntegerLiteral:
+    {
+        const auto value = static_cast<IntegerLiteral*>(node)->m_value;
+        emit(OpCode::Constant, {add_constant(Value::integer(value))});
+        break;
+    }
+    case NodeType::StringLiteral:
+    {
+        const auto& value = static_cast<StringLiteral*>(node)->m_value;
+        emit(OpCode::Constant, {add_constant(make_ref<StringObj>(value))});
+        break;
+    }
+    case NodeType::BooleanLiteral:
+    {
+        emit(static_cast<BooleanLiteral*>(node)->m_value ? OpCode::True : OpCode::False);
+        break;
+    }
+    case NodeType::PrefixExpression:
+    {
+        compile_prefix(*static_cast<PrefixExpression*>(node));
+        break;
+    }
+    case NodeType::InfixExpression:
+    {
+        compile_infix(*static_cast<InfixExpression*>(node));
+        break;
+    }
+    case NodeType::IfExpression:
+    {
+        compile_if(*static_cast<IfExpression*>(node));
+        break;
+    }
+    case NodeType::Identifier:
+    {
+        const auto& name = static_cast<Identifier*>(node)->m_value;
+        load_symbol(resolve(name, m_scopes.size() - 1), name);
+        break;
+    }
+    case NodeType::FnLiteral:
+    {
+        compile_fn(*static_cast<FnLiteral*>(node), {});
+        break;
+    }
+    case NodeType::CallExpression:
+    {
+        auto* nd = static_cast<CallExpression*>(node);
+        compile_node(nd->m_function.get());
+        for (const auto& arg : nd->m_arguments)
+        {
+            compile_node(arg.get());
+        }
+        if (nd->m_arguments.size() > MAX_U16_OPERAND)
+        {
+            m_errors.push_back(fmt::format("too many call arguments: {}", nd->m_arguments.size()));
+        }
+        emit(OpCode::Call, {nd->m_arguments.size()});
+        break;
+    }
+    case NodeType::ArrayLiteral:
+    {
+        auto* nd = static_cast<ArrayLiteral*>(node);
+        for (const auto& expr : nd->m_expressions)
+        {
+            compile_node(expr.get());
+        }
+        emit(OpCode::Array, {nd->m_expressions.size()});
+        break;
+    }
+    case NodeType::HashLiteral:
+    {
+        auto* nd = static_cast<HashLiteral*>(node);
+        for (const auto& [key, val] : nd->m_pairs)
+        {
+            compile_node(key.get());
+            compile_node(val.get());
+        }
+        emit(OpCode::Hash, {nd->m_pairs.size() * 2});
+        break;
+    }
+    case NodeType::IndexExpression:
+    {
+        auto* nd = static_cast<IndexExpression*>(node);
+        compile_node(nd->m_left.get());
+        compile_node(nd->m_index.get());
+        emit(OpCode::Index);
+        break;
+    }
+    }
+}
+
+void Compiler::compile_let(LetStatement& let)
+{
+    const auto& name = let.m_name->m_value;
+    if (m_scopes.size() > 1 && let.m_value && let.m_value->get_type() == NodeType::FnLiteral)
+    {
+        compile_fn(static_cast<FnLiteral&>(*let.m_value), name);
+    }
+    else
+    {
+        compile_node(let.m_value.get());
+    }
+    const auto symbol = define(name);
+    if (symbol.scope == SymbolScope::Global)
+    {
+        emit(OpCode::SetGlobal, {symbol.index});
+    }
+    else
+    {
+        emit(OpCode::SetLocal, {symbol.index});
+    }
+    emit(OpCode::Null);
+}
+
+void Compiler::compile_while(WhileStatement& stmt)
+{
+    const auto loop_start = scope().m_instructions.size();
+    compile_node(stmt.m_condition.get());
+    const auto exit_jump = emit(OpCode::JumpNotTruthy, {0});
+    compile_statements(stmt.m_loop_body->m_statements, false);
+    emit(OpCode::Jump, {loop_start});
+    patch_jump(exit_jump, scope().m_instructions.size());
+    emit(OpCode::Null);
+}
+
+void Compiler::compile_if(IfExpression& expr)
+{
+    compile_node(expr.m_condition.get());
+    const auto else_jump = emit(OpCode::JumpNotTruthy, {0});
+    compile_statements(expr.m_consequence->m_statements, true);
+    const auto end_jump = emit(OpCode::Jump, {0});
+    patch_jump(else_jump, scope().m_instructions.size());
+    if (expr.m_alternative)
+    {
+        compile_statements(expr.m_alternative->m_statements, true);
+    }
+    else
+    {
+        emit(OpCode::Null);
+    }
+    patch_jump(end_jump, scope().m_instructions.size());
+}
+
+void Compiler::compile_infix(InfixExpression& expr)
+{
+    compile_node(expr.m_left.get());
+    compile_node(expr.m_right.get());
+    switch (expr.m_operator)
+    {
+    case Operator::Plus:
+        emit(OpCode::Add);
+        break;
+    case Operator::Minus:
+        emit(OpCode::Sub);
+        break;
+    case Operator::Multiply:
+        emit(OpCode::Mul);
+        break;
+    case Operator::Divide:
+        emit(OpCode::Div);
+        break;
+    case Operator::Equal:
+        emit(OpCode::Equal);
+        break;
+    case Operator::NotEqual:
+        emit(OpCode::NotEqual);
+        break;
+    case Operator::Greater:
+        emit(OpCode::GreaterThan);
+        break;
+    case Operator::Less:
+        emit(OpCode::LessThan);
+        break;
+    default:
+        m_errors.push_back(fmt::format("unknown operator {}", to_string(expr.m_operator)));
+        break;
+    }
+}
+
+void Compiler::compile_prefix(PrefixExpression& expr)
+{
+    compile_node(expr.m_right.get());
+    switch (expr.m_operator)
+    {
+    case Operator::Bang:
+        emit(OpCode::Bang);
+        break;
+    case Operator::Minus:
+        emit(OpCode::Minus);
+        break;
+    default:
+        m_errors.push_back(fmt::format("unknown operator {}", to_string(expr.m_operator)));
+        break;
+    }
+}
+
+void Compiler::compile_fn(FnLiteral& fn, std::string_view self_name)
+{
+    enter_scope();
+    scope().m_self_name = self_name;
+    scope().m_declared = fn.m_slot_names;
+    for (const auto& param : fn.m_parameters)
+    {
+        define(param->m_value);
+    }
+    compile_statements(fn.m_body->m_statements, true);
+    emit(OpCode::ReturnValue);
+    mark_tail_calls(scope().m_instructions);
+    resolve_fallbacks(fn.m_parameters.size());
+
+    auto fn_scope = leave_scope();
+    const auto num_free = fn_scope.m_captures.size();
+    auto compiled = make_ref<CompiledFnObj>(std::move(fn_scope.m_instructions),
+                                            std::move(fn_scope.m_constants),
+                                            std::move(fn_scope.m_names),
+                                            std::move(fn_scope.m_local_names),
+                                            fn.m_parameters.size(),
+                                            std::move(fn_scope.m_captures),
+                                            std::move(fn_scope.m_local_fallbacks));
+    if (num_free > MAX_U16_OPERAND || compiled->m_local_names.size() > MAX_U16_OPERAND)
+    {
+        m_errors.push_back("too many local or free variables in function");
+    }
+    emit(OpCode::Closure, {add_constant(std::move(compiled)), num_free});
+}
+
+auto Compiler::emit(OpCode op, std::initializer_list<std::size_t> operands) -> std::size_t
+{
+    auto& instructions = scope().m_instructions;
+    const auto pos = instructions.size();
+    if (pos > MAX_U32_OPERAND)
+    {
+        m_errors.push_back(fmt::format("function body exceeds {} bytes of bytecode", MAX_U32_OPERAND));
+    }
+    const auto instruction = make(op, operands);
+    instructions.insert(std::end(instructions), std::begin(instruction), std::end(instruction));
+    return pos;
+}
+
+void Compiler::patch_jump(std::size_t pos, std::size_t target)
+{
+    write_u32(&scope().m_instructions[pos + 1], target);
+}
+
+auto Compiler::add_constant(Value obj) -> std::size_t
+{
+    auto& constants = scope().m_constants;
+    constants.push_back(std::move(obj));
+    if (constants.size() > MAX_U32_OPERAND)
+    {
+        m_errors.push_back(fmt::format("constant pool exceeds {} entries", MAX_U32_OPERAND));
+    }
+    return constants.size() - 1;
+}
+
+auto Compiler::add_name(std::string_view name) -> std::size_t
+{
+    auto& curr = scope();
+    if (const auto it = curr.m_name_indices.find(name); it != std::end(curr.m_name_indices))
+    {
+        return it->second;
+    }
+    curr.m_names.push_back(Atom::intern(name));
+    curr.m_name_indices.emplace(std::string(name), curr.m_names.size() - 1);
+    return curr.m_names.size() - 1;
+}
+
+auto Compiler::define(std::string_view name) -> Symbol
+{
+    if (m_scopes.size() == 1)
+    {
+        return Symbol{SymbolScope::Global, add_name(name)};
+    }
+    return define_local(scope(), name);
+}
+
+auto Compiler::define_local(CompilationScope& curr, std::string_view name) -> Symbol
+{
+    if (const auto it = curr.m_symbols.find(name); it != std::end(curr.m_symbols) && it->second.scope == SymbolScope::Local)
+    {
+        return it->second;
+    }
+    const Symbol symbol{SymbolScope::Local, curr.m_local_names.size()};
+    curr.m_local_names.emplace_back(name);
+    curr.m_symbols.insert_or_assign(std::string(name), symbol);
+    return symbol;
+}
+
+auto Compiler::resolve(std::string_view name, std::size_t level) -> Symbol
+{
+    if (level == 0)
+    {
+        return Symbol{SymbolScope::Global, 0};
+    }
+    auto& curr = m_scopes[level];
+    if (const auto it = curr.m_symbols.find(name); it != std::end(curr.m_symbols))
+    {
+        return it->second;
+    }
+    // Unset locals read the enclosing binding, see fallback().
+    if (curr.m_declared && std::find(std::begin(*curr.m_declared), std::end(*curr.m_declared), Atom::intern(name)) != std::end(*curr.m_declared))
+    {
+        return define_local(curr, name);
+    }
+    if (level + 1 == m_scopes.size() && !curr.m_self_name.empty() && curr.m_self_name == name)
+    {
+        return Symbol{SymbolScope::Function, 0};
+    }
+    const auto outer = resolve(name, level - 1);
+    if (outer.scope == SymbolScope::Global)
+    {
+        return outer;
+    }
+    curr.m_captures.push_back(Capture{outer.scope == SymbolScope::Local, outer.index, std::string(name)});
+    const Symbol symbol{SymbolScope::Free, curr.m_captures.size() - 1};
+    curr.m_symbols.emplace(std::string(name), symbol);
+    return symbol;
+}
+
+// Enclosing binding of name as an upvalue of the function at level, or Capture::GLOBAL.
+auto Compiler::fallback(std::size_t level, const Symbol& symbol, std::string_view name) -> std::size_t
+{
+    auto outer = Symbol{SymbolScope::Global, 0};
+    if (symbol.scope == SymbolScope::Local)
+    {
+        outer = resolve(name, level - 1);
+    }
+    else if (symbol.scope == SymbolScope::Free)
+    {
+        const auto& capture = m_scopes[level].m_captures[symbol.index];
+        const auto captured = Symbol{capture.m_local ? SymbolScope::Local : SymbolScope::Free, capture.m_index};
+        if (const auto index = fallback(level - 1, captured, name); index != Capture::GLOBAL)
+        {
+            outer = Symbol{SymbolScope::Free, index};
+        }
+    }
+    if (outer.scope == SymbolScope::Global)
+    {
+        return Capture::GLOBAL;
+    }
+    auto& captures = m_scopes[level].m_captures;
+    const auto is_local = outer.scope == SymbolScope::Local;
+    const auto it = std::find_if(std::begin(captures), std::end(captures), [&](const Capture& capture)
+                                 { return capture.m_local == is_local && capture.m_index == outer.index; });
+    if (it != std::end(captures))
+    {
+        return static_cast<std::size_t>(it - std::begin(captures));
+    }
+    captures.push_back(Capture{is_local, outer.index, std::string(name)});
+    return captures.size() - 1;
+}
+
+void Compiler::resolve_fallbacks(std::size_t num_parameters)
+{
+    const auto level = m_scopes.size() - 1;
+    auto& curr = scope();
+    curr.m_local_fallbacks.resize(curr.m_local_names.size(), Capture::GLOBAL);
+    for (std::size_t i = num_parameters; i < curr.m_local_names.size(); ++i)
+    {
+        const auto name = curr.m_local_names[i];
+        curr.m_local_fallbacks[i] = fallback(level, Symbol{SymbolScope::Local, i}, name);
+    }
+    // Resolving fallbacks can add upvalues, which need fallbacks of their own.
+    for (std::size_t i = 0; i < curr.m_captures.size(); ++i)
+    {
+        const auto name = curr.m_captures[i].m_name;
+        curr.m_captures[i].m_fallback = fallback(level, Symbol{SymbolScope::Free, i}, name);
+    }
+}
+
+void Compiler::load_symbol(const Symbol& symbol, std::string_view name)
+{
+    switch (symbol.scope)
+    {
+    case SymbolScope::Global:
+        emit(OpCode::GetGlobal, {add_name(name)});
+        break;
+    case SymbolScope::Local:
+        emit(OpCode::GetLocal, {symbol.index});
+        break;
+    case SymbolScope::Free:
+        emit(OpCode::GetFree, {symbol.index});
+        break;
+    case SymbolScope::Function:
+        emit(OpCode::CurrentClosure);
+        break;
+    }
+}
+
+auto Compiler::scope() -> CompilationScope&
+{
+    return m_scopes.back();
+}
+
+void Compiler::enter_scope()
+{
+    m_scopes.emplace_back();
+}
+
+auto Compiler::leave_scope() -> CompilationScope
+{
+    auto last = std::move(m_scopes.back());
+    m_scopes.pop_back();
+    return last;
+}
+}  // namespace mlang
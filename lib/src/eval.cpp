@@ -1,7 +1,24 @@
+#include <algorithm>
+#include <fmt/ranges.h>
 #include <memory>
+#include <mlang/closure_compiler.hpp>
+#include <mlang/compiler.hpp>
 #include <mlang/eval.hpp>
+#include <mlang/feedback.hpp>
+#include <mlang/flat_walker.hpp>
+#include <mlang/operator_table.hpp>
+#include <mlang/raii_wrapper.hpp>
+#include <mlang/register_compiler.hpp>
+#include <mlang/register_vm.hpp>
+#include <mlang/vm.hpp>
 #include <range/v3/view.hpp>
 #include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sys/resource.h>
+#endif
 
 namespace rv = ::ranges::views;
 using namespace std::literals;
@@ -9,24 +26,37 @@ using namespace std::literals;
 namespace
 {
 template <typename Getter>
-auto eval_getter_pos(Getter&& callable, std::string_view name, const std::vector<std::shared_ptr<mlang::Object>>& args) -> std::shared_ptr<mlang::Object>
+auto eval_getter_pos(Getter&& callable, std::string_view name, const std::vector<mlang::Value>& args) -> mlang::Value
 {
     if (std::size(args) != 1)
     {
-        return std::make_shared<mlang::ErrorObj>(fmt::format("invalid number of parameters for {}, expected 1 got {}", name, std::size(args)));
+        return mlang::make_ref<mlang::ErrorObj>(fmt::format("invalid number of parameters for {}, expected 1 got {}", name, std::size(args)));
     }
-    auto& arg = *args[0];
+    const auto& arg = args[0];
     const auto arg_type = arg.get_type();
     if (arg_type == mlang::ObjectType::ARRAY)
     {
-        auto& values = static_cast<mlang::ArrayObj&>(arg).m_values;
-        if (values.empty())
+        const auto& array = arg.as<mlang::ArrayObj>();
+        if (array.size() == 0)
         {
             return mlang::detail::NIL;
         }
-        return std::invoke(std::forward<Getter>(callable), values);
+        return std::invoke(std::forward<Getter>(callable), array);
     }
-    return std::make_shared<mlang::ErrorObj>(fmt::format("{} is not implemented for type {}", name, arg_type));
+    return mlang::make_ref<mlang::ErrorObj>(fmt::format("{} is not implemented for type {}", name, arg_type));
+}
+
+auto make_builtin(const mlang::BuiltInObj::BuiltInFn& fn) -> mlang::Ref<mlang::BuiltInObj>
+{
+    auto res = mlang::make_ref<mlang::BuiltInObj>(fn);
+    res->make_immortal();
+    return res;
+}
+
+// Arguments nobody else refers to are updated in place.
+auto is_unique(const mlang::Value& value) -> bool
+{
+    return value.object()->ref_count() == 1;
 }
 }  // namespace
 
@@ -34,25 +64,35 @@ namespace mlang
 {
 namespace detail
 {
-const std::shared_ptr<BooleanObj> TRUE = std::make_shared<BooleanObj>(true);
-const std::shared_ptr<BooleanObj> FALSE = std::make_shared<BooleanObj>(false);
-const std::shared_ptr<NullObj> NIL = std::make_shared<NullObj>();
-
-const std::shared_ptr<BuiltInObj> LEN = std::make_shared<BuiltInObj>(&eval_len);
-const std::shared_ptr<BuiltInObj> REST = std::make_shared<BuiltInObj>(&eval_rest);
-const std::shared_ptr<BuiltInObj> PUTS = std::make_shared<BuiltInObj>(&eval_puts);
-const std::shared_ptr<BuiltInObj> PUSH = std::make_shared<BuiltInObj>(&eval_push);
-const std::shared_ptr<BuiltInObj> ERASE = std::make_shared<BuiltInObj>(&eval_erase);
-const std::shared_ptr<BuiltInObj> FIRST = std::make_shared<BuiltInObj>([](const std::vector<std::shared_ptr<Object>>& args)
-                                                                       { return eval_getter_pos([](const auto& cont)
-                                                                                                { return cont.front(); },
-                                                                                                "first"sv, args); });
-const std::shared_ptr<BuiltInObj> LAST = std::make_shared<BuiltInObj>([](const std::vector<std::shared_ptr<Object>>& args)
-                                                                      { return eval_getter_pos([](const auto& cont)
-                                                                                               { return cont.back(); },
-                                                                                               "last"sv, args); });
-
-const std::unordered_map<std::string_view, std::shared_ptr<Object>> BUILTINS = {
+const Ref<BuiltInObj> LEN = make_builtin(&eval_len);
+const Ref<BuiltInObj> REST = make_builtin(&eval_rest);
+const Ref<BuiltInObj> PUTS = make_builtin(&eval_puts);
+const Ref<BuiltInObj> PUSH = make_builtin(&eval_push);
+const Ref<BuiltInObj> ERASE = make_builtin(&eval_erase);
+const Ref<BuiltInObj> SLICE = make_builtin(&eval_slice);
+const Ref<BuiltInObj> GC_STATS = make_builtin(&eval_gc_stats);
+const Ref<BuiltInObj> FIRST = make_builtin([](const std::vector<Value>& args)
+                                           { return eval_getter_pos([](const auto& cont)
+                                                                    { return cont.at(0); },
+                                                                    "first"sv, args); });
+const Ref<BuiltInObj> LAST = make_builtin([](const std::vector<Value>& args)
+                                          { return eval_getter_pos([](const auto& cont)
+                                                                   { return cont.at(cont.size() - 1); },
+                                                                   "last"sv, args); });
+
+const std::unordered_map<std::string_view, Value> BUILTINS = {
+    std::make_pair("len"sv, LEN),
+    std::make_pair("first"sv, FIRST),
+    std::make_pair("last"sv, LAST),
+    std::make_pair("rest"sv, REST),
+    std::make_pair("push"sv, PUSH),
+    std::make_pair("puts"sv, PUTS),
+    std::make_pair("erase"sv, ERASE),
+    std::make_pair("gc_stats"sv, GC_STATS),
+    std::make_pair("slice"sv, SLICE),
+};
+
+const std::vector<std::pair<std::string_view, Value>> BUILTIN_TABLE = {
     std::make_pair("len"sv, LEN),
     std::make_pair("first"sv, FIRST),
     std::make_pair("last"sv, LAST),
@@ -60,129 +100,274 @@ const std::unordered_map<std::string_view, std::shared_ptr<Object>> BUILTINS = {
     std::make_pair("push"sv, PUSH),
     std::make_pair("puts"sv, PUTS),
     std::make_pair("erase"sv, ERASE),
+    std::make_pair("gc_stats"sv, GC_STATS),
+    std::make_pair("slice"sv, SLICE),
 };
 
-auto eval_len(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>
+auto eval_len(const std::vector<Value>& args) -> Value
 {
     if (std::size(args) != 1)
     {
-        return std::make_shared<ErrorObj>(fmt::format("invalid number of parameters for len, expected 1 got {}", std::size(args)));
+        return make_ref<ErrorObj>(fmt::format("invalid number of parameters for len, expected 1 got {}", std::size(args)));
     }
-    auto& arg = *args[0];
+    const auto& arg = args[0];
     if (arg.get_type() == ObjectType::STRING)
     {
-        return std::make_shared<IntegerObj>(static_cast<StringObj&>(arg).m_value.size());
+        return Value::integer(static_cast<std::int64_t>(arg.as<StringObj>().size()));
     }
     if (arg.get_type() == ObjectType::ARRAY)
     {
-        return std::make_shared<IntegerObj>(static_cast<ArrayObj&>(arg).m_values.size());
+        return Value::integer(static_cast<std::int64_t>(arg.as<ArrayObj>().size()));
     }
-    return std::make_shared<ErrorObj>(fmt::format("len is not implemented for type {}", arg.get_type()));
+    return make_ref<ErrorObj>(fmt::format("len is not implemented for type {}", arg.get_type()));
 }
 
-auto eval_puts(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>
+auto eval_puts(const std::vector<Value>& args) -> Value
 {
     if (std::empty(args))
     {
-        return std::make_shared<ErrorObj>(fmt::format("invalid number of parameters for puts, expected  at least 1 got {}", std::size(args)));
+        return make_ref<ErrorObj>(fmt::format("invalid number of parameters for puts, expected  at least 1 got {}", std::size(args)));
     }
     for (const auto& obj : args)
     {
-        fmt::println("{}", obj->inspect());
+        fmt::println("{}", obj.inspect());
     }
     return NIL;
 }
 
-auto eval_rest(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>
+auto eval_rest(const std::vector<Value>& args) -> Value
 {
     if (std::size(args) != 1)
     {
-        return std::make_shared<ErrorObj>(fmt::format("invalid number of parameters for rest, expected 1 got {}", std::size(args)));
+        return make_ref<ErrorObj>(fmt::format("invalid number of parameters for rest, expected 1 got {}", std::size(args)));
     }
-    auto& arg = *args[0];
+    const auto& arg = args[0];
     const auto arg_type = arg.get_type();
     if (arg_type == ObjectType::ARRAY)
     {
-        const auto& values = static_cast<ArrayObj&>(arg).m_values;
-        if (values.empty())
+        const auto& array = arg.as<ArrayObj>();
+        if (array.size() == 0)
         {
             return NIL;
         }
-        return std::make_shared<ArrayObj>(decltype(values){std::next(std::begin(values)), std::end(values)});
+        return ArrayObj::slice(arg.cast<ArrayObj>(), 1, array.size());
     }
     if (arg_type == ObjectType::STRING)
     {
-        const auto& value = static_cast<StringObj&>(arg).m_value;
-        if (value.empty())
+        const auto& str = arg.as<StringObj>();
+        if (str.size() == 0)
         {
             return NIL;
         }
-        return std::make_shared<StringObj>(decltype(value){std::next(std::begin(value)), std::end(value)});
+        return StringObj::slice(arg.cast<StringObj>(), 1, str.size());
     }
-    return std::make_shared<ErrorObj>(fmt::format("rest is not implemented for type {}", arg_type));
+    return make_ref<ErrorObj>(fmt::format("rest is not implemented for type {}", arg_type));
 }
 
-auto eval_push(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>
+auto eval_push(const std::vector<Value>& args) -> Value
 {
     if (std::size(args) < 1)
     {
-        return std::make_shared<ErrorObj>(fmt::format("invalid number of parameters for push {}", std::size(args)));
+        return make_ref<ErrorObj>(fmt::format("invalid number of parameters for push {}", std::size(args)));
     }
-    auto& arg = *args[0];
+    const auto& arg = args[0];
     const auto arg_type = arg.get_type();
     if (arg_type == ObjectType::ARRAY)
     {
         if (std::size(args) != 2)
         {
-            return std::make_shared<ErrorObj>(fmt::format("invalid number of parameters for push, expected 2 got {}", std::size(args)));
+            return make_ref<ErrorObj>(fmt::format("invalid number of parameters for push, expected 2 got {}", std::size(args)));
         }
-        auto values = static_cast<ArrayObj&>(arg).m_values;
-        values.push_back(args[1]);
-        return std::make_shared<ArrayObj>(values);
+        if (is_unique(arg))
+        {
+            arg.as<ArrayObj>().append(args[1]);
+            return arg;
+        }
+        return arg.as<ArrayObj>().push(args[1]);
     }
     if (arg_type == ObjectType::HASH)
     {
-        auto values = static_cast<HashObj&>(arg).m_pairs;
-        values[args[1]] = args[2];
-        return std::make_shared<HashObj>(std::move(values));
+        if (std::size(args) != 3)
+        {
+            return make_ref<ErrorObj>(fmt::format("invalid number of parameters for push, expected 3 got {}", std::size(args)));
+        }
+        if (is_unique(arg))
+        {
+            arg.as<HashObj>().m_pairs.set(args[1], args[2]);
+            return arg;
+        }
+        auto pairs = arg.as<HashObj>().m_pairs;
+        pairs.set(args[1], args[2]);
+        return make_ref<HashObj>(std::move(pairs));
     }
-    return std::make_shared<ErrorObj>(fmt::format("push is not implemented for type {}", arg.get_type()));
+    return make_ref<ErrorObj>(fmt::format("push is not implemented for type {}", arg.get_type()));
 }
 
-auto eval_erase(const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>
+auto eval_erase(const std::vector<Value>& args) -> Value
 {
     if (std::size(args) != 2)
     {
-        return std::make_shared<ErrorObj>(fmt::format("invalid number of parameters for erase, expected 2 got {}", std::size(args)));
+        return make_ref<ErrorObj>(fmt::format("invalid number of parameters for erase, expected 2 got {}", std::size(args)));
     }
-    auto& arg = *args[0];
+    const auto& arg = args[0];
     if (arg.get_type() == ObjectType::HASH)
     {
-        auto values = static_cast<HashObj&>(arg).m_pairs;
-        values.erase(args[1]);
-        return std::make_shared<HashObj>(values);
+        if (is_unique(arg))
+        {
+            arg.as<HashObj>().m_pairs.erase(args[1]);
+            return arg;
+        }
+        auto pairs = arg.as<HashObj>().m_pairs;
+        pairs.erase(args[1]);
+        return make_ref<HashObj>(std::move(pairs));
+    }
+    return make_ref<ErrorObj>(fmt::format("erase is not implemented for type {}", arg.get_type()));
+}
+
+auto eval_slice(const std::vector<Value>& args) -> Value
+{
+    if (std::size(args) != 3)
+    {
+        return make_ref<ErrorObj>(fmt::format("invalid number of parameters for slice, expected 3 got {}", std::size(args)));
+    }
+    const auto& arg = args[0];
+    const auto arg_type = arg.get_type();
+    if (arg_type != ObjectType::ARRAY && arg_type != ObjectType::STRING)
+    {
+        return make_ref<ErrorObj>(fmt::format("slice is not implemented for type {}", arg_type));
+    }
+    if (args[1].get_type() != ObjectType::INTEGER || args[2].get_type() != ObjectType::INTEGER)
+    {
+        return make_ref<ErrorObj>(fmt::format("slice bounds must be {}, got {} and {}", ObjectType::INTEGER, args[1].get_type(), args[2].get_type()));
+    }
+    const auto size = static_cast<std::int64_t>(arg_type == ObjectType::ARRAY ? arg.as<ArrayObj>().size() : arg.as<StringObj>().size());
+    const auto start = std::clamp(args[1].as_integer(), std::int64_t{0}, size);
+    const auto end = std::clamp(args[2].as_integer(), start, size);
+    if (arg_type == ObjectType::ARRAY)
+    {
+        return ArrayObj::slice(arg.cast<ArrayObj>(), start, end);
+    }
+    return StringObj::slice(arg.cast<StringObj>(), start, end);
+}
+
+auto eval_gc_stats(const std::vector<Value>& args) -> Value
+{
+    if (!std::empty(args))
+    {
+        return make_ref<ErrorObj>(fmt::format("invalid number of parameters for gc_stats, expected 0 got {}", std::size(args)));
+    }
+    const auto stats = gc_stats();
+    PersistentMap pairs;
+    const auto add = [&pairs](std::string_view name, std::size_t value)
+    {
+        pairs.set(make_ref<StringObj>(name), Value::integer(static_cast<std::int64_t>(value)));
+    };
+    add("collections", stats.m_collections);
+    add("collected", stats.m_collected);
+    add("candidates", stats.m_candidates);
+    add("tracked", stats.m_tracked);
+    const auto heap = heap_stats();
+    add("heap_chunks", heap.m_chunks);
+    add("heap_live", heap.m_live);
+    return make_ref<HashObj>(std::move(pairs));
+}
+
+namespace
+{
+// Lowest address native recursion may reach.
+auto native_stack_limit() -> std::uintptr_t
+{
+    const char marker = 0;
+    const auto stack_pos = reinterpret_cast<std::uintptr_t>(&marker);
+    std::uintptr_t stack_end = 0;
+#if defined(__linux__)
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0)
+    {
+        void* addr = nullptr;
+        std::size_t size = 0;
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0)
+        {
+            stack_end = reinterpret_cast<std::uintptr_t>(addr);
+        }
+        pthread_attr_destroy(&attr);
+    }
+#elif defined(__APPLE__)
+    const auto self = pthread_self();
+    stack_end = reinterpret_cast<std::uintptr_t>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    if (stack_end == 0)
+    {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < stack_pos)
+        {
+            stack_end = stack_pos - limit.rlim_cur;
+        }
+    }
+#endif
+    if (stack_end == 0 || stack_end > stack_pos)
+    {
+        stack_end = stack_pos - std::min<std::uintptr_t>(stack_pos, FALLBACK_NATIVE_STACK_SIZE);
     }
-    return std::make_shared<ErrorObj>(fmt::format("erase is not implemented for type {}", arg.get_type()));
+    return stack_pos - stack_end > NATIVE_STACK_MARGIN ? stack_end + NATIVE_STACK_MARGIN : stack_pos;
 }
 
-auto is_truth(const std::shared_ptr<Object>& obj) -> bool
+thread_local std::size_t call_depth = 0;
+thread_local std::size_t max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+thread_local const std::uintptr_t stack_limit = native_stack_limit();
+}  // namespace
+
+auto enter_call() -> Value
+{
+    const char marker = 0;
+    if (call_depth >= max_call_depth)
+    {
+        return stack_overflow_error(max_call_depth);
+    }
+    if (reinterpret_cast<std::uintptr_t>(&marker) < stack_limit)
+    {
+        return make_ref<ErrorObj>(fmt::format("stack overflow: native stack exhausted at call depth {}", call_depth));
+    }
+    ++call_depth;
+    return nullptr;
+}
+
+void leave_call()
+{
+    --call_depth;
+}
+
+auto stack_overflow_error(std::size_t max_call_depth) -> Value
+{
+    return make_ref<ErrorObj>(fmt::format("stack overflow: maximum call depth {} exceeded", max_call_depth));
+}
+
+auto builtin_index(std::string_view name) -> std::optional<std::size_t>
 {
-    return obj != FALSE && obj != NIL;
+    for (std::size_t i = 0; i < BUILTIN_TABLE.size(); ++i)
+    {
+        if (BUILTIN_TABLE[i].first == name)
+        {
+            return i;
+        }
+    }
+    return std::nullopt;
 }
 
-auto eval_program(Program& prog, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>
+auto eval_program(Program& prog, const Ref<Context>& env) -> Value
 {
-    std::shared_ptr<Object> res;
+    Value res;
     using value_t = typename decltype(prog.m_statements)::value_type;
     for (auto* s : prog.m_statements | rv::transform([](const value_t& ptr)
                                                      { return ptr.get(); }))
     {
         res = eval(s, env);
-        if (res && res->get_type() == ObjectType::RETURN)
+        if (res && res.get_type() == ObjectType::RETURN)
         {
-            return static_cast<ReturnValueObj&>(*res).m_value;
+            return res.as<ReturnValueObj>().m_value;
         }
-        else if (res && res->get_type() == ObjectType::ERROR)
+        else if (res && res.get_type() == ObjectType::ERROR)
         {
             return res;
         }
@@ -190,15 +375,15 @@ auto eval_program(Program& prog, const std::shared_ptr<Context>& env) -> std::sh
     return res;
 }
 
-auto eval_block_statement(BlockStatement& stmt, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>
+auto eval_block_statement(BlockStatement& stmt, const Ref<Context>& env) -> Value
 {
-    std::shared_ptr<Object> res;
+    Value res;
     using value_t = typename decltype(stmt.m_statements)::value_type;
     for (auto* stmt : stmt.m_statements | rv::transform([](const value_t& val)
                                                         { return val.get(); }))
     {
         res = eval(stmt, env);
-        if (res && (res->get_type() == ObjectType::RETURN || res->get_type() == ObjectType::ERROR))
+        if (res && (res.get_type() == ObjectType::RETURN || res.get_type() == ObjectType::ERROR))
         {
             return res;
         }
@@ -206,29 +391,40 @@ auto eval_block_statement(BlockStatement& stmt, const std::shared_ptr<Context>&
     return res;
 }
 
-auto eval_identifier(Identifier& node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>
+auto eval_identifier(Identifier& node, const Ref<Context>& env) -> Value
 {
+    if (node.m_address)
+    {
+        if (auto val = env->get_slot(node.m_address->m_depth, node.m_address->m_slot))
+        {
+            return val;
+        }
+    }
     auto val = env->get_obj(node.m_value);
     if (val)
     {
         return val;
     }
+    if (node.m_builtin)
+    {
+        return BUILTIN_TABLE[*node.m_builtin].second;
+    }
     if (const auto it = BUILTINS.find(node.m_value); it != std::end(BUILTINS))
     {
         return it->second;
     }
-    return std::make_shared<ErrorObj>(fmt::format("identifier not found: {}", node.m_value));
+    return make_ref<ErrorObj>(fmt::format("identifier not found: {}", node.m_value));
 }
 
-auto eval_expressions(const std::vector<std::unique_ptr<Expression>>& nodes, const std::shared_ptr<Context>& env) -> std::vector<std::shared_ptr<Object>>
+auto eval_expressions(const NodeList<Expression>& nodes, const Ref<Context>& env) -> std::vector<Value>
 {
-    std::vector<std::shared_ptr<Object>> res;
+    std::vector<Value> res;
     using value_t = typename std::remove_cvref_t<decltype(nodes)>::value_type;
     for (auto* expr : nodes | rv::transform([](const value_t& val)
                                             { return val.get(); }))
     {
         auto evaluated = eval(expr, env);
-        if (evaluated->get_type() == ObjectType::ERROR)
+        if (evaluated.get_type() == ObjectType::ERROR)
         {
             return {std::move(evaluated)};
         }
@@ -237,119 +433,157 @@ auto eval_expressions(const std::vector<std::unique_ptr<Expression>>& nodes, con
     return res;
 }
 
-auto apply_function(const std::shared_ptr<FunctionObj>& fn, const std::vector<std::shared_ptr<Object>>& args) -> std::shared_ptr<Object>
-{
-    if (std::size(fn->m_parameters) != std::size(args))
-    {
-        return std::make_shared<ErrorObj>(fmt::format("invalid number of args expected {} got {}", std::size(fn->m_parameters), std::size(args)));
-    }
-    auto extended_env = std::make_shared<Context>(fn->m_env);
-    for (const auto& [i, arg] : rv::enumerate(fn->m_parameters))
-    {
-        extended_env->set_obj(arg->m_value, args.at(i));
-    }
-    auto evaluated = eval(fn->m_body.get(), extended_env);
-    if (evaluated->get_type() == ObjectType::RETURN)
-    {
-        return static_cast<ReturnValueObj&>(*evaluated).m_value;
-    }
-    return evaluated;
-}
-
-auto eval_int_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>
+auto apply_function(const Ref<FunctionObj>& fn, const std::vector<Value>& args) -> Value
 {
-    const auto right_val = static_cast<IntegerObj&>(*right).m_value;
-    const auto left_val = static_cast<IntegerObj&>(*left).m_value;
-
-    if (op == "+")
-    {
-        return std::make_shared<IntegerObj>(left_val + right_val);
-    }
-    else if (op == "-")
-    {
-        return std::make_shared<IntegerObj>(left_val - right_val);
-    }
-    else if (op == "*")
-    {
-        return std::make_shared<IntegerObj>(left_val * right_val);
-    }
-    else if (op == "/")
-    {
-        return std::make_shared<IntegerObj>(left_val / right_val);
-    }
-    else if (op == ">")
-    {
-        return left_val > right_val ? TRUE : FALSE;
-    }
-    else if (op == "<")
-    {
-        return left_val < right_val ? TRUE : FALSE;
-    }
-    else if (op == "!=")
+    if (auto err = enter_call())
     {
-        return left_val != right_val ? TRUE : FALSE;
+        return err;
     }
-    else if (op == "==")
+    const auto leave = RaiiWrapper(&leave_call);
+    TailCall<FunctionObj> call{fn, args};
+    while (call.m_fn)
     {
-        return left_val == right_val ? TRUE : FALSE;
+        const auto current = std::move(call.m_fn);
+        const auto current_args = std::move(call.m_args);
+        call = TailCall<FunctionObj>{};
+        const auto& literal = *current->m_literal;
+        if (std::size(literal.m_parameters) != std::size(current_args))
+        {
+            return make_ref<ErrorObj>(fmt::format("invalid number of args expected {} got {}", std::size(literal.m_parameters), std::size(current_args)));
+        }
+        auto extended_env = make_ref<Context>(current->m_env, literal.m_slot_names);
+        for (const auto& [i, arg] : rv::enumerate(literal.m_parameters))
+        {
+            if (arg->m_address)
+            {
+                extended_env->set_slot(arg->m_address->m_slot, current_args[i]);
+            }
+            else
+            {
+                extended_env->set_obj(arg->m_value, current_args[i]);
+            }
+        }
+        auto evaluated = eval_tail_position(literal.m_body.get(), extended_env, call, true);
+        if (call.m_fn)
+        {
+            continue;
+        }
+        if (!evaluated)
+        {
+            return NIL;
+        }
+        if (evaluated.get_type() == ObjectType::RETURN)
+        {
+            return evaluated.as<ReturnValueObj>().m_value;
+        }
+        return evaluated;
     }
-    return std::make_shared<ErrorObj>(fmt::format("unknown operator: {} {} {}", left->get_type(), op, right->get_type()));
+    return NIL;
 }
 
-auto eval_string_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>
+auto eval_tail_position(Node* node, const Ref<Context>& env, TailCall<FunctionObj>& call, bool tail) -> Value
 {
-    const auto right_val = static_cast<StringObj&>(*right).m_value;
-    const auto left_val = static_cast<StringObj&>(*left).m_value;
-
-    if (op == "+")
+    // Last nodes continue in this loop instead of recursing.
+    while (true)
     {
-        return std::make_shared<StringObj>(left_val + right_val);
+        const auto node_type = node->get_type();
+        if (node_type == NodeType::BlockStatement)
+        {
+            const auto& statements = static_cast<BlockStatement*>(node)->m_statements;
+            if (statements.empty())
+            {
+                return nullptr;
+            }
+            for (std::size_t i = 0; i + 1 < statements.size(); ++i)
+            {
+                auto res = eval_tail_position(statements[i].get(), env, call, false);
+                if (call.m_fn)
+                {
+                    return nullptr;
+                }
+                if (res && (res.get_type() == ObjectType::RETURN || res.get_type() == ObjectType::ERROR))
+                {
+                    return res;
+                }
+            }
+            node = statements.back().get();
+            continue;
+        }
+        if (node_type == NodeType::ExpressionStatement)
+        {
+            node = static_cast<ExpressionStatement*>(node)->m_expression.get();
+            continue;
+        }
+        if (node_type == NodeType::IfExpression)
+        {
+            auto& expr = *static_cast<IfExpression*>(node);
+            auto condition = eval(expr.m_condition.get(), env);
+            if (condition.get_type() == ObjectType::ERROR)
+            {
+                return condition;
+            }
+            if (is_truth(condition))
+            {
+                node = expr.m_consequence.get();
+            }
+            else if (expr.m_alternative)
+            {
+                node = expr.m_alternative.get();
+            }
+            else
+            {
+                return NIL;
+            }
+            continue;
+        }
+        break;
     }
-    return std::make_shared<ErrorObj>(fmt::format("unknown operator: {} {} {}", left->get_type(), op, right->get_type()));
-}
-
-auto eval_bool_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>
-{
-    const auto right_val = static_cast<BooleanObj&>(*right).m_value;
-    const auto left_val = static_cast<BooleanObj&>(*left).m_value;
-
-    if (op == "==")
+    const auto node_type = node->get_type();
+    if (node_type == NodeType::ReturnStatement)
     {
-        return std::make_shared<BooleanObj>(left_val == right_val);
+        auto val = eval_tail_position(static_cast<ReturnStatement*>(node)->m_return_value.get(), env, call, true);
+        if (call.m_fn)
+        {
+            return nullptr;
+        }
+        return make_ref<ReturnValueObj>(std::move(val));
     }
-    else if (op == "!=")
+    if (tail && node_type == NodeType::CallExpression)
     {
-        return std::make_shared<BooleanObj>(left_val != right_val);
+        auto& expr = *static_cast<CallExpression*>(node);
+        auto func = eval(expr.m_function.get(), env);
+        if (func.get_type() == ObjectType::ERROR)
+        {
+            return func;
+        }
+        auto args = eval_expressions(expr.m_arguments, env);
+        if (args.size() == 1 && args.front().get_type() == ObjectType::ERROR)
+        {
+            return std::move(args.front());
+        }
+        if (func.get_type() == ObjectType::FUNCTION)
+        {
+            call = TailCall<FunctionObj>{func.cast<FunctionObj>(), std::move(args)};
+            return nullptr;
+        }
+        if (func.get_type() == ObjectType::BUILTIN)
+        {
+            return func.as<BuiltInObj>().m_value(args);
+        }
+        return make_ref<ErrorObj>(fmt::format("not a function: {}", func.get_type()));
     }
-    return std::make_shared<ErrorObj>(fmt::format("unknown operator: {} {} {}", left->get_type(), op, right->get_type()));
+    return eval(node, env);
 }
 
-auto eval_infix_expression(const std::string& op, const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>
+auto eval_infix_expression(Operator op, const Value& left, const Value& right) -> Value
 {
-    const auto left_type = left->get_type();
-    if (left_type != right->get_type())
-    {
-        return std::make_shared<ErrorObj>(fmt::format("type mismatch: {} {} {}", left->get_type(), op, right->get_type()));
-    }
-    else if (left_type == ObjectType::INTEGER)
-    {
-        return eval_int_infix_expression(op, left, right);
-    }
-    else if (left_type == ObjectType::BOOLEAN)
-    {
-        return eval_bool_infix_expression(op, left, right);
-    }
-    else if (left_type == ObjectType::STRING)
-    {
-        return eval_string_infix_expression(op, left, right);
-    }
-    return std::make_shared<ErrorObj>(fmt::format("unknown operator: {} {} {}", left->get_type(), op, right->get_type()));
+    return infix_handler(op, left.get_type(), right.get_type())(op, left, right);
 }
 
-auto eval_if_expression(IfExpression& expr, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>
+auto eval_if_expression(IfExpression& expr, const Ref<Context>& env) -> Value
 {
     auto condition = eval(expr.m_condition.get(), env);
-    if (condition->get_type() == ObjectType::ERROR)
+    if (condition.get_type() == ObjectType::ERROR)
     {
         return condition;
     }
@@ -364,17 +598,17 @@ auto eval_if_expression(IfExpression& expr, const std::shared_ptr<Context>& env)
     return NIL;
 }
 
-auto eval_minus_prefix_operator(const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>
+auto eval_minus_prefix_operator(const Value& right) -> Value
 {
-    if (right->get_type() != ObjectType::INTEGER)
+    if (right.get_type() != ObjectType::INTEGER)
     {
-        return std::make_shared<ErrorObj>(fmt::format("unknown operator: -{}", right->get_type()));
+        return make_ref<ErrorObj>(fmt::format("unknown operator: -{}", right.get_type()));
     }
-    const auto val = static_cast<IntegerObj&>(*right).m_value;
-    return std::make_shared<IntegerObj>(-val);
+    const auto val = right.as_integer();
+    return Value::integer(-val);
 }
 
-auto eval_bang_expression(const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>
+auto eval_bang_expression(const Value& right) -> Value
 {
     if (right == FALSE)
     {
@@ -391,53 +625,87 @@ auto eval_bang_expression(const std::shared_ptr<Object>& right) -> std::shared_p
     return FALSE;
 }
 
-auto eval_prefix_expression(const std::string& op, const std::shared_ptr<Object>& right) -> std::shared_ptr<Object>
+auto eval_prefix_expression(Operator op, const Value& right) -> Value
 {
-    if (op == "!")
-    {
-        return eval_bang_expression(right);
-    }
-    else if (op == "-")
-    {
-        return eval_minus_prefix_operator(right);
-    }
-    return std::make_shared<ErrorObj>(fmt::format("unknown operator: {}{}", op, right->get_type()));
+    return prefix_handler(op, right.get_type())(op, right);
 }
 
-auto eval_index_expression(const std::shared_ptr<Object>& obj, const std::shared_ptr<Object>& index) -> std::shared_ptr<Object>
+auto eval_index_expression(const Value& obj, const Value& index) -> Value
 {
-    const auto obj_type = obj->get_type();
+    const auto obj_type = obj.get_type();
     if (obj_type == ObjectType::ARRAY)
     {
-        if (index->get_type() != ObjectType::INTEGER)
+        if (index.get_type() != ObjectType::INTEGER)
         {
-            return std::make_shared<ErrorObj>(fmt::format("Expected index type to be {}, got {}", ObjectType::INTEGER, index->get_type()));
+            return make_ref<ErrorObj>(fmt::format("Expected index type to be {}, got {}", ObjectType::INTEGER, index.get_type()));
         }
-        const auto& arr_obj = static_cast<ArrayObj&>(*obj);
-        const auto idx = static_cast<IntegerObj&>(*index).m_value;
-        const auto max_element = static_cast<std::int64_t>(std::size(arr_obj.m_values));
+        const auto& arr_obj = obj.as<ArrayObj>();
+        const auto idx = index.as_integer();
+        const auto max_element = static_cast<std::int64_t>(arr_obj.size());
 
         if (idx < 0 || idx >= max_element)
         {
             return NIL;
         }
-        return arr_obj.m_values[idx];
+        return arr_obj.at(idx);
     }
     if (obj_type == ObjectType::HASH)
     {
-        const auto& hash_obj = static_cast<HashObj&>(*obj);
-        const auto it = hash_obj.m_pairs.find(index);
-        if (it == std::end(hash_obj.m_pairs))
+        const auto* value = obj.as<HashObj>().m_pairs.find(index);
+        if (!value)
         {
             return NIL;
         }
-        return it->second;
+        return *value;
+    }
+    return make_ref<ErrorObj>(fmt::format("Index operator not supported for type {}", obj.get_type()));
+}
+
+auto call_rebinding_builtin(const BuiltInObj& builtin, const std::vector<Value>& args, Value* binding) -> Value
+{
+    if (!binding || args.empty() || !args.front().object() || binding->object() != args.front().object())
+    {
+        return builtin.m_value(args);
+    }
+    *binding = nullptr;
+    auto res = builtin.m_value(args);
+    if (res.get_type() == ObjectType::ERROR)
+    {
+        *binding = args.front();
+    }
+    return res;
+}
+
+auto eval_call_expression(CallExpression& expr, const Ref<Context>& env, const Identifier* target) -> Value
+{
+    auto func = eval(expr.m_function.get(), env);
+    if (func.get_type() == ObjectType::ERROR)
+    {
+        return func;
+    }
+    auto args = eval_expressions(expr.m_arguments, env);
+    if (args.size() == 1 && args.front().get_type() == ObjectType::ERROR)
+    {
+        return std::move(args.front());
+    }
+    if (func.get_type() == ObjectType::BUILTIN)
+    {
+        if (target)
+        {
+            auto* binding = target->m_address ? &env->slot(target->m_address->m_slot) : env->find_binding(target->m_value);
+            return call_rebinding_builtin(func.as<BuiltInObj>(), args, binding);
+        }
+        return func.as<BuiltInObj>().m_value(args);
+    }
+    if (func.get_type() != ObjectType::FUNCTION)
+    {
+        return make_ref<ErrorObj>(fmt::format("not a function: {}", func.get_type()));
     }
-    return std::make_shared<ErrorObj>(fmt::format("Index operator not supported for type {}", obj->get_type()));
+    return apply_function(func.cast<FunctionObj>(), args);
 }
 }  // namespace detail
 
-auto eval(Node* node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Object>
+auto eval(Node* node, const Ref<Context>& env) -> Value
 {
     assert(node);
     assert(env);
@@ -471,13 +739,12 @@ auto eval(Node* node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Ob
     else if (node_type == NodeType::IntegerLiteral)
     {
         auto* nd = static_cast<IntegerLiteral*>(node);
-        auto obj = std::make_shared<IntegerObj>(nd->m_value);
-        return obj;
+        return Value::integer(nd->m_value);
     }
     else if (node_type == NodeType::StringLiteral)
     {
         auto* nd = static_cast<StringLiteral*>(node);
-        auto obj = std::make_shared<StringObj>(nd->m_value);
+        auto obj = make_ref<StringObj>(nd->m_value);
         return obj;
     }
     else if (node_type == NodeType::BooleanLiteral)
@@ -489,22 +756,22 @@ auto eval(Node* node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Ob
     {
         auto* nd = static_cast<InfixExpression*>(node);
         auto left = eval(nd->m_left.get(), env);
-        if (left->get_type() == ObjectType::ERROR)
+        if (left.get_type() == ObjectType::ERROR)
         {
             return left;
         }
         auto right = eval(nd->m_right.get(), env);
-        if (left->get_type() == ObjectType::ERROR)
+        if (right.get_type() == ObjectType::ERROR)
         {
             return right;
         }
-        return detail::eval_infix_expression(nd->m_operator, left, right);
+        return detail::eval_quickened_infix(*nd, left, right);
     }
     else if (node_type == NodeType::ReturnStatement)
     {
         auto* nd = static_cast<ReturnStatement*>(node);
         auto val = eval(nd->m_return_value.get(), env);
-        return std::make_shared<ReturnValueObj>(std::move(val));
+        return make_ref<ReturnValueObj>(std::move(val));
     }
     else if (node_type == NodeType::Identifier)
     {
@@ -514,57 +781,78 @@ auto eval(Node* node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Ob
     else if (node_type == NodeType::LetStatement)
     {
         auto* nd = static_cast<LetStatement*>(node);
-        auto val = eval(nd->m_value.get(), env);
-        if (val->get_type() == ObjectType::ERROR)
+        auto* value = nd->m_value.get();
+        auto val = value->get_type() == NodeType::CallExpression
+                       ? detail::eval_call_expression(*static_cast<CallExpression*>(value), env, nd->m_name.get())
+                       : eval(value, env);
+        if (val.get_type() == ObjectType::ERROR)
         {
             return val;
         }
-        env->set_obj(nd->m_name->m_value, val);
+        if (nd->m_name->m_address)
+        {
+            env->set_slot(nd->m_name->m_address->m_slot, val);
+        }
+        else
+        {
+            env->set_obj(nd->m_name->m_value, val);
+        }
         return detail::NIL;
     }
     else if (node_type == NodeType::FnLiteral)
     {
         auto* nd = static_cast<FnLiteral*>(node);
-        return std::make_shared<FunctionObj>(nd->m_parameters, nd->m_body, env);
+        return make_ref<FunctionObj>(nd->m_arena->share(nd), env);
     }
     else if (node_type == NodeType::ArrayLiteral)
     {
         auto* nd = static_cast<ArrayLiteral*>(node);
         auto elements = detail::eval_expressions(nd->m_expressions, env);
-        if (elements.size() == 1 && elements.front()->get_type() == ObjectType::ERROR)
+        if (elements.size() == 1 && elements.front().get_type() == ObjectType::ERROR)
         {
             return std::move(elements.front());
         }
-        return std::make_shared<ArrayObj>(elements);
+        return make_ref<ArrayObj>(std::move(elements));
     }
     else if (node_type == NodeType::IndexExpression)
     {
         auto* nd = static_cast<IndexExpression*>(node);
         auto left = eval(nd->m_left.get(), env);
-        if (left->get_type() == ObjectType::ERROR)
+        if (left.get_type() == ObjectType::ERROR)
         {
             return left;
         }
+        if (nd->m_index->get_type() == NodeType::StringLiteral)
+        {
+            if (const auto* value = detail::find_by_shape(nd->m_shape_cache, left, static_cast<StringLiteral*>(nd->m_index.get())->m_value))
+            {
+                return *value;
+            }
+        }
         auto index = eval(nd->m_index.get(), env);
-        return detail::eval_index_expression(left, index);
+        if (index.get_type() == ObjectType::ERROR)
+        {
+            return index;
+        }
+        return detail::eval_quickened_index(*nd, left, index);
     }
     else if (node_type == NodeType::HashLiteral)
     {
         auto* nd = static_cast<HashLiteral*>(node);
-        auto hash_obj = std::make_shared<HashObj>();
+        auto hash_obj = make_ref<HashObj>();
         for (const auto& [key, val] : nd->m_pairs)
         {
             auto key_obj = eval(key.get(), env);
-            if (key_obj->get_type() == ObjectType::ERROR)
+            if (key_obj.get_type() == ObjectType::ERROR)
             {
                 return key_obj;
             }
             auto val_obj = eval(val.get(), env);
-            if (val_obj->get_type() == ObjectType::ERROR)
+            if (val_obj.get_type() == ObjectType::ERROR)
             {
                 return val_obj;
             }
-            hash_obj->m_pairs[std::move(key_obj)] = std::move(val_obj);
+            hash_obj->m_pairs.set(std::move(key_obj), std::move(val_obj));
         }
         return hash_obj;
     }
@@ -572,19 +860,19 @@ auto eval(Node* node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Ob
     {
         auto* nd = static_cast<WhileStatement*>(node);
         auto condition = eval(nd->m_condition.get(), env);
-        if (condition->get_type() == ObjectType::ERROR)
+        if (condition.get_type() == ObjectType::ERROR)
         {
             return condition;
         }
         while (detail::is_truth(condition))
         {
             auto body = eval(nd->m_loop_body.get(), env);
-            if (body->get_type() == ObjectType::ERROR)
+            if (body.get_type() == ObjectType::RETURN || body.get_type() == ObjectType::ERROR)
             {
                 return body;
             }
             condition = eval(nd->m_condition.get(), env);
-            if (condition->get_type() == ObjectType::ERROR)
+            if (condition.get_type() == ObjectType::ERROR)
             {
                 return condition;
             }
@@ -594,22 +882,53 @@ auto eval(Node* node, const std::shared_ptr<Context>& env) -> std::shared_ptr<Ob
     else if (node_type == NodeType::CallExpression)
     {
         auto* nd = static_cast<CallExpression*>(node);
-        auto func = eval(nd->m_function.get(), env);
-        if (func->get_type() == ObjectType::ERROR)
-        {
-            return func;
-        }
-        auto args = detail::eval_expressions(nd->m_arguments, env);
-        if (args.size() == 1 && args.front()->get_type() == ObjectType::ERROR)
+        return detail::eval_call_expression(*nd, env, nullptr);
+    }
+    return nullptr;
+}
+
+auto eval(Node* node, const Ref<Context>& env, Engine engine) -> Value
+{
+    return eval(node, env, engine, DEFAULT_MAX_CALL_DEPTH);
+}
+
+auto eval(Node* node, const Ref<Context>& env, Engine engine, std::size_t max_call_depth) -> Value
+{
+    assert(node);
+    assert(env);
+    const auto previous_max_call_depth = std::exchange(detail::max_call_depth, max_call_depth);
+    const auto restore = RaiiWrapper([previous_max_call_depth]()
+                                     { detail::max_call_depth = previous_max_call_depth; });
+    if (engine == Engine::StackVm)
+    {
+        Compiler compiler;
+        const auto main = compiler.compile(node);
+        const auto& errors = compiler.get_errors();
+        if (!errors.empty())
         {
-            return std::move(args.front());
+            return make_ref<ErrorObj>(fmt::format("compiler errors: {}", fmt::join(errors, "; ")));
         }
-        if (func->get_type() == ObjectType::BUILTIN)
+        return Vm(env, max_call_depth).run(main);
+    }
+    if (engine == Engine::RegisterVm)
+    {
+        RegisterCompiler compiler;
+        const auto main = compiler.compile(node);
+        const auto& errors = compiler.get_errors();
+        if (!errors.empty())
         {
-            return static_cast<BuiltInObj&>(*func).m_value(args);
+            return make_ref<ErrorObj>(fmt::format("compiler errors: {}", fmt::join(errors, "; ")));
         }
-        return detail::apply_function(std::static_pointer_cast<FunctionObj>(func), args);
+        return RegisterVm(env, max_call_depth).run(main);
     }
-    return nullptr;
+    if (engine == Engine::ClosureCompiler)
+    {
+        return compile_closures(node)(env);
+    }
+    if (engine == Engine::FlatWalker)
+    {
+        return eval_flat(std::make_shared<const FlatAst>(flatten(node)), env);
+    }
+    return eval(node, env);
 }
 }  // namespace mlang
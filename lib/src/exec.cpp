@@ -4,6 +4,7 @@
 #include <fstream>
 #include <mlang/eval.hpp>
 #include <mlang/exec.hpp>
+#include <mlang/optimizer.hpp>
 #include <mlang/parser.hpp>
 #include <string>
 
@@ -26,11 +27,21 @@ auto read_file(const fs::path& file_path) -> std::string
 }
 }  // namespace detail
 
-void exec(const fs::path& file_path)
+auto parse_engine_arg(std::string_view arg) -> std::optional<Engine>
+{
+    constexpr auto prefix = std::string_view("--engine=");
+    if (!arg.starts_with(prefix))
+    {
+        return std::nullopt;
+    }
+    return magic_enum::enum_cast<Engine>(arg.substr(prefix.size()));
+}
+
+void exec(const fs::path& file_path, Engine engine, bool optimize)
 {
     auto input = detail::read_file(file_path);
 
-    auto env = std::make_shared<Context>();
+    auto env = make_ref<Context>();
     Parser parser(std::make_unique<Lexer>(input));
     const auto program = parser.parse_program();
     const auto& errors = parser.get_errors();
@@ -39,6 +50,14 @@ void exec(const fs::path& file_path)
         fmt::println("  parser errors:\n      {}", fmt::join(errors, "\n      "));
         return;
     }
-    const auto evaluated = eval(program.get(), env);
+    if (optimize)
+    {
+        fmt::println("optimizer: {}", format_optimizer_stats(mlang::optimize(*program)));
+    }
+    const auto evaluated = eval(program.get(), env, engine);
+    if (evaluated && evaluated.get_type() == ObjectType::ERROR)
+    {
+        fmt::println("{}", evaluated.inspect());
+    }
 }
 }  // namespace mlang
@@ -0,0 +1,139 @@
+#include <fmt/core.h>
+#include <mlang/eval.hpp>
+#include <mlang/feedback.hpp>
+#include <mlang/operator_table.hpp>
+
+namespace mlang
+{
+namespace
+{
+auto array_at(const Value& obj, const Value& index) -> Value
+{
+    const auto& array = obj.as<ArrayObj>();
+    const auto idx = index.as_integer();
+    if (idx < 0 || idx >= static_cast<std::int64_t>(array.size()))
+    {
+        return detail::NIL;
+    }
+    return array.at(idx);
+}
+
+auto hash_at(const Value& obj, const Value& index) -> Value
+{
+    const auto* value = obj.as<HashObj>().m_pairs.find(index);
+    if (!value)
+    {
+        return detail::NIL;
+    }
+    return *value;
+}
+
+auto select_index(ObjectType obj_type, ObjectType index_type) -> IndexHandler
+{
+    if (obj_type == ObjectType::ARRAY && index_type == ObjectType::INTEGER)
+    {
+        return &array_at;
+    }
+    if (obj_type == ObjectType::HASH && (index_type == ObjectType::INTEGER || index_type == ObjectType::STRING || index_type == ObjectType::BOOLEAN))
+    {
+        return &hash_at;
+    }
+    return &detail::eval_index_expression;
+}
+
+template <typename Handler, typename Select>
+auto specialize(TypeFeedback<Handler>& site, ObjectType left_type, ObjectType right_type, Handler generic, Select&& select) -> Handler
+{
+    if (site.m_handler)
+    {
+        ++site.m_misses;
+    }
+    if (site.m_specializations == MAX_SPECIALIZATIONS)
+    {
+        site.m_megamorphic = true;
+        site.m_handler = generic;
+        return site.m_handler;
+    }
+    ++site.m_specializations;
+    site.m_left_type = static_cast<int>(left_type);
+    site.m_right_type = static_cast<int>(right_type);
+    site.m_handler = select();
+    return site.m_handler;
+}
+
+template <typename Handler>
+void add_site(FeedbackStats& stats, const TypeFeedback<Handler>& site)
+{
+    if (!site.m_handler)
+    {
+        return;
+    }
+    ++stats.m_sites;
+    if (site.m_megamorphic)
+    {
+        ++stats.m_megamorphic;
+    }
+    else if (site.m_specializations == 1)
+    {
+        ++stats.m_monomorphic;
+    }
+    else
+    {
+        ++stats.m_polymorphic;
+    }
+    stats.m_hits += site.m_hits;
+    stats.m_misses += site.m_misses;
+}
+
+void collect(Node* node, FeedbackStats& stats)
+{
+    if (!node)
+    {
+        return;
+    }
+    const auto node_type = node->get_type();
+    if (node_type == NodeType::InfixExpression)
+    {
+        add_site(stats, static_cast<InfixExpression*>(node)->m_feedback);
+    }
+    else if (node_type == NodeType::IndexExpression)
+    {
+        add_site(stats, static_cast<IndexExpression*>(node)->m_feedback);
+    }
+    else if (node_type == NodeType::FnLiteral)
+    {
+        collect(static_cast<FnLiteral*>(node)->m_body.get(), stats);
+    }
+    detail::for_each_child(node, [&stats](Node* child)
+                           { collect(child, stats); });
+}
+}  // namespace
+
+auto collect_feedback(Node* node) -> FeedbackStats
+{
+    FeedbackStats stats;
+    collect(node, stats);
+    return stats;
+}
+
+auto format_feedback(const FeedbackStats& stats) -> std::string
+{
+    return fmt::format("sites {} monomorphic {} polymorphic {} megamorphic {} guard hits {} misses {}",
+                       stats.m_sites, stats.m_monomorphic, stats.m_polymorphic, stats.m_megamorphic, stats.m_hits, stats.m_misses);
+}
+
+namespace detail
+{
+auto specialize_infix(TypeFeedback<InfixHandler>& site, Operator op, ObjectType left_type, ObjectType right_type) -> InfixHandler
+{
+    return specialize(site, left_type, right_type, InfixHandler{&eval_infix_expression}, [&]()
+                      { return infix_handler(op, left_type, right_type); });
+}
+
+auto specialize_index(TypeFeedback<IndexHandler>& site, ObjectType left_type, ObjectType index_type) -> IndexHandler
+{
+    return specialize(site, left_type, index_type, IndexHandler{&eval_index_expression}, [&]()
+                      { return select_index(left_type, index_type); });
+}
+}  // namespace detail
+}  // namespace mlang
@@ -0,0 +1,282 @@
+#include <fmt/ranges.h>
+#include <mlang/flat_ast.hpp>
+#include <range/v3/view.hpp>
+
+namespace rv = ranges::views;
+
+namespace mlang
+{
+namespace
+{
+class Flattener
+{
+public:
+    explicit Flattener(FlatAst& ast)
+        : m_ast(ast)
+    {
+    }
+
+    auto lower(Node* node) -> FlatIndex
+    {
+        if (!node)
+        {
+            return NO_NODE;
+        }
+        const auto kind = node->get_type();
+        const auto index = add(kind);
+        switch (kind)
+        {
+        case NodeType::Program:
+            set_list(index, static_cast<Program*>(node)->m_statements);
+            break;
+        case NodeType::BlockStatement:
+            set_list(index, static_cast<BlockStatement*>(node)->m_statements);
+            break;
+        case NodeType::ArrayLiteral:
+            set_list(index, static_cast<ArrayLiteral*>(node)->m_expressions);
+            break;
+        case NodeType::HashLiteral:
+        {
+            const auto& pairs = static_cast<HashLiteral*>(node)->m_pairs;
+            std::vector<FlatIndex> items;
+            items.reserve(2 * pairs.size());
+            for (const auto& [key, val] : pairs)
+            {
+                items.push_back(lower(key.get()));
+                items.push_back(lower(val.get()));
+            }
+            m_ast.m_children[index].m_first = append(items);
+            m_ast.m_payloads[index] = pairs.size();
+            break;
+        }
+        case NodeType::CallExpression:
+        {
+            auto* nd = static_cast<CallExpression*>(node);
+            const auto callee = lower(nd->m_function.get());
+            m_ast.m_children[index] = {callee, NO_NODE};
+            const auto [offset, count] = lower_all(nd->m_arguments);
+            m_ast.m_children[index].m_second = offset;
+            m_ast.m_payloads[index] = count;
+            break;
+        }
+        case NodeType::LetStatement:
+        {
+            auto* nd = static_cast<LetStatement*>(node);
+            set_children(index, lower(nd->m_name.get()), lower(nd->m_value.get()));
+            break;
+        }
+        case NodeType::ReturnStatement:
+            set_children(index, lower(static_cast<ReturnStatement*>(node)->m_return_value.get()), NO_NODE);
+            break;
+        case NodeType::ExpressionStatement:
+            set_children(index, lower(static_cast<ExpressionStatement*>(node)->m_expression.get()), NO_NODE);
+            break;
+        case NodeType::IfExpression:
+        {
+            auto* nd = static_cast<IfExpression*>(node);
+            const auto condition = lower(nd->m_condition.get());
+            const auto consequence = lower(nd->m_consequence.get());
+            set_children(index, condition, consequence);
+            m_ast.m_payloads[index] = lower(nd->m_alternative.get());
+            break;
+        }
+        case NodeType::WhileStatement:
+        {
+            auto* nd = static_cast<WhileStatement*>(node);
+            const auto condition = lower(nd->m_condition.get());
+            set_children(index, condition, lower(nd->m_loop_body.get()));
+            break;
+        }
+        case NodeType::IndexExpression:
+        {
+            auto* nd = static_cast<IndexExpression*>(node);
+            const auto left = lower(nd->m_left.get());
+            set_children(index, left, lower(nd->m_index.get()));
+            break;
+        }
+        case NodeType::PrefixExpression:
+        {
+            auto* nd = static_cast<PrefixExpression*>(node);
+            set_children(index, lower(nd->m_right.get()), NO_NODE);
+            m_ast.m_payloads[index] = static_cast<std::uint32_t>(nd->m_operator);
+            break;
+        }
+        case NodeType::InfixExpression:
+        {
+            auto* nd = static_cast<InfixExpression*>(node);
+            const auto left = lower(nd->m_left.get());
+            set_children(index, left, lower(nd->m_right.get()));
+            m_ast.m_payloads[index] = static_cast<std::uint32_t>(nd->m_operator);
+            break;
+        }
+        case NodeType::IntegerLiteral:
+        {
+            auto* nd = static_cast<IntegerLiteral*>(node);
+            m_ast.m_payloads[index] = m_ast.m_integers.size();
+            m_ast.m_integers.push_back(nd->m_value);
+            set_children(index, add_string(nd->m_token.literal), NO_NODE);
+            break;
+        }
+        case NodeType::StringLiteral:
+            m_ast.m_payloads[index] = m_ast.m_atoms.size();
+            m_ast.m_atoms.push_back(static_cast<StringLiteral*>(node)->m_value);
+            break;
+        case NodeType::BooleanLiteral:
+            m_ast.m_payloads[index] = static_cast<BooleanLiteral*>(node)->m_value ? 1 : 0;
+            break;
+        case NodeType::Identifier:
+        {
+            auto* nd = static_cast<Identifier*>(node);
+            m_ast.m_payloads[index] = m_ast.m_identifiers.size();
+            m_ast.m_identifiers.push_back(FlatIdentifier{nd->m_value, nd->m_address, nd->m_builtin});
+            break;
+        }
+        case NodeType::FnLiteral:
+        {
+            auto* nd = static_cast<FnLiteral*>(node);
+            const auto [parameters, arity] = lower_all(nd->m_parameters);
+            const auto body = lower(nd->m_body.get());
+            m_ast.m_payloads[index] = m_ast.m_functions.size();
+            m_ast.m_functions.push_back(FlatFunction{parameters, arity, body, nd->m_slot_names});
+            break;
+        }
+        }
+        return index;
+    }
+
+private:
+    auto add(NodeType kind) -> FlatIndex
+    {
+        const auto index = static_cast<FlatIndex>(m_ast.m_kinds.size());
+        m_ast.m_kinds.push_back(kind);
+        m_ast.m_payloads.push_back(0);
+        m_ast.m_children.emplace_back();
+        return index;
+    }
+
+    auto add_string(std::string_view str) -> FlatIndex
+    {
+        const auto index = static_cast<FlatIndex>(m_ast.m_strings.size());
+        m_ast.m_strings.push_back(m_ast.m_arena->intern(str));
+        return index;
+    }
+
+    auto append(const std::vector<FlatIndex>& items) -> FlatIndex
+    {
+        const auto offset = static_cast<FlatIndex>(m_ast.m_lists.size());
+        m_ast.m_lists.insert(std::end(m_ast.m_lists), std::begin(items), std::end(items));
+        return offset;
+    }
+
+    // Lower children first so nested lists do not interleave.
+    template <typename T>
+    auto lower_all(const NodeList<T>& nodes) -> std::pair<FlatIndex, FlatIndex>
+    {
+        std::vector<FlatIndex> items;
+        items.reserve(nodes.size());
+        for (const auto& node : nodes)
+        {
+            items.push_back(lower(node.get()));
+        }
+        return {append(items), static_cast<FlatIndex>(items.size())};
+    }
+
+    template <typename T>
+    void set_list(FlatIndex index, const NodeList<T>& nodes)
+    {
+        const auto [offset, count] = lower_all(nodes);
+        m_ast.m_children[index].m_first = offset;
+        m_ast.m_payloads[index] = count;
+    }
+
+    void set_children(FlatIndex index, FlatIndex first, FlatIndex second)
+    {
+        m_ast.m_children[index] = FlatChildren{first, second};
+    }
+
+private:
+    FlatAst& m_ast;
+};
+
+auto join(const FlatAst& ast, FlatIndex offset, FlatIndex count, std::string_view sep) -> std::string
+{
+    return fmt::format("{}", fmt::join(rv::iota(FlatIndex{0}, count) | rv::transform([&](FlatIndex i)
+                                                                                      { return ast.to_string(ast.list(offset)[i]); }),
+                                       sep));
+}
+}  // namespace
+
+auto FlatAst::to_string() const -> std::string
+{
+    return to_string(m_root);
+}
+
+auto FlatAst::to_string(FlatIndex node) const -> std::string
+{
+    if (node == NO_NODE)
+    {
+        return {};
+    }
+    const auto payload = m_payloads[node];
+    const auto [first, second] = m_children[node];
+    switch (m_kinds[node])
+    {
+    case NodeType::Program:
+    case NodeType::BlockStatement:
+        return join(*this, first, payload, "");
+    case NodeType::LetStatement:
+        return fmt::format("let {} = {};", to_string(first), to_string(second));
+    case NodeType::ReturnStatement:
+        return fmt::format("return = {};", to_string(first));
+    case NodeType::ExpressionStatement:
+        return to_string(first);
+    case NodeType::IntegerLiteral:
+        return std::string(m_strings[first]);
+    case NodeType::BooleanLiteral:
+        return payload ? "true" : "false";
+    case NodeType::StringLiteral:
+        return fmt::format("\"{}\"", m_atoms[payload]);
+    case NodeType::Identifier:
+        return std::string(m_identifiers[payload].m_name.view());
+    case NodeType::IfExpression:
+    {
+        auto if_str = fmt::format("if {} {{{}}}", to_string(first), to_string(second));
+        if (payload != NO_NODE)
+        {
+            if_str += fmt::format(" else {{{}}}", to_string(payload));
+        }
+        return if_str;
+    }
+    case NodeType::WhileStatement:
+        return fmt::format("while({}){{{}}}", to_string(first), to_string(second));
+    case NodeType::PrefixExpression:
+        return fmt::format("({}{})", mlang::to_string(static_cast<Operator>(payload)), to_string(first));
+    case NodeType::InfixExpression:
+        return fmt::format("({} {} {})", to_string(first), mlang::to_string(static_cast<Operator>(payload)), to_string(second));
+    case NodeType::FnLiteral:
+    {
+        const auto& fn = m_functions[payload];
+        return fmt::format("fn({}){{{}}}", join(*this, fn.m_parameters, fn.m_arity, ", "), to_string(fn.m_body));
+    }
+    case NodeType::CallExpression:
+        return fmt::format("{}({})", to_string(first), join(*this, second, payload, ", "));
+    case NodeType::ArrayLiteral:
+        return fmt::format("[{}]", join(*this, first, payload, ", "));
+    case NodeType::IndexExpression:
+        return fmt::format("({}[{}])", to_string(first), to_string(second));
+    case NodeType::HashLiteral:
+        return fmt::format("{{{}}}", fmt::join(rv::iota(FlatIndex{0}, payload) | rv::transform([&](FlatIndex i)
+                                                                                               { return to_string(list(first)[2 * i]) + ":" + to_string(list(first)[2 * i + 1]); }),
+                                               ", "));
+    }
+    return {};
+}
+
+auto flatten(Node* node) -> FlatAst
+{
+    FlatAst ast;
+    ast.m_arena = std::make_shared<AstArena>();
+    ast.m_root = Flattener(ast).lower(node);
+    return ast;
+}
+}  // namespace mlang
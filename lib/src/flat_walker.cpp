@@ -0,0 +1,408 @@
+#include <mlang/eval.hpp>
+#include <mlang/flat_walker.hpp>
+#include <mlang/raii_wrapper.hpp>
+#include <utility>
+
+namespace mlang
+{
+namespace
+{
+auto is_error(const Value& obj) -> bool
+{
+    return obj.get_type() == ObjectType::ERROR;
+}
+
+class FlatWalker
+{
+public:
+    explicit FlatWalker(const std::shared_ptr<const FlatAst>& ast)
+        : m_owner(ast)
+        , m_ast(*ast)
+    {
+    }
+
+    auto eval(FlatIndex node, const Ref<Context>& env) -> Value
+    {
+        const auto payload = m_ast.m_payloads[node];
+        const auto [first, second] = m_ast.m_children[node];
+        switch (m_ast.m_kinds[node])
+        {
+        case NodeType::Program:
+        {
+            auto res = eval_statements(first, payload, env);
+            if (res && res.get_type() == ObjectType::RETURN)
+            {
+                return res.as<ReturnValueObj>().m_value;
+            }
+            return res;
+        }
+        case NodeType::BlockStatement:
+            return eval_statements(first, payload, env);
+        case NodeType::ExpressionStatement:
+            return eval(first, env);
+        case NodeType::ReturnStatement:
+            return make_ref<ReturnValueObj>(eval(first, env));
+        case NodeType::LetStatement:
+        {
+            const auto& name = m_ast.m_identifiers[m_ast.m_payloads[first]];
+            auto val = m_ast.m_kinds[second] == NodeType::CallExpression ? eval_call(second, env, &name, nullptr) : eval(second, env);
+            if (is_error(val))
+            {
+                return val;
+            }
+            if (name.m_address)
+            {
+                env->set_slot(name.m_address->m_slot, val);
+            }
+            else
+            {
+                env->set_obj(name.m_name, val);
+            }
+            return detail::NIL;
+        }
+        case NodeType::IntegerLiteral:
+            return Value::integer(m_ast.m_integers[payload]);
+        case NodeType::BooleanLiteral:
+            return payload ? detail::TRUE : detail::FALSE;
+        case NodeType::StringLiteral:
+            return make_ref<StringObj>(m_ast.m_atoms[payload]);
+        case NodeType::Identifier:
+            return eval_identifier(m_ast.m_identifiers[payload], env);
+        case NodeType::PrefixExpression:
+            return detail::eval_prefix_expression(static_cast<Operator>(payload), eval(first, env));
+        case NodeType::InfixExpression:
+        {
+            auto left = eval(first, env);
+            if (is_error(left))
+            {
+                return left;
+            }
+            auto right = eval(second, env);
+            if (is_error(right))
+            {
+                return right;
+            }
+            return detail::eval_infix_expression(static_cast<Operator>(payload), left, right);
+        }
+        case NodeType::IfExpression:
+        {
+            auto condition = eval(first, env);
+            if (is_error(condition))
+            {
+                return condition;
+            }
+            if (detail::is_truth(condition))
+            {
+                return eval(second, env);
+            }
+            if (payload != NO_NODE)
+            {
+                return eval(payload, env);
+            }
+            return detail::NIL;
+        }
+        case NodeType::WhileStatement:
+        {
+            auto condition = eval(first, env);
+            if (is_error(condition))
+            {
+                return condition;
+            }
+            while (detail::is_truth(condition))
+            {
+                auto body = eval(second, env);
+                if (body.get_type() == ObjectType::RETURN || is_error(body))
+                {
+                    return body;
+                }
+                condition = eval(first, env);
+                if (is_error(condition))
+                {
+                    return condition;
+                }
+            }
+            return detail::NIL;
+        }
+        case NodeType::FnLiteral:
+            return make_ref<FlatFnObj>(m_owner, payload, env);
+        case NodeType::CallExpression:
+            return eval_call(node, env, nullptr, nullptr);
+        case NodeType::ArrayLiteral:
+        {
+            std::vector<Value> elements;
+            if (auto err = eval_all(first, payload, env, elements))
+            {
+                return err;
+            }
+            return make_ref<ArrayObj>(std::move(elements));
+        }
+        case NodeType::IndexExpression:
+        {
+            auto left = eval(first, env);
+            if (is_error(left))
+            {
+                return left;
+            }
+            auto index = eval(second, env);
+            if (is_error(index))
+            {
+                return index;
+            }
+            return detail::eval_index_expression(left, index);
+        }
+        case NodeType::HashLiteral:
+        {
+            auto hash_obj = make_ref<HashObj>();
+            const auto* items = m_ast.list(first);
+            for (FlatIndex i = 0; i < 2 * payload; i += 2)
+            {
+                auto key_obj = eval(items[i], env);
+                if (is_error(key_obj))
+                {
+                    return key_obj;
+                }
+                auto val_obj = eval(items[i + 1], env);
+                if (is_error(val_obj))
+                {
+                    return val_obj;
+                }
+                hash_obj->m_pairs.set(std::move(key_obj), std::move(val_obj));
+            }
+            return hash_obj;
+        }
+        }
+        return nullptr;
+    }
+
+    // Evaluates the last node of a function body, leaving calls to a FlatFnObj in call.
+    auto eval_tail(FlatIndex node, const Ref<Context>& env, detail::TailCall<FlatFnObj>& call) -> Value
+    {
+        while (true)
+        {
+            const auto payload = m_ast.m_payloads[node];
+            const auto [first, second] = m_ast.m_children[node];
+            switch (m_ast.m_kinds[node])
+            {
+            case NodeType::BlockStatement:
+            {
+                if (payload == 0)
+                {
+                    return nullptr;
+                }
+                if (auto res = eval_statements(first, payload - 1, env); res && (res.get_type() == ObjectType::RETURN || is_error(res)))
+                {
+                    return res;
+                }
+                node = m_ast.list(first)[payload - 1];
+                break;
+            }
+            case NodeType::ExpressionStatement:
+                node = first;
+                break;
+            case NodeType::IfExpression:
+            {
+                auto condition = eval(first, env);
+                if (is_error(condition))
+                {
+                    return condition;
+                }
+                if (detail::is_truth(condition))
+                {
+                    node = second;
+                }
+                else if (payload != NO_NODE)
+                {
+                    node = payload;
+                }
+                else
+                {
+                    return detail::NIL;
+                }
+                break;
+            }
+            case NodeType::ReturnStatement:
+            {
+                auto val = eval_tail(first, env, call);
+                if (call.m_fn || is_error(val))
+                {
+                    return val;
+                }
+                return make_ref<ReturnValueObj>(std::move(val));
+            }
+            case NodeType::CallExpression:
+                return eval_call(node, env, nullptr, &call);
+            default:
+                return eval(node, env);
+            }
+        }
+    }
+
+private:
+    // target is the name a let binds the result to, tail receives calls in tail position.
+    auto eval_call(FlatIndex node, const Ref<Context>& env, const FlatIdentifier* target, detail::TailCall<FlatFnObj>* tail) -> Value
+    {
+        const auto payload = m_ast.m_payloads[node];
+        const auto [first, second] = m_ast.m_children[node];
+        auto func = eval(first, env);
+        if (is_error(func))
+        {
+            return func;
+        }
+        std::vector<Value> args;
+        if (auto err = eval_all(second, payload, env, args))
+        {
+            return err;
+        }
+        const auto func_type = func.get_type();
+        if (func_type == ObjectType::FLAT_FUNCTION)
+        {
+            if (tail)
+            {
+                *tail = detail::TailCall<FlatFnObj>{func.cast<FlatFnObj>(), std::move(args)};
+                return nullptr;
+            }
+            return detail::apply_flat_function(func.as<FlatFnObj>(), args);
+        }
+        if (func_type == ObjectType::BUILTIN)
+        {
+            if (target)
+            {
+                auto* binding = target->m_address ? &env->slot(target->m_address->m_slot) : env->find_binding(target->m_name);
+                return detail::call_rebinding_builtin(func.as<BuiltInObj>(), args, binding);
+            }
+            return func.as<BuiltInObj>().m_value(args);
+        }
+        if (func_type == ObjectType::FUNCTION)
+        {
+            return detail::apply_function(func.cast<FunctionObj>(), args);
+        }
+        return make_ref<ErrorObj>(fmt::format("not a function: {}", func_type));
+    }
+
+    auto eval_statements(FlatIndex offset, FlatIndex count, const Ref<Context>& env) -> Value
+    {
+        Value res;
+        const auto* statements = m_ast.list(offset);
+        for (FlatIndex i = 0; i < count; ++i)
+        {
+            res = eval(statements[i], env);
+            if (res && (res.get_type() == ObjectType::RETURN || is_error(res)))
+            {
+                return res;
+            }
+        }
+        return res;
+    }
+
+    auto eval_all(FlatIndex offset, FlatIndex count, const Ref<Context>& env, std::vector<Value>& out) -> Value
+    {
+        out.reserve(count);
+        const auto* nodes = m_ast.list(offset);
+        for (FlatIndex i = 0; i < count; ++i)
+        {
+            auto obj = eval(nodes[i], env);
+            if (is_error(obj))
+            {
+                return obj;
+            }
+            out.push_back(std::move(obj));
+        }
+        return nullptr;
+    }
+
+    static auto eval_identifier(const FlatIdentifier& ident, const Ref<Context>& env) -> Value
+    {
+        if (ident.m_address)
+        {
+            if (auto val = env->get_slot(ident.m_address->m_depth, ident.m_address->m_slot))
+            {
+                return val;
+            }
+        }
+        if (auto val = env->get_obj(ident.m_name))
+        {
+            return val;
+        }
+        if (ident.m_builtin)
+        {
+            return detail::BUILTIN_TABLE[*ident.m_builtin].second;
+        }
+        if (const auto it = detail::BUILTINS.find(ident.m_name); it != std::end(detail::BUILTINS))
+        {
+            return it->second;
+        }
+        return make_ref<ErrorObj>(fmt::format("identifier not found: {}", ident.m_name));
+    }
+
+private:
+    const std::shared_ptr<const FlatAst>& m_owner;
+    const FlatAst& m_ast;
+};
+}  // namespace
+
+auto eval_flat(const std::shared_ptr<const FlatAst>& ast, const Ref<Context>& env) -> Value
+{
+    if (ast->m_root == NO_NODE)
+    {
+        return nullptr;
+    }
+    return FlatWalker(ast).eval(ast->m_root, env);
+}
+
+namespace detail
+{
+auto apply_flat_function(const FlatFnObj& fn, const std::vector<Value>& args) -> Value
+{
+    if (auto err = enter_call())
+    {
+        return err;
+    }
+    const auto leave = RaiiWrapper(&leave_call);
+    // Tail calls made by the body come back here and run in this native frame.
+    const FlatFnObj* callee = &fn;
+    const std::vector<Value>* callee_args = &args;
+    TailCall<FlatFnObj> call;
+    TailCall<FlatFnObj> current;
+    while (true)
+    {
+        const auto& ast = *callee->m_ast;
+        const auto& function = ast.m_functions[callee->m_function];
+        if (function.m_arity != callee_args->size())
+        {
+            return make_ref<ErrorObj>(fmt::format("invalid number of args expected {} got {}", function.m_arity, callee_args->size()));
+        }
+        auto extended_env = make_ref<Context>(callee->m_env, function.m_slot_names);
+        const auto* parameters = ast.list(function.m_parameters);
+        for (std::size_t i = 0; i < callee_args->size(); ++i)
+        {
+            const auto& param = ast.m_identifiers[ast.m_payloads[parameters[i]]];
+            if (param.m_address)
+            {
+                extended_env->set_slot(param.m_address->m_slot, (*callee_args)[i]);
+            }
+            else
+            {
+                extended_env->set_obj(param.m_name, (*callee_args)[i]);
+            }
+        }
+        auto evaluated = FlatWalker(callee->m_ast).eval_tail(function.m_body, extended_env, call);
+        if (call.m_fn)
+        {
+            current = std::exchange(call, TailCall<FlatFnObj>{});
+            callee = current.m_fn.get();
+            callee_args = &current.m_args;
+            continue;
+        }
+        if (!evaluated)
+        {
+            return NIL;
+        }
+        if (evaluated.get_type() == ObjectType::RETURN)
+        {
+            return evaluated.as<ReturnValueObj>().m_value;
+        }
+        return evaluated;
+    }
+}
+}  // namespace detail
+}  // namespace mlang
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cassert>
+#include <mlang/gc.hpp>
+
+namespace mlang
+{
+#ifndef ENABLE_ATOMIC_REFCOUNT
+namespace detail
+{
+// Synchronous trial deletion (Bacon & Rajan).
+class CycleCollector
+{
+public:
+    static constexpr std::size_t MIN_THRESHOLD = 10000;
+    static constexpr std::size_t GROWTH_FACTOR = 2;
+    static constexpr std::uint32_t PIN = 1u << 30;
+
+    void add_root(const Collectable* obj)
+    {
+        obj->m_color = Collectable::Color::Purple;
+        obj->m_buffered = true;
+        obj->m_root_index = static_cast<std::uint32_t>(m_roots.size());
+        m_roots.push_back(const_cast<Collectable*>(obj));
+    }
+
+    void remove_root(const Collectable* obj)
+    {
+        assert(obj->m_root_index < m_roots.size() && m_roots[obj->m_root_index] == obj);
+        auto* last = m_roots.back();
+        m_roots[obj->m_root_index] = last;
+        last->m_root_index = obj->m_root_index;
+        m_roots.pop_back();
+        obj->m_buffered = false;
+    }
+
+    void track()
+    {
+        ++m_stats.m_tracked;
+        if (m_roots.size() >= m_threshold)
+        {
+            collect();
+        }
+    }
+
+    void untrack()
+    {
+        --m_stats.m_tracked;
+    }
+
+    void collect()
+    {
+        if (m_collecting)
+        {
+            return;
+        }
+        m_collecting = true;
+        auto roots = std::move(m_roots);
+        m_roots.clear();
+        std::size_t visited = 0;
+        for (auto* root : roots)
+        {
+            visited += mark_gray(root);
+        }
+        for (auto* root : roots)
+        {
+            scan(root);
+        }
+        for (auto* root : roots)
+        {
+            root->m_buffered = false;
+        }
+        std::vector<Collectable*> garbage;
+        for (auto* root : roots)
+        {
+            collect_white(root, garbage);
+        }
+        // Pinned so that dropping the edges inside the garbage frees no member early.
+        for (auto* obj : garbage)
+        {
+            obj->m_refs += PIN;
+            obj->m_buffered = true;
+        }
+        for (auto* obj : garbage)
+        {
+            for (auto* child : traced_children(obj))
+            {
+                if (!child->m_buffered)
+                {
+                    ++child->m_refs;
+                }
+            }
+        }
+        for (auto* obj : garbage)
+        {
+            obj->clear_refs();
+        }
+        for (auto* obj : garbage)
+        {
+            delete obj;
+        }
+        ++m_stats.m_collections;
+        m_stats.m_collected += garbage.size();
+        m_threshold = std::max(MIN_THRESHOLD, GROWTH_FACTOR * (visited - garbage.size()));
+        m_collecting = false;
+    }
+
+    auto stats() const -> GcStats
+    {
+        auto res = m_stats;
+        res.m_candidates = m_roots.size();
+        return res;
+    }
+
+private:
+    auto traced_children(Collectable* obj) -> const std::vector<Collectable*>&
+    {
+        m_children.clear();
+        obj->trace(m_children);
+        std::erase_if(m_children, [](const Collectable* child)
+                      { return !child || !child->m_traced; });
+        return m_children;
+    }
+
+    auto mark_gray(Collectable* root) -> std::size_t
+    {
+        if (root->m_color == Collectable::Color::Gray)
+        {
+            return 0;
+        }
+        std::size_t visited = 0;
+        root->m_color = Collectable::Color::Gray;
+        m_stack.push_back(root);
+        while (!m_stack.empty())
+        {
+            auto* obj = m_stack.back();
+            m_stack.pop_back();
+            ++visited;
+            for (auto* child : traced_children(obj))
+            {
+                --child->m_refs;
+                if (child->m_color != Collectable::Color::Gray)
+                {
+                    child->m_color = Collectable::Color::Gray;
+                    m_stack.push_back(child);
+                }
+            }
+        }
+        return visited;
+    }
+
+    void scan(Collectable* root)
+    {
+        m_stack.push_back(root);
+        while (!m_stack.empty())
+        {
+            auto* obj = m_stack.back();
+            m_stack.pop_back();
+            if (obj->m_color != Collectable::Color::Gray)
+            {
+                continue;
+            }
+            if (obj->m_refs > 0)
+            {
+                scan_black(obj);
+                continue;
+            }
+            obj->m_color = Collectable::Color::White;
+            for (auto* child : traced_children(obj))
+            {
+                if (child->m_color == Collectable::Color::Gray)
+                {
+                    m_stack.push_back(child);
+                }
+            }
+        }
+    }
+
+    void scan_black(Collectable* root)
+    {
+        root->m_color = Collectable::Color::Black;
+        m_black_stack.push_back(root);
+        while (!m_black_stack.empty())
+        {
+            auto* obj = m_black_stack.back();
+            m_black_stack.pop_back();
+            for (auto* child : traced_children(obj))
+            {
+                ++child->m_refs;
+                if (child->m_color != Collectable::Color::Black)
+                {
+                    child->m_color = Collectable::Color::Black;
+                    m_black_stack.push_back(child);
+                }
+            }
+        }
+    }
+
+    void collect_white(Collectable* root, std::vector<Collectable*>& garbage)
+    {
+        m_stack.push_back(root);
+        while (!m_stack.empty())
+        {
+            auto* obj = m_stack.back();
+            m_stack.pop_back();
+            if (obj->m_color != Collectable::Color::White || obj->m_buffered)
+            {
+                continue;
+            }
+            obj->m_color = Collectable::Color::Black;
+            garbage.push_back(obj);
+            for (auto* child : traced_children(obj))
+            {
+                if (child->m_color == Collectable::Color::White)
+                {
+                    m_stack.push_back(child);
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<Collectable*> m_roots;
+    std::vector<Collectable*> m_stack;
+    std::vector<Collectable*> m_black_stack;
+    std::vector<Collectable*> m_children;
+    std::size_t m_threshold = MIN_THRESHOLD;
+    GcStats m_stats;
+    bool m_collecting = false;
+};
+
+namespace
+{
+thread_local CycleCollector collector;
+}  // namespace
+}  // namespace detail
+
+Collectable::Collectable(bool traced)
+    : m_traced(traced)
+{
+    if (m_traced)
+    {
+        detail::collector.track();
+    }
+}
+
+Collectable::Collectable(const Collectable& other)
+    : Collectable(other.m_traced)
+{
+}
+
+Collectable::~Collectable()
+{
+    if (m_traced)
+    {
+        detail::collector.untrack();
+    }
+}
+
+void Collectable::buffer_root() const
+{
+    detail::collector.add_root(this);
+}
+
+void Collectable::unbuffer_root() const
+{
+    detail::collector.remove_root(this);
+}
+
+auto gc_stats() -> GcStats
+{
+    return detail::collector.stats();
+}
+
+void collect_cycles()
+{
+    detail::collector.collect();
+}
+#else
+Collectable::Collectable(bool traced)
+    : m_traced(traced)
+{
+}
+
+Collectable::Collectable(const Collectable& other)
+    : Collectable(other.m_traced)
+{
+}
+
+Collectable::~Collectable() = default;
+
+auto gc_stats() -> GcStats
+{
+    return {};
+}
+
+void collect_cycles()
+{
+}
+#endif
+
+void Collectable::trace(std::vector<Collectable*>&)
+{
+}
+
+void Collectable::clear_refs()
+{
+}
+}  // namespace mlang
@@ -0,0 +1,123 @@
+#include <array>
+#include <cstdint>
+#include <mlang/heap.hpp>
+#include <new>
+
+namespace mlang
+{
+namespace detail
+{
+namespace
+{
+constexpr std::size_t GRANULE = 16;
+constexpr std::size_t MAX_SMALL_SIZE = 256;
+constexpr std::size_t SIZE_CLASSES = MAX_SMALL_SIZE / GRANULE;
+constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+struct FreeBlock
+{
+    FreeBlock* m_next;
+};
+
+struct Chunk
+{
+    Chunk* m_next;
+};
+
+constexpr std::size_t CHUNK_HEADER = (sizeof(Chunk) + GRANULE - 1) / GRANULE * GRANULE;
+
+// Trivially destructible so that static destruction can still return blocks.
+struct Heap
+{
+    std::array<FreeBlock*, SIZE_CLASSES> m_free{};
+    std::byte* m_cursor = nullptr;
+    std::byte* m_end = nullptr;
+    Chunk* m_chunks = nullptr;
+    HeapStats m_stats{};
+};
+
+constinit thread_local Heap heap;
+
+struct HeapReleaser
+{
+    ~HeapReleaser()
+    {
+        if (heap.m_stats.m_live != 0)
+        {
+            return;
+        }
+        while (heap.m_chunks)
+        {
+            auto* next = heap.m_chunks->m_next;
+            ::operator delete(heap.m_chunks);
+            heap.m_chunks = next;
+        }
+        heap = Heap{};
+    }
+    bool m_armed = false;
+};
+
+thread_local HeapReleaser releaser;
+
+auto size_class(std::size_t size) -> std::size_t
+{
+    return (size + GRANULE - 1) / GRANULE - 1;
+}
+
+void refill()
+{
+    auto* chunk = static_cast<Chunk*>(::operator new(CHUNK_SIZE));
+    chunk->m_next = heap.m_chunks;
+    heap.m_chunks = chunk;
+    heap.m_cursor = reinterpret_cast<std::byte*>(chunk) + CHUNK_HEADER;
+    heap.m_end = reinterpret_cast<std::byte*>(chunk) + CHUNK_SIZE;
+    ++heap.m_stats.m_chunks;
+    releaser.m_armed = true;
+}
+}  // namespace
+
+auto heap_allocate(std::size_t size) -> void*
+{
+    if (size > MAX_SMALL_SIZE)
+    {
+        return ::operator new(size);
+    }
+    ++heap.m_stats.m_live;
+    const auto cls = size_class(size);
+    if (auto* block = heap.m_free[cls])
+    {
+        heap.m_free[cls] = block->m_next;
+        ++heap.m_stats.m_recycled;
+        return block;
+    }
+    const auto bytes = (cls + 1) * GRANULE;
+    if (static_cast<std::size_t>(heap.m_end - heap.m_cursor) < bytes)
+    {
+        refill();
+    }
+    auto* res = heap.m_cursor;
+    heap.m_cursor += bytes;
+    ++heap.m_stats.m_bumped;
+    return res;
+}
+
+void heap_deallocate(void* ptr, std::size_t size)
+{
+    if (size > MAX_SMALL_SIZE)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    --heap.m_stats.m_live;
+    auto* block = static_cast<FreeBlock*>(ptr);
+    const auto cls = size_class(size);
+    block->m_next = heap.m_free[cls];
+    heap.m_free[cls] = block;
+}
+}  // namespace detail
+
+auto heap_stats() -> HeapStats
+{
+    return detail::heap.m_stats;
+}
+}  // namespace mlang
@@ -27,64 +27,62 @@ Token Lexer::next_token()
     {
         if (peek_char() == '=')
         {
-            const auto prv = m_ch;
             read_char();
-            tok = Token{TokenType::EQ, std::string(1, prv) + std::string(1, m_ch)};
+            tok = Token{TokenType::EQ, "=="};
         }
         else
         {
-            tok = Token{TokenType::ASSIGN, std::string(1, m_ch)};
+            tok = Token{TokenType::ASSIGN, "="};
         }
 
         break;
     }
     case '+':
     {
-        tok = Token{TokenType::PLUS, std::string(1, m_ch)};
+        tok = Token{TokenType::PLUS, "+"};
         break;
     }
     case '-':
     {
-        tok = Token{TokenType::MINUS, std::string(1, m_ch)};
+        tok = Token{TokenType::MINUS, "-"};
         break;
     }
     case '!':
     {
         if (peek_char() == '=')
         {
-            const auto prv = m_ch;
             read_char();
-            tok = tok = Token{TokenType::NOT_EQ, std::string(1, prv) + std::string(1, m_ch)};
+            tok = Token{TokenType::NOT_EQ, "!="};
         }
         else
         {
-            tok = Token{TokenType::BANG, std::string(1, m_ch)};
+            tok = Token{TokenType::BANG, "!"};
         }
         break;
     }
     case '/':
     {
-        tok = Token{TokenType::SLASH, std::string(1, m_ch)};
+        tok = Token{TokenType::SLASH, "/"};
         break;
     }
     case '*':
     {
-        tok = Token{TokenType::ASTERISK, std::string(1, m_ch)};
+        tok = Token{TokenType::ASTERISK, "*"};
         break;
     }
     case '<':
     {
-        tok = Token{TokenType::LT, std::string(1, m_ch)};
+        tok = Token{TokenType::LT, "<"};
         break;
     }
     case '>':
     {
-        tok = Token{TokenType::GT, std::string(1, m_ch)};
+        tok = Token{TokenType::GT, ">"};
         break;
     }
     case ';':
     {
-        tok = Token{TokenType::SEMICOLON, std::string(1, m_ch)};
+        tok = Token{TokenType::SEMICOLON, ";"};
         break;
     }
     case '"':
@@ -95,42 +93,42 @@ Token Lexer::next_token()
     }
     case ':':
     {
-        tok = Token{TokenType::COLON, std::string(1, m_ch)};
+        tok = Token{TokenType::COLON, ":"};
         break;
     }
     case ',':
     {
-        tok = Token{TokenType::COMMA, std::string(1, m_ch)};
+        tok = Token{TokenType::COMMA, ","};
         break;
     }
     case '(':
     {
-        tok = Token{TokenType::LPAREN, std::string(1, m_ch)};
+        tok = Token{TokenType::LPAREN, "("};
         break;
     }
     case ')':
     {
-        tok = Token{TokenType::RPAREN, std::string(1, m_ch)};
+        tok = Token{TokenType::RPAREN, ")"};
         break;
     }
     case '{':
     {
-        tok = Token{TokenType::LBRACE, std::string(1, m_ch)};
+        tok = Token{TokenType::LBRACE, "{"};
         break;
     }
     case '}':
     {
-        tok = Token{TokenType::RBRACE, std::string(1, m_ch)};
+        tok = Token{TokenType::RBRACE, "}"};
         break;
     }
     case '[':
     {
-        tok = Token{TokenType::LBRACKET, std::string(1, m_ch)};
+        tok = Token{TokenType::LBRACKET, "["};
         break;
     }
     case ']':
     {
-        tok = Token{TokenType::RBRACKET, std::string(1, m_ch)};
+        tok = Token{TokenType::RBRACKET, "]"};
         break;
     }
     case 0:
@@ -142,9 +140,7 @@ Token Lexer::next_token()
     {
         if (is_letter(m_ch))
         {
-            tok.literal = read_identifier();
-            tok.type = lookup_ident(tok.literal);
-            return tok;
+            return lookup_ident(read_identifier());
         }
         else if (isdigit(m_ch))
         {
@@ -154,7 +150,7 @@ Token Lexer::next_token()
         }
         else
         {
-            tok.literal = std::string(1, m_ch);
+            tok.literal = m_input.substr(m_pos, 1);
         }
     }
     };
@@ -163,34 +159,34 @@ Token Lexer::next_token()
     return tok;
 }
 
-std::string Lexer::read_identifier()
+auto Lexer::read_identifier() -> std::string_view
 {
     const auto pos = m_pos;
     while (is_letter(m_ch))
     {
         read_char();
     }
-    return std::string(m_input.substr(pos, m_pos - pos));
+    return m_input.substr(pos, m_pos - pos);
 }
 
-auto Lexer::read_number() -> std::string
+auto Lexer::read_number() -> std::string_view
 {
     const auto pos = m_pos;
     while (isdigit(m_ch))
     {
         read_char();
     }
-    return std::string(m_input.substr(pos, m_pos - pos));
+    return m_input.substr(pos, m_pos - pos);
 }
 
-auto Lexer::read_string() -> std::string
+auto Lexer::read_string() -> std::string_view
 {
     const auto pos = m_pos;
     while (m_ch != '"' && m_ch != 0)
     {
         read_char();
     }
-    return std::string(m_input.substr(pos, m_pos - pos));
+    return m_input.substr(pos, m_pos - pos);
 }
 
 void Lexer::skip_whitespaces()
@@ -229,7 +225,7 @@ auto Lexer::is_letter(char ch) -> bool
     return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ch == '_';
 }
 
-TokenType Lexer::lookup_ident(std::string_view ident) const
+auto Lexer::lookup_ident(std::string_view ident) const -> Token
 {
     static constexpr auto TOKENS = std::array{
         std::make_pair("fn"sv, TokenType::FUNCTION),
@@ -245,9 +241,9 @@ TokenType Lexer::lookup_ident(std::string_view ident) const
     {
         if (tok_ident == ident)
         {
-            return tok_type;
+            return Token{tok_type, tok_ident};
         }
     }
-    return TokenType::IDENT;
+    return Token{TokenType::IDENT, ident};
 }
 }  // namespace mlang
@@ -1,14 +1,24 @@
 #include <fmt/ranges.h>
 #include <mlang/node.hpp>
 #include <range/v3/view.hpp>
+#include <type_traits>
 
 namespace rv = ranges::views;
 
 namespace mlang
 {
-Node::~Node() = default;
-Statement::~Statement() = default;
-Expression::~Expression() = default;
+static_assert(std::is_trivially_destructible_v<Identifier>);
+static_assert(std::is_trivially_destructible_v<BlockStatement>);
+static_assert(std::is_trivially_destructible_v<InfixExpression>);
+static_assert(std::is_trivially_destructible_v<CallExpression>);
+static_assert(std::is_trivially_destructible_v<HashLiteral>);
+
+Program::Program(std::shared_ptr<AstArena> arena)
+    : Node(NodeType::Program)
+    , m_arena(std::move(arena))
+    , m_statements(*m_arena)
+{
+}
 
 auto Program::token_literal() -> std::string
 {
@@ -29,14 +39,14 @@ auto Program::to_string() -> std::string
     return out;
 }
 
-auto Program::get_type() -> NodeType
+LetStatement::LetStatement()
+    : Statement(NodeType::LetStatement)
 {
-    return NodeType::Program;
 }
 
 auto LetStatement::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto LetStatement::to_string() -> std::string
@@ -44,29 +54,29 @@ auto LetStatement::to_string() -> std::string
     return fmt::format("{} {} = {};", token_literal(), m_name->to_string(), m_value ? m_value->to_string() : "");
 }
 
-auto LetStatement::get_type() -> NodeType
+Identifier::Identifier()
+    : Expression(NodeType::Identifier)
 {
-    return NodeType::LetStatement;
 }
 
 auto Identifier::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto Identifier::to_string() -> std::string
 {
-    return m_value;
+    return std::string(m_value.view());
 }
 
-auto Identifier::get_type() -> NodeType
+ReturnStatement::ReturnStatement()
+    : Statement(NodeType::ReturnStatement)
 {
-    return NodeType::Identifier;
 }
 
 auto ReturnStatement::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto ReturnStatement::to_string() -> std::string
@@ -74,14 +84,15 @@ auto ReturnStatement::to_string() -> std::string
     return fmt::format("{} = {};", token_literal(), m_return_value ? m_return_value->to_string() : "");
 }
 
-auto ReturnStatement::get_type() -> NodeType
+BlockStatement::BlockStatement(AstArena& arena)
+    : Statement(NodeType::BlockStatement)
+    , m_statements(arena)
 {
-    return NodeType::ReturnStatement;
 }
 
 auto BlockStatement::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto BlockStatement::to_string() -> std::string
@@ -92,14 +103,14 @@ auto BlockStatement::to_string() -> std::string
                                        ""));
 }
 
-auto BlockStatement::get_type() -> NodeType
+ExpressionStatement::ExpressionStatement()
+    : Statement(NodeType::ExpressionStatement)
 {
-    return NodeType::BlockStatement;
 }
 
 auto ExpressionStatement::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto ExpressionStatement::to_string() -> std::string
@@ -111,39 +122,41 @@ auto ExpressionStatement::to_string() -> std::string
     return m_expression->to_string();
 }
 
-auto ExpressionStatement::get_type() -> NodeType
+IntegerLiteral::IntegerLiteral()
+    : Expression(NodeType::IntegerLiteral)
 {
-    return NodeType::ExpressionStatement;
 }
 
 IntegerLiteral::IntegerLiteral(std::int64_t val)
-    : m_value{val}
+    : Expression(NodeType::IntegerLiteral)
+    , m_value{val}
 {
 }
 
 auto IntegerLiteral::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto IntegerLiteral::to_string() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
-auto IntegerLiteral::get_type() -> NodeType
+StringLiteral::StringLiteral()
+    : Expression(NodeType::StringLiteral)
 {
-    return NodeType::IntegerLiteral;
 }
 
-StringLiteral::StringLiteral(std::string_view str)
-    : m_value(str)
+StringLiteral::StringLiteral(Atom str)
+    : Expression(NodeType::StringLiteral)
+    , m_value(str)
 {
 }
 
 auto StringLiteral::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto StringLiteral::to_string() -> std::string
@@ -151,29 +164,29 @@ auto StringLiteral::to_string() -> std::string
     return fmt::format("\"{}\"", m_value);
 }
 
-auto StringLiteral::get_type() -> NodeType
+BooleanLiteral::BooleanLiteral()
+    : Expression(NodeType::BooleanLiteral)
 {
-    return NodeType::StringLiteral;
 }
 
 auto BooleanLiteral::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto BooleanLiteral::to_string() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
-auto BooleanLiteral::get_type() -> NodeType
+IfExpression::IfExpression()
+    : Expression(NodeType::IfExpression)
 {
-    return NodeType::BooleanLiteral;
 }
 
 auto IfExpression::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto IfExpression::to_string() -> std::string
@@ -186,44 +199,46 @@ auto IfExpression::to_string() -> std::string
     return if_str;
 }
 
-auto IfExpression::get_type() -> NodeType
+PrefixExpression::PrefixExpression()
+    : Expression(NodeType::PrefixExpression)
 {
-    return NodeType::IfExpression;
 }
 
 auto PrefixExpression::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto PrefixExpression::to_string() -> std::string
 {
-    return fmt::format("({}{})", m_operator, m_right->to_string());
+    return fmt::format("({}{})", mlang::to_string(m_operator), m_right->to_string());
 }
 
-auto PrefixExpression::get_type() -> NodeType
+InfixExpression::InfixExpression()
+    : Expression(NodeType::InfixExpression)
 {
-    return NodeType::PrefixExpression;
 }
 
 auto InfixExpression::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto InfixExpression::to_string() -> std::string
 {
-    return fmt::format("({} {} {})", m_left->to_string(), m_operator, m_right->to_string());
+    return fmt::format("({} {} {})", m_left->to_string(), mlang::to_string(m_operator), m_right->to_string());
 }
 
-auto InfixExpression::get_type() -> NodeType
+FnLiteral::FnLiteral(AstArena& arena)
+    : Expression(NodeType::FnLiteral)
+    , m_parameters(arena)
+    , m_arena(&arena)
 {
-    return NodeType::InfixExpression;
 }
 
 auto FnLiteral::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto FnLiteral::to_string() -> std::string
@@ -235,14 +250,15 @@ auto FnLiteral::to_string() -> std::string
                        m_body->to_string());
 }
 
-auto FnLiteral::get_type() -> NodeType
+CallExpression::CallExpression(AstArena& arena)
+    : Expression(NodeType::CallExpression)
+    , m_arguments(arena)
 {
-    return NodeType::FnLiteral;
 }
 
 auto CallExpression::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto CallExpression::to_string() -> std::string
@@ -253,14 +269,15 @@ auto CallExpression::to_string() -> std::string
                                                                     ", "));
 }
 
-auto CallExpression::get_type() -> NodeType
+ArrayLiteral::ArrayLiteral(AstArena& arena)
+    : Expression(NodeType::ArrayLiteral)
+    , m_expressions(arena)
 {
-    return NodeType::CallExpression;
 }
 
 auto ArrayLiteral::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto ArrayLiteral::to_string() -> std::string
@@ -271,14 +288,14 @@ auto ArrayLiteral::to_string() -> std::string
                                          ", "));
 }
 
-auto ArrayLiteral::get_type() -> NodeType
+IndexExpression::IndexExpression()
+    : Expression(NodeType::IndexExpression)
 {
-    return NodeType::ArrayLiteral;
 }
 
 auto IndexExpression::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto IndexExpression::to_string() -> std::string
@@ -286,14 +303,14 @@ auto IndexExpression::to_string() -> std::string
     return fmt::format("({}[{}])", m_left->to_string(), m_index->to_string());
 }
 
-auto IndexExpression::get_type() -> NodeType
+WhileStatement::WhileStatement()
+    : Statement(NodeType::WhileStatement)
 {
-    return NodeType::IndexExpression;
 }
 
 auto WhileStatement::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 
 auto WhileStatement::to_string() -> std::string
@@ -301,9 +318,10 @@ auto WhileStatement::to_string() -> std::string
     return fmt::format("while({}){{{}}}", m_condition->to_string(), m_loop_body->to_string());
 }
 
-auto WhileStatement::get_type() -> NodeType
+HashLiteral::HashLiteral(AstArena& arena)
+    : Expression(NodeType::HashLiteral)
+    , m_pairs(arena)
 {
-    return NodeType::WhileStatement;
 }
 
 auto HashLiteral::to_string() -> std::string
@@ -314,13 +332,8 @@ auto HashLiteral::to_string() -> std::string
                                            ", "));
 }
 
-auto HashLiteral::get_type() -> NodeType
-{
-    return NodeType::HashLiteral;
-}
-
 auto HashLiteral::token_literal() -> std::string
 {
-    return m_token.literal;
+    return std::string(m_token.literal);
 }
 }  // namespace mlang
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cassert>
 #include <fmt/core.h>
 #include <fmt/ranges.h>
 #include <mlang/object.hpp>
@@ -9,181 +11,465 @@ namespace mlang
 {
 Object::~Object() = default;
 
-IntegerObj::IntegerObj(std::int64_t value)
-    : m_value(value)
+namespace
+{
+// Shorter results are copied instead of sharing a buffer.
+constexpr std::size_t MIN_SHARED_LENGTH = 64;
+}  // namespace
+
+StringObj::StringObj(std::string_view value)
+    : Object(ObjectType::STRING)
+    , m_storage(Storage::Owned)
+    , m_length(value.size())
+    , m_text(value)
 {
 }
 
-auto IntegerObj::get_type() -> ObjectType
+StringObj::StringObj(Atom atom)
+    : Object(ObjectType::STRING)
+    , m_storage(Storage::Atom)
+    , m_length(atom.view().size())
+    , m_atom(atom)
 {
-    return ObjectType::INTEGER;
 }
 
-auto IntegerObj::inspect() -> std::string
+StringObj::StringObj(Ref<StringObj> owner, std::size_t offset, std::size_t length)
+    : Object(ObjectType::STRING)
+    , m_storage(Storage::Range)
+    , m_length(length)
+    , m_range{std::move(owner), offset}
 {
-    return fmt::format("{}", m_value);
 }
 
-BooleanObj::BooleanObj(bool value)
-    : m_value(value)
+StringObj::~StringObj()
 {
+    if (m_storage == Storage::Owned)
+    {
+        m_text.~basic_string();
+    }
+    else if (m_storage == Storage::Range)
+    {
+        m_range.~Range();
+    }
 }
 
-auto BooleanObj::get_type() -> ObjectType
+auto StringObj::inspect() -> std::string
 {
-    return ObjectType::BOOLEAN;
+    return fmt::format("\"{}\"", view());
 }
 
-auto BooleanObj::inspect() -> std::string
+auto StringObj::slice(const Ref<StringObj>& str, std::size_t start, std::size_t end) -> Ref<StringObj>
 {
-    return fmt::format("{}", m_value);
+    if (start == 0 && end == str->m_length)
+    {
+        return str;
+    }
+    const auto length = end - start;
+    if (length < MIN_SHARED_LENGTH)
+    {
+        return make_ref<StringObj>(str->view().substr(start, length));
+    }
+    if (str->m_storage == Storage::Range)
+    {
+        return make_ref<StringObj>(str->m_range.m_owner, str->m_range.m_offset + start, length);
+    }
+    return make_ref<StringObj>(str, start, length);
 }
 
-StringObj::StringObj(std::string_view value)
-    : m_value(value)
+auto StringObj::concat(const Ref<StringObj>& left, const StringObj& right) -> Ref<StringObj>
 {
+    const auto length = left->m_length + right.m_length;
+#ifndef ENABLE_ATOMIC_REFCOUNT
+    const auto is_range = left->m_storage == Storage::Range;
+    const auto& owner = is_range ? left->m_range.m_owner : left;
+    const auto offset = is_range ? left->m_range.m_offset : 0;
+    if (length >= MIN_SHARED_LENGTH && owner->m_storage == Storage::Owned && offset + left->m_length == owner->m_text.size())
+    {
+        // right may be a range of the same buffer
+        owner->m_text.reserve(owner->m_text.size() + right.m_length);
+        owner->m_text.append(right.view());
+        return make_ref<StringObj>(owner, offset, length);
+    }
+#endif
+    auto res = make_ref<StringObj>(std::string_view());
+    res->m_text.reserve(length);
+    res->m_text.append(left->view()).append(right.view());
+    res->m_length = length;
+    return res;
 }
 
-auto StringObj::get_type() -> ObjectType
+ReturnValueObj::ReturnValueObj(Value value)
+    : Object(ObjectType::RETURN)
+    , m_value(std::move(value))
 {
-    return ObjectType::STRING;
 }
 
-auto StringObj::inspect() -> std::string
+auto ReturnValueObj::inspect() -> std::string
 {
-    return "\"" + m_value + "\"";
+    return m_value.inspect();
 }
 
-auto NullObj::get_type() -> ObjectType
+BuiltInObj::BuiltInObj(const BuiltInFn& fn)
+    : Object(ObjectType::BUILTIN)
+    , m_value(fn)
 {
-    return ObjectType::NIL;
 }
 
-auto NullObj::inspect() -> std::string
+auto BuiltInObj::inspect() -> std::string
 {
-    return std::string("null");
+    return "builtin function";
 }
 
-ReturnValueObj::ReturnValueObj(std::shared_ptr<Object> obj)
-    : m_value(std::move(obj))
+ErrorObj::ErrorObj(std::string what)
+    : Object(ObjectType::ERROR)
+    , m_what(std::move(what))
 {
 }
 
-auto ReturnValueObj::get_type() -> ObjectType
+auto ErrorObj::inspect() -> std::string
 {
-    return ObjectType::RETURN;
+    return fmt::format("ERROR: {}", m_what);
 }
 
-auto ReturnValueObj::inspect() -> std::string
+ArrayObj::ArrayObj(const std::vector<Value>& values)
+    : Object(ObjectType::ARRAY, true)
+    , m_length(values.size())
 {
-    return m_value->inspect();
+    for (const auto& value : values)
+    {
+        m_values.push_back(value);
+    }
 }
 
-BuiltInObj::BuiltInObj(const BuiltInFn& fn)
-    : m_value(fn)
+ArrayObj::ArrayObj(PersistentVector values, std::size_t offset, std::size_t length)
+    : Object(ObjectType::ARRAY, true)
+    , m_values(std::move(values))
+    , m_offset(offset)
+    , m_length(length)
 {
 }
 
-auto BuiltInObj::get_type() -> ObjectType
+auto ArrayObj::inspect() -> std::string
 {
-    return ObjectType::BUILTIN;
+    std::vector<std::string> elements;
+    elements.reserve(m_length);
+    for_each([&elements](const Value& val)
+             { elements.push_back(val.inspect()); });
+    return fmt::format("[{}]", fmt::join(elements, ", "));
 }
 
-auto BuiltInObj::inspect() -> std::string
+void ArrayObj::trace(std::vector<Collectable*>& children)
 {
-    return "builtin function";
+    m_values.trace(children);
 }
 
-ErrorObj::ErrorObj(std::string what)
-    : m_what(std::move(what))
+void ArrayObj::clear_refs()
 {
+    m_values = {};
+    m_offset = 0;
+    m_length = 0;
 }
 
-auto ErrorObj::get_type() -> ObjectType
+auto ArrayObj::push(Value value) const -> Ref<ArrayObj>
 {
-    return ObjectType::ERROR;
+    auto res = make_ref<ArrayObj>(m_values, m_offset, m_length);
+    res->append(std::move(value));
+    return res;
 }
 
-auto ErrorObj::inspect() -> std::string
+// Pushing onto a range that stops short of the vector's end overwrites the next element.
+void ArrayObj::append(Value value)
 {
-    return fmt::format("ERROR: {}", m_what);
+    const auto index = m_offset + m_length;
+    if (index == m_values.size())
+    {
+        m_values.push_back(std::move(value));
+    }
+    else
+    {
+        m_values.assign(index, std::move(value));
+    }
+    ++m_length;
 }
 
-ArrayObj::ArrayObj(const std::vector<std::shared_ptr<Object>>& values)
-    : m_values(values)
+auto ArrayObj::slice(const Ref<ArrayObj>& array, std::size_t start, std::size_t end) -> Ref<ArrayObj>
 {
+    if (start == 0 && end == array->m_length)
+    {
+        return array;
+    }
+    return make_ref<ArrayObj>(array->m_values, array->m_offset + start, end - start);
 }
 
-auto ArrayObj::get_type() -> ObjectType
+FunctionObj::FunctionObj(std::shared_ptr<FnLiteral> literal, const Ref<Context>& env)
+    : Object(ObjectType::FUNCTION, true)
+    , m_literal(std::move(literal))
+    , m_env(env)
 {
-    return ObjectType::ARRAY;
 }
 
-auto ArrayObj::inspect() -> std::string
+auto FunctionObj::inspect() -> std::string
+{
+    using value_t = typename decltype(m_literal->m_parameters)::value_type;
+    return fmt::format("fn({}){{\n{}\n}}", fmt::join(m_literal->m_parameters | rv::transform([](const value_t& ptr)
+                                                                                             { return ptr->to_string(); }),
+                                                     ", "),
+                       m_literal->m_body->to_string());
+}
+
+void FunctionObj::trace(std::vector<Collectable*>& children)
+{
+    if (m_env)
+    {
+        children.push_back(m_env.get());
+    }
+}
+
+void FunctionObj::clear_refs()
+{
+    m_env = nullptr;
+}
+
+Upvalue::Upvalue(std::size_t slot)
+    : Collectable(true)
+    , m_slot(slot)
+{
+}
+
+void Upvalue::close(const std::vector<Value>& slots)
+{
+    m_value = slots[m_slot];
+    m_open = false;
+}
+
+void Upvalue::trace(std::vector<Collectable*>& children)
+{
+    m_value.trace(children);
+}
+
+void Upvalue::clear_refs()
+{
+    m_value = nullptr;
+}
+
+CompiledFnObj::CompiledFnObj(Instructions instructions,
+                             std::vector<Value> constants,
+                             std::vector<Atom> names,
+                             std::vector<std::string> local_names,
+                             std::size_t num_parameters,
+                             std::vector<Capture> captures,
+                             std::vector<std::size_t> local_fallbacks)
+    : Object(ObjectType::COMPILED_FUNCTION)
+    , m_instructions(std::move(instructions))
+    , m_constants(std::move(constants))
+    , m_names(std::move(names))
+    , m_local_names(std::move(local_names))
+    , m_num_parameters(num_parameters)
+    , m_captures(std::move(captures))
+    , m_local_fallbacks(std::move(local_fallbacks))
+{
+}
+
+auto CompiledFnObj::inspect() -> std::string
+{
+    return fmt::format("compiled fn({} params)", m_num_parameters);
+}
+
+ClosureObj::ClosureObj(const Ref<CompiledFnObj>& fn, std::vector<Ref<Upvalue>> free)
+    : Object(ObjectType::CLOSURE, true)
+    , m_fn(fn)
+    , m_free(std::move(free))
+{
+}
+
+auto ClosureObj::inspect() -> std::string
+{
+    return fmt::format("closure[{}]", m_fn->inspect());
+}
+
+void ClosureObj::trace(std::vector<Collectable*>& children)
+{
+    for (const auto& upvalue : m_free)
+    {
+        children.push_back(upvalue.get());
+    }
+}
+
+void ClosureObj::clear_refs()
+{
+    m_free.clear();
+}
+
+RegisterFnObj::RegisterFnObj(std::vector<RegInstruction> code,
+                             std::vector<Value> constants,
+                             std::vector<Atom> names,
+                             std::vector<std::string> local_names,
+                             std::size_t num_parameters,
+                             std::size_t num_registers,
+                             std::vector<Capture> captures,
+                             std::vector<std::size_t> local_fallbacks)
+    : Object(ObjectType::REGISTER_FUNCTION)
+    , m_code(std::move(code))
+    , m_constants(std::move(constants))
+    , m_names(std::move(names))
+    , m_local_names(std::move(local_names))
+    , m_num_parameters(num_parameters)
+    , m_num_registers(num_registers)
+    , m_captures(std::move(captures))
+    , m_local_fallbacks(std::move(local_fallbacks))
+{
+}
+
+auto RegisterFnObj::inspect() -> std::string
+{
+    return fmt::format("register fn({} params, {} registers)", m_num_parameters, m_num_registers);
+}
+
+RegisterClosureObj::RegisterClosureObj(const Ref<RegisterFnObj>& fn, std::vector<Ref<Upvalue>> free)
+    : Object(ObjectType::REGISTER_CLOSURE, true)
+    , m_fn(fn)
+    , m_free(std::move(free))
+{
+}
+
+auto RegisterClosureObj::inspect() -> std::string
+{
+    return fmt::format("closure[{}]", m_fn->inspect());
+}
+
+void RegisterClosureObj::trace(std::vector<Collectable*>& children)
 {
-    using value_t = typename decltype(m_values)::value_type;
-    return fmt::format("[{}]", fmt::join(m_values | rv::transform([](const value_t& val)
-                                                                  { return val->inspect(); }),
-                                         ", "));
+    for (const auto& upvalue : m_free)
+    {
+        children.push_back(upvalue.get());
+    }
 }
 
-FunctionObj::FunctionObj(const std::vector<std::shared_ptr<Identifier>>& parameters,
-                         const std::shared_ptr<BlockStatement>& body,
-                         const std::shared_ptr<Context>& env)
-    : m_parameters(parameters)
-    , m_body(body)
+void RegisterClosureObj::clear_refs()
+{
+    m_free.clear();
+}
+
+ThunkFnObj::ThunkFnObj(const std::shared_ptr<const ThunkFnProto>& proto, const Ref<Context>& env)
+    : Object(ObjectType::THUNK_FUNCTION, true)
+    , m_proto(proto)
     , m_env(env)
 {
 }
 
-auto FunctionObj::get_type() -> ObjectType
+auto ThunkFnObj::inspect() -> std::string
 {
-    return ObjectType::FUNCTION;
+    return fmt::format("fn({}) {{ <compiled> }}", fmt::join(m_proto->m_parameters, ", "));
 }
 
-auto FunctionObj::inspect() -> std::string
+void ThunkFnObj::trace(std::vector<Collectable*>& children)
+{
+    if (m_env)
+    {
+        children.push_back(m_env.get());
+    }
+}
+
+void ThunkFnObj::clear_refs()
+{
+    m_env = nullptr;
+}
+
+FlatFnObj::FlatFnObj(const std::shared_ptr<const FlatAst>& ast, FlatIndex function, const Ref<Context>& env)
+    : Object(ObjectType::FLAT_FUNCTION, true)
+    , m_ast(ast)
+    , m_function(function)
+    , m_env(env)
 {
-    using value_t = typename decltype(m_parameters)::value_type;
-    return fmt::format("fn({}){{\n{}\n}}", fmt::join(m_parameters | rv::transform([](const value_t& ptr)
-                                                                                  { return ptr->to_string(); }),
+}
+
+auto FlatFnObj::inspect() -> std::string
+{
+    const auto& fn = m_ast->m_functions[m_function];
+    return fmt::format("fn({}){{\n{}\n}}", fmt::join(rv::iota(FlatIndex{0}, fn.m_arity) | rv::transform([&](FlatIndex i)
+                                                                                                    { return m_ast->to_string(m_ast->list(fn.m_parameters)[i]); }),
                                                      ", "),
-                       m_body->to_string());
+                       m_ast->to_string(fn.m_body));
+}
+
+void FlatFnObj::trace(std::vector<Collectable*>& children)
+{
+    if (m_env)
+    {
+        children.push_back(m_env.get());
+    }
 }
 
-HashObj::HashObj(ObjHashMap&& objects)
-    : m_pairs(std::move(objects))
+void FlatFnObj::clear_refs()
 {
+    m_env = nullptr;
 }
 
-HashObj::HashObj(const ObjHashMap& objects)
-    : m_pairs(objects)
+HashObj::HashObj()
+    : Object(ObjectType::HASH, true)
 {
 }
 
-auto HashObj::get_type() -> ObjectType
+HashObj::HashObj(PersistentMap pairs)
+    : Object(ObjectType::HASH, true)
+    , m_pairs(std::move(pairs))
 {
-    return ObjectType::HASH;
 }
 
 auto HashObj::inspect() -> std::string
 {
-    using value_t = typename decltype(m_pairs)::value_type;
-    return fmt::format("{{{}}}", fmt::join(m_pairs | rv::transform([](const value_t& ptr_pair)
-                                                                   { return ptr_pair.first->inspect() + ":" + ptr_pair.second->inspect(); }),
-                                           ", "));
+    std::vector<std::string> pairs;
+    pairs.reserve(m_pairs.size());
+    m_pairs.for_each([&pairs](const Value& key, const Value& value)
+                     { pairs.push_back(key.inspect() + ":" + value.inspect()); });
+    return fmt::format("{{{}}}", fmt::join(pairs, ", "));
+}
+
+void HashObj::trace(std::vector<Collectable*>& children)
+{
+    m_pairs.trace(children);
 }
 
-Context::Context(const std::shared_ptr<Context>& parent_env)
-    : m_parent_env(parent_env)
+void HashObj::clear_refs()
 {
+    m_pairs = {};
 }
 
-auto Context::get_obj(std::string_view name) -> std::shared_ptr<Object>
+Context::Context()
+    : Collectable(true)
 {
-    const auto it = m_objects.find(name);
-    if (it != std::end(m_objects))
+}
+
+Context::Context(const Ref<Context>& parent_env)
+    : Collectable(true)
+    , m_parent_env(parent_env)
+{
+}
+
+Context::Context(const Ref<Context>& parent_env, const std::shared_ptr<const std::vector<Atom>>& slot_names)
+    : Collectable(true)
+    , m_parent_env(parent_env)
+    , m_slot_names(slot_names)
+{
+    if (m_slot_names)
+    {
+        m_slots.resize(m_slot_names->size());
+    }
+}
+
+auto Context::get_obj(Atom name) -> Value
+{
+    if (!m_objects.empty())
+    {
+        const auto it = m_objects.find(name);
+        if (it != std::end(m_objects))
+        {
+            return it->second;
+        }
+    }
+    if (const auto slot = find_slot(name); slot && m_slots[*slot])
     {
-        return it->second;
+        return m_slots[*slot];
     }
     if (m_parent_env)
     {
@@ -192,8 +478,94 @@ auto Context::get_obj(std::string_view name) -> std::shared_ptr<Object>
     return nullptr;
 }
 
-void Context::set_obj(std::string_view name, const std::shared_ptr<Object>& obj)
+void Context::set_obj(Atom name, const Value& obj)
+{
+    if (const auto slot = find_slot(name))
+    {
+        m_slots[*slot] = obj;
+        return;
+    }
+    if (const auto it = m_objects.find(name); it != std::end(m_objects))
+    {
+        it->second = obj;
+        return;
+    }
+    m_objects.emplace(name, obj);
+}
+
+auto Context::get_slot(std::size_t depth, std::size_t slot) -> Value
+{
+    auto* ctx = this;
+    for (; depth > 0 && ctx; --depth)
+    {
+        ctx = ctx->m_parent_env.get();
+    }
+    if (!ctx || slot >= ctx->m_slots.size())
+    {
+        return nullptr;
+    }
+    return ctx->m_slots[slot];
+}
+
+void Context::set_slot(std::size_t slot, const Value& obj)
+{
+    assert(slot < m_slots.size());
+    m_slots[slot] = obj;
+}
+
+auto Context::find_binding(Atom name) -> Value*
+{
+    if (const auto slot = find_slot(name))
+    {
+        return &m_slots[*slot];
+    }
+    if (const auto it = m_objects.find(name); it != std::end(m_objects))
+    {
+        return &it->second;
+    }
+    return nullptr;
+}
+
+auto Context::slot(std::size_t slot) -> Value&
+{
+    assert(slot < m_slots.size());
+    return m_slots[slot];
+}
+
+void Context::trace(std::vector<Collectable*>& children)
 {
-    m_objects[std::string(name)] = obj;
+    for (const auto& [name, value] : m_objects)
+    {
+        value.trace(children);
+    }
+    for (const auto& value : m_slots)
+    {
+        value.trace(children);
+    }
+    if (m_parent_env)
+    {
+        children.push_back(m_parent_env.get());
+    }
+}
+
+void Context::clear_refs()
+{
+    m_objects.clear();
+    m_slots.clear();
+    m_parent_env = nullptr;
+}
+
+auto Context::find_slot(Atom name) const -> std::optional<std::size_t>
+{
+    if (!m_slot_names)
+    {
+        return std::nullopt;
+    }
+    const auto it = std::find(std::begin(*m_slot_names), std::end(*m_slot_names), name);
+    if (it == std::end(*m_slot_names))
+    {
+        return std::nullopt;
+    }
+    return static_cast<std::size_t>(std::distance(std::begin(*m_slot_names), it));
 }
 }  // namespace mlang
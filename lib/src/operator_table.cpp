@@ -0,0 +1,160 @@
+#include <array>
+#include <functional>
+#include <magic_enum/magic_enum.hpp>
+#include <mlang/eval.hpp>
+#include <mlang/operator_table.hpp>
+
+namespace mlang
+{
+namespace detail
+{
+namespace
+{
+constexpr auto OBJECT_TYPE_COUNT = magic_enum::enum_count<ObjectType>();
+constexpr auto OPERATOR_COUNT = magic_enum::enum_count<Operator>();
+
+template <typename Op>
+auto int_arithmetic(Operator, const Value& left, const Value& right) -> Value
+{
+    return Value::integer(Op{}(left.as_integer(), right.as_integer()));
+}
+
+template <typename Op>
+auto int_comparison(Operator, const Value& left, const Value& right) -> Value
+{
+    return Value::boolean(Op{}(left.as_integer(), right.as_integer()));
+}
+
+template <typename Op>
+auto bool_comparison(Operator, const Value& left, const Value& right) -> Value
+{
+    return Value::boolean(Op{}(left.as_boolean(), right.as_boolean()));
+}
+
+auto string_concat(Operator, const Value& left, const Value& right) -> Value
+{
+    return StringObj::concat(left.cast<StringObj>(), right.as<StringObj>());
+}
+
+auto type_mismatch(Operator op, const Value& left, const Value& right) -> Value
+{
+    return make_ref<ErrorObj>(fmt::format("type mismatch: {} {} {}", left.get_type(), to_string(op), right.get_type()));
+}
+
+auto unknown_infix_operator(Operator op, const Value& left, const Value& right) -> Value
+{
+    return make_ref<ErrorObj>(fmt::format("unknown operator: {} {} {}", left.get_type(), to_string(op), right.get_type()));
+}
+
+auto bang(Operator, const Value& right) -> Value
+{
+    return eval_bang_expression(right);
+}
+
+auto int_negate(Operator, const Value& right) -> Value
+{
+    return Value::integer(-right.as_integer());
+}
+
+auto unknown_prefix_operator(Operator op, const Value& right) -> Value
+{
+    return make_ref<ErrorObj>(fmt::format("unknown operator: {}{}", to_string(op), right.get_type()));
+}
+
+struct InfixRule
+{
+    ObjectType m_left;
+    ObjectType m_right;
+    Operator m_operator;
+    InfixHandler m_handler;
+};
+
+constexpr auto INFIX_RULES = std::array{
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::Plus, &int_arithmetic<std::plus<>>},
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::Minus, &int_arithmetic<std::minus<>>},
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::Multiply, &int_arithmetic<std::multiplies<>>},
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::Divide, &int_arithmetic<std::divides<>>},
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::Less, &int_comparison<std::less<>>},
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::Greater, &int_comparison<std::greater<>>},
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::Equal, &int_comparison<std::equal_to<>>},
+    InfixRule{ObjectType::INTEGER, ObjectType::INTEGER, Operator::NotEqual, &int_comparison<std::not_equal_to<>>},
+    InfixRule{ObjectType::BOOLEAN, ObjectType::BOOLEAN, Operator::Equal, &bool_comparison<std::equal_to<>>},
+    InfixRule{ObjectType::BOOLEAN, ObjectType::BOOLEAN, Operator::NotEqual, &bool_comparison<std::not_equal_to<>>},
+    InfixRule{ObjectType::STRING, ObjectType::STRING, Operator::Plus, &string_concat},
+};
+
+struct PrefixRule
+{
+    ObjectType m_right;
+    Operator m_operator;
+    PrefixHandler m_handler;
+};
+
+constexpr auto PREFIX_RULES = std::array{
+    PrefixRule{ObjectType::INTEGER, Operator::Minus, &int_negate},
+};
+
+constexpr auto infix_index(Operator op, ObjectType left_type, ObjectType right_type) -> std::size_t
+{
+    return (static_cast<std::size_t>(left_type) * OBJECT_TYPE_COUNT + static_cast<std::size_t>(right_type)) * OPERATOR_COUNT + static_cast<std::size_t>(op);
+}
+
+constexpr auto prefix_index(Operator op, ObjectType right_type) -> std::size_t
+{
+    return static_cast<std::size_t>(right_type) * OPERATOR_COUNT + static_cast<std::size_t>(op);
+}
+
+constexpr auto make_infix_table()
+{
+    std::array<InfixHandler, OBJECT_TYPE_COUNT * OBJECT_TYPE_COUNT * OPERATOR_COUNT> table{};
+    for (std::size_t left = 0; left < OBJECT_TYPE_COUNT; ++left)
+    {
+        for (std::size_t right = 0; right < OBJECT_TYPE_COUNT; ++right)
+        {
+            for (std::size_t op = 0; op < OPERATOR_COUNT; ++op)
+            {
+                table[infix_index(static_cast<Operator>(op), static_cast<ObjectType>(left), static_cast<ObjectType>(right))] =
+                    left == right ? &unknown_infix_operator : &type_mismatch;
+            }
+        }
+    }
+    for (const auto& rule : INFIX_RULES)
+    {
+        table[infix_index(rule.m_operator, rule.m_left, rule.m_right)] = rule.m_handler;
+    }
+    return table;
+}
+
+constexpr auto make_prefix_table()
+{
+    std::array<PrefixHandler, OBJECT_TYPE_COUNT * OPERATOR_COUNT> table{};
+    for (std::size_t right = 0; right < OBJECT_TYPE_COUNT; ++right)
+    {
+        for (std::size_t op = 0; op < OPERATOR_COUNT; ++op)
+        {
+            table[prefix_index(static_cast<Operator>(op), static_cast<ObjectType>(right))] =
+                static_cast<Operator>(op) == Operator::Bang ? &bang : &unknown_prefix_operator;
+        }
+    }
+    for (const auto& rule : PREFIX_RULES)
+    {
+        table[prefix_index(rule.m_operator, rule.m_right)] = rule.m_handler;
+    }
+    return table;
+}
+
+constexpr auto INFIX_TABLE = make_infix_table();
+constexpr auto PREFIX_TABLE = make_prefix_table();
+}  // namespace
+
+auto infix_handler(Operator op, ObjectType left_type, ObjectType right_type) -> InfixHandler
+{
+    return INFIX_TABLE[infix_index(op, left_type, right_type)];
+}
+
+auto prefix_handler(Operator op, ObjectType right_type) -> PrefixHandler
+{
+    return PREFIX_TABLE[prefix_index(op, right_type)];
+}
+}  // namespace detail
+}  // namespace mlang
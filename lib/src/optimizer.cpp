@@ -0,0 +1,351 @@
+#include <fmt/core.h>
+#include <mlang/eval.hpp>
+#include <mlang/optimizer.hpp>
+#include <unordered_map>
+
+namespace mlang
+{
+namespace
+{
+auto is_literal(Node* node) -> bool
+{
+    if (!node)
+    {
+        return false;
+    }
+    const auto node_type = node->get_type();
+    return node_type == NodeType::IntegerLiteral || node_type == NodeType::StringLiteral || node_type == NodeType::BooleanLiteral;
+}
+
+auto to_object(Node* literal) -> Value
+{
+    switch (literal->get_type())
+    {
+    case NodeType::IntegerLiteral:
+        return Value::integer(static_cast<IntegerLiteral*>(literal)->m_value);
+    case NodeType::StringLiteral:
+        return make_ref<StringObj>(static_cast<StringLiteral*>(literal)->m_value);
+    default:
+        return static_cast<BooleanLiteral*>(literal)->m_value ? detail::TRUE : detail::FALSE;
+    }
+}
+
+auto make_bool_literal(AstArena& arena, bool value) -> NodePtr<Expression>
+{
+    auto literal = arena.make<BooleanLiteral>();
+    literal->m_token = value ? Token{TokenType::TRUE, "true"} : Token{TokenType::FALSE, "false"};
+    literal->m_value = value;
+    return literal;
+}
+
+auto to_literal(AstArena& arena, const Value& obj) -> NodePtr<Expression>
+{
+    switch (obj.get_type())
+    {
+    case ObjectType::INTEGER:
+    {
+        const auto value = obj.as_integer();
+        auto literal = arena.make<IntegerLiteral>(value);
+        literal->m_token = Token{TokenType::INT, arena.intern(std::to_string(value))};
+        return literal;
+    }
+    case ObjectType::STRING:
+    {
+        const auto value = Atom::intern(obj.as<StringObj>().view());
+        auto literal = arena.make<StringLiteral>(value);
+        literal->m_token = Token{TokenType::STRING, value};
+        return literal;
+    }
+    case ObjectType::BOOLEAN:
+        return make_bool_literal(arena, obj.as_boolean());
+    default:
+        return nullptr;
+    }
+}
+
+auto is_truthy(Node* literal) -> bool
+{
+    return literal->get_type() != NodeType::BooleanLiteral || static_cast<BooleanLiteral*>(literal)->m_value;
+}
+
+class Optimizer
+{
+public:
+    explicit Optimizer(AstArena& arena)
+        : m_arena(arena)
+    {
+    }
+
+    void optimize_program(Program& program)
+    {
+        m_scopes.emplace_back();
+        declare_lets(&program, m_scopes.back());
+        optimize_scope_statements(program.m_statements);
+        m_scopes.pop_back();
+    }
+
+    auto stats() const -> const OptimizerStats&
+    {
+        return m_stats;
+    }
+
+private:
+    struct Binding
+    {
+        std::size_t m_lets = 0;
+        bool m_parameter = false;
+        Node* m_value = nullptr;
+    };
+
+    using Scope = std::unordered_map<std::string_view, Binding>;
+
+    void declare_lets(Node* node, Scope& scope)
+    {
+        if (!node || node->get_type() == NodeType::FnLiteral)
+        {
+            return;
+        }
+        if (node->get_type() == NodeType::LetStatement)
+        {
+            ++scope[static_cast<LetStatement*>(node)->m_name->m_value].m_lets;
+        }
+        detail::for_each_child(node, [this, &scope](Node* child)
+                               { declare_lets(child, scope); });
+    }
+
+    void optimize_scope_statements(NodeList<Statement>& statements)
+    {
+        for (auto& stmt : statements)
+        {
+            optimize_statement(stmt.get());
+            if (stmt->get_type() != NodeType::LetStatement)
+            {
+                continue;
+            }
+            auto& let = static_cast<LetStatement&>(*stmt);
+            auto& binding = m_scopes.back()[let.m_name->m_value];
+            if (binding.m_lets == 1 && !binding.m_parameter && is_literal(let.m_value.get()))
+            {
+                binding.m_value = let.m_value.get();
+            }
+        }
+    }
+
+    void optimize_statements(NodeList<Statement>& statements)
+    {
+        for (auto& stmt : statements)
+        {
+            optimize_statement(stmt.get());
+        }
+    }
+
+    void optimize_statement(Statement* stmt)
+    {
+        switch (stmt->get_type())
+        {
+        case NodeType::LetStatement:
+            optimize_expression(static_cast<LetStatement*>(stmt)->m_value);
+            break;
+        case NodeType::ReturnStatement:
+            optimize_expression(static_cast<ReturnStatement*>(stmt)->m_return_value);
+            break;
+        case NodeType::ExpressionStatement:
+            optimize_expression(static_cast<ExpressionStatement*>(stmt)->m_expression);
+            break;
+        case NodeType::BlockStatement:
+            optimize_statements(static_cast<BlockStatement*>(stmt)->m_statements);
+            break;
+        case NodeType::WhileStatement:
+        {
+            auto* loop = static_cast<WhileStatement*>(stmt);
+            optimize_expression(loop->m_condition);
+            optimize_statements(loop->m_loop_body->m_statements);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    template <typename ExprPtr>
+    void optimize_expression(ExprPtr& expr)
+    {
+        if (!expr)
+        {
+            return;
+        }
+        switch (expr->get_type())
+        {
+        case NodeType::Identifier:
+            propagate(expr);
+            break;
+        case NodeType::PrefixExpression:
+            fold_prefix(expr);
+            break;
+        case NodeType::InfixExpression:
+            fold_infix(expr);
+            break;
+        case NodeType::IfExpression:
+            prune_if(static_cast<IfExpression&>(*expr));
+            break;
+        case NodeType::FnLiteral:
+            optimize_fn(static_cast<FnLiteral&>(*expr));
+            break;
+        case NodeType::CallExpression:
+        {
+            auto& call = static_cast<CallExpression&>(*expr);
+            optimize_expression(call.m_function);
+            for (auto& arg : call.m_arguments)
+            {
+                optimize_expression(arg);
+            }
+            break;
+        }
+        case NodeType::ArrayLiteral:
+            for (auto& element : static_cast<ArrayLiteral&>(*expr).m_expressions)
+            {
+                optimize_expression(element);
+            }
+            break;
+        case NodeType::IndexExpression:
+        {
+            auto& index = static_cast<IndexExpression&>(*expr);
+            optimize_expression(index.m_left);
+            optimize_expression(index.m_index);
+            break;
+        }
+        case NodeType::HashLiteral:
+            for (auto& [key, value] : static_cast<HashLiteral&>(*expr).m_pairs)
+            {
+                optimize_expression(key);
+                optimize_expression(value);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    template <typename ExprPtr>
+    void propagate(ExprPtr& expr)
+    {
+        const auto& name = static_cast<Identifier&>(*expr).m_value;
+        for (auto scope = m_scopes.rbegin(); scope != m_scopes.rend(); ++scope)
+        {
+            const auto it = scope->find(name);
+            if (it == std::end(*scope))
+            {
+                continue;
+            }
+            if (it->second.m_value)
+            {
+                expr = to_literal(m_arena, to_object(it->second.m_value));
+                ++m_stats.m_propagated;
+            }
+            return;
+        }
+    }
+
+    template <typename ExprPtr>
+    void fold_prefix(ExprPtr& expr)
+    {
+        auto& prefix = static_cast<PrefixExpression&>(*expr);
+        optimize_expression(prefix.m_right);
+        if (!is_literal(prefix.m_right.get()))
+        {
+            return;
+        }
+        replace_with_constant(expr, detail::eval_prefix_expression(prefix.m_operator, to_object(prefix.m_right.get())));
+    }
+
+    template <typename ExprPtr>
+    void fold_infix(ExprPtr& expr)
+    {
+        auto& infix = static_cast<InfixExpression&>(*expr);
+        optimize_expression(infix.m_left);
+        optimize_expression(infix.m_right);
+        if (!is_literal(infix.m_left.get()) || !is_literal(infix.m_right.get()))
+        {
+            return;
+        }
+        const auto right = to_object(infix.m_right.get());
+        if (infix.m_operator == Operator::Divide && right.is_integer() && right.as_integer() == 0)
+        {
+            return;
+        }
+        replace_with_constant(expr, detail::eval_infix_expression(infix.m_operator, to_object(infix.m_left.get()), right));
+    }
+
+    template <typename ExprPtr>
+    void replace_with_constant(ExprPtr& expr, const Value& value)
+    {
+        if (auto literal = to_literal(m_arena, value))
+        {
+            expr = std::move(literal);
+            ++m_stats.m_folded;
+        }
+    }
+
+    void prune_if(IfExpression& expr)
+    {
+        optimize_expression(expr.m_condition);
+        if (is_literal(expr.m_condition.get()))
+        {
+            if (is_truthy(expr.m_condition.get()))
+            {
+                if (expr.m_alternative)
+                {
+                    expr.m_alternative.reset();
+                    ++m_stats.m_pruned;
+                }
+            }
+            else if (expr.m_alternative)
+            {
+                expr.m_consequence = std::move(expr.m_alternative);
+                expr.m_condition = make_bool_literal(m_arena, true);
+                ++m_stats.m_pruned;
+            }
+            else if (!expr.m_consequence->m_statements.empty())
+            {
+                expr.m_consequence->m_statements.clear();
+                ++m_stats.m_pruned;
+            }
+        }
+        optimize_statements(expr.m_consequence->m_statements);
+        if (expr.m_alternative)
+        {
+            optimize_statements(expr.m_alternative->m_statements);
+        }
+    }
+
+    void optimize_fn(FnLiteral& fn)
+    {
+        auto& scope = m_scopes.emplace_back();
+        for (const auto& param : fn.m_parameters)
+        {
+            scope[param->m_value].m_parameter = true;
+        }
+        declare_lets(fn.m_body.get(), scope);
+        optimize_scope_statements(fn.m_body->m_statements);
+        m_scopes.pop_back();
+    }
+
+private:
+    AstArena& m_arena;
+    std::vector<Scope> m_scopes;
+    OptimizerStats m_stats;
+};
+}  // namespace
+
+auto optimize(Program& program) -> OptimizerStats
+{
+    Optimizer optimizer(*program.m_arena);
+    optimizer.optimize_program(program);
+    return optimizer.stats();
+}
+
+auto format_optimizer_stats(const OptimizerStats& stats) -> std::string
+{
+    return fmt::format("folded {} propagated {} pruned {}", stats.m_folded, stats.m_propagated, stats.m_pruned);
+}
+}  // namespace mlang
@@ -1,6 +1,7 @@
 #include <charconv>
 #include <mlang/parser.hpp>
 #include <mlang/raii_wrapper.hpp>
+#include <mlang/resolver.hpp>
 #include <utility>
 
 #if defined(ENABLE_PARSE_TRACING)
@@ -27,6 +28,7 @@ namespace mlang
 {
 Parser::Parser(std::unique_ptr<ILexer>&& lexer)
     : m_lexer(std::move(lexer))
+    , m_arena(std::make_shared<AstArena>())
 {
     assert(m_lexer);
     next_token();
@@ -60,7 +62,7 @@ Parser::Parser(std::unique_ptr<ILexer>&& lexer)
 auto Parser::parse_program() -> std::unique_ptr<Program>
 {
     TRACE();
-    auto program = std::make_unique<Program>();
+    auto program = std::make_unique<Program>(m_arena);
     while (m_curr.type != TokenType::EOFILE)
     {
         auto statement = parse_statement();
@@ -70,9 +72,16 @@ auto Parser::parse_program() -> std::unique_ptr<Program>
         }
         next_token();
     }
+    resolve(*program);
     return program;
 }
 
+auto Parser::parse_flat_program() -> std::shared_ptr<const FlatAst>
+{
+    const auto program = parse_program();
+    return std::make_shared<const FlatAst>(flatten(program.get()));
+}
+
 void Parser::peek_error(TokenType unwanted_token)
 {
     m_errors.push_back(fmt::format("expected next token to be {}, got {} instead", unwanted_token, m_next));
@@ -86,10 +95,31 @@ auto Parser::get_errors() const -> const std::vector<std::string>&
 void Parser::next_token()
 {
     m_curr = m_next;
+    m_curr_atom = m_next_atom;
     m_next = m_lexer->next_token();
+    m_next_atom = Atom();
+    switch (m_next.type)
+    {
+    case TokenType::IDENT:
+    case TokenType::STRING:
+        m_next_atom = Atom::intern(m_next.literal);
+        m_next.literal = m_next_atom.view();
+        break;
+    case TokenType::INT:
+    case TokenType::ILLEGAL:
+        m_next.literal = m_arena->intern(m_next.literal);
+        break;
+    default:
+        break;
+    }
+}
+
+auto Parser::curr_atom() const -> Atom
+{
+    return m_curr_atom.empty() ? Atom::intern(m_curr.literal) : m_curr_atom;
 }
 
-auto Parser::parse_statement() -> std::unique_ptr<Statement>
+auto Parser::parse_statement() -> NodePtr<Statement>
 {
     TRACE();
     switch (m_curr.type)
@@ -111,18 +141,18 @@ auto Parser::parse_statement() -> std::unique_ptr<Statement>
     };
 }
 
-auto Parser::parse_let_statement() -> std::unique_ptr<LetStatement>
+auto Parser::parse_let_statement() -> NodePtr<LetStatement>
 {
     TRACE();
-    auto let_statement = std::make_unique<LetStatement>();
+    auto let_statement = m_arena->make<LetStatement>();
     let_statement->m_token = m_curr;
     if (!expect_peek(TokenType::IDENT))
     {
         return nullptr;
     }
-    let_statement->m_name = std::make_unique<Identifier>();
+    let_statement->m_name = m_arena->make<Identifier>();
     let_statement->m_name->m_token = m_curr;
-    let_statement->m_name->m_value = m_curr.literal;
+    let_statement->m_name->m_value = curr_atom();
 
     if (!expect_peek(TokenType::ASSIGN))
     {
@@ -143,10 +173,10 @@ auto Parser::parse_let_statement() -> std::unique_ptr<LetStatement>
     return let_statement;
 }
 
-auto Parser::parse_return_statement() -> std::unique_ptr<ReturnStatement>
+auto Parser::parse_return_statement() -> NodePtr<ReturnStatement>
 {
     TRACE();
-    auto return_statement = std::make_unique<ReturnStatement>();
+    auto return_statement = m_arena->make<ReturnStatement>();
     return_statement->m_token = m_curr;
 
     next_token();
@@ -158,10 +188,10 @@ auto Parser::parse_return_statement() -> std::unique_ptr<ReturnStatement>
     return return_statement;
 }
 
-auto Parser::parse_while_statement() -> std::unique_ptr<WhileStatement>
+auto Parser::parse_while_statement() -> NodePtr<WhileStatement>
 {
     TRACE();
-    auto while_statement = std::make_unique<WhileStatement>();
+    auto while_statement = m_arena->make<WhileStatement>();
     while_statement->m_token = m_curr;
     if (!expect_peek(TokenType::LPAREN))
     {
@@ -182,10 +212,10 @@ auto Parser::parse_while_statement() -> std::unique_ptr<WhileStatement>
     return while_statement;
 }
 
-auto Parser::parse_expression_statement() -> std::unique_ptr<ExpressionStatement>
+auto Parser::parse_expression_statement() -> NodePtr<ExpressionStatement>
 {
     TRACE();
-    auto expr_statement = std::make_unique<ExpressionStatement>();
+    auto expr_statement = m_arena->make<ExpressionStatement>();
     expr_statement->m_token = m_curr;
 
     expr_statement->m_expression = parse_expression(Precedence::LOWEST);
@@ -196,7 +226,7 @@ auto Parser::parse_expression_statement() -> std::unique_ptr<ExpressionStatement
     return expr_statement;
 }
 
-auto Parser::parse_expression(Precedence precedence) -> std::unique_ptr<Expression>
+auto Parser::parse_expression(Precedence precedence) -> NodePtr<Expression>
 {
     TRACE();
     const auto prefix_it = m_prefix_parse_fns.find(m_curr.type);
@@ -230,19 +260,19 @@ bool Parser::expect_peek(TokenType type)
     return false;
 }
 
-auto Parser::parse_identifier() -> std::unique_ptr<Identifier>
+auto Parser::parse_identifier() -> NodePtr<Identifier>
 {
     TRACE();
-    auto expr = std::make_unique<Identifier>();
+    auto expr = m_arena->make<Identifier>();
     expr->m_token = m_curr;
-    expr->m_value = m_curr.literal;
+    expr->m_value = curr_atom();
     return expr;
 }
 
-auto Parser::parse_int() -> std::unique_ptr<IntegerLiteral>
+auto Parser::parse_int() -> NodePtr<IntegerLiteral>
 {
     TRACE();
-    auto expr = std::make_unique<IntegerLiteral>();
+    auto expr = m_arena->make<IntegerLiteral>();
     expr->m_token = m_curr;
 
     auto [ptr, ec] = std::from_chars(m_curr.literal.data(), m_curr.literal.data() + m_curr.literal.size(), expr->m_value);
@@ -254,61 +284,61 @@ auto Parser::parse_int() -> std::unique_ptr<IntegerLiteral>
     return expr;
 }
 
-auto Parser::parse_bool() -> std::unique_ptr<BooleanLiteral>
+auto Parser::parse_bool() -> NodePtr<BooleanLiteral>
 {
     TRACE();
-    auto expr = std::make_unique<BooleanLiteral>();
+    auto expr = m_arena->make<BooleanLiteral>();
     expr->m_token = m_curr;
     expr->m_value = m_curr.type == TokenType::TRUE;
     return expr;
 }
 
-auto Parser::parse_fn_parameters() -> std::vector<std::shared_ptr<Identifier>>
+auto Parser::parse_fn_parameters() -> NodeList<Identifier>
 {
     TRACE();
     if (m_next.type == TokenType::RPAREN)
     {
         next_token();
-        return {};
+        return NodeList<Identifier>(*m_arena);
     }
     next_token();
-    auto ident = std::make_unique<Identifier>();
+    auto ident = m_arena->make<Identifier>();
     ident->m_token = m_curr;
-    ident->m_value = m_curr.literal;
+    ident->m_value = curr_atom();
 
-    std::vector<std::shared_ptr<Identifier>> identifiers;
+    NodeList<Identifier> identifiers(*m_arena);
     identifiers.push_back(std::move(ident));
 
     while (m_next.type == TokenType::COMMA)
     {
         next_token();
         next_token();
-        auto ident = std::make_shared<Identifier>();
+        auto ident = m_arena->make<Identifier>();
         ident->m_token = m_curr;
-        ident->m_value = m_curr.literal;
+        ident->m_value = curr_atom();
 
         identifiers.push_back(std::move(ident));
     }
     if (!expect_peek(TokenType::RPAREN))
     {
-        return {};
+        return NodeList<Identifier>(*m_arena);
     }
     return identifiers;
 }
 
-auto Parser::parse_string() -> std::unique_ptr<StringLiteral>
+auto Parser::parse_string() -> NodePtr<StringLiteral>
 {
     TRACE();
-    auto str_expr = std::make_unique<StringLiteral>();
+    auto str_expr = m_arena->make<StringLiteral>();
     str_expr->m_token = m_curr;
-    str_expr->m_value = m_curr.literal;
+    str_expr->m_value = curr_atom();
     return str_expr;
 }
 
-auto Parser::parse_array() -> std::unique_ptr<ArrayLiteral>
+auto Parser::parse_array() -> NodePtr<ArrayLiteral>
 {
     TRACE();
-    auto arr_expr = std::make_unique<ArrayLiteral>();
+    auto arr_expr = m_arena->make<ArrayLiteral>(*m_arena);
     arr_expr->m_token = m_curr;
 
     next_token();
@@ -336,10 +366,10 @@ auto Parser::parse_array() -> std::unique_ptr<ArrayLiteral>
     return arr_expr;
 }
 
-auto Parser::parse_hash() -> std::unique_ptr<HashLiteral>
+auto Parser::parse_hash() -> NodePtr<HashLiteral>
 {
     TRACE();
-    auto hash_lit = std::make_unique<HashLiteral>();
+    auto hash_lit = m_arena->make<HashLiteral>(*m_arena);
     while (m_next.type != TokenType::RBRACE)
     {
         if (m_next.type == TokenType::EOFILE)
@@ -368,10 +398,10 @@ auto Parser::parse_hash() -> std::unique_ptr<HashLiteral>
     return hash_lit;
 }
 
-auto Parser::parse_fn() -> std::unique_ptr<FnLiteral>
+auto Parser::parse_fn() -> NodePtr<FnLiteral>
 {
     TRACE();
-    auto fn_expr = std::make_unique<FnLiteral>();
+    auto fn_expr = m_arena->make<FnLiteral>(*m_arena);
     if (!expect_peek(TokenType::LPAREN))
     {
         return nullptr;
@@ -385,23 +415,35 @@ auto Parser::parse_fn() -> std::unique_ptr<FnLiteral>
     return fn_expr;
 }
 
-auto Parser::parse_prefix_expression() -> std::unique_ptr<PrefixExpression>
+auto Parser::parse_prefix_expression() -> NodePtr<PrefixExpression>
 {
     TRACE();
-    auto expr = std::make_unique<PrefixExpression>();
+    const auto op = to_operator(m_curr.type);
+    if (!op)
+    {
+        m_errors.push_back(fmt::format("unknown operator {}", m_curr));
+        return nullptr;
+    }
+    auto expr = m_arena->make<PrefixExpression>();
     expr->m_token = m_curr;
-    expr->m_operator = m_curr.literal;
+    expr->m_operator = *op;
     next_token();
     expr->m_right = parse_expression(Precedence::PREFIX);
     return expr;
 }
 
-auto Parser::parse_infix_expression(std::unique_ptr<Expression>&& left) -> std::unique_ptr<InfixExpression>
+auto Parser::parse_infix_expression(NodePtr<Expression>&& left) -> NodePtr<InfixExpression>
 {
     TRACE();
-    auto expr = std::make_unique<InfixExpression>();
+    const auto op = to_operator(m_curr.type);
+    if (!op)
+    {
+        m_errors.push_back(fmt::format("unknown operator {}", m_curr));
+        return nullptr;
+    }
+    auto expr = m_arena->make<InfixExpression>();
     expr->m_token = m_curr;
-    expr->m_operator = m_curr.literal;
+    expr->m_operator = *op;
     expr->m_left = std::move(left);
 
     const auto p = get_precedence(m_curr.type);
@@ -410,10 +452,10 @@ auto Parser::parse_infix_expression(std::unique_ptr<Expression>&& left) -> std::
     return expr;
 }
 
-auto Parser::parse_index_expression(std::unique_ptr<Expression>&& left) -> std::unique_ptr<IndexExpression>
+auto Parser::parse_index_expression(NodePtr<Expression>&& left) -> NodePtr<IndexExpression>
 {
     TRACE();
-    auto index_expr = std::make_unique<IndexExpression>();
+    auto index_expr = m_arena->make<IndexExpression>();
     index_expr->m_token = m_curr;
     index_expr->m_left = std::move(left);
     next_token();
@@ -425,7 +467,7 @@ auto Parser::parse_index_expression(std::unique_ptr<Expression>&& left) -> std::
     return index_expr;
 }
 
-auto Parser::parse_grouped_expression() -> std::unique_ptr<Expression>
+auto Parser::parse_grouped_expression() -> NodePtr<Expression>
 {
     TRACE();
     next_token();
@@ -437,10 +479,10 @@ auto Parser::parse_grouped_expression() -> std::unique_ptr<Expression>
     return expr;
 }
 
-auto Parser::parse_if_expression() -> std::unique_ptr<IfExpression>
+auto Parser::parse_if_expression() -> NodePtr<IfExpression>
 {
     TRACE();
-    auto expr = std::make_unique<IfExpression>();
+    auto expr = m_arena->make<IfExpression>();
     expr->m_token = m_curr;
 
     if (!expect_peek(TokenType::LPAREN))
@@ -466,26 +508,26 @@ auto Parser::parse_if_expression() -> std::unique_ptr<IfExpression>
     return expr;
 }
 
-auto Parser::parse_call_expression(std::unique_ptr<Expression>&& function) -> std::unique_ptr<CallExpression>
+auto Parser::parse_call_expression(NodePtr<Expression>&& function) -> NodePtr<CallExpression>
 {
     TRACE();
-    auto call_expr = std::make_unique<CallExpression>();
+    auto call_expr = m_arena->make<CallExpression>(*m_arena);
     call_expr->m_token = m_curr;
     call_expr->m_function = std::move(function);
     call_expr->m_arguments = parse_call_arguments();
     return call_expr;
 }
 
-auto Parser::parse_call_arguments() -> std::vector<std::unique_ptr<Expression>>
+auto Parser::parse_call_arguments() -> NodeList<Expression>
 {
     TRACE();
     if (m_next.type == TokenType::RPAREN)
     {
         next_token();
-        return {};
+        return NodeList<Expression>(*m_arena);
     }
     next_token();
-    std::vector<std::unique_ptr<Expression>> args;
+    NodeList<Expression> args(*m_arena);
     args.push_back(parse_expression(Precedence::LOWEST));
 
     while (m_next.type == TokenType::COMMA)
@@ -496,15 +538,15 @@ auto Parser::parse_call_arguments() -> std::vector<std::unique_ptr<Expression>>
     }
     if (!expect_peek(TokenType::RPAREN))
     {
-        return {};
+        return NodeList<Expression>(*m_arena);
     }
     return args;
 }
 
-auto Parser::parse_block_statement() -> std::unique_ptr<BlockStatement>
+auto Parser::parse_block_statement() -> NodePtr<BlockStatement>
 {
     TRACE();
-    auto block = std::make_unique<BlockStatement>();
+    auto block = m_arena->make<BlockStatement>(*m_arena);
     block->m_token = m_curr;
     next_token();
     while (m_curr.type != TokenType::RBRACE && m_curr.type != TokenType::EOFILE)
@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <bit>
+#include <mlang/object.hpp>
+#include <mlang/persistent_map.hpp>
+
+namespace mlang
+{
+namespace detail
+{
+namespace
+{
+using Entry = MapNode::Entry;
+
+// Takes over node if nothing else refers to it and copies it otherwise.
+auto writable(Ref<MapNode> node) -> Ref<MapNode>
+{
+    if (node->ref_count() == 1)
+    {
+        return node;
+    }
+    return make_ref<MapNode>(*node);
+}
+
+auto fragment_bit(std::size_t hash, std::uint32_t shift) -> std::uint32_t
+{
+    return 1u << ((hash >> shift) & MAP_MASK);
+}
+
+auto dense_index(std::uint32_t map, std::uint32_t bit) -> std::size_t
+{
+    return std::popcount(map & (bit - 1));
+}
+
+auto matches(const Entry& entry, std::size_t hash, const Value& key) -> bool
+{
+    return entry.m_hash == hash && value_eq()(entry.m_key, key);
+}
+
+// Atom of a key that is an interned string, empty for any other key.
+auto key_atom(const Value& key) -> Atom
+{
+    return key.get_type() == ObjectType::STRING ? key.as<StringObj>().atom() : Atom();
+}
+
+constexpr std::uint64_t CONTROL_LSB = 0x0101010101010101;
+constexpr std::uint64_t CONTROL_MSB = 0x8080808080808080;
+
+// The high bit marks a used control byte, so an unused one never matches.
+auto control_byte(std::size_t hash) -> std::uint64_t
+{
+    return 0x80 | (hash & 0x7F);
+}
+
+// Marks the high bit of every control byte equal to byte, plus false positives.
+auto match_control(std::uint64_t control, std::uint64_t byte) -> std::uint64_t
+{
+    const auto diff = control ^ (byte * CONTROL_LSB);
+    return (diff - CONTROL_LSB) & ~diff & CONTROL_MSB;
+}
+
+// Subtree holding two entries whose hashes agree above shift.
+auto make_pair_node(std::uint32_t shift, Entry first, Entry second) -> Ref<MapNode>
+{
+    auto node = make_ref<MapNode>();
+    if (shift >= MAP_HASH_BITS)
+    {
+        node->m_entries.push_back(std::move(first));
+        node->m_entries.push_back(std::move(second));
+        return node;
+    }
+    const auto first_bit = fragment_bit(first.m_hash, shift);
+    const auto second_bit = fragment_bit(second.m_hash, shift);
+    if (first_bit == second_bit)
+    {
+        node->m_child_map = first_bit;
+        node->m_children.push_back(make_pair_node(shift + MAP_BITS, std::move(first), std::move(second)));
+        return node;
+    }
+    node->m_entry_map = first_bit | second_bit;
+    if (first_bit > second_bit)
+    {
+        std::swap(first, second);
+    }
+    node->m_entries.push_back(std::move(first));
+    node->m_entries.push_back(std::move(second));
+    return node;
+}
+
+auto insert(Ref<MapNode> node, std::uint32_t shift, Entry entry, bool& added) -> Ref<MapNode>
+{
+    if (!node)
+    {
+        node = make_ref<MapNode>();
+    }
+    else
+    {
+        node = writable(std::move(node));
+    }
+    if (shift >= MAP_HASH_BITS)
+    {
+        for (auto& existing : node->m_entries)
+        {
+            if (value_eq()(existing.m_key, entry.m_key))
+            {
+                existing.m_value = std::move(entry.m_value);
+                return node;
+            }
+        }
+        node->m_entries.push_back(std::move(entry));
+        added = true;
+        return node;
+    }
+    const auto bit = fragment_bit(entry.m_hash, shift);
+    if (node->m_entry_map & bit)
+    {
+        const auto index = dense_index(node->m_entry_map, bit);
+        auto& existing = node->m_entries[index];
+        if (matches(existing, entry.m_hash, entry.m_key))
+        {
+            existing.m_value = std::move(entry.m_value);
+            return node;
+        }
+        auto child = make_pair_node(shift + MAP_BITS, std::move(existing), std::move(entry));
+        node->m_entries.erase(node->m_entries.begin() + index);
+        node->m_entry_map &= ~bit;
+        node->m_children.insert(node->m_children.begin() + dense_index(node->m_child_map, bit), std::move(child));
+        node->m_child_map |= bit;
+        added = true;
+        return node;
+    }
+    if (node->m_child_map & bit)
+    {
+        auto& child = node->m_children[dense_index(node->m_child_map, bit)];
+        child = insert(std::move(child), shift + MAP_BITS, std::move(entry), added);
+        return node;
+    }
+    node->m_entries.insert(node->m_entries.begin() + dense_index(node->m_entry_map, bit), std::move(entry));
+    node->m_entry_map |= bit;
+    added = true;
+    return node;
+}
+
+// Only called for keys that are present. Folds single-entry children back into the parent.
+auto remove(Ref<MapNode> node, std::uint32_t shift, std::size_t hash, const Value& key) -> Ref<MapNode>
+{
+    node = writable(std::move(node));
+    if (shift >= MAP_HASH_BITS)
+    {
+        std::erase_if(node->m_entries, [&key](const Entry& entry)
+                      { return value_eq()(entry.m_key, key); });
+    }
+    else
+    {
+        const auto bit = fragment_bit(hash, shift);
+        if (node->m_entry_map & bit)
+        {
+            node->m_entries.erase(node->m_entries.begin() + dense_index(node->m_entry_map, bit));
+            node->m_entry_map &= ~bit;
+        }
+        else
+        {
+            const auto index = dense_index(node->m_child_map, bit);
+            auto child = remove(std::move(node->m_children[index]), shift + MAP_BITS, hash, key);
+            if (child && (!child->m_children.empty() || child->m_entries.size() != 1))
+            {
+                node->m_children[index] = std::move(child);
+            }
+            else
+            {
+                node->m_children.erase(node->m_children.begin() + index);
+                node->m_child_map &= ~bit;
+                if (child)
+                {
+                    node->m_entries.insert(node->m_entries.begin() + dense_index(node->m_entry_map, bit), std::move(child->m_entries.front()));
+                    node->m_entry_map |= bit;
+                }
+            }
+        }
+    }
+    if (node->m_entries.empty() && node->m_children.empty())
+    {
+        return nullptr;
+    }
+    return node;
+}
+}  // namespace
+
+void MapNode::trace(std::vector<Collectable*>& children)
+{
+    for (const auto& entry : m_entries)
+    {
+        entry.m_key.trace(children);
+        entry.m_value.trace(children);
+    }
+    for (const auto& child : m_children)
+    {
+        children.push_back(child.get());
+    }
+}
+
+void MapNode::clear_refs()
+{
+    m_entries.clear();
+    m_children.clear();
+}
+}  // namespace detail
+
+auto PersistentMap::find_inline(std::size_t hash, const Value& key) const -> std::size_t
+{
+    using namespace detail;
+    for (auto candidates = match_control(m_control, control_byte(hash)); candidates; candidates &= candidates - 1)
+    {
+        const auto index = static_cast<std::size_t>(std::countr_zero(candidates)) / 8;
+        if (matches(m_inline[index], hash, key))
+        {
+            return index;
+        }
+    }
+    return SMALL_MAP_CAPACITY;
+}
+
+// Shifts the later entries and their control bytes down to keep insertion order.
+void PersistentMap::erase_inline(std::size_t index)
+{
+    std::move(m_inline.begin() + index + 1, m_inline.begin() + m_size, m_inline.begin() + index);
+    m_inline[m_size - 1] = {};
+    if (m_shape)
+    {
+        m_shape = m_shape->remove(index);
+    }
+    const auto below = m_control & ((std::uint64_t{1} << (8 * index)) - 1);
+    const auto above = index + 1 < detail::SMALL_MAP_CAPACITY ? (m_control >> (8 * (index + 1))) << (8 * index) : 0;
+    m_control = below | above;
+    --m_size;
+}
+
+void PersistentMap::spill()
+{
+    bool added = false;
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        m_root = detail::insert(std::move(m_root), 0, std::move(m_inline[i]), added);
+        m_inline[i] = {};
+    }
+    m_control = 0;
+    m_shape = nullptr;
+}
+
+auto PersistentMap::find(const Value& key) const -> const Value*
+{
+    using namespace detail;
+    if (m_shape)
+    {
+        if (const auto atom = key_atom(key); !atom.empty())
+        {
+            const auto slot = m_shape->slot(atom);
+            return slot < m_size ? &m_inline[slot].m_value : nullptr;
+        }
+    }
+    const auto hash = value_hash()(key);
+    if (!m_root)
+    {
+        const auto index = find_inline(hash, key);
+        return index < m_size ? &m_inline[index].m_value : nullptr;
+    }
+    const MapNode* node = m_root.get();
+    for (std::uint32_t shift = 0; node; shift += MAP_BITS)
+    {
+        if (shift >= MAP_HASH_BITS)
+        {
+            for (const auto& entry : node->m_entries)
+            {
+                if (value_eq()(entry.m_key, key))
+                {
+                    return &entry.m_value;
+                }
+            }
+            return nullptr;
+        }
+        const auto bit = fragment_bit(hash, shift);
+        if (node->m_entry_map & bit)
+        {
+            const auto& entry = node->m_entries[dense_index(node->m_entry_map, bit)];
+            return matches(entry, hash, key) ? &entry.m_value : nullptr;
+        }
+        if (!(node->m_child_map & bit))
+        {
+            return nullptr;
+        }
+        node = node->m_children[dense_index(node->m_child_map, bit)].get();
+    }
+    return nullptr;
+}
+
+void PersistentMap::set(Value key, Value value)
+{
+    using namespace detail;
+    const auto hash = value_hash()(key);
+    if (!m_root)
+    {
+        if (const auto index = find_inline(hash, key); index < m_size)
+        {
+            m_inline[index].m_value = std::move(value);
+            return;
+        }
+        if (m_size < SMALL_MAP_CAPACITY)
+        {
+            const auto* shape = m_size == 0 ? Shape::empty() : m_shape;
+            const auto atom = key_atom(key);
+            m_shape = shape && !atom.empty() ? shape->add(atom) : nullptr;
+            m_inline[m_size] = {hash, std::move(key), std::move(value)};
+            m_control |= control_byte(hash) << (8 * m_size);
+            ++m_size;
+            return;
+        }
+        spill();
+    }
+    bool added = false;
+    m_root = detail::insert(std::move(m_root), 0, {hash, std::move(key), std::move(value)}, added);
+    if (added)
+    {
+        ++m_size;
+    }
+}
+
+auto PersistentMap::erase(const Value& key) -> bool
+{
+    if (!m_root)
+    {
+        const auto index = find_inline(detail::value_hash()(key), key);
+        if (index >= m_size)
+        {
+            return false;
+        }
+        erase_inline(index);
+        return true;
+    }
+    if (!find(key))
+    {
+        return false;
+    }
+    m_root = detail::remove(std::move(m_root), 0, detail::value_hash()(key), key);
+    --m_size;
+    return true;
+}
+
+void PersistentMap::trace(std::vector<Collectable*>& children) const
+{
+    if (m_root)
+    {
+        children.push_back(m_root.get());
+        return;
+    }
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        m_inline[i].m_key.trace(children);
+        m_inline[i].m_value.trace(children);
+    }
+}
+}  // namespace mlang
@@ -0,0 +1,136 @@
+#include <mlang/persistent_vector.hpp>
+
+namespace mlang
+{
+namespace detail
+{
+namespace
+{
+// Takes over node if nothing else refers to it and copies it otherwise.
+template <typename N>
+auto writable(Ref<VectorNode> node) -> Ref<N>
+{
+    if (!node)
+    {
+        return make_ref<N>();
+    }
+    auto* ptr = static_cast<N*>(node.get());
+    if (ptr->ref_count() == 1)
+    {
+        node.detach();
+        return Ref<N>::adopt(ptr);
+    }
+    return make_ref<N>(*ptr);
+}
+}  // namespace
+
+void VectorLeaf::trace(std::vector<Collectable*>& children)
+{
+    for (const auto& value : m_values)
+    {
+        value.trace(children);
+    }
+}
+
+void VectorLeaf::clear_refs()
+{
+    m_values.fill(Value());
+}
+
+void VectorBranch::trace(std::vector<Collectable*>& children)
+{
+    for (const auto& child : m_children)
+    {
+        if (child)
+        {
+            children.push_back(child.get());
+        }
+    }
+}
+
+void VectorBranch::clear_refs()
+{
+    m_children.fill(nullptr);
+}
+}  // namespace detail
+
+void PersistentVector::push_back(Value value)
+{
+    using namespace detail;
+    const auto tail_size = m_size - tail_offset();
+    if (tail_size < VECTOR_WIDTH)
+    {
+        m_tail = writable<VectorLeaf>(std::move(m_tail));
+        m_tail->m_values[tail_size] = std::move(value);
+        ++m_size;
+        return;
+    }
+    if ((m_size >> VECTOR_BITS) > (1u << m_shift))
+    {
+        auto root = make_ref<VectorBranch>();
+        root->m_children[0] = std::move(m_root);
+        m_root = std::move(root);
+        m_shift += VECTOR_BITS;
+    }
+    m_root = push_tail(m_shift, std::move(m_root), std::move(m_tail));
+    m_tail = make_ref<VectorLeaf>();
+    m_tail->m_values[0] = std::move(value);
+    ++m_size;
+}
+
+void PersistentVector::assign(std::size_t index, Value value)
+{
+    using namespace detail;
+    if (index >= tail_offset())
+    {
+        m_tail = writable<VectorLeaf>(std::move(m_tail));
+        m_tail->m_values[index & VECTOR_MASK] = std::move(value);
+        return;
+    }
+    m_root = assign_in_tree(m_shift, std::move(m_root), index, std::move(value));
+}
+
+void PersistentVector::trace(std::vector<Collectable*>& children) const
+{
+    if (m_root)
+    {
+        children.push_back(m_root.get());
+    }
+    if (m_tail)
+    {
+        children.push_back(m_tail.get());
+    }
+}
+
+// Appends the full tail as the next leaf of the trie.
+auto PersistentVector::push_tail(std::uint32_t level, Ref<detail::VectorNode> parent, Ref<detail::VectorNode> tail) const -> Ref<detail::VectorNode>
+{
+    using namespace detail;
+    auto branch = writable<VectorBranch>(std::move(parent));
+    auto& child = branch->m_children[((m_size - 1) >> level) & VECTOR_MASK];
+    if (level == VECTOR_BITS)
+    {
+        child = std::move(tail);
+    }
+    else
+    {
+        child = push_tail(level - VECTOR_BITS, std::move(child), std::move(tail));
+    }
+    return branch;
+}
+
+auto PersistentVector::assign_in_tree(std::uint32_t level, Ref<detail::VectorNode> node, std::size_t index, Value value) -> Ref<detail::VectorNode>
+{
+    using namespace detail;
+    if (level == 0)
+    {
+        auto leaf = writable<VectorLeaf>(std::move(node));
+        leaf->m_values[index & VECTOR_MASK] = std::move(value);
+        return leaf;
+    }
+    auto branch = writable<VectorBranch>(std::move(node));
+    auto& child = branch->m_children[(index >> level) & VECTOR_MASK];
+    child = assign_in_tree(level - VECTOR_BITS, std::move(child), index, std::move(value));
+    return branch;
+}
+}  // namespace mlang
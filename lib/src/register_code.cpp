@@ -0,0 +1,92 @@
+#include <fmt/core.h>
+#include <mlang/register_code.hpp>
+
+namespace mlang
+{
+namespace
+{
+using enum OperandKind;
+
+constexpr auto REG_OP_DEFINITIONS = std::array{
+    RegOpDefinition{"LoadConst",      {RegDef, Const, None}          },
+    RegOpDefinition{"LoadBool",       {RegDef, Immediate, None}      },
+    RegOpDefinition{"LoadNull",       {RegDef, None, None}           },
+    RegOpDefinition{"Move",           {RegDef, RegUse, None}         },
+    RegOpDefinition{"Add",            {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"Sub",            {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"Mul",            {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"Div",            {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"Equal",          {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"NotEqual",       {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"GreaterThan",    {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"LessThan",       {RegDef, RegOrConst, RegOrConst}},
+    RegOpDefinition{"Minus",          {RegDef, RegUse, None}         },
+    RegOpDefinition{"Bang",           {RegDef, RegUse, None}         },
+    RegOpDefinition{"Jump",           {None, Target, None}           },
+    RegOpDefinition{"JumpIfFalse",    {RegUse, Target, None}         },
+    RegOpDefinition{"GetGlobal",      {RegDef, Name, None}           },
+    RegOpDefinition{"SetGlobal",      {RegUse, Name, None}           },
+    RegOpDefinition{"GetLocal",       {RegDef, RegUse, None}         },
+    RegOpDefinition{"GetFree",        {RegDef, Immediate, None}      },
+    RegOpDefinition{"CurrentClosure", {RegDef, None, None}           },
+    RegOpDefinition{"Array",          {RegDef, Immediate, None}      },
+    RegOpDefinition{"Hash",           {RegDef, Immediate, None}      },
+    RegOpDefinition{"Index",          {RegDef, RegUse, RegOrConst}   },
+    RegOpDefinition{"Call",           {RegDef, RegUse, Immediate}    },
+    RegOpDefinition{"TailCall",       {RegDef, RegUse, Immediate}    },
+    RegOpDefinition{"RebindingCall",  {RegDef, RegUse, Immediate}    },
+    RegOpDefinition{"Return",         {RegUse, None, None}           },
+    RegOpDefinition{"Closure",        {RegDef, Const, None}          },
+    RegOpDefinition{"Arg",            {RegUse, Immediate, None}      },
+};
+static_assert(std::size(REG_OP_DEFINITIONS) == static_cast<std::size_t>(RegOpCode::Arg) + 1);
+
+auto format_operand(OperandKind kind, std::uint16_t operand) -> std::string
+{
+    switch (kind)
+    {
+    case RegDef:
+    case RegUse:
+        return fmt::format(" r{}", operand);
+    case RegOrConst:
+        if (operand & CONST_OPERAND_BIT)
+        {
+            return fmt::format(" k{}", operand & ~CONST_OPERAND_BIT);
+        }
+        return fmt::format(" r{}", operand);
+    case Const:
+        return fmt::format(" k{}", operand);
+    case Name:
+        return fmt::format(" g{}", operand);
+    case Target:
+        return fmt::format(" @{}", operand);
+    case Immediate:
+        return fmt::format(" {}", operand);
+    case None:
+        break;
+    }
+    return {};
+}
+}  // namespace
+
+auto lookup(RegOpCode op) -> const RegOpDefinition&
+{
+    return REG_OP_DEFINITIONS[static_cast<std::size_t>(op)];
+}
+
+auto disassemble(const std::vector<RegInstruction>& code) -> std::string
+{
+    std::string out;
+    for (std::size_t pc = 0; pc < code.size(); ++pc)
+    {
+        const auto& ins = code[pc];
+        const auto& def = lookup(ins.op);
+        out += fmt::format("{:04} {}", pc, def.name);
+        out += format_operand(def.operands[0], ins.a);
+        out += format_operand(def.operands[1], ins.b);
+        out += format_operand(def.operands[2], ins.c);
+        out += '\n';
+    }
+    return out;
+}
+}  // namespace mlang
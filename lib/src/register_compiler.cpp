@@ -0,0 +1,795 @@
+#include <algorithm>
+#include <fmt/core.h>
+#include <limits>
+#include <mlang/register_compiler.hpp>
+#include <set>
+
+namespace mlang
+{
+namespace
+{
+constexpr std::size_t MAX_REGISTERS = CONST_OPERAND_BIT;
+constexpr std::size_t MAX_U16_OPERAND = std::numeric_limits<std::uint16_t>::max();
+
+void collect_let_names(Node* node, std::vector<std::string>& names)
+{
+    if (node && node->get_type() == NodeType::FnLiteral)
+    {
+        return;
+    }
+    if (node && node->get_type() == NodeType::LetStatement)
+    {
+        names.emplace_back(static_cast<LetStatement*>(node)->m_name->m_value.view());
+    }
+    detail::for_each_child(node, [&names](Node* child)
+                   { collect_let_names(child, names); });
+}
+
+auto assigns_locals(Node* node) -> bool
+{
+    if (!node)
+    {
+        return false;
+    }
+    if (node->get_type() == NodeType::LetStatement)
+    {
+        return true;
+    }
+    bool found = false;
+    detail::for_each_child(node, [&found](Node* child)
+                   { found = found || assigns_locals(child); });
+    return found;
+}
+
+// Calls whose destination is returned right away become TailCall.
+void mark_tail_calls(std::vector<RegInstruction>& code)
+{
+    for (auto& ins : code)
+    {
+        if (ins.op != RegOpCode::Call)
+        {
+            continue;
+        }
+        auto target = static_cast<std::size_t>(&ins - code.data()) + 1 + ins.c;
+        while (target < code.size() && code[target].op == RegOpCode::Jump)
+        {
+            target = code[target].b;
+        }
+        if (target < code.size() && code[target].op == RegOpCode::Return && code[target].a == ins.a)
+        {
+            ins.op = RegOpCode::TailCall;
+        }
+    }
+}
+
+auto infix_opcode(Operator op) -> std::optional<RegOpCode>
+{
+    switch (op)
+    {
+    case Operator::Plus:
+        return RegOpCode::Add;
+    case Operator::Minus:
+        return RegOpCode::Sub;
+    case Operator::Multiply:
+        return RegOpCode::Mul;
+    case Operator::Divide:
+        return RegOpCode::Div;
+    case Operator::Equal:
+        return RegOpCode::Equal;
+    case Operator::NotEqual:
+        return RegOpCode::NotEqual;
+    case Operator::Greater:
+        return RegOpCode::GreaterThan;
+    case Operator::Less:
+        return RegOpCode::LessThan;
+    default:
+        return std::nullopt;
+    }
+}
+}  // namespace
+
+RegisterCompiler::RegisterCompiler()
+{
+    enter_scope(nullptr);
+}
+
+auto RegisterCompiler::compile(Node* node) -> Ref<RegisterFnObj>
+{
+    if (node->get_type() == NodeType::Program)
+    {
+        const auto& statements = static_cast<Program*>(node)->m_statements;
+        if (!statements.empty())
+        {
+            emit(RegOpCode::Return, *compile_block(statements, std::nullopt, true));
+        }
+    }
+    else if (node->get_type() == NodeType::BlockStatement || node->get_type() == NodeType::LetStatement || node->get_type() == NodeType::ReturnStatement
+             || node->get_type() == NodeType::ExpressionStatement || node->get_type() == NodeType::WhileStatement)
+    {
+        emit(RegOpCode::Return, *compile_statement(static_cast<Statement*>(node), std::nullopt, true));
+    }
+    else
+    {
+        emit(RegOpCode::Return, compile_expr(node, std::nullopt));
+    }
+    auto main_scope = leave_scope();
+    std::size_t num_registers = 0;
+    allocate_registers(main_scope, num_registers);
+    enter_scope(nullptr);
+    return make_ref<RegisterFnObj>(std::move(main_scope.m_code),
+                                   std::move(main_scope.m_constants),
+                                   std::move(main_scope.m_names),
+                                   std::move(main_scope.m_local_names),
+                                   0,
+                                   num_registers);
+}
+
+auto RegisterCompiler::get_errors() const -> const std::vector<std::string>&
+{
+    return m_errors;
+}
+
+auto RegisterCompiler::compile_block(const NodeList<Statement>& statements, std::optional<Reg> dest, bool want_value) -> std::optional<Reg>
+{
+    if (statements.empty())
+    {
+        if (!want_value)
+        {
+            return std::nullopt;
+        }
+        const auto reg = target(dest);
+        emit(RegOpCode::LoadNull, reg);
+        return reg;
+    }
+    // Statements do not share temporaries.
+    const auto first_temp = scope().m_next_temp;
+    for (std::size_t i = 0; i + 1 < statements.size(); ++i)
+    {
+        compile_statement(statements[i].get(), std::nullopt, false);
+        scope().m_next_temp = first_temp;
+    }
+    return compile_statement(statements.back().get(), dest, want_value);
+}
+
+auto RegisterCompiler::compile_statement(Statement* stmt, std::optional<Reg> dest, bool want_value) -> std::optional<Reg>
+{
+    if (!stmt)
+    {
+        m_errors.push_back("unable to compile empty statement");
+        return std::nullopt;
+    }
+    switch (stmt->get_type())
+    {
+    case NodeType::ExpressionStatement:
+    {
+        return compile_expr(static_cast<ExpressionStatement*>(stmt)->m_expression.get(), dest);
+    }
+    case NodeType::ReturnStatement:
+    {
+        const auto reg = compile_expr(static_cast<ReturnStatement*>(stmt)->m_return_value.get(), dest);
+        emit(RegOpCode::Return, reg);
+        return reg;
+    }
+    case NodeType::BlockStatement:
+    {
+        return compile_block(static_cast<BlockStatement*>(stmt)->m_statements, dest, want_value);
+    }
+    case NodeType::LetStatement:
+    {
+        compile_let(*static_cast<LetStatement*>(stmt));
+        break;
+    }
+    case NodeType::WhileStatement:
+    {
+        compile_while(*static_cast<WhileStatement*>(stmt));
+        break;
+    }
+    default:
+    {
+        m_errors.push_back(fmt::format("unexpected statement {}", stmt->get_type()));
+        break;
+    }
+    }
+    if (!want_value)
+    {
+        return std::nullopt;
+    }
+    const auto reg = target(dest);
+    emit(RegOpCode::LoadNull, reg);
+    return reg;
+}
+
+void RegisterCompiler::compile_let(LetStatement& let)
+{
+    const auto& name = let.m_name->m_value;
+    const auto is_call = let.m_value && let.m_value->get_type() == NodeType::CallExpression;
+    if (m_scopes.size() == 1)
+    {
+        const auto reg = is_call ? compile_call(static_cast<CallExpression&>(*let.m_value), std::nullopt, RegOpCode::RebindingCall)
+                                 : compile_expr(let.m_value.get(), std::nullopt);
+        emit(RegOpCode::SetGlobal, reg, add_name(name));
+        return;
+    }
+    const auto slot = scope().m_local_slots.find(name)->second;
+    if (let.m_value && let.m_value->get_type() == NodeType::FnLiteral)
+    {
+        compile_fn(static_cast<FnLiteral&>(*let.m_value), name, slot);
+    }
+    else if (is_call)
+    {
+        compile_call(static_cast<CallExpression&>(*let.m_value), slot, RegOpCode::RebindingCall);
+    }
+    else
+    {
+        compile_expr(let.m_value.get(), slot);
+    }
+    define(name);
+}
+
+void RegisterCompiler::compile_while(WhileStatement& stmt)
+{
+    auto& curr = scope();
+    const auto loop_start = curr.m_code.size();
+    const auto condition = compile_expr(stmt.m_condition.get(), std::nullopt);
+    const auto exit_jump = emit(RegOpCode::JumpIfFalse, condition);
+    ++scope().m_block_depth;
+    compile_block(stmt.m_loop_body->m_statements, std::nullopt, false);
+    --scope().m_block_depth;
+    emit(RegOpCode::Jump, 0, static_cast<std::uint16_t>(loop_start));
+    scope().m_code[exit_jump].b = static_cast<std::uint16_t>(scope().m_code.size());
+}
+
+auto RegisterCompiler::compile_if(IfExpression& expr, std::optional<Reg> dest) -> Reg
+{
+    const auto condition = compile_expr(expr.m_condition.get(), std::nullopt);
+    const auto else_jump = emit(RegOpCode::JumpIfFalse, condition);
+    const auto reg = target(dest);
+    ++scope().m_block_depth;
+    compile_block(expr.m_consequence->m_statements, reg, true);
+    const auto end_jump = emit(RegOpCode::Jump);
+    scope().m_code[else_jump].b = static_cast<std::uint16_t>(scope().m_code.size());
+    if (expr.m_alternative)
+    {
+        compile_block(expr.m_alternative->m_statements, reg, true);
+    }
+    else
+    {
+        emit(RegOpCode::LoadNull, reg);
+    }
+    --scope().m_block_depth;
+    scope().m_code[end_jump].b = static_cast<std::uint16_t>(scope().m_code.size());
+    return reg;
+}
+
+auto RegisterCompiler::compile_infix(InfixExpression& expr, std::optional<Reg> dest) -> Reg
+{
+    const auto opcode = infix_opcode(expr.m_operator);
+    if (!opcode)
+    {
+        m_errors.push_back(fmt::format("unknown operator {}", to_string(expr.m_operator)));
+        return target(dest);
+    }
+    auto left = compile_operand(expr.m_left.get(), true);
+    if (left < scope().m_local_slots.size() && assigns_locals(expr.m_right.get()))
+    {
+        const auto copy = temp();
+        emit(RegOpCode::Move, copy, left);
+        left = copy;
+    }
+    const auto right = compile_operand(expr.m_right.get(), true);
+    const auto reg = target(dest);
+    emit(*opcode, reg, left, right);
+    return reg;
+}
+
+auto RegisterCompiler::compile_operand(Node* node, bool allow_const) -> Reg
+{
+    if (allow_const && node && node->get_type() == NodeType::IntegerLiteral)
+    {
+        return add_constant(Value::integer(static_cast<IntegerLiteral*>(node)->m_value)) | CONST_OPERAND_BIT;
+    }
+    if (allow_const && node && node->get_type() == NodeType::StringLiteral)
+    {
+        return add_constant(make_ref<StringObj>(static_cast<StringLiteral*>(node)->m_value)) | CONST_OPERAND_BIT;
+    }
+    return compile_expr(node, std::nullopt);
+}
+
+auto RegisterCompiler::compile_operands(const std::vector<Node*>& nodes) -> std::vector<Reg>
+{
+    std::vector<Reg> regs;
+    for (std::size_t i = 0; i < nodes.size(); ++i)
+    {
+        auto reg = compile_expr(nodes[i], std::nullopt);
+        if (reg < scope().m_local_slots.size()
+            && std::any_of(std::begin(nodes) + i + 1, std::end(nodes), [](Node* later)
+                           { return assigns_locals(later); }))
+        {
+            const auto copy = temp();
+            emit(RegOpCode::Move, copy, reg);
+            reg = copy;
+        }
+        regs.push_back(reg);
+    }
+    return regs;
+}
+
+auto RegisterCompiler::compile_expr(Node* node, std::optional<Reg> dest) -> Reg
+{
+    if (!node)
+    {
+        m_errors.push_back("unable to compile empty expression");
+        return target(dest);
+    }
+    switch (node->get_type())
+    {
+    case NodeType::IntegerLiteral:
+    {
+        const auto reg = target(dest);
+        emit(RegOpCode::LoadConst, reg, add_constant(Value::integer(static_cast<IntegerLiteral*>(node)->m_value)));
+        return reg;
+    }
+    case NodeType::StringLiteral:
+    {
+        const auto reg = target(dest);
+        emit(RegOpCode::LoadConst, reg, add_constant(make_ref<StringObj>(static_cast<StringLiteral*>(node)->m_value)));
+        return reg;
+    }
+    case NodeType::BooleanLiteral:
+    {
+        const auto reg = target(dest);
+        emit(RegOpCode::LoadBool, reg, static_cast<BooleanLiteral*>(node)->m_value ? 1 : 0);
+        return reg;
+    }
+    case NodeType::Identifier:
+    {
+        return compile_identifier(static_cast<Identifier*>(node)->m_value, dest);
+    }
+    case NodeType::PrefixExpression:
+    {
+        auto* nd = static_cast<PrefixExpression*>(node);
+        const auto right = compile_expr(nd->m_right.get(), std::nullopt);
+        const auto reg = target(dest);
+        if (nd->m_operator == Operator::Bang)
+        {
+            emit(RegOpCode::Bang, reg, right);
+        }
+        else if (nd->m_operator == Operator::Minus)
+        {
+            emit(RegOpCode::Minus, reg, right);
+        }
+        else
+        {
+            m_errors.push_back(fmt::format("unknown operator {}", to_string(nd->m_operator)));
+        }
+        return reg;
+    }
+    case NodeType::InfixExpression:
+    {
+        return compile_infix(*static_cast<InfixExpression*>(node), dest);
+    }
+    case NodeType::IfExpression:
+    {
+        return compile_if(*static_cast<IfExpression*>(node), dest);
+    }
+    case NodeType::FnLiteral:
+    {
+        return compile_fn(*static_cast<FnLiteral*>(node), {}, dest);
+    }
+    case NodeType::CallExpression:
+    {
+        return compile_call(*static_cast<CallExpression*>(node), dest, RegOpCode::Call);
+    }
+    case NodeType::ArrayLiteral:
+    {
+        auto* nd = static_cast<ArrayLiteral*>(node);
+        std::vector<Node*> operands;
+        for (const auto& expr : nd->m_expressions)
+        {
+            operands.push_back(expr.get());
+        }
+        const auto regs = compile_operands(operands);
+        const auto reg = target(dest);
+        emit(RegOpCode::Array, reg, static_cast<std::uint16_t>(regs.size()));
+        emit_args(regs);
+        return reg;
+    }
+    case NodeType::HashLiteral:
+    {
+        auto* nd = static_cast<HashLiteral*>(node);
+        std::vector<Node*> operands;
+        for (const auto& [key, val] : nd->m_pairs)
+        {
+            operands.push_back(key.get());
+            operands.push_back(val.get());
+        }
+        const auto regs = compile_operands(operands);
+        const auto reg = target(dest);
+        emit(RegOpCode::Hash, reg, static_cast<std::uint16_t>(regs.size()));
+        emit_args(regs);
+        return reg;
+    }
+    case NodeType::IndexExpression:
+    {
+        auto* nd = static_cast<IndexExpression*>(node);
+        auto left = compile_operand(nd->m_left.get(), false);
+        if (left < scope().m_local_slots.size() && assigns_locals(nd->m_index.get()))
+        {
+            const auto copy = temp();
+            emit(RegOpCode::Move, copy, left);
+            left = copy;
+        }
+        const auto index = compile_operand(nd->m_index.get(), true);
+        const auto reg = target(dest);
+        emit(RegOpCode::Index, reg, left, index);
+        return reg;
+    }
+    default:
+    {
+        const auto value = compile_statement(static_cast<Statement*>(node), dest, true);
+        return value ? *value : target(dest);
+    }
+    }
+}
+
+// A let whose value is a call compiles it to a RebindingCall.
+auto RegisterCompiler::compile_call(CallExpression& expr, std::optional<Reg> dest, RegOpCode op) -> Reg
+{
+    std::vector<Node*> operands{expr.m_function.get()};
+    for (const auto& arg : expr.m_arguments)
+    {
+        operands.push_back(arg.get());
+    }
+    const auto regs = compile_operands(operands);
+    const auto reg = target(dest);
+    emit(op, reg, regs.front(), static_cast<std::uint16_t>(regs.size() - 1));
+    emit_args({std::next(std::begin(regs)), std::end(regs)});
+    return reg;
+}
+
+auto RegisterCompiler::compile_identifier(std::string_view name, std::optional<Reg> dest) -> Reg
+{
+    return load_symbol(resolve(name, m_scopes.size() - 1), name, dest);
+}
+
+auto RegisterCompiler::load_symbol(const RegSymbol& symbol, std::string_view name, std::optional<Reg> dest) -> Reg
+{
+    switch (symbol.scope)
+    {
+    case SymbolScope::Local:
+    {
+        const auto local = static_cast<Reg>(symbol.index);
+        if (symbol.maybe_unset)
+        {
+            const auto reg = target(dest);
+            emit(RegOpCode::GetLocal, reg, local);
+            return reg;
+        }
+        if (dest && *dest != local)
+        {
+            emit(RegOpCode::Move, *dest, local);
+            return *dest;
+        }
+        return local;
+    }
+    case SymbolScope::Global:
+    {
+        const auto reg = target(dest);
+        emit(RegOpCode::GetGlobal, reg, add_name(name));
+        return reg;
+    }
+    case SymbolScope::Free:
+    {
+        const auto reg = target(dest);
+        emit(RegOpCode::GetFree, reg, static_cast<std::uint16_t>(symbol.index));
+        return reg;
+    }
+    case SymbolScope::Function:
+    {
+        const auto reg = target(dest);
+        emit(RegOpCode::CurrentClosure, reg);
+        return reg;
+    }
+    }
+    return target(dest);
+}
+
+auto RegisterCompiler::compile_fn(FnLiteral& fn, std::string_view self_name, std::optional<Reg> dest) -> Reg
+{
+    enter_scope(&fn);
+    scope().m_self_name = self_name;
+    for (const auto& param : fn.m_parameters)
+    {
+        define(param->m_value);
+    }
+    const auto value = compile_block(fn.m_body->m_statements, std::nullopt, true);
+    emit(RegOpCode::Return, *value);
+    mark_tail_calls(scope().m_code);
+    resolve_fallbacks(fn.m_parameters.size());
+
+    auto fn_scope = leave_scope();
+    std::size_t num_registers = 0;
+    allocate_registers(fn_scope, num_registers);
+
+    auto compiled = make_ref<RegisterFnObj>(std::move(fn_scope.m_code),
+                                            std::move(fn_scope.m_constants),
+                                            std::move(fn_scope.m_names),
+                                            std::move(fn_scope.m_local_names),
+                                            fn.m_parameters.size(),
+                                            num_registers,
+                                            std::move(fn_scope.m_captures),
+                                            std::move(fn_scope.m_local_fallbacks));
+    const auto reg = target(dest);
+    emit(RegOpCode::Closure, reg, add_constant(std::move(compiled)));
+    return reg;
+}
+
+auto RegisterCompiler::emit(RegOpCode op, std::uint16_t a, std::uint16_t b, std::uint16_t c) -> std::size_t
+{
+    auto& code = scope().m_code;
+    if (code.size() >= MAX_U16_OPERAND)
+    {
+        m_errors.push_back(fmt::format("function body exceeds {} instructions", MAX_U16_OPERAND));
+    }
+    code.push_back(RegInstruction{op, a, b, c});
+    return code.size() - 1;
+}
+
+// Temporaries are dead once passed, so an Arg marks them for the VM to move from.
+void RegisterCompiler::emit_args(const std::vector<Reg>& regs)
+{
+    for (const auto reg : regs)
+    {
+        emit(RegOpCode::Arg, reg, reg >= scope().m_local_slots.size() ? 1 : 0);
+    }
+}
+
+auto RegisterCompiler::temp() -> Reg
+{
+    auto& curr = scope();
+    if (curr.m_next_temp >= MAX_REGISTERS)
+    {
+        m_errors.push_back("expression requires too many temporaries");
+        return 0;
+    }
+    curr.m_num_temps = std::max(curr.m_num_temps, curr.m_next_temp + 1);
+    return static_cast<Reg>(curr.m_next_temp++);
+}
+
+auto RegisterCompiler::target(std::optional<Reg> dest) -> Reg
+{
+    return dest ? *dest : temp();
+}
+
+auto RegisterCompiler::add_constant(Value obj) -> Reg
+{
+    auto& constants = scope().m_constants;
+    constants.push_back(std::move(obj));
+    if (constants.size() >= CONST_OPERAND_BIT)
+    {
+        m_errors.push_back(fmt::format("constant pool exceeds {} entries", CONST_OPERAND_BIT));
+    }
+    return static_cast<Reg>(constants.size() - 1);
+}
+
+auto RegisterCompiler::add_name(std::string_view name) -> Reg
+{
+    auto& curr = scope();
+    if (const auto it = curr.m_name_indices.find(name); it != std::end(curr.m_name_indices))
+    {
+        return static_cast<Reg>(it->second);
+    }
+    curr.m_names.push_back(Atom::intern(name));
+    curr.m_name_indices.emplace(std::string(name), curr.m_names.size() - 1);
+    return static_cast<Reg>(curr.m_names.size() - 1);
+}
+
+void RegisterCompiler::define(std::string_view name)
+{
+    auto& curr = scope();
+    const auto slot = curr.m_local_slots.at(std::string(name));
+    const bool maybe_unset = curr.m_block_depth > 0;
+    if (const auto it = curr.m_symbols.find(name); it != std::end(curr.m_symbols) && it->second.scope == SymbolScope::Local)
+    {
+        it->second.maybe_unset = it->second.maybe_unset && maybe_unset;
+        return;
+    }
+    curr.m_symbols.insert_or_assign(std::string(name), RegSymbol{SymbolScope::Local, slot, maybe_unset});
+}
+
+auto RegisterCompiler::resolve(std::string_view name, std::size_t level) -> RegSymbol
+{
+    if (level == 0)
+    {
+        return RegSymbol{SymbolScope::Global, 0, false};
+    }
+    auto& curr = m_scopes[level];
+    if (const auto it = curr.m_symbols.find(name); it != std::end(curr.m_symbols))
+    {
+        return it->second;
+    }
+    // Unset locals read the enclosing binding, see fallback().
+    if (const auto it = curr.m_local_slots.find(name); it != std::end(curr.m_local_slots))
+    {
+        return RegSymbol{SymbolScope::Local, it->second, true};
+    }
+    if (level + 1 == m_scopes.size() && !curr.m_self_name.empty() && curr.m_self_name == name)
+    {
+        return RegSymbol{SymbolScope::Function, 0, false};
+    }
+    const auto outer = resolve(name, level - 1);
+    if (outer.scope == SymbolScope::Global)
+    {
+        return outer;
+    }
+    curr.m_captures.push_back(Capture{outer.scope == SymbolScope::Local, outer.index, std::string(name)});
+    const RegSymbol symbol{SymbolScope::Free, curr.m_captures.size() - 1, false};
+    curr.m_symbols.emplace(std::string(name), symbol);
+    return symbol;
+}
+
+// Enclosing binding of name as an upvalue of the function at level, or Capture::GLOBAL.
+auto RegisterCompiler::fallback(std::size_t level, const RegSymbol& symbol, std::string_view name) -> std::size_t
+{
+    auto outer = RegSymbol{SymbolScope::Global, 0, false};
+    if (symbol.scope == SymbolScope::Local)
+    {
+        outer = resolve(name, level - 1);
+    }
+    else if (symbol.scope == SymbolScope::Free)
+    {
+        const auto& capture = m_scopes[level].m_captures[symbol.index];
+        const auto captured = RegSymbol{capture.m_local ? SymbolScope::Local : SymbolScope::Free, capture.m_index, false};
+        if (const auto index = fallback(level - 1, captured, name); index != Capture::GLOBAL)
+        {
+            outer = RegSymbol{SymbolScope::Free, index, false};
+        }
+    }
+    if (outer.scope == SymbolScope::Global)
+    {
+        return Capture::GLOBAL;
+    }
+    auto& captures = m_scopes[level].m_captures;
+    const auto is_local = outer.scope == SymbolScope::Local;
+    const auto it = std::find_if(std::begin(captures), std::end(captures), [&](const Capture& capture)
+                                 { return capture.m_local == is_local && capture.m_index == outer.index; });
+    if (it != std::end(captures))
+    {
+        return static_cast<std::size_t>(it - std::begin(captures));
+    }
+    captures.push_back(Capture{is_local, outer.index, std::string(name)});
+    return captures.size() - 1;
+}
+
+void RegisterCompiler::resolve_fallbacks(std::size_t num_parameters)
+{
+    const auto level = m_scopes.size() - 1;
+    auto& curr = scope();
+    curr.m_local_fallbacks.resize(curr.m_local_names.size(), Capture::GLOBAL);
+    for (std::size_t i = num_parameters; i < curr.m_local_names.size(); ++i)
+    {
+        const auto name = curr.m_local_names[i];
+        curr.m_local_fallbacks[i] = fallback(level, RegSymbol{SymbolScope::Local, i, true}, name);
+    }
+    // Resolving fallbacks can add upvalues, which need fallbacks of their own.
+    for (std::size_t i = 0; i < curr.m_captures.size(); ++i)
+    {
+        const auto name = curr.m_captures[i].m_name;
+        curr.m_captures[i].m_fallback = fallback(level, RegSymbol{SymbolScope::Free, i, false}, name);
+    }
+}
+
+auto RegisterCompiler::scope() -> FunctionScope&
+{
+    return m_scopes.back();
+}
+
+void RegisterCompiler::enter_scope(const FnLiteral* fn)
+{
+    auto& curr = m_scopes.emplace_back();
+    if (!fn)
+    {
+        return;
+    }
+    std::vector<std::string> names;
+    for (const auto& param : fn->m_parameters)
+    {
+        names.emplace_back(param->m_value.view());
+    }
+    collect_let_names(fn->m_body.get(), names);
+    for (auto& name : names)
+    {
+        if (!curr.m_local_slots.contains(name))
+        {
+            curr.m_local_slots.emplace(name, static_cast<Reg>(curr.m_local_names.size()));
+            curr.m_local_names.push_back(std::move(name));
+        }
+    }
+    curr.m_next_temp = curr.m_local_names.size();
+    curr.m_num_temps = curr.m_next_temp;
+}
+
+auto RegisterCompiler::leave_scope() -> FunctionScope
+{
+    auto last = std::move(m_scopes.back());
+    m_scopes.pop_back();
+    return last;
+}
+
+void RegisterCompiler::allocate_registers(FunctionScope& fn_scope, std::size_t& num_registers)
+{
+    struct Interval
+    {
+        std::size_t start = std::numeric_limits<std::size_t>::max();
+        std::size_t end = 0;
+    };
+
+    const auto num_locals = fn_scope.m_local_names.size();
+    std::vector<Interval> intervals(fn_scope.m_num_temps - num_locals);
+    const auto visit_operands = [&fn_scope, num_locals](auto&& callable)
+    {
+        for (std::size_t pc = 0; pc < fn_scope.m_code.size(); ++pc)
+        {
+            auto& ins = fn_scope.m_code[pc];
+            const auto& def = lookup(ins.op);
+            for (auto [kind, operand] : {std::make_pair(def.operands[0], &ins.a), std::make_pair(def.operands[1], &ins.b), std::make_pair(def.operands[2], &ins.c)})
+            {
+                const bool is_reg = kind == OperandKind::RegDef || kind == OperandKind::RegUse || (kind == OperandKind::RegOrConst && !(*operand & CONST_OPERAND_BIT));
+                if (is_reg && *operand >= num_locals)
+                {
+                    callable(pc, *operand);
+                }
+            }
+        }
+    };
+    visit_operands([&intervals, num_locals](std::size_t pc, std::uint16_t& operand)
+                   {
+        auto& interval = intervals[operand - num_locals];
+        interval.start = std::min(interval.start, pc);
+        interval.end = std::max(interval.end, pc); });
+
+    std::vector<std::size_t> order(intervals.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(std::begin(order), std::end(order), [&intervals](std::size_t lhs, std::size_t rhs)
+              { return intervals[lhs].start < intervals[rhs].start; });
+
+    std::vector<std::uint16_t> assignment(intervals.size());
+    std::set<std::uint16_t> free_regs;
+    std::vector<std::pair<std::size_t, std::uint16_t>> active;
+    std::size_t next_reg = num_locals;
+    for (const auto vreg : order)
+    {
+        const auto& interval = intervals[vreg];
+        if (interval.start > interval.end)
+        {
+            continue;
+        }
+        std::erase_if(active, [&free_regs, &interval](const auto& entry)
+                      {
+            if (entry.first <= interval.start)
+            {
+                free_regs.insert(entry.second);
+                return true;
+            }
+            return false; });
+        std::uint16_t reg;
+        if (free_regs.empty())
+        {
+            reg = static_cast<std::uint16_t>(next_reg++);
+        }
+        else
+        {
+            reg = *std::begin(free_regs);
+            free_regs.erase(std::begin(free_regs));
+        }
+        assignment[vreg] = reg;
+        active.emplace_back(interval.end, reg);
+    }
+    visit_operands([&assignment, num_locals](std::size_t, std::uint16_t& operand)
+                   { operand = assignment[operand - num_locals]; });
+    num_registers = next_reg;
+}
+}  // namespace mlang
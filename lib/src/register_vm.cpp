@@ -0,0 +1,537 @@
+#include <mlang/dispatch.hpp>
+#include <mlang/eval.hpp>
+#include <mlang/feedback.hpp>
+#include <mlang/raii_wrapper.hpp>
+#include <mlang/register_vm.hpp>
+
+namespace mlang
+{
+namespace
+{
+auto infix_operator(RegOpCode op) -> std::optional<Operator>
+{
+    switch (op)
+    {
+    case RegOpCode::Add:
+        return Operator::Plus;
+    case RegOpCode::Sub:
+        return Operator::Minus;
+    case RegOpCode::Mul:
+        return Operator::Multiply;
+    case RegOpCode::Div:
+        return Operator::Divide;
+    case RegOpCode::Equal:
+        return Operator::Equal;
+    case RegOpCode::NotEqual:
+        return Operator::NotEqual;
+    case RegOpCode::GreaterThan:
+        return Operator::Greater;
+    case RegOpCode::LessThan:
+        return Operator::Less;
+    default:
+        return std::nullopt;
+    }
+}
+
+auto eval_binary(RegOpCode op, const Value& left, const Value& right) -> Value
+{
+    if (left.is_integer() && right.is_integer())
+    {
+        const auto left_val = left.as_integer();
+        const auto right_val = right.as_integer();
+        switch (op)
+        {
+        case RegOpCode::Add:
+            return Value::integer(left_val + right_val);
+        case RegOpCode::Sub:
+            return Value::integer(left_val - right_val);
+        case RegOpCode::Mul:
+            return Value::integer(left_val * right_val);
+        case RegOpCode::Equal:
+            return left_val == right_val ? detail::TRUE : detail::FALSE;
+        case RegOpCode::NotEqual:
+            return left_val != right_val ? detail::TRUE : detail::FALSE;
+        case RegOpCode::GreaterThan:
+            return left_val > right_val ? detail::TRUE : detail::FALSE;
+        case RegOpCode::LessThan:
+            return left_val < right_val ? detail::TRUE : detail::FALSE;
+        default:
+            break;
+        }
+    }
+    if (const auto oper = infix_operator(op))
+    {
+        return detail::eval_infix_expression(*oper, left, right);
+    }
+    return make_ref<ErrorObj>(fmt::format("unknown operator {}", op));
+}
+
+auto is_error(const Value& obj) -> bool
+{
+    return obj.get_type() == ObjectType::ERROR;
+}
+}  // namespace
+
+RegisterVm::RegisterVm(const Ref<Context>& env, std::size_t max_call_depth)
+    : m_env(env)
+    , m_max_call_depth(max_call_depth)
+{
+}
+
+auto RegisterVm::run(const Ref<RegisterFnObj>& main) -> Value
+{
+    if (main->m_code.empty())
+    {
+        return nullptr;
+    }
+    m_registers.assign(main->m_num_registers, nullptr);
+    m_frames.clear();
+    m_frames.push_back(Frame{make_ref<RegisterClosureObj>(main, std::vector<Ref<Upvalue>>{}), 0, 0, 0});
+    const auto close_all = RaiiWrapper([this]()
+                                       { close_upvalues(0); });
+
+#if MLANG_THREADED_DISPATCH
+    static const void* const LABELS[] = {
+        &&op_LoadConst,
+        &&op_LoadBool,
+        &&op_LoadNull,
+        &&op_Move,
+        &&op_Add,
+        &&op_Sub,
+        &&op_Mul,
+        &&op_Div,
+        &&op_Equal,
+        &&op_NotEqual,
+        &&op_GreaterThan,
+        &&op_LessThan,
+        &&op_Minus,
+        &&op_Bang,
+        &&op_Jump,
+        &&op_JumpIfFalse,
+        &&op_GetGlobal,
+        &&op_SetGlobal,
+        &&op_GetLocal,
+        &&op_GetFree,
+        &&op_CurrentClosure,
+        &&op_Array,
+        &&op_Hash,
+        &&op_Index,
+        &&op_Call,
+        &&op_TailCall,
+        &&op_RebindingCall,
+        &&op_Return,
+        &&op_Closure,
+        &&op_Arg,
+    };
+    static_assert(std::size(LABELS) == static_cast<std::size_t>(RegOpCode::Arg) + 1);
+    const void* const* handlers = nullptr;
+// Handler bodies are blocks that close before VM_NEXT(), see Vm::run().
+#define VM_LABEL(name) op_##name:
+#define VM_CASE(name) op_##name : if (constexpr bool vm_in_handler = true; vm_in_handler)
+#define VM_NEXT()         \
+    ins = code[pc];      \
+    goto* handlers[pc++]; \
+    static_assert(!vm_in_handler, "dispatch after the handler block")
+#else
+#define VM_LABEL(name) case RegOpCode::name:
+#define VM_CASE(name) case RegOpCode::name : if (constexpr bool vm_in_handler = true; vm_in_handler)
+#define VM_NEXT() \
+    break;        \
+    static_assert(!vm_in_handler, "dispatch after the handler block")
+#endif
+    [[maybe_unused]] constexpr bool vm_in_handler = false;
+
+    Frame* frame = nullptr;
+    const RegisterFnObj* fn = nullptr;
+    const RegInstruction* code = nullptr;
+    Value* regs = nullptr;
+    std::size_t pc = 0;
+    RegInstruction ins{};
+    const auto reload = [&]()
+    {
+        frame = &m_frames.back();
+        fn = frame->m_closure->m_fn.get();
+        code = fn->m_code.data();
+        regs = m_registers.data() + frame->m_base;
+        pc = frame->m_pc;
+#if MLANG_THREADED_DISPATCH
+        auto& linked = frame->m_closure->m_fn->m_handlers;
+        if (linked.empty())
+        {
+            linked.reserve(fn->m_code.size());
+            for (const auto& instruction : fn->m_code)
+            {
+                linked.push_back(LABELS[static_cast<std::size_t>(instruction.op)]);
+            }
+        }
+        handlers = linked.data();
+#endif
+    };
+    const auto operand = [&](std::uint16_t reg_or_const) -> const Value&
+    {
+        if (reg_or_const & CONST_OPERAND_BIT)
+        {
+            return fn->m_constants[reg_or_const & ~CONST_OPERAND_BIT];
+        }
+        return regs[reg_or_const];
+    };
+    const auto collect_args = [&](std::size_t count)
+    {
+        std::vector<Value> args;
+        args.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            // Temporaries are marked by the compiler and dead after the call.
+            auto& arg = regs[code[pc + i].a];
+            if (code[pc + i].b)
+            {
+                args.push_back(std::move(arg));
+            }
+            else
+            {
+                args.push_back(arg);
+            }
+        }
+        pc += count;
+        return args;
+    };
+    reload();
+
+#if MLANG_THREADED_DISPATCH
+    VM_NEXT();
+#else
+    while (true)
+    {
+        ins = code[pc++];
+        switch (ins.op)
+        {
+#endif
+        VM_CASE(LoadConst)
+        {
+            regs[ins.a] = fn->m_constants[ins.b];
+        }
+        VM_NEXT();
+        VM_CASE(LoadBool)
+        {
+            regs[ins.a] = ins.b ? detail::TRUE : detail::FALSE;
+        }
+        VM_NEXT();
+        VM_CASE(LoadNull)
+        {
+            regs[ins.a] = detail::NIL;
+        }
+        VM_NEXT();
+        VM_CASE(Move)
+        {
+            regs[ins.a] = regs[ins.b];
+        }
+        VM_NEXT();
+        VM_LABEL(Add)
+        VM_LABEL(Sub)
+        VM_LABEL(Mul)
+        VM_LABEL(Div)
+        VM_LABEL(Equal)
+        VM_LABEL(NotEqual)
+        VM_LABEL(GreaterThan)
+        VM_CASE(LessThan)
+        {
+            auto res = eval_binary(ins.op, operand(ins.b), operand(ins.c));
+            if (is_error(res))
+            {
+                return res;
+            }
+            regs[ins.a] = std::move(res);
+        }
+        VM_NEXT();
+        VM_CASE(Minus)
+        {
+            auto res = detail::eval_minus_prefix_operator(regs[ins.b]);
+            if (is_error(res))
+            {
+                return res;
+            }
+            regs[ins.a] = std::move(res);
+        }
+        VM_NEXT();
+        VM_CASE(Bang)
+        {
+            regs[ins.a] = detail::eval_bang_expression(regs[ins.b]);
+        }
+        VM_NEXT();
+        VM_CASE(Jump)
+        {
+            pc = ins.b;
+        }
+        VM_NEXT();
+        VM_CASE(JumpIfFalse)
+        {
+            if (!detail::is_truth(regs[ins.a]))
+            {
+                pc = ins.b;
+            }
+        }
+        VM_NEXT();
+        VM_CASE(GetGlobal)
+        {
+            auto res = load_global(fn->m_names[ins.b]);
+            if (is_error(res))
+            {
+                return res;
+            }
+            regs[ins.a] = std::move(res);
+        }
+        VM_NEXT();
+        VM_CASE(SetGlobal)
+        {
+            m_env->set_obj(fn->m_names[ins.b], regs[ins.a]);
+        }
+        VM_NEXT();
+        VM_CASE(GetLocal)
+        {
+            if (const auto& value = regs[ins.b])
+            {
+                regs[ins.a] = value;
+            }
+            else
+            {
+                auto fallback = load_unset(*frame->m_closure, fn->m_local_fallbacks[ins.b], fn->m_local_names[ins.b]);
+                if (is_error(fallback))
+                {
+                    return fallback;
+                }
+                regs[ins.a] = std::move(fallback);
+            }
+        }
+        VM_NEXT();
+        VM_CASE(GetFree)
+        {
+            if (const auto& value = frame->m_closure->m_free[ins.b]->get(m_registers))
+            {
+                regs[ins.a] = value;
+            }
+            else
+            {
+                auto fallback = load_unset(*frame->m_closure, fn->m_captures[ins.b].m_fallback, fn->m_captures[ins.b].m_name);
+                if (is_error(fallback))
+                {
+                    return fallback;
+                }
+                regs[ins.a] = std::move(fallback);
+            }
+        }
+        VM_NEXT();
+        VM_CASE(CurrentClosure)
+        {
+            regs[ins.a] = frame->m_closure;
+        }
+        VM_NEXT();
+        VM_CASE(Array)
+        {
+            regs[ins.a] = make_ref<ArrayObj>(collect_args(ins.b));
+        }
+        VM_NEXT();
+        VM_CASE(Hash)
+        {
+            auto hash = make_ref<HashObj>();
+            for (std::size_t i = 0; i < ins.b; i += 2)
+            {
+                hash->m_pairs.set(regs[code[pc + i].a], regs[code[pc + i + 1].a]);
+            }
+            pc += ins.b;
+            regs[ins.a] = std::move(hash);
+        }
+        VM_NEXT();
+        VM_CASE(Index)
+        {
+            const Value* cached = nullptr;
+            if (ins.c & CONST_OPERAND_BIT)
+            {
+                const auto& key = fn->m_constants[ins.c & ~CONST_OPERAND_BIT];
+                if (key.get_type() == ObjectType::STRING && !key.as<StringObj>().atom().empty())
+                {
+                    auto& caches = frame->m_closure->m_fn->m_shape_caches;
+                    if (caches.empty())
+                    {
+                        caches.resize(fn->m_code.size());
+                    }
+                    cached = detail::find_by_shape(caches[pc - 1], regs[ins.b], key.as<StringObj>().atom());
+                }
+            }
+            if (cached)
+            {
+                regs[ins.a] = *cached;
+            }
+            else
+            {
+                auto res = detail::eval_index_expression(regs[ins.b], operand(ins.c));
+                if (is_error(res))
+                {
+                    return res;
+                }
+                regs[ins.a] = std::move(res);
+            }
+        }
+        VM_NEXT();
+        VM_LABEL(TailCall)
+        VM_LABEL(RebindingCall)
+        VM_CASE(Call)
+        {
+            const auto callee_type = regs[ins.b].get_type();
+            if (callee_type == ObjectType::REGISTER_CLOSURE)
+            {
+                auto closure = regs[ins.b].cast<RegisterClosureObj>();
+                const auto& callee_fn = *closure->m_fn;
+                if (callee_fn.m_num_parameters != ins.c)
+                {
+                    return make_ref<ErrorObj>(fmt::format("invalid number of args expected {} got {}", callee_fn.m_num_parameters, ins.c));
+                }
+                if (ins.op == RegOpCode::TailCall)
+                {
+                    // The callee takes over the registers of the running frame.
+                    auto args = collect_args(ins.c);
+                    close_upvalues(frame->m_base);
+                    m_registers.resize(frame->m_base);
+                    m_registers.resize(frame->m_base + callee_fn.m_num_registers);
+                    std::move(std::begin(args), std::end(args), std::begin(m_registers) + frame->m_base);
+                    frame->m_closure = std::move(closure);
+                    frame->m_pc = 0;
+                }
+                else if (m_frames.size() > m_max_call_depth)
+                {
+                    return detail::stack_overflow_error(m_max_call_depth);
+                }
+                else
+                {
+                    const auto base = frame->m_base + fn->m_num_registers;
+                    m_registers.resize(base + callee_fn.m_num_registers);
+                    regs = m_registers.data() + frame->m_base;
+                    for (std::size_t i = 0; i < ins.c; ++i)
+                    {
+                        m_registers[base + i] = regs[code[pc + i].a];
+                    }
+                    frame->m_pc = pc + ins.c;
+                    m_frames.push_back(Frame{std::move(closure), 0, base, ins.a});
+                }
+                reload();
+            }
+            else
+            {
+                Value res;
+                if (callee_type == ObjectType::BUILTIN)
+                {
+                    // The rebound variable does not keep the first argument alive.
+                    Value* binding = nullptr;
+                    if (ins.op == RegOpCode::RebindingCall)
+                    {
+                        const auto& next = code[pc + ins.c];
+                        binding = next.op == RegOpCode::SetGlobal ? m_env->find_binding(fn->m_names[next.b]) : &regs[ins.a];
+                    }
+                    res = detail::call_rebinding_builtin(regs[ins.b].as<BuiltInObj>(), collect_args(ins.c), binding);
+                }
+                else if (callee_type == ObjectType::FUNCTION)
+                {
+                    res = detail::apply_function(regs[ins.b].cast<FunctionObj>(), collect_args(ins.c));
+                }
+                else
+                {
+                    return make_ref<ErrorObj>(fmt::format("not a function: {}", callee_type));
+                }
+                if (is_error(res))
+                {
+                    return res;
+                }
+                regs[ins.a] = std::move(res);
+            }
+        }
+        VM_NEXT();
+        VM_CASE(Return)
+        {
+            auto res = regs[ins.a];
+            if (m_frames.size() == 1)
+            {
+                return res;
+            }
+            const auto result_reg = frame->m_result;
+            const auto base = frame->m_base;
+            close_upvalues(base);
+            m_frames.pop_back();
+            m_registers.resize(base);
+            reload();
+            regs[result_reg] = std::move(res);
+        }
+        VM_NEXT();
+        VM_CASE(Closure)
+        {
+            const auto& compiled = fn->m_constants[ins.b];
+            std::vector<Ref<Upvalue>> free;
+            free.reserve(compiled.as<RegisterFnObj>().m_captures.size());
+            for (const auto& capture : compiled.as<RegisterFnObj>().m_captures)
+            {
+                free.push_back(capture.m_local ? capture_upvalue(frame->m_base + capture.m_index) : frame->m_closure->m_free[capture.m_index]);
+            }
+            regs[ins.a] = make_ref<RegisterClosureObj>(compiled.cast<RegisterFnObj>(), std::move(free));
+        }
+        VM_NEXT();
+        VM_CASE(Arg)
+        {
+        }
+        VM_NEXT();
+#if !MLANG_THREADED_DISPATCH
+        }
+    }
+#endif
+#undef VM_LABEL
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+auto RegisterVm::capture_upvalue(std::size_t slot) -> Ref<Upvalue>
+{
+    auto it = std::end(m_open_upvalues);
+    while (it != std::begin(m_open_upvalues) && (*std::prev(it))->m_slot >= slot)
+    {
+        --it;
+        if ((*it)->m_slot == slot)
+        {
+            return *it;
+        }
+    }
+    return *m_open_upvalues.insert(it, make_ref<Upvalue>(slot));
+}
+
+void RegisterVm::close_upvalues(std::size_t first_slot)
+{
+    while (!m_open_upvalues.empty() && m_open_upvalues.back()->m_slot >= first_slot)
+    {
+        m_open_upvalues.back()->close(m_registers);
+        m_open_upvalues.pop_back();
+    }
+}
+
+// An unset variable reads the binding it shadows.
+auto RegisterVm::load_unset(const RegisterClosureObj& closure, std::size_t fallback, std::string_view name) -> Value
+{
+    while (fallback != Capture::GLOBAL)
+    {
+        if (const auto& value = closure.m_free[fallback]->get(m_registers))
+        {
+            return value;
+        }
+        fallback = closure.m_fn->m_captures[fallback].m_fallback;
+    }
+    return load_global(Atom::intern(name));
+}
+
+auto RegisterVm::load_global(Atom name) -> Value
+{
+    if (auto val = m_env->get_obj(name))
+    {
+        return val;
+    }
+    if (const auto it = detail::BUILTINS.find(name); it != std::end(detail::BUILTINS))
+    {
+        return it->second;
+    }
+    return make_ref<ErrorObj>(fmt::format("identifier not found: {}", name));
+}
+}  // namespace mlang
@@ -6,21 +6,21 @@
 
 namespace mlang
 {
-void repl_interactive()
+void repl_interactive(Engine engine)
 {
     fmt::print(">> ");
-    auto env = std::make_shared<Context>();
+    auto env = make_ref<Context>();
     std::string input;
     while (std::getline(std::cin, input))
     {
-        detail::exec(input, env);
+        detail::exec(input, env, engine);
         fmt::print(">> ");
     }
 }
 
 namespace detail
 {
-void exec(std::string_view input, const std::shared_ptr<Context>& env)
+void exec(std::string_view input, const Ref<Context>& env, Engine engine)
 {
     Parser parser(std::make_unique<Lexer>(input));
     const auto program = parser.parse_program();
@@ -31,10 +31,10 @@ void exec(std::string_view input, const std::shared_ptr<Context>& env)
         fmt::println("  parser errors:\n      {}", fmt::join(errors, "\n      "));
         return;
     }
-    const auto evaluated = eval(program.get(), env);
+    const auto evaluated = eval(program.get(), env, engine);
     if (evaluated)
     {
-        fmt::println("{}", evaluated->inspect());
+        fmt::println("{}", evaluated.inspect());
     }
 }
 }  // namespace detail
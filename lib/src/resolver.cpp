@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <mlang/eval.hpp>
+#include <mlang/resolver.hpp>
+
+namespace mlang
+{
+namespace
+{
+class Resolver
+{
+public:
+    void resolve(Node* node)
+    {
+        if (!node)
+        {
+            return;
+        }
+        const auto node_type = node->get_type();
+        if (node_type == NodeType::FnLiteral)
+        {
+            resolve_fn(*static_cast<FnLiteral*>(node));
+            return;
+        }
+        if (node_type == NodeType::Identifier)
+        {
+            resolve_identifier(*static_cast<Identifier*>(node));
+            return;
+        }
+        if (node_type == NodeType::LetStatement)
+        {
+            auto& let = *static_cast<LetStatement*>(node);
+            if (!m_scopes.empty())
+            {
+                let.m_name->m_address = LexicalAddress{0, *find(m_scopes.back(), let.m_name->m_value)};
+            }
+        }
+        detail::for_each_child(node, [this](Node* child)
+                               { resolve(child); });
+    }
+
+private:
+    void resolve_fn(FnLiteral& fn)
+    {
+        auto& names = m_scopes.emplace_back();
+        for (const auto& param : fn.m_parameters)
+        {
+            param->m_address = LexicalAddress{0, declare(names, param->m_value)};
+        }
+        declare_lets(fn.m_body.get(), names);
+        resolve(fn.m_body.get());
+        fn.m_slot_names = std::make_shared<const std::vector<Atom>>(std::move(m_scopes.back()));
+        m_scopes.pop_back();
+    }
+
+    void resolve_identifier(Identifier& ident)
+    {
+        for (std::size_t depth = 0; depth < m_scopes.size(); ++depth)
+        {
+            if (const auto slot = find(m_scopes[m_scopes.size() - 1 - depth], ident.m_value))
+            {
+                ident.m_address = LexicalAddress{depth, *slot};
+                return;
+            }
+        }
+        ident.m_builtin = detail::builtin_index(ident.m_value);
+    }
+
+    void declare_lets(Node* node, std::vector<Atom>& names)
+    {
+        if (!node || node->get_type() == NodeType::FnLiteral)
+        {
+            return;
+        }
+        if (node->get_type() == NodeType::LetStatement)
+        {
+            declare(names, static_cast<LetStatement*>(node)->m_name->m_value);
+        }
+        detail::for_each_child(node, [this, &names](Node* child)
+                               { declare_lets(child, names); });
+    }
+
+    static auto find(const std::vector<Atom>& names, Atom name) -> std::optional<std::size_t>
+    {
+        const auto it = std::find(std::begin(names), std::end(names), name);
+        if (it == std::end(names))
+        {
+            return std::nullopt;
+        }
+        return static_cast<std::size_t>(std::distance(std::begin(names), it));
+    }
+
+    static auto declare(std::vector<Atom>& names, Atom name) -> std::size_t
+    {
+        if (const auto slot = find(names, name))
+        {
+            return *slot;
+        }
+        names.emplace_back(name);
+        return names.size() - 1;
+    }
+
+private:
+    std::vector<std::vector<Atom>> m_scopes;
+};
+}  // namespace
+
+void resolve(Program& program)
+{
+    Resolver().resolve(&program);
+}
+}  // namespace mlang
@@ -0,0 +1,62 @@
+#include <mlang/shape.hpp>
+#include <mutex>
+
+namespace mlang
+{
+namespace
+{
+auto shape_mutex() -> std::mutex&
+{
+    static auto* mutex = new std::mutex;
+    return *mutex;
+}
+}  // namespace
+
+auto Shape::empty() -> const Shape*
+{
+    static const auto* root = new Shape;
+    return root;
+}
+
+auto Shape::add(Atom key) const -> const Shape*
+{
+    const auto find = [this, key]() -> const Shape*
+    {
+        for (const auto* transition = m_transitions.load(std::memory_order_acquire); transition; transition = transition->m_next)
+        {
+            if (transition->m_key == key)
+            {
+                return transition->m_shape;
+            }
+        }
+        return nullptr;
+    };
+    if (const auto* shape = find())
+    {
+        return shape;
+    }
+    const auto lock = std::lock_guard(shape_mutex());
+    if (const auto* shape = find())
+    {
+        return shape;
+    }
+    auto* shape = new Shape;
+    shape->m_keys = m_keys;
+    shape->m_keys.push_back(key);
+    m_transitions.store(new Transition{key, shape, m_transitions.load(std::memory_order_relaxed)}, std::memory_order_release);
+    return shape;
+}
+
+auto Shape::remove(std::size_t slot) const -> const Shape*
+{
+    const auto* shape = empty();
+    for (std::size_t i = 0; i < m_keys.size(); ++i)
+    {
+        if (i != slot)
+        {
+            shape = shape->add(m_keys[i]);
+        }
+    }
+    return shape;
+}
+}  // namespace mlang
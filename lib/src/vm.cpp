@@ -0,0 +1,541 @@
+#include <mlang/dispatch.hpp>
+#include <mlang/eval.hpp>
+#include <mlang/raii_wrapper.hpp>
+#include <mlang/vm.hpp>
+
+namespace mlang
+{
+namespace
+{
+auto infix_operator(OpCode op) -> std::optional<Operator>
+{
+    switch (op)
+    {
+    case OpCode::Add:
+        return Operator::Plus;
+    case OpCode::Sub:
+        return Operator::Minus;
+    case OpCode::Mul:
+        return Operator::Multiply;
+    case OpCode::Div:
+        return Operator::Divide;
+    case OpCode::Equal:
+        return Operator::Equal;
+    case OpCode::NotEqual:
+        return Operator::NotEqual;
+    case OpCode::GreaterThan:
+        return Operator::Greater;
+    case OpCode::LessThan:
+        return Operator::Less;
+    default:
+        return std::nullopt;
+    }
+}
+
+auto eval_binary(OpCode op, const Value& left, const Value& right) -> Value
+{
+    if (left.is_integer() && right.is_integer())
+    {
+        const auto left_val = left.as_integer();
+        const auto right_val = right.as_integer();
+        switch (op)
+        {
+        case OpCode::Add:
+            return Value::integer(left_val + right_val);
+        case OpCode::Sub:
+            return Value::integer(left_val - right_val);
+        case OpCode::Mul:
+            return Value::integer(left_val * right_val);
+        case OpCode::Equal:
+            return left_val == right_val ? detail::TRUE : detail::FALSE;
+        case OpCode::NotEqual:
+            return left_val != right_val ? detail::TRUE : detail::FALSE;
+        case OpCode::GreaterThan:
+            return left_val > right_val ? detail::TRUE : detail::FALSE;
+        case OpCode::LessThan:
+            return left_val < right_val ? detail::TRUE : detail::FALSE;
+        default:
+            break;
+        }
+    }
+    if (const auto oper = infix_operator(op))
+    {
+        return detail::eval_infix_expression(*oper, left, right);
+    }
+    return make_ref<ErrorObj>(fmt::format("unknown operator {}", op));
+}
+
+auto is_error(const Value& obj) -> bool
+{
+    return obj.get_type() == ObjectType::ERROR;
+}
+}  // namespace
+
+Vm::Vm(const Ref<Context>& env, std::size_t max_call_depth)
+    : m_env(env)
+    , m_max_call_depth(max_call_depth)
+{
+}
+
+auto Vm::run(const Ref<CompiledFnObj>& main) -> Value
+{
+    if (main->m_instructions.empty())
+    {
+        return nullptr;
+    }
+    m_stack.clear();
+    m_frames.clear();
+    m_frames.push_back(Frame{make_ref<ClosureObj>(main, std::vector<Ref<Upvalue>>{}), 0, 0});
+    const auto close_all = RaiiWrapper([this]()
+                                       { close_upvalues(0); });
+
+#if MLANG_THREADED_DISPATCH
+    static const void* const LABELS[] = {
+        &&op_Constant,
+        &&op_Pop,
+        &&op_Add,
+        &&op_Sub,
+        &&op_Mul,
+        &&op_Div,
+        &&op_Equal,
+        &&op_NotEqual,
+        &&op_GreaterThan,
+        &&op_LessThan,
+        &&op_Minus,
+        &&op_Bang,
+        &&op_True,
+        &&op_False,
+        &&op_Null,
+        &&op_Jump,
+        &&op_JumpNotTruthy,
+        &&op_GetGlobal,
+        &&op_SetGlobal,
+        &&op_GetLocal,
+        &&op_SetLocal,
+        &&op_GetFree,
+        &&op_CurrentClosure,
+        &&op_Array,
+        &&op_Hash,
+        &&op_Index,
+        &&op_Call,
+        &&op_ReturnValue,
+        &&op_Closure,
+        &&op_TailCall,
+    };
+    static_assert(std::size(LABELS) == static_cast<std::size_t>(OpCode::TailCall) + 1);
+    const void* const* handlers = nullptr;
+// A computed goto skips destructors, so handler bodies close before VM_NEXT().
+#define VM_LABEL(name) op_##name:
+#define VM_CASE(name) op_##name : if (constexpr bool vm_in_handler = true; vm_in_handler)
+#define VM_NEXT()          \
+    goto* handlers[ip++]; \
+    static_assert(!vm_in_handler, "dispatch after the handler block")
+#else
+#define VM_LABEL(name) case OpCode::name:
+#define VM_CASE(name) case OpCode::name : if (constexpr bool vm_in_handler = true; vm_in_handler)
+#define VM_NEXT() \
+    break;        \
+    static_assert(!vm_in_handler, "dispatch after the handler block")
+#endif
+    [[maybe_unused]] constexpr bool vm_in_handler = false;
+
+    Frame* frame = nullptr;
+    const CompiledFnObj* fn = nullptr;
+    const std::uint8_t* code = nullptr;
+    std::size_t ip = 0;
+    const auto reload = [&]()
+    {
+        frame = &m_frames.back();
+        fn = frame->m_closure->m_fn.get();
+        code = fn->m_instructions.data();
+        ip = frame->m_ip;
+#if MLANG_THREADED_DISPATCH
+        auto& linked = frame->m_closure->m_fn->m_handlers;
+        if (linked.empty())
+        {
+            const auto& instructions = fn->m_instructions;
+            linked.assign(instructions.size(), nullptr);
+            for (std::size_t offset = 0; offset < instructions.size();)
+            {
+                const auto& def = lookup(static_cast<OpCode>(instructions[offset]));
+                linked[offset] = LABELS[instructions[offset]];
+                offset += 1;
+                for (std::size_t i = 0; i < def.operand_count; ++i)
+                {
+                    offset += def.operand_widths[i];
+                }
+            }
+        }
+        handlers = linked.data();
+#endif
+    };
+    reload();
+
+#if MLANG_THREADED_DISPATCH
+    VM_NEXT();
+#else
+    while (true)
+    {
+        switch (static_cast<OpCode>(code[ip++]))
+        {
+#endif
+        VM_CASE(Constant)
+        {
+            m_stack.push_back(fn->m_constants[read_u32(code + ip)]);
+            ip += 4;
+        }
+        VM_NEXT();
+        VM_CASE(Pop)
+        {
+            m_stack.pop_back();
+        }
+        VM_NEXT();
+        VM_LABEL(Add)
+        VM_LABEL(Sub)
+        VM_LABEL(Mul)
+        VM_LABEL(Div)
+        VM_LABEL(Equal)
+        VM_LABEL(NotEqual)
+        VM_LABEL(GreaterThan)
+        VM_CASE(LessThan)
+        {
+            auto res = eval_binary(static_cast<OpCode>(code[ip - 1]), m_stack[m_stack.size() - 2], m_stack.back());
+            if (is_error(res))
+            {
+                return res;
+            }
+            m_stack.pop_back();
+            m_stack.back() = std::move(res);
+        }
+        VM_NEXT();
+        VM_CASE(Minus)
+        {
+            auto res = detail::eval_minus_prefix_operator(pop());
+            if (is_error(res))
+            {
+                return res;
+            }
+            m_stack.push_back(std::move(res));
+        }
+        VM_NEXT();
+        VM_CASE(Bang)
+        {
+            m_stack.push_back(detail::eval_bang_expression(pop()));
+        }
+        VM_NEXT();
+        VM_CASE(True)
+        {
+            m_stack.push_back(detail::TRUE);
+        }
+        VM_NEXT();
+        VM_CASE(False)
+        {
+            m_stack.push_back(detail::FALSE);
+        }
+        VM_NEXT();
+        VM_CASE(Null)
+        {
+            m_stack.push_back(detail::NIL);
+        }
+        VM_NEXT();
+        VM_CASE(Jump)
+        {
+            ip = read_u32(code + ip);
+        }
+        VM_NEXT();
+        VM_CASE(JumpNotTruthy)
+        {
+            if (!detail::is_truth(pop()))
+            {
+                ip = read_u32(code + ip);
+            }
+            else
+            {
+                ip += 4;
+            }
+        }
+        VM_NEXT();
+        VM_CASE(GetGlobal)
+        {
+            auto res = load_global(fn->m_names[read_u32(code + ip)]);
+            if (is_error(res))
+            {
+                return res;
+            }
+            ip += 4;
+            m_stack.push_back(std::move(res));
+        }
+        VM_NEXT();
+        VM_CASE(SetGlobal)
+        {
+            m_env->set_obj(fn->m_names[read_u32(code + ip)], pop());
+            ip += 4;
+        }
+        VM_NEXT();
+        VM_CASE(GetLocal)
+        {
+            const auto idx = read_u16(code + ip);
+            ip += 2;
+            if (const auto& local = m_stack[frame->m_base + idx])
+            {
+                m_stack.push_back(local);
+            }
+            else
+            {
+                auto value = load_unset(*frame->m_closure, fn->m_local_fallbacks[idx], fn->m_local_names[idx]);
+                if (is_error(value))
+                {
+                    return value;
+                }
+                m_stack.push_back(std::move(value));
+            }
+        }
+        VM_NEXT();
+        VM_CASE(SetLocal)
+        {
+            m_stack[frame->m_base + read_u16(code + ip)] = pop();
+            ip += 2;
+        }
+        VM_NEXT();
+        VM_CASE(GetFree)
+        {
+            const auto idx = read_u16(code + ip);
+            ip += 2;
+            if (const auto& value = frame->m_closure->m_free[idx]->get(m_stack))
+            {
+                m_stack.push_back(value);
+            }
+            else
+            {
+                auto fallback = load_unset(*frame->m_closure, fn->m_captures[idx].m_fallback, fn->m_captures[idx].m_name);
+                if (is_error(fallback))
+                {
+                    return fallback;
+                }
+                m_stack.push_back(std::move(fallback));
+            }
+        }
+        VM_NEXT();
+        VM_CASE(CurrentClosure)
+        {
+            m_stack.push_back(frame->m_closure);
+        }
+        VM_NEXT();
+        VM_CASE(Array)
+        {
+            const auto count = read_u32(code + ip);
+            ip += 4;
+            const auto first = std::end(m_stack) - count;
+            auto arr = make_ref<ArrayObj>(std::vector<Value>(first, std::end(m_stack)));
+            m_stack.erase(first, std::end(m_stack));
+            m_stack.push_back(std::move(arr));
+        }
+        VM_NEXT();
+        VM_CASE(Hash)
+        {
+            const auto count = read_u32(code + ip);
+            ip += 4;
+            const auto first = std::end(m_stack) - count;
+            auto hash = make_ref<HashObj>();
+            for (auto it = first; it != std::end(m_stack); it += 2)
+            {
+                hash->m_pairs.set(*it, *std::next(it));
+            }
+            m_stack.erase(first, std::end(m_stack));
+            m_stack.push_back(std::move(hash));
+        }
+        VM_NEXT();
+        VM_CASE(Index)
+        {
+            auto res = detail::eval_index_expression(m_stack[m_stack.size() - 2], m_stack.back());
+            if (is_error(res))
+            {
+                return res;
+            }
+            m_stack.pop_back();
+            m_stack.back() = std::move(res);
+        }
+        VM_NEXT();
+        VM_LABEL(TailCall)
+        VM_CASE(Call)
+        {
+            frame->m_ip = ip + 2;
+            if (auto res = call(read_u16(code + ip), static_cast<OpCode>(code[ip - 1]) == OpCode::TailCall))
+            {
+                return res;
+            }
+            reload();
+        }
+        VM_NEXT();
+        VM_CASE(ReturnValue)
+        {
+            auto res = pop();
+            if (m_frames.size() == 1)
+            {
+                return res;
+            }
+            close_upvalues(frame->m_base);
+            m_stack.resize(frame->m_base - 1);
+            m_stack.push_back(std::move(res));
+            m_frames.pop_back();
+            reload();
+        }
+        VM_NEXT();
+        VM_CASE(Closure)
+        {
+            const auto& compiled = fn->m_constants[read_u32(code + ip)];
+            ip += 6;
+            std::vector<Ref<Upvalue>> free;
+            free.reserve(compiled.as<CompiledFnObj>().m_captures.size());
+            for (const auto& capture : compiled.as<CompiledFnObj>().m_captures)
+            {
+                free.push_back(capture.m_local ? capture_upvalue(frame->m_base + capture.m_index) : frame->m_closure->m_free[capture.m_index]);
+            }
+            m_stack.push_back(make_ref<ClosureObj>(compiled.cast<CompiledFnObj>(), std::move(free)));
+        }
+        VM_NEXT();
+#if !MLANG_THREADED_DISPATCH
+        }
+    }
+#endif
+#undef VM_LABEL
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+auto Vm::load_global(Atom name) -> Value
+{
+    if (auto val = m_env->get_obj(name))
+    {
+        return val;
+    }
+    if (const auto it = detail::BUILTINS.find(name); it != std::end(detail::BUILTINS))
+    {
+        return it->second;
+    }
+    return make_ref<ErrorObj>(fmt::format("identifier not found: {}", name));
+}
+
+// An unset variable reads the binding it shadows.
+auto Vm::load_unset(const ClosureObj& closure, std::size_t fallback, std::string_view name) -> Value
+{
+    while (fallback != Capture::GLOBAL)
+    {
+        if (const auto& value = closure.m_free[fallback]->get(m_stack))
+        {
+            return value;
+        }
+        fallback = closure.m_fn->m_captures[fallback].m_fallback;
+    }
+    return load_global(Atom::intern(name));
+}
+
+// Replaces the calling frame with the callee's.
+auto Vm::call(std::size_t argc, bool tail) -> Value
+{
+    const auto callee_pos = m_stack.size() - 1 - argc;
+    const auto callee = m_stack[callee_pos];
+    const auto callee_type = callee.get_type();
+    if (callee_type == ObjectType::CLOSURE)
+    {
+        auto closure = callee.cast<ClosureObj>();
+        const auto& fn = *closure->m_fn;
+        if (fn.m_num_parameters != argc)
+        {
+            return make_ref<ErrorObj>(fmt::format("invalid number of args expected {} got {}", fn.m_num_parameters, argc));
+        }
+        if (tail)
+        {
+            auto& frame = m_frames.back();
+            close_upvalues(frame.m_base);
+            std::move(std::begin(m_stack) + callee_pos, std::end(m_stack), std::begin(m_stack) + frame.m_base - 1);
+            m_stack.resize(frame.m_base + argc);
+            m_stack.resize(frame.m_base + fn.m_local_names.size());
+            frame.m_closure = std::move(closure);
+            frame.m_ip = 0;
+            return nullptr;
+        }
+        if (m_frames.size() > m_max_call_depth)
+        {
+            return detail::stack_overflow_error(m_max_call_depth);
+        }
+        const auto base = callee_pos + 1;
+        m_stack.resize(base + fn.m_local_names.size());
+        m_frames.push_back(Frame{std::move(closure), 0, base});
+        return nullptr;
+    }
+    std::vector<Value> args(std::make_move_iterator(std::begin(m_stack) + callee_pos + 1), std::make_move_iterator(std::end(m_stack)));
+    Value res;
+    if (callee_type == ObjectType::BUILTIN)
+    {
+        res = detail::call_rebinding_builtin(callee.as<BuiltInObj>(), args, rebinding());
+    }
+    else if (callee_type == ObjectType::FUNCTION)
+    {
+        res = detail::apply_function(callee.cast<FunctionObj>(), args);
+    }
+    else
+    {
+        return make_ref<ErrorObj>(fmt::format("not a function: {}", callee_type));
+    }
+    if (is_error(res))
+    {
+        return res;
+    }
+    m_stack.resize(callee_pos);
+    m_stack.push_back(std::move(res));
+    return nullptr;
+}
+
+// A call directly followed by a store rebinds the stored variable.
+auto Vm::rebinding() -> Value*
+{
+    const auto& frame = m_frames.back();
+    const auto& fn = *frame.m_closure->m_fn;
+    if (frame.m_ip >= fn.m_instructions.size())
+    {
+        return nullptr;
+    }
+    const auto* next = fn.m_instructions.data() + frame.m_ip;
+    const auto op = static_cast<OpCode>(*next);
+    if (op == OpCode::SetGlobal)
+    {
+        return m_env->find_binding(fn.m_names[read_u32(next + 1)]);
+    }
+    if (op == OpCode::SetLocal)
+    {
+        return &m_stack[frame.m_base + read_u16(next + 1)];
+    }
+    return nullptr;
+}
+
+auto Vm::capture_upvalue(std::size_t slot) -> Ref<Upvalue>
+{
+    auto it = std::end(m_open_upvalues);
+    while (it != std::begin(m_open_upvalues) && (*std::prev(it))->m_slot >= slot)
+    {
+        --it;
+        if ((*it)->m_slot == slot)
+        {
+            return *it;
+        }
+    }
+    return *m_open_upvalues.insert(it, make_ref<Upvalue>(slot));
+}
+
+void Vm::close_upvalues(std::size_t first_slot)
+{
+    while (!m_open_upvalues.empty() && m_open_upvalues.back()->m_slot >= first_slot)
+    {
+        m_open_upvalues.back()->close(m_stack);
+        m_open_upvalues.pop_back();
+    }
+}
+
+auto Vm::pop() -> Value
+{
+    auto obj = std::move(m_stack.back());
+    m_stack.pop_back();
+    return obj;
+}
+}  // namespace mlang
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <mlang/code.hpp>
+#include <mlang/compiler.hpp>
+#include <mlang/parser.hpp>
+#include <mlang/register_compiler.hpp>
+
+using namespace ::testing;
+
+namespace
+{
+auto compile(const std::string& input) -> mlang::Ref<mlang::CompiledFnObj>
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+    auto program = p.parse_program();
+    EXPECT_THAT(p.get_errors(), IsEmpty()) << input;
+    mlang::Compiler compiler;
+    auto main = compiler.compile(program.get());
+    EXPECT_THAT(compiler.get_errors(), IsEmpty()) << input;
+    return main;
+}
+
+auto concat(std::initializer_list<mlang::Instructions> parts) -> mlang::Instructions
+{
+    mlang::Instructions out;
+    for (const auto& part : parts)
+    {
+        out.insert(std::end(out), std::begin(part), std::end(part));
+    }
+    return out;
+}
+}  // namespace
+
+TEST(code, Make)
+{
+    EXPECT_EQ(mlang::make(mlang::OpCode::Constant, {65534}), (mlang::Instructions{0, 0, 0, 255, 254}));
+    EXPECT_EQ(mlang::make(mlang::OpCode::Constant, {70000}), (mlang::Instructions{0, 0, 1, 17, 112}));
+    EXPECT_EQ(mlang::make(mlang::OpCode::Add), (mlang::Instructions{2}));
+    EXPECT_EQ(mlang::make(mlang::OpCode::GetLocal, {300}), (mlang::Instructions{19, 1, 44}));
+    EXPECT_EQ(mlang::make(mlang::OpCode::Closure, {65534, 255}), (mlang::Instructions{28, 0, 0, 255, 254, 0, 255}));
+}
+
+TEST(code, Disassemble)
+{
+    const auto instructions = concat({
+        mlang::make(mlang::OpCode::Add),
+        mlang::make(mlang::OpCode::GetLocal, {1}),
+        mlang::make(mlang::OpCode::Constant, {2}),
+        mlang::make(mlang::OpCode::Closure, {70000, 300}),
+    });
+    EXPECT_EQ(mlang::disassemble(instructions), "0000 OpAdd\n"
+                                                "0001 OpGetLocal 1\n"
+                                                "0004 OpConstant 2\n"
+                                                "0009 OpClosure 70000 300\n");
+}
+
+TEST(compiler, IntegerArithmetic)
+{
+    const auto main = compile("1 + 2; 3");
+    EXPECT_EQ(main->m_instructions, concat({
+                                        mlang::make(mlang::OpCode::Constant, {0}),
+                                        mlang::make(mlang::OpCode::Constant, {1}),
+                                        mlang::make(mlang::OpCode::Add),
+                                        mlang::make(mlang::OpCode::Pop),
+                                        mlang::make(mlang::OpCode::Constant, {2}),
+                                        mlang::make(mlang::OpCode::ReturnValue),
+                                    }))
+        << mlang::disassemble(main->m_instructions);
+    EXPECT_THAT(main->m_constants, SizeIs(3));
+}
+
+TEST(compiler, Conditionals)
+{
+    const auto main = compile("if (true) { 10 }");
+    EXPECT_EQ(main->m_instructions, concat({
+                                        mlang::make(mlang::OpCode::True),
+                                        mlang::make(mlang::OpCode::JumpNotTruthy, {16}),
+                                        mlang::make(mlang::OpCode::Constant, {0}),
+                                        mlang::make(mlang::OpCode::Jump, {17}),
+                                        mlang::make(mlang::OpCode::Null),
+                                        mlang::make(mlang::OpCode::ReturnValue),
+                                    }))
+        << mlang::disassemble(main->m_instructions);
+}
+
+TEST(compiler, ClosuresCaptureFreeVariables)
+{
+    const auto main = compile("fn(a) { fn(b) { a + b } }");
+    ASSERT_THAT(main->m_constants, SizeIs(1));
+    ASSERT_EQ(main->m_constants[0].get_type(), mlang::ObjectType::COMPILED_FUNCTION);
+    const auto& outer = main->m_constants[0].as<mlang::CompiledFnObj>();
+    EXPECT_EQ(outer.m_instructions, concat({
+                                        mlang::make(mlang::OpCode::Closure, {0, 1}),
+                                        mlang::make(mlang::OpCode::ReturnValue),
+                                    }))
+        << mlang::disassemble(outer.m_instructions);
+    const auto& inner = outer.m_constants[0].as<mlang::CompiledFnObj>();
+    ASSERT_THAT(inner.m_captures, SizeIs(1));
+    EXPECT_TRUE(inner.m_captures[0].m_local);
+    EXPECT_EQ(inner.m_captures[0].m_index, 0);
+    EXPECT_EQ(inner.m_instructions, concat({
+                                        mlang::make(mlang::OpCode::GetFree, {0}),
+                                        mlang::make(mlang::OpCode::GetLocal, {0}),
+                                        mlang::make(mlang::OpCode::Add),
+                                        mlang::make(mlang::OpCode::ReturnValue),
+                                    }))
+        << mlang::disassemble(inner.m_instructions);
+}
+
+TEST(compiler, LocalRecursiveFunction)
+{
+    const auto main = compile("fn() { let f = fn(x) { f(x) }; f(1) }");
+    const auto& outer = main->m_constants[0].as<mlang::CompiledFnObj>();
+    const auto& inner = outer.m_constants[0].as<mlang::CompiledFnObj>();
+    EXPECT_EQ(inner.m_instructions, concat({
+                                        mlang::make(mlang::OpCode::CurrentClosure),
+                                        mlang::make(mlang::OpCode::GetLocal, {0}),
+                                        mlang::make(mlang::OpCode::TailCall, {1}),
+                                        mlang::make(mlang::OpCode::ReturnValue),
+                                    }))
+        << mlang::disassemble(inner.m_instructions);
+}
+
+TEST(compiler, CallsInTailPositionReuseTheFrame)
+{
+    const auto main = compile("fn(f, n) { if (n) { f(n) } else { f(n) + 1 } }");
+    const auto& fn = main->m_constants[0].as<mlang::CompiledFnObj>();
+    EXPECT_EQ(fn.m_instructions, concat({
+                                     mlang::make(mlang::OpCode::GetLocal, {1}),
+                                     mlang::make(mlang::OpCode::JumpNotTruthy, {22}),
+                                     mlang::make(mlang::OpCode::GetLocal, {0}),
+                                     mlang::make(mlang::OpCode::GetLocal, {1}),
+                                     mlang::make(mlang::OpCode::TailCall, {1}),
+                                     mlang::make(mlang::OpCode::Jump, {37}),
+                                     mlang::make(mlang::OpCode::GetLocal, {0}),
+                                     mlang::make(mlang::OpCode::GetLocal, {1}),
+                                     mlang::make(mlang::OpCode::Call, {1}),
+                                     mlang::make(mlang::OpCode::Constant, {0}),
+                                     mlang::make(mlang::OpCode::Add),
+                                     mlang::make(mlang::OpCode::ReturnValue),
+                                 }))
+        << mlang::disassemble(fn.m_instructions);
+}
+
+TEST(register_compiler, ArithmeticUsesThreeOperandInstructions)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>("fn(a, b) { let c = a + b * 2; c }"));
+    auto program = p.parse_program();
+    mlang::RegisterCompiler compiler;
+    const auto main = compiler.compile(program.get());
+    ASSERT_THAT(compiler.get_errors(), IsEmpty());
+    ASSERT_EQ(main->m_constants[0].get_type(), mlang::ObjectType::REGISTER_FUNCTION);
+    const auto& fn = main->m_constants[0].as<mlang::RegisterFnObj>();
+    EXPECT_EQ(mlang::disassemble(fn.m_code), "0000 Mul r3 r1 k0\n"
+                                             "0001 Add r2 r0 r3\n"
+                                             "0002 Return r2\n");
+    EXPECT_EQ(fn.m_num_registers, 4);
+}
+
+TEST(register_compiler, LinearScanReusesTemporaries)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>("fn(a) { (a * a) + (a * a) + (a * a) }"));
+    auto program = p.parse_program();
+    mlang::RegisterCompiler compiler;
+    const auto main = compiler.compile(program.get());
+    ASSERT_THAT(compiler.get_errors(), IsEmpty());
+    const auto& fn = main->m_constants[0].as<mlang::RegisterFnObj>();
+    EXPECT_EQ(fn.m_num_registers, 3) << mlang::disassemble(fn.m_code);
+}
+
+TEST(register_compiler, CallsInTailPositionReuseTheFrame)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>("fn(f, n) { if (n) { f(n) } else { f(n) + 1 } }"));
+    auto program = p.parse_program();
+    mlang::RegisterCompiler compiler;
+    const auto main = compiler.compile(program.get());
+    ASSERT_THAT(compiler.get_errors(), IsEmpty());
+    const auto& fn = main->m_constants[0].as<mlang::RegisterFnObj>();
+    const auto count = [&fn](mlang::RegOpCode op)
+    {
+        return std::count_if(std::begin(fn.m_code), std::end(fn.m_code), [op](const mlang::RegInstruction& ins)
+                             { return ins.op == op; });
+    };
+    EXPECT_EQ(count(mlang::RegOpCode::TailCall), 1) << mlang::disassemble(fn.m_code);
+    EXPECT_EQ(count(mlang::RegOpCode::Call), 1) << mlang::disassemble(fn.m_code);
+}
+
+TEST(register_compiler, LetMarksRebindingCalls)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>("let a = [1]; let a = push(a, 2);"));
+    auto program = p.parse_program();
+    mlang::RegisterCompiler compiler;
+    const auto main = compiler.compile(program.get());
+    ASSERT_THAT(compiler.get_errors(), IsEmpty());
+    EXPECT_EQ(mlang::disassemble(main->m_code), "0000 LoadConst r0 k0\n"
+                                                "0001 Array r1 1\n"
+                                                "0002 Arg r0 1\n"
+                                                "0003 SetGlobal r1 g0\n"
+                                                "0004 GetGlobal r0 g1\n"
+                                                "0005 GetGlobal r1 g0\n"
+                                                "0006 LoadConst r2 k1\n"
+                                                "0007 RebindingCall r0 r0 2\n"
+                                                "0008 Arg r1 1\n"
+                                                "0009 Arg r2 1\n"
+                                                "0010 SetGlobal r0 g0\n"
+                                                "0011 LoadNull r0\n"
+                                                "0012 Return r0\n");
+}
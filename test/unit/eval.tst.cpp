@@ -1,8 +1,11 @@
 
 
+#include <fmt/ranges.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <mlang/closure_compiler.hpp>
 #include <mlang/eval.hpp>
+#include <mlang/feedback.hpp>
 #include <mlang/object.hpp>
 #include <mlang/parser.hpp>
 
@@ -10,55 +13,81 @@ using namespace ::testing;
 
 namespace
 {
-template <typename OutObj, typename Out, typename = std::enable_if_t<std::is_convertible_v<Out, decltype(OutObj::m_value)>>>
+constexpr auto ENGINES = std::array{mlang::Engine::TreeWalker, mlang::Engine::StackVm, mlang::Engine::RegisterVm, mlang::Engine::ClosureCompiler, mlang::Engine::FlatWalker};
+
+template <typename Out>
+auto unwrap(const mlang::Value& val) -> Out
+{
+    if constexpr (std::is_same_v<Out, bool>)
+    {
+        return val.as_boolean();
+    }
+    else if constexpr (std::is_integral_v<Out>)
+    {
+        return val.as_integer();
+    }
+    else
+    {
+        return std::string(val.as<mlang::StringObj>().view());
+    }
+}
+
+template <typename Out>
 void test_generic_expr(const std::string& input, const Out& expected, mlang::ObjectType out_type)
 {
-    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
-    auto program = p.parse_program();
-    const auto& errors = p.get_errors();
-    EXPECT_THAT(errors, IsEmpty()) << input;
-    ASSERT_THAT(program, NotNull()) << input;
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        const auto& errors = p.get_errors();
+        EXPECT_THAT(errors, IsEmpty()) << input;
+        ASSERT_THAT(program, NotNull()) << input;
 
-    auto env = std::make_shared<mlang::Context>();
-    auto res = eval(program.get(), env);
-    ASSERT_THAT(res, NotNull()) << input;
-    ASSERT_EQ(res->get_type(), out_type) << res->inspect();
-    auto* obj = static_cast<OutObj*>(res.get());
-    EXPECT_EQ(obj->m_value, expected) << input;
+        auto env = mlang::make_ref<mlang::Context>();
+        auto res = eval(program.get(), env, engine);
+        ASSERT_TRUE(res) << input << " " << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), out_type) << res.inspect() << " " << magic_enum::enum_name(engine);
+        EXPECT_EQ(unwrap<Out>(res), expected) << input << " " << magic_enum::enum_name(engine);
+    }
 }
 
 void test_generic_expr_with_nil(const std::string& input)
 {
-    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
-    auto program = p.parse_program();
-    const auto& errors = p.get_errors();
-    EXPECT_THAT(errors, IsEmpty()) << input;
-    ASSERT_THAT(program, NotNull()) << input;
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        const auto& errors = p.get_errors();
+        EXPECT_THAT(errors, IsEmpty()) << input;
+        ASSERT_THAT(program, NotNull()) << input;
 
-    auto env = std::make_shared<mlang::Context>();
-    auto res = eval(program.get(), env);
-    ASSERT_THAT(res, NotNull()) << input;
-    EXPECT_EQ(mlang::detail::NIL, res) << input;
+        auto env = mlang::make_ref<mlang::Context>();
+        auto res = eval(program.get(), env, engine);
+        ASSERT_TRUE(res) << input << " " << magic_enum::enum_name(engine);
+        EXPECT_EQ(mlang::detail::NIL, res) << input << " " << magic_enum::enum_name(engine);
+    }
 }
 
 void test_error(const std::string& input, const std::string& expected_err)
 {
-    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
-    auto program = p.parse_program();
-    const auto& errors = p.get_errors();
-    EXPECT_THAT(errors, IsEmpty()) << input << "\n"
-                                   << expected_err;
-    ASSERT_THAT(program, NotNull()) << input << "\n"
-                                    << expected_err;
-
-    auto env = std::make_shared<mlang::Context>();
-    auto res = eval(program.get(), env);
-    ASSERT_THAT(res, NotNull()) << input << "\n"
-                                << expected_err;
-    ASSERT_EQ(res->get_type(), mlang::ObjectType::ERROR) << input << "\n"
-                                                         << expected_err;
-    auto* obj = static_cast<mlang::ErrorObj*>(res.get());
-    EXPECT_EQ(obj->m_what, expected_err) << input;
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        const auto& errors = p.get_errors();
+        EXPECT_THAT(errors, IsEmpty()) << input << "\n"
+                                       << expected_err;
+        ASSERT_THAT(program, NotNull()) << input << "\n"
+                                        << expected_err;
+
+        auto env = mlang::make_ref<mlang::Context>();
+        auto res = eval(program.get(), env, engine);
+        ASSERT_TRUE(res) << input << "\n"
+                                    << expected_err << " " << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::ERROR) << input << "\n"
+                                                             << expected_err << " " << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.as<mlang::ErrorObj>().m_what, expected_err) << input << " " << magic_enum::enum_name(engine);
+    }
 }
 }  // namespace
 
@@ -70,7 +99,7 @@ TEST(eval, IntegerObj)
              {"10", 10}
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
     }
 }
 
@@ -82,7 +111,7 @@ TEST(eval, BooleanObj)
              {"false", false},
     })
     {
-        test_generic_expr<mlang::BooleanObj>(input, expected, mlang::ObjectType::BOOLEAN);
+        test_generic_expr<bool>(input, expected, mlang::ObjectType::BOOLEAN);
     }
 }
 
@@ -98,7 +127,7 @@ TEST(eval, PrefixOperatorBool)
              {"!!5",     true },
     })
     {
-        test_generic_expr<mlang::BooleanObj>(input, expected, mlang::ObjectType::BOOLEAN);
+        test_generic_expr<bool>(input, expected, mlang::ObjectType::BOOLEAN);
     }
 }
 
@@ -112,7 +141,7 @@ TEST(eval, PrefixOperatorInt)
              {"-10", -10},
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
     }
 }
 
@@ -138,7 +167,7 @@ TEST(eval, EvalIntegerExpression)
              {"(5 + 10 * 2 + 15 / 3) * 2 + -10", 50 },
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
     }
 }
 
@@ -168,7 +197,7 @@ TEST(eval, EvalBooleanExpression)
              {"1 != 2",           true }
     })
     {
-        test_generic_expr<mlang::BooleanObj>(input, expected, mlang::ObjectType::BOOLEAN);
+        test_generic_expr<bool>(input, expected, mlang::ObjectType::BOOLEAN);
     }
 }
 
@@ -184,7 +213,7 @@ TEST(eval, IfElseExpressions)
              {"if (10 > 1) {if (10 > 1) {return 10;}return 1;}", 10},
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
     }
     for (const auto& input : {"if (1 > 2) { 10 }", "if (false) { 10 }"})
     {
@@ -202,7 +231,23 @@ TEST(eval, ReturnStatements)
              {"9; return 2 * 5; 9;", 10},
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
+    }
+}
+
+TEST(eval, EmptyProgram)
+{
+    for (const std::string input : {"", "  \n\t"})
+    {
+        for (const auto engine : ENGINES)
+        {
+            mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+            auto program = p.parse_program();
+            EXPECT_THAT(p.get_errors(), IsEmpty());
+            ASSERT_THAT(program, NotNull());
+            const auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+            EXPECT_FALSE(res) << res.inspect() << " " << magic_enum::enum_name(engine);
+        }
     }
 }
 
@@ -217,6 +262,9 @@ TEST(eval, ErrorMessage)
              {"5; true + false; 5",                                             "unknown operator: BOOLEAN + BOOLEAN"},
              {"if (10 > 1) { true + false; }",                                  "unknown operator: BOOLEAN + BOOLEAN"},
              {"if (10 > 1) { if (10 > 1) { return true + false; } return 1; }", "unknown operator: BOOLEAN + BOOLEAN"},
+             {"\"a\" - \"b\"",                                                    "unknown operator: STRING - STRING"  },
+             {"[1] == [1]",                                                     "unknown operator: ARRAY == ARRAY"   },
+             {"-\"a\"",                                                         "unknown operator: -STRING"          },
              {"foobar",                                                         "identifier not found: foobar"       },
     })
     {
@@ -234,7 +282,7 @@ TEST(eval, LetStatement)
              {"let a = 5; let b = a; let c = a + b + 5; c;", 15},
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, val, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, val, mlang::ObjectType::INTEGER);
     }
 }
 
@@ -248,7 +296,7 @@ TEST(eval, FunctionObj)
              {"let a = 5; let b = a; let c = a + b + 5; c;", 15},
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, val, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, val, mlang::ObjectType::INTEGER);
     }
 }
 
@@ -264,7 +312,7 @@ TEST(eval, FnCall)
              {"fn(x) { x; }(5)",                                       5 },
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
     }
 }
 
@@ -277,7 +325,7 @@ TEST(eval, FnCallClosure)
         let addTwo = newAdder(2);
         addTwo(2);
     )";
-    test_generic_expr<mlang::IntegerObj>(input, 4, mlang::ObjectType::INTEGER);
+    test_generic_expr<std::int64_t>(input, 4, mlang::ObjectType::INTEGER);
 }
 
 TEST(eval, StringObj)
@@ -290,43 +338,142 @@ TEST(eval, StringObj)
              {"\"parse\" + \" me\" + \" daddy\"", "parse me daddy"},
     })
     {
-        test_generic_expr<mlang::StringObj>(input, expected, mlang::ObjectType::STRING);
+        test_generic_expr<std::string>(input, expected, mlang::ObjectType::STRING);
+    }
+}
+
+TEST(eval, StringConcatenationSharesBuffers)
+{
+    const std::string base(64, 'x');
+    const auto input = fmt::format(R"(
+        let s = "{0}";
+        let t = s + "a";
+        let u = s + "b";
+        let v = t + t;
+        let w = v + s;
+        [t, u, v, w, t + u]
+    )",
+                                   base);
+    const auto t = base + "a";
+    const auto u = base + "b";
+    const auto v = t + t;
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        ASSERT_THAT(p.get_errors(), IsEmpty());
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::ARRAY) << res.inspect() << " " << magic_enum::enum_name(engine);
+        std::vector<std::string> values;
+        res.as<mlang::ArrayObj>().for_each([&values](const mlang::Value& value)
+                                            { values.push_back(unwrap<std::string>(value)); });
+        EXPECT_THAT(values, ElementsAre(t, u, v, v + base, t + u)) << magic_enum::enum_name(engine);
     }
+    test_generic_expr<std::int64_t>(R"(let s = ""; let i = 0; while (i < 100000) { let s = s + "ab"; let i = i + 1; } len(s))", 200000, mlang::ObjectType::INTEGER);
 }
 
 TEST(eval, BuiltInFns)
 {
     using arg_list_t = std::initializer_list<std::tuple<std::string, std::int64_t>>;
     for (const auto& [input, expected] : arg_list_t{
-             {"len(\"dis\")",       3},
-             {"len(\"\")",          0},
-             {"len([1,2,3,4,5])",   5},
-             {"last([1,2,3,4,5])",  5},
-             {"first([1,2,3,4,5])", 1},
+             {"len(\"dis\")",                        3},
+             {"len(\"\")",                           0},
+             {"len([1,2,3,4,5])",                    5},
+             {"last([1,2,3,4,5])",                   5},
+             {"first([1,2,3,4,5])",                  1},
+             {"len(rest([1,2,3]))",                  2},
+             {"first(rest(rest([1,2,3,4])))",        3},
+             {"last(slice([1,2,3,4,5], 1, 3))",      3},
+             {"slice([1,2,3,4,5], 1, 4)[2]",         4},
+             {"len(slice(rest([1,2,3,4,5]), 1, 3))", 2},
+             {"len(slice([1,2,3], -5, 10))",         3},
+             {"len(slice(\"abcdef\", 4, 1))",        0},
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
+    }
+}
+
+TEST(eval, SlicesShareStorage)
+{
+    const std::string text(100, 'x');
+    test_generic_expr<std::string>("slice(\"abcdef\", 1, 4)", "bcd", mlang::ObjectType::STRING);
+    test_generic_expr<std::string>("rest(rest(\"abc\"))", "c", mlang::ObjectType::STRING);
+    test_generic_expr<std::string>(fmt::format("slice(\"{}\", 10, 90) + \"y\"", text), std::string(80, 'x') + "y", mlang::ObjectType::STRING);
+    test_generic_expr<std::string>(fmt::format("let s = \"{}\" + \"y\"; rest(rest(s)) + \"z\"", text), text.substr(2) + "yz", mlang::ObjectType::STRING);
+    test_generic_expr<std::string>(fmt::format("let s = \"{}\" + \"y\"; let t = rest(s) + \"1\"; rest(s) + \"2\"", text), text.substr(1) + "y2", mlang::ObjectType::STRING);
+    test_error("slice(1, 0, 1)", "slice is not implemented for type INTEGER");
+    test_error("slice([1], true, 1)", "slice bounds must be INTEGER, got BOOLEAN and INTEGER");
+    test_error("slice([1], 0)", "invalid number of parameters for slice, expected 3 got 2");
+
+    constexpr std::int64_t count = 1000000;
+    std::vector<mlang::Value> values;
+    for (std::int64_t i = 0; i < count; ++i)
+    {
+        values.push_back(mlang::Value::integer(i % 7));
+    }
+    const auto arr = mlang::make_ref<mlang::ArrayObj>(std::move(values));
+    mlang::Parser p(std::make_unique<mlang::Lexer>(R"(
+        let sum = fn(arr, acc) { if (len(arr) == 0) { return acc; } sum(rest(arr), acc + first(arr)); };
+        sum(arr, 0)
+    )"));
+    auto program = p.parse_program();
+    ASSERT_THAT(p.get_errors(), IsEmpty());
+    for (const auto engine : ENGINES)
+    {
+        auto env = mlang::make_ref<mlang::Context>();
+        env->set_obj(mlang::Atom::intern("arr"), arr);
+        auto res = eval(program.get(), env, engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::INTEGER) << res.inspect() << " " << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.as_integer(), 2999997) << magic_enum::enum_name(engine);
+    }
+    EXPECT_EQ(arr->size(), count);
+}
+
+TEST(eval, PushKeepsEarlierVersions)
+{
+    const std::string input = R"(
+        let build = fn(arr, i, n) { if (i == n) { arr } else { build(push(arr, i), i + 1, n) } };
+        let a = build([], 0, 1000);
+        let b = build(a, 1000, 2000);
+        let c = push(a, -1);
+        let d = push(rest(a), -2);
+        [len(a), a[999], a[1000], len(b), b[0], b[1055], b[1999], c[1000], b[1000], len(d), d[998], d[999]]
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        ASSERT_THAT(p.get_errors(), IsEmpty());
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.inspect(), "[1000, 999, null, 2000, 0, 1055, 1999, -1, 1000, 1000, 999, -2]") << magic_enum::enum_name(engine);
     }
 }
 
 TEST(eval, ArrayLiteral)
 {
     const std::string input = "[1, 2 * 2, 3 + 3]";
-    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
-    auto program = p.parse_program();
-    const auto& errors = p.get_errors();
-    EXPECT_THAT(errors, IsEmpty()) << input;
-    ASSERT_THAT(program, NotNull()) << input;
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        const auto& errors = p.get_errors();
+        EXPECT_THAT(errors, IsEmpty()) << input;
+        ASSERT_THAT(program, NotNull()) << input;
 
-    auto env = std::make_shared<mlang::Context>();
-    auto res = eval(program.get(), env);
-    ASSERT_THAT(res, NotNull()) << input;
-    ASSERT_EQ(res->get_type(), mlang::ObjectType::ARRAY) << res->inspect();
-    auto* obj = static_cast<mlang::ArrayObj*>(res.get());
-    ASSERT_EQ(obj->m_values.size(), 3);
-    EXPECT_EQ(dynamic_cast<mlang::IntegerObj&>(*obj->m_values[0]).m_value, 1) << input;
-    EXPECT_EQ(dynamic_cast<mlang::IntegerObj&>(*obj->m_values[1]).m_value, 4) << input;
-    EXPECT_EQ(dynamic_cast<mlang::IntegerObj&>(*obj->m_values[2]).m_value, 6) << input;
+        auto env = mlang::make_ref<mlang::Context>();
+        auto res = eval(program.get(), env, engine);
+        ASSERT_TRUE(res) << input;
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::ARRAY) << res.inspect();
+        const auto& obj = res.as<mlang::ArrayObj>();
+        ASSERT_EQ(obj.size(), 3);
+        EXPECT_EQ(obj.at(0).as_integer(), 1) << input;
+        EXPECT_EQ(obj.at(1).as_integer(), 4) << input;
+        EXPECT_EQ(obj.at(2).as_integer(), 6) << input;
+    }
 }
 
 TEST(eval, HashLiteral)
@@ -342,18 +489,80 @@ TEST(eval, HashLiteral)
         false: 6
     };
     )";
-    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
-    auto program = p.parse_program();
-    const auto& errors = p.get_errors();
-    EXPECT_THAT(errors, IsEmpty()) << input;
-    ASSERT_THAT(program, NotNull()) << input;
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        const auto& errors = p.get_errors();
+        EXPECT_THAT(errors, IsEmpty()) << input;
+        ASSERT_THAT(program, NotNull()) << input;
+
+        auto env = mlang::make_ref<mlang::Context>();
+        auto res = eval(program.get(), env, engine);
+        ASSERT_TRUE(res) << input;
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::HASH) << res.inspect();
+        ASSERT_EQ(res.as<mlang::HashObj>().m_pairs.size(), 6);
+    }
+}
+
+TEST(eval, HashPushAndEraseKeepEarlierVersions)
+{
+    const std::string input = R"(
+        let build = fn(h, i, n) { if (i == n) { h } else { build(push(h, i, i * 2), i + 1, n) } };
+        let drop = fn(h, i, n) { if (i < n) { drop(erase(h, i), i + 2, n) } else { h } };
+        let a = build({}, 0, 2000);
+        let b = drop(a, 0, 2000);
+        let c = push(push(b, 1, "one"), true, "yes");
+        let d = erase(c, 1);
+        [a[0], a[1999], b[0], b[1], b[1999], c[1], c[true], d[1], d[true], erase(d, true)[true], d[3], erase(d, "missing")[5]]
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        ASSERT_THAT(p.get_errors(), IsEmpty());
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.inspect(), R"([0, 3998, null, 2, 3998, "one", "yes", null, "yes", null, 6, 10])") << magic_enum::enum_name(engine);
+    }
+}
 
-    auto env = std::make_shared<mlang::Context>();
-    auto res = eval(program.get(), env);
-    ASSERT_THAT(res, NotNull()) << input;
-    ASSERT_EQ(res->get_type(), mlang::ObjectType::HASH) << res->inspect();
-    auto* obj = static_cast<mlang::HashObj*>(res.get());
-    ASSERT_EQ(obj->m_pairs.size(), 6);
+TEST(eval, RebindingPushUpdatesInPlaceOnlyWhenUnshared)
+{
+    const std::string input = R"(
+        let a = [0];
+        let before = a;
+        let i = 1;
+        while (i < 1000) {
+            let a = push(a, i);
+            let i = i + 1;
+        }
+        let fill = fn(n) {
+            let h = {};
+            let empty = h;
+            let j = 0;
+            while (j < n) {
+                let h = push(h, j, j * 2);
+                let j = j + 1;
+            }
+            let half = h;
+            let h = erase(h, 0);
+            let h = push(h, 1, "one");
+            [empty[0], half[0], half[1], h[0], h[1], h[n - 1]]
+        };
+        let b = a;
+        let a = push(a, 1000);
+        [len(before), len(a), a[999], a[1000], len(b), b[1000], fill(500)]
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        ASSERT_THAT(p.get_errors(), IsEmpty());
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.inspect(), R"([1, 1001, 999, 1000, 1000, null, [null, 0, 2, null, "one", 998]])") << magic_enum::enum_name(engine);
+    }
 }
 
 TEST(eval, IndexExpression)
@@ -375,6 +584,362 @@ TEST(eval, IndexExpression)
              {"{5: 5}[5]",                                                      5}
     })
     {
-        test_generic_expr<mlang::IntegerObj>(input, expected, mlang::ObjectType::INTEGER);
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
+    }
+}
+
+TEST(eval, RecursiveClosures)
+{
+    const std::string input = R"(
+        let reduce = fn(arr, initial, f) {
+            let iter = fn(arr, result) {
+                if (len(arr) == 0) {
+                    result
+                } else {
+                    iter(rest(arr), f(result, first(arr)));
+                }
+            };
+            iter(arr, initial);
+        };
+        let sum = fn(arr) { reduce(arr, 0, fn(initial, el) { initial + el }); };
+        sum([1, 2, 3, 4]);
+    )";
+    test_generic_expr<std::int64_t>(input, 10, mlang::ObjectType::INTEGER);
+}
+
+TEST(eval, ClosuresCaptureVariablesByReference)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::string>>;
+    for (const auto& [input, expected] : arg_list_t{
+             {"let f = fn() { let g = fn() { h() }; let h = fn() { 42 }; g() }; f()",                                     "42"       },
+             {R"(let f = fn(n) {
+                     let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };
+                     let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } };
+                     [even(n), odd(n)]
+                 };
+                 f(7))",                                                                                                  "[false, true]"},
+             {"let f = fn() { let x = 1; let g = fn() { x }; let r = g(); let x = 2; [r, g()] }; f()",                    "[1, 2]"   },
+             {"let f = fn() { let g = fn() { x }; let x = 1; g }; f()()",                                                  "1"        },
+             {"let f = fn() { let g = fn() { x }; g() }; f()",                                                              "ERROR: identifier not found: x"},
+    })
+    {
+        for (const auto engine : ENGINES)
+        {
+            mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+            auto program = p.parse_program();
+            ASSERT_THAT(p.get_errors(), IsEmpty()) << input;
+            const auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+            ASSERT_TRUE(res) << input << " " << magic_enum::enum_name(engine);
+            EXPECT_EQ(res.inspect(), expected) << input << " " << magic_enum::enum_name(engine);
+        }
+    }
+}
+
+TEST(eval, WhileStatement)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::int64_t>>;
+    for (const auto& [input, expected] : arg_list_t{
+             {"let i = 0; while (i < 10) { let i = i + 1; } i;",                                                                         10},
+             {"let f = fn(n) { let i = 0; while (i < n) { let i = i + 2; } i }; f(7)",                                                   8 },
+             {"let f = fn(n) { let i = 0; while (i < n) { if (i == 3) { return i * 10; } let i = i + 1; } 0 - 1 }; f(10)",               30},
+             {"let f = fn() { let i = 0; while (true) { let j = 0; while (j < 5) { if (j == 2) { return j; } let j = j + 1; } } }; f()", 2 },
+             {"let i = 0; while (i < 10) { if (i == 4) { return i; } let i = i + 1; } 99",                                               4 },
+    })
+    {
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
+    }
+}
+
+TEST(eval, ClosureCompilerOutlivesAst)
+{
+    mlang::Thunk thunk;
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>("let adder = fn(x) { fn(y) { x + y } }; adder(2)(3) * 2;"));
+        auto program = p.parse_program();
+        ASSERT_THAT(p.get_errors(), IsEmpty());
+        thunk = mlang::compile_closures(program.get());
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        auto res = thunk(mlang::make_ref<mlang::Context>());
+        ASSERT_TRUE(res);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::INTEGER) << res.inspect();
+        EXPECT_EQ(res.as_integer(), 10);
+    }
+}
+
+TEST(eval, ResolvedLocalsFallBackToEnclosingScope)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::int64_t>>;
+    for (const auto& [input, expected] : arg_list_t{
+             {"let x = 1; let f = fn() { let y = x; let x = 2; y + x }; f()",                     3 },
+             {"let f = fn(a, b) { let g = fn(c) { a * b + c }; g(a) }; f(4, 10)",                 44},
+             {"let len = fn(a) { 5 }; let f = fn() { len([1]) }; f()",                           5 },
+    })
+    {
+        test_generic_expr<std::int64_t>(input, expected, mlang::ObjectType::INTEGER);
+    }
+}
+
+TEST(eval, UnsetLocalsReadEnclosingBinding)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::string>>;
+    for (const auto& [input, expected] : arg_list_t{
+             {"let x = 1; let f = fn(c) { if (c) { let x = 2; } x }; [f(true), f(false)]",                                                 "[2, 1]"                        },
+             {"let x = 1; let f = fn() { let g = fn() { x }; let r = g(); let y = x; let x = 3; [r, y, g(), x] }; f()",                    "[1, 1, 3, 3]"                  },
+             {"let f = fn() { let x = 10; let g = fn(c) { if (c) { let x = 20; } x }; [g(true), g(false)] }; f()",                         "[20, 10]"                      },
+             {"let x = 1; let f = fn() { let i = 0; let r = []; while (i < 2) { let r = push(r, x); let x = 5; let i = i + 1; } r }; f()", "[1, 5]"                        },
+             {"let x = 1; let f = fn() { let g = fn() { let h = fn() { x }; h() }; let r = g(); let x = 7; [r, g()] }; f()",               "[1, 7]"                        },
+             {"let f = fn(c) { if (c) { let y = 2; } y }; f(false)",                                                                       "ERROR: identifier not found: y"},
+    })
+    {
+        for (const auto engine : ENGINES)
+        {
+            mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+            auto program = p.parse_program();
+            ASSERT_THAT(p.get_errors(), IsEmpty()) << input;
+            const auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+            ASSERT_TRUE(res) << input << " " << magic_enum::enum_name(engine);
+            EXPECT_EQ(res.inspect(), expected) << input << " " << magic_enum::enum_name(engine);
+        }
+    }
+}
+
+TEST(eval, LargePrograms)
+{
+    std::string body = "let total = 0;";
+    for (int i = 0; i < 5000; ++i)
+    {
+        body += fmt::format(" if (total < {}) {{ let total = total + {}; }} else {{ let total = total - 1; }}", i * 3 + 1, i);
+    }
+    test_generic_expr<std::int64_t>(body + " total", 16164, mlang::ObjectType::INTEGER);
+    test_generic_expr<std::int64_t>(fmt::format("let f = fn() {{ {} total }}; f()", body), 16164, mlang::ObjectType::INTEGER);
+
+    std::vector<std::string> params;
+    std::vector<std::string> args;
+    for (int i = 0; i < 300; ++i)
+    {
+        params.push_back(fmt::format("{}{}", static_cast<char>('a' + i / 26), static_cast<char>('a' + i % 26)));
+        args.push_back(std::to_string(i));
+    }
+    test_generic_expr<std::int64_t>(fmt::format("let f = fn({}) {{ {} + {} }}; f({})", fmt::join(params, ", "), params.front(), params.back(), fmt::join(args, ", ")),
+                                    299, mlang::ObjectType::INTEGER);
+}
+
+TEST(eval, TailCallsRunInConstantStack)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::int64_t>>;
+    for (const auto& [input, expected] : arg_list_t{
+             {R"(
+                let count = fn(n, acc) {
+                    if (n == 0) {
+                        return acc;
+                    }
+                    count(n - 1, acc + 1);
+                };
+                let even = fn(n) { if (n == 0) { true } else { odd(n - 1) } };
+                let odd = fn(n) { if (n == 0) { false } else { even(n - 1) } };
+                if (even(1001)) { 0 } else { count(10000000, 0) }
+             )",                                                                                           10000000},
+             {R"(
+                let make = fn(n, fs) { if (n == 0) { return fs; } make(n - 1, push(fs, fn() { n })) };
+                let fs = make(3, []);
+                fs[0]() + fs[1]() * 10 + fs[2]() * 100
+             )",                                                                                           123     },
+    })
+    {
+        for (const auto engine : ENGINES)
+        {
+            mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+            auto program = p.parse_program();
+            ASSERT_THAT(p.get_errors(), IsEmpty());
+            auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+            ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+            ASSERT_EQ(res.get_type(), mlang::ObjectType::INTEGER) << magic_enum::enum_name(engine) << ": " << res.inspect();
+            EXPECT_EQ(res.as_integer(), expected) << magic_enum::enum_name(engine);
+        }
+    }
+}
+
+TEST(eval, StackOverflowIsAnError)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>("let f = fn(n) { 1 + f(n + 1) }; f(0)"));
+    auto program = p.parse_program();
+    ASSERT_THAT(p.get_errors(), IsEmpty());
+    for (const auto engine : ENGINES)
+    {
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine, 100);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::ERROR) << res.inspect() << " " << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.as<mlang::ErrorObj>().m_what, "stack overflow: maximum call depth 100 exceeded") << magic_enum::enum_name(engine);
+
+        res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::ERROR) << res.inspect() << " " << magic_enum::enum_name(engine);
+        EXPECT_THAT(res.as<mlang::ErrorObj>().m_what, StartsWith("stack overflow")) << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(eval, DeepRecursionOnHeapFrames)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>("let f = fn(n) { if (n == 0) { 0 } else { 1 + f(n - 1) } }; f(1000000)"));
+    auto program = p.parse_program();
+    ASSERT_THAT(p.get_errors(), IsEmpty());
+    for (const auto engine : {mlang::Engine::StackVm, mlang::Engine::RegisterVm})
+    {
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::INTEGER) << res.inspect() << " " << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.as_integer(), 1000000) << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(eval, NativeRecursionUsesThreadStack)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>("let f = fn(n) { if (n == 0) { 0 } else { 1 + f(n - 1) } }; f(5000)"));
+    auto program = p.parse_program();
+    ASSERT_THAT(p.get_errors(), IsEmpty());
+    for (const auto engine : {mlang::Engine::TreeWalker, mlang::Engine::ClosureCompiler, mlang::Engine::FlatWalker})
+    {
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        ASSERT_EQ(res.get_type(), mlang::ObjectType::INTEGER) << res.inspect() << " " << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.as_integer(), 5000) << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(eval, QuickenedSitesFallBackOnTypeChange)
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>(R"(
+        let add = fn(a, b) { a + b };
+        let at = fn(c, i) { c[i] };
+        let ints = add(1, 2) + add(3, 4);
+        let strs = add("a", "b");
+        let flags = [true == true, true != true];
+        [ints, strs, at([1, 2], 1), at({"k": 3}, "k"), at([1], 5), flags[0], flags[1]]
+    )"));
+    auto program = p.parse_program();
+    ASSERT_THAT(p.get_errors(), IsEmpty());
+    auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), mlang::Engine::TreeWalker);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res.inspect(), R"([10, "ab", 2, 3, null, true, false])");
+
+    const auto stats = mlang::collect_feedback(program.get());
+    EXPECT_EQ(stats.m_polymorphic, 2);
+    EXPECT_GT(stats.m_monomorphic, 0);
+    EXPECT_EQ(stats.m_megamorphic, 0);
+    EXPECT_GT(stats.m_hits, 0);
+    EXPECT_EQ(stats.m_misses, 3);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        eval(program.get(), mlang::make_ref<mlang::Context>(), mlang::Engine::TreeWalker);
+    }
+    EXPECT_EQ(mlang::collect_feedback(program.get()).m_megamorphic, 2);
+}
+
+TEST(eval, InlineValues)
+{
+    EXPECT_EQ(mlang::Value::integer(42), mlang::Value::integer(42));
+    EXPECT_NE(mlang::Value::integer(1), mlang::Value::boolean(true));
+    EXPECT_EQ(mlang::Value::boolean(false), mlang::detail::FALSE);
+    EXPECT_EQ(mlang::Value::nil().get_type(), mlang::ObjectType::NIL);
+    EXPECT_FALSE(mlang::Value());
+    EXPECT_EQ(mlang::Value::integer(-7).inspect(), "-7");
+
+    mlang::PersistentMap pairs;
+    pairs.set(mlang::Value::integer(1), mlang::Value::integer(10));
+    pairs.set(mlang::make_ref<mlang::StringObj>("1"), mlang::Value::integer(20));
+    EXPECT_EQ(pairs.find(mlang::Value::integer(1))->as_integer(), 10);
+    EXPECT_EQ(pairs.find(mlang::make_ref<mlang::StringObj>("1"))->as_integer(), 20);
+    EXPECT_EQ(pairs.find(mlang::make_ref<mlang::StringObj>(mlang::Atom::intern("1")))->as_integer(), 20);
+}
+
+TEST(eval, SmallHashesKeepInsertionOrder)
+{
+    const std::string input = R"(
+        let small = erase({"c": 1, "a": 2, 1: 3, true: 4, "b": 5}, 1);
+        let fill = fn(h, i, n) { if (i == n) { h } else { fill(push(h, i, i), i + 1, n) } };
+        let drain = fn(h, i, n) { if (i == n) { h } else { drain(erase(h, i), i + 1, n) } };
+        let big = fill({}, 0, 9);
+        let again = push(drain(big, 0, 9), "x", 1);
+        [small, push(small, "a", 6), big[0], big[8], big[9], again, drain(big, 1, 9)]
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        ASSERT_THAT(p.get_errors(), IsEmpty());
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.inspect(), R"([{"c":1, "a":2, true:4, "b":5}, {"c":1, "a":6, true:4, "b":5}, 0, 8, null, {"x":1}, {0:0}])")
+            << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(eval, HashesWithSameKeysShareShape)
+{
+    const std::string input = R"(
+        [{"a": 1, "b": 2}, {"a": 3, "b": 4}, {"b": 5, "a": 6}, erase({"a": 7, "c": 8, "b": 9}, "c"), push({"a": 0}, "b", 1), {"a": 1, 2: 3}, {}]
+    )";
+    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+    auto program = p.parse_program();
+    ASSERT_THAT(p.get_errors(), IsEmpty());
+    auto res = eval(program.get(), mlang::make_ref<mlang::Context>());
+    ASSERT_EQ(res.get_type(), mlang::ObjectType::ARRAY);
+    const auto shape = [&res](std::size_t i)
+    {
+        return res.as<mlang::ArrayObj>().at(i).as<mlang::HashObj>().m_pairs.shape();
+    };
+    ASSERT_THAT(shape(0), NotNull());
+    EXPECT_EQ(shape(0)->size(), 2);
+    EXPECT_EQ(shape(0)->slot(mlang::Atom::intern("b")), 1);
+    EXPECT_EQ(shape(1), shape(0));
+    EXPECT_NE(shape(2), shape(0));
+    EXPECT_EQ(shape(3), shape(0));
+    EXPECT_EQ(shape(4), shape(0));
+    EXPECT_EQ(shape(5), nullptr);
+    EXPECT_EQ(shape(6), nullptr);
+}
+
+TEST(eval, ShapeCachedIndexSites)
+{
+    const std::string input = R"(
+        let get = fn(h) { h["x"] };
+        let a = {"x": 1, "y": 2};
+        let b = {"y": 3, "x": 4};
+        let c = push(a, "z", 5);
+        let d = erase(b, "y");
+        let e = {"w": 0, 1: 2, "x": 7};
+        let f = {"y": 8};
+        [get(a), get(b), get(c), get(d), get(e), get(f), get(a), get(push(f, "x", 9)), get(push(a, "x", 10)), get(a)]
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+        auto program = p.parse_program();
+        ASSERT_THAT(p.get_errors(), IsEmpty());
+        auto res = eval(program.get(), mlang::make_ref<mlang::Context>(), engine);
+        ASSERT_TRUE(res) << magic_enum::enum_name(engine);
+        EXPECT_EQ(res.inspect(), "[1, 4, 1, 4, 7, null, 1, 9, 10, 1]") << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(eval, RefCounting)
+{
+    auto str = mlang::make_ref<mlang::StringObj>("abc");
+    EXPECT_EQ(str->ref_count(), 1);
+    {
+        mlang::Value val = str;
+        auto copy = val;
+        EXPECT_EQ(str->ref_count(), 3);
+        auto moved = std::move(copy);
+        EXPECT_EQ(str->ref_count(), 3);
+        EXPECT_EQ(moved.cast<mlang::StringObj>(), str);
     }
+    EXPECT_EQ(str->ref_count(), 1);
+    auto arr = mlang::make_ref<mlang::ArrayObj>(std::vector<mlang::Value>{str, str});
+    EXPECT_EQ(str->ref_count(), 3);
+    arr = nullptr;
+    EXPECT_EQ(str->ref_count(), 1);
 }
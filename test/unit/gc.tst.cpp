@@ -0,0 +1,242 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <mlang/eval.hpp>
+#include <mlang/gc.hpp>
+#include <mlang/parser.hpp>
+#include <thread>
+
+using namespace ::testing;
+
+namespace
+{
+constexpr auto ENGINES = std::array{mlang::Engine::TreeWalker, mlang::Engine::StackVm, mlang::Engine::RegisterVm, mlang::Engine::ClosureCompiler, mlang::Engine::FlatWalker};
+
+auto parse(const std::string& input) -> std::unique_ptr<mlang::Program>
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+    auto program = p.parse_program();
+    EXPECT_THAT(p.get_errors(), IsEmpty()) << input;
+    return program;
+}
+
+auto run(const std::string& input, const mlang::Ref<mlang::Context>& env, mlang::Engine engine) -> std::string
+{
+    auto program = parse(input);
+    const auto res = mlang::eval(program.get(), env, engine);
+    return res ? res.inspect() : "nil";
+}
+}  // namespace
+
+TEST(gc, CollectsUnreachableCycles)
+{
+#ifdef ENABLE_ATOMIC_REFCOUNT
+    GTEST_SKIP() << "cycle collection is disabled with atomic reference counts";
+#endif
+    const std::string input = R"(
+    let make = fn(n) {
+        let f = fn(x) { if (x > 0) { f(x - 1) } else { n } };
+        let xs = [fn() { xs }];
+        f
+    };
+    let i = 0;
+    while (i < 1000) {
+        let g = make(i);
+        let i = i + 1;
+    }
+    g(3)
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::collect_cycles();
+        const auto tracked = mlang::gc_stats().m_tracked;
+        const auto collected = mlang::gc_stats().m_collected;
+        {
+            auto env = mlang::make_ref<mlang::Context>();
+            EXPECT_EQ(run(input, env, engine), "999") << magic_enum::enum_name(engine);
+        }
+        mlang::collect_cycles();
+        EXPECT_EQ(mlang::gc_stats().m_tracked, tracked) << magic_enum::enum_name(engine);
+        EXPECT_EQ(mlang::gc_stats().m_candidates, 0) << magic_enum::enum_name(engine);
+        if (engine == mlang::Engine::TreeWalker)
+        {
+            EXPECT_GE(mlang::gc_stats().m_collected - collected, 4000);
+        }
+    }
+}
+
+TEST(gc, KeepsReachableCycles)
+{
+    for (const auto engine : ENGINES)
+    {
+        auto env = mlang::make_ref<mlang::Context>();
+        run("let make = fn(n) { let f = fn(x) { if (x > 0) { f(x - 1) } else { n } }; f }; let g = make(7);", env, engine);
+        mlang::collect_cycles();
+        EXPECT_EQ(run("g(5)", env, engine), "7") << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(gc, TracesSharedVectorNodes)
+{
+#ifdef ENABLE_ATOMIC_REFCOUNT
+    GTEST_SKIP() << "cycle collection is disabled with atomic reference counts";
+#endif
+    const std::string input = R"(
+    let fill = fn(arr, k) { if (k == 0) { arr } else { fill(push(arr, k), k - 1) } };
+    let make = fn(n) {
+        let f = fn(k) { if (k > 0) { f(k - 1) } else { n } };
+        let xs = fill([f], 40);
+        [push(xs, 0), push(xs, 1)]
+    };
+    let i = 0;
+    while (i < 100) {
+        let pair = make(i);
+        let i = i + 1;
+    }
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::collect_cycles();
+        const auto tracked = mlang::gc_stats().m_tracked;
+        {
+            auto env = mlang::make_ref<mlang::Context>();
+            run(input, env, engine);
+            mlang::collect_cycles();
+            EXPECT_EQ(run("pair[0][0](3) + pair[1][0](2) + len(pair[1])", env, engine), "240") << magic_enum::enum_name(engine);
+        }
+        mlang::collect_cycles();
+        EXPECT_EQ(mlang::gc_stats().m_tracked, tracked) << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(gc, TracesSharedMapNodes)
+{
+#ifdef ENABLE_ATOMIC_REFCOUNT
+    GTEST_SKIP() << "cycle collection is disabled with atomic reference counts";
+#endif
+    const std::string input = R"(
+    let fill = fn(h, k) { if (k == 0) { h } else { fill(push(h, k, k), k - 1) } };
+    let make = fn(n) {
+        let f = fn(k) { if (k > 0) { f(k - 1) } else { n } };
+        let h = fill({0: f}, 40);
+        [push(h, 41, 0), erase(h, 40)]
+    };
+    let i = 0;
+    while (i < 100) {
+        let pair = make(i);
+        let i = i + 1;
+    }
+    )";
+    for (const auto engine : ENGINES)
+    {
+        mlang::collect_cycles();
+        const auto tracked = mlang::gc_stats().m_tracked;
+        {
+            auto env = mlang::make_ref<mlang::Context>();
+            run(input, env, engine);
+            mlang::collect_cycles();
+            EXPECT_EQ(run("pair[0][0](3) + pair[1][0](2) + pair[0][40]", env, engine), "238") << magic_enum::enum_name(engine);
+        }
+        mlang::collect_cycles();
+        EXPECT_EQ(mlang::gc_stats().m_tracked, tracked) << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(gc, StatsBuiltin)
+{
+    auto env = mlang::make_ref<mlang::Context>();
+    for (const auto engine : ENGINES)
+    {
+#ifdef ENABLE_ATOMIC_REFCOUNT
+        const auto* expected = "[4, false]";
+#else
+        const auto* expected = "[4, true]";
+#endif
+        EXPECT_EQ(run(R"(let s = gc_stats(); [len([s["collections"], s["collected"], s["candidates"], s["tracked"]]), s["tracked"] > 0])", env, engine),
+                  expected)
+            << magic_enum::enum_name(engine);
+        EXPECT_EQ(run("gc_stats(1)", env, engine), "ERROR: invalid number of parameters for gc_stats, expected 0 got 1") << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(gc, HeapRecyclesBlocks)
+{
+#ifdef ENABLE_ATOMIC_REFCOUNT
+    GTEST_SKIP() << "objects use the global allocator with atomic reference counts";
+#endif
+    const auto before = mlang::heap_stats();
+    const void* first = nullptr;
+    {
+        auto str = mlang::make_ref<mlang::StringObj>("first");
+        first = str.get();
+        EXPECT_EQ(mlang::heap_stats().m_live, before.m_live + 1);
+    }
+    const auto after = mlang::heap_stats();
+    EXPECT_EQ(after.m_live, before.m_live);
+    auto err = mlang::make_ref<mlang::ErrorObj>("second");
+    EXPECT_EQ(static_cast<const void*>(err.get()), first);
+    EXPECT_EQ(mlang::heap_stats().m_recycled, after.m_recycled + 1);
+}
+
+TEST(gc, RepeatedCollectionsStayBounded)
+{
+#ifdef ENABLE_ATOMIC_REFCOUNT
+    GTEST_SKIP() << "cycle collection is disabled with atomic reference counts";
+#endif
+    const std::string input = R"(
+    let work = fn(n) {
+        let xs = [n, n + 1];
+        let f = fn(k) { if (k > 0) { f(k - 1) } else { xs[0] } };
+        f(2)
+    };
+    let i = 0;
+    let tracked = 0;
+    let live = 0;
+    while (i < 200000) {
+        work(i);
+        let s = gc_stats();
+        if (tracked < s["tracked"]) { let tracked = s["tracked"]; }
+        if (live < s["heap_live"]) { let live = s["heap_live"]; }
+        let i = i + 1;
+    }
+    [tracked < 100000, live < 200000]
+    )";
+    for (const auto engine : ENGINES)
+    {
+        auto env = mlang::make_ref<mlang::Context>();
+        EXPECT_EQ(run(input, env, engine), "[true, true]") << magic_enum::enum_name(engine);
+    }
+}
+
+TEST(gc, BuiltinsAreSharedAcrossThreads)
+{
+    const std::string input = R"(
+    let i = 0;
+    let xs = [];
+    while (i < 20000) {
+        let f = [len, push, first, last, rest][i - i / 5 * 5];
+        let xs = push(xs, len([f, i]));
+        let i = i + 1;
+    }
+    [len(xs), first(xs), last(rest(xs))]
+    )";
+    const auto refs = mlang::detail::LEN->ref_count();
+    {
+        const mlang::Value len = mlang::detail::LEN;
+        EXPECT_EQ(mlang::detail::LEN->ref_count(), refs);
+    }
+    for (const auto engine : ENGINES)
+    {
+        std::array<std::string, 2> results;
+        const auto worker = [&](std::size_t i)
+        {
+            auto env = mlang::make_ref<mlang::Context>();
+            results[i] = run(input, env, engine);
+        };
+        std::array threads{std::thread(worker, 0), std::thread(worker, 1)};
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        EXPECT_THAT(results, Each(Eq("[20000, 2, 2]"))) << magic_enum::enum_name(engine);
+    }
+}
@@ -0,0 +1,93 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <mlang/eval.hpp>
+#include <mlang/optimizer.hpp>
+#include <mlang/parser.hpp>
+
+using namespace ::testing;
+
+namespace
+{
+constexpr auto ENGINES = std::array{mlang::Engine::TreeWalker, mlang::Engine::StackVm, mlang::Engine::RegisterVm, mlang::Engine::ClosureCompiler, mlang::Engine::FlatWalker};
+
+auto parse(const std::string& input) -> std::unique_ptr<mlang::Program>
+{
+    mlang::Parser p(std::make_unique<mlang::Lexer>(input));
+    auto program = p.parse_program();
+    EXPECT_THAT(p.get_errors(), IsEmpty()) << input;
+    return program;
+}
+
+auto run(mlang::Program& program, mlang::Engine engine) -> std::string
+{
+    auto env = mlang::make_ref<mlang::Context>();
+    const auto res = mlang::eval(&program, env, engine);
+    return res ? res.inspect() : "nil";
+}
+
+void test_optimize(const std::string& input, const std::string& expected, std::size_t folded, std::size_t propagated, std::size_t pruned)
+{
+    auto reference = parse(input);
+    ASSERT_THAT(reference, NotNull()) << input;
+    auto program = parse(input);
+    const auto stats = mlang::optimize(*program);
+    EXPECT_EQ(program->to_string(), expected) << input;
+    EXPECT_EQ(stats.m_folded, folded) << input;
+    EXPECT_EQ(stats.m_propagated, propagated) << input;
+    EXPECT_EQ(stats.m_pruned, pruned) << input;
+    for (const auto engine : ENGINES)
+    {
+        EXPECT_EQ(run(*program, engine), run(*reference, engine)) << input << " " << magic_enum::enum_name(engine);
+    }
+}
+}  // namespace
+
+TEST(optimizer, FoldsConstants)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::string, std::size_t>>;
+    for (const auto& [input, expected, folded] : arg_list_t{
+             {R"("b" + "a" + "r")",  R"("bar")",          2},
+             {"6 / 2 * (1 + 2)",     "9",                 3},
+             {"-5 + 10",             "5",                 2},
+             {"!true == false",      "true",              2},
+             {"1 < 2",               "true",              1},
+             {"5 + true",            "(5 + true)",        0},
+             {"x + 1 * 2",           "(x + 2)",           1},
+    })
+    {
+        test_optimize(input, expected, folded, 0, 0);
+    }
+    auto division_by_zero = parse("1 / 0");
+    EXPECT_EQ(mlang::optimize(*division_by_zero).m_folded, 0);
+    EXPECT_EQ(division_by_zero->to_string(), "(1 / 0)");
+}
+
+TEST(optimizer, PropagatesLetConstants)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::string, std::size_t, std::size_t>>;
+    for (const auto& [input, expected, folded, propagated] : arg_list_t{
+             {"let x = 2 * 3; let y = x + 1; y",               "let x = 6;let y = 7;7",                         2, 2},
+             {"let x = 1; let x = 2; x",                       "let x = 1;let x = 2;x",                         0, 0},
+             {"let x = 1; let f = fn(x) { x }; f(2)",          "let x = 1;let f = fn(x){x};f(2)",               0, 0},
+             {"let f = fn() { let a = 4; a * a }; f()",        "let f = fn(){let a = 4;16};f()",                1, 2},
+             {"let x = 1; let f = fn() { x + 1 }; f()",        "let x = 1;let f = fn(){2};f()",                 1, 1},
+             {"let i = 0; while (i < 3) { let i = i + 1; } i", "let i = 0;while((i < 3)){let i = (i + 1);}i",   0, 0},
+    })
+    {
+        test_optimize(input, expected, folded, propagated, 0);
+    }
+}
+
+TEST(optimizer, PrunesConstantBranches)
+{
+    using arg_list_t = std::initializer_list<std::tuple<std::string, std::string, std::size_t, std::size_t>>;
+    for (const auto& [input, expected, folded, pruned] : arg_list_t{
+             {"if (1 > 2) { 10 } else { 20 }", "if true {20}", 1, 1},
+             {"if (1 < 2) { 10 } else { 20 }", "if true {10}", 1, 1},
+             {"if (false) { 10 }",             "if false {}",  0, 1},
+             {"if (1) { 10 }",                 "if 1 {10}",    0, 0},
+    })
+    {
+        test_optimize(input, expected, folded, 0, pruned);
+    }
+}
@@ -105,7 +105,7 @@ void test_prefix_expr(const std::string& input, const std::string& op, std::int6
     EXPECT_EQ(program->m_statements.size(), 1);
     const auto& node_val = dynamic_cast<mlang::PrefixExpression&>(
         *dynamic_cast<mlang::ExpressionStatement&>(*program->m_statements[0]).m_expression);
-    EXPECT_EQ(node_val.m_operator, op);
+    EXPECT_EQ(mlang::to_string(node_val.m_operator), op);
     EXPECT_EQ(node_val.m_token.literal, op);
     EXPECT_EQ("("s + input + ")"s, program->to_string());
     EXPECT_EQ(dynamic_cast<mlang::IntegerLiteral&>(*node_val.m_right).m_value, val);
@@ -136,7 +136,7 @@ void test_infix_expr(const std::string& input, std::int64_t l, const std::string
     EXPECT_EQ(program->m_statements.size(), 1);
     const auto& node_val = dynamic_cast<mlang::InfixExpression&>(
         *dynamic_cast<mlang::ExpressionStatement&>(*program->m_statements[0]).m_expression);
-    EXPECT_EQ(node_val.m_operator, op);
+    EXPECT_EQ(mlang::to_string(node_val.m_operator), op);
     EXPECT_EQ(node_val.m_token.literal, op);
     EXPECT_EQ("("s + input.substr(0, std::size(input) - 1) + ")"s, program->to_string());
     EXPECT_EQ(dynamic_cast<mlang::IntegerLiteral&>(*node_val.m_right).m_value, l);
@@ -336,9 +336,105 @@ TEST(Parser, IndexExpression)
     const auto& left = dynamic_cast<mlang::Identifier&>(*node_val.m_left);
     const auto& right = dynamic_cast<mlang::InfixExpression&>(*node_val.m_index);
     EXPECT_EQ(left.m_value, "arr");
-    EXPECT_EQ(right.m_operator, "+");
+    EXPECT_EQ(right.m_operator, mlang::Operator::Plus);
     const auto& left_int = dynamic_cast<mlang::IntegerLiteral&>(*right.m_left);
     EXPECT_EQ(left_int.m_value, 2);
     const auto& right_int = dynamic_cast<mlang::IntegerLiteral&>(*right.m_right);
     EXPECT_EQ(right_int.m_value, 1);
 }
+
+TEST(Parser, ResolvesLexicalAddresses)
+{
+    mlang::Parser parser(std::make_unique<mlang::Lexer>("let g = 1; fn(a) { let b = a; fn(c) { a + b + c + g + len } }"));
+    const auto program = parser.parse_program();
+    EXPECT_THAT(parser.get_errors(), IsEmpty());
+    ASSERT_EQ(program->m_statements.size(), 2);
+
+    auto& global_let = dynamic_cast<mlang::LetStatement&>(*program->m_statements[0]);
+    EXPECT_FALSE(global_let.m_name->m_address);
+
+    auto& outer = dynamic_cast<mlang::FnLiteral&>(*dynamic_cast<mlang::ExpressionStatement&>(*program->m_statements[1]).m_expression);
+    ASSERT_THAT(outer.m_slot_names, NotNull());
+    EXPECT_THAT(*outer.m_slot_names, ElementsAre("a", "b"));
+
+    auto& let_b = dynamic_cast<mlang::LetStatement&>(*outer.m_body->m_statements[0]);
+    ASSERT_TRUE(let_b.m_name->m_address);
+    EXPECT_EQ(let_b.m_name->m_address->m_slot, 1);
+
+    auto& inner = dynamic_cast<mlang::FnLiteral&>(*dynamic_cast<mlang::ExpressionStatement&>(*outer.m_body->m_statements[1]).m_expression);
+    EXPECT_THAT(*inner.m_slot_names, ElementsAre("c"));
+    std::vector<mlang::Identifier*> idents;
+    mlang::Expression* expr = dynamic_cast<mlang::ExpressionStatement&>(*inner.m_body->m_statements[0]).m_expression.get();
+    while (auto* infix = dynamic_cast<mlang::InfixExpression*>(expr))
+    {
+        idents.insert(std::begin(idents), &dynamic_cast<mlang::Identifier&>(*infix->m_right));
+        expr = infix->m_left.get();
+    }
+    idents.insert(std::begin(idents), &dynamic_cast<mlang::Identifier&>(*expr));
+    ASSERT_EQ(idents.size(), 5);
+    const auto expect_address = [](mlang::Identifier& ident, std::size_t depth, std::size_t slot)
+    {
+        ASSERT_TRUE(ident.m_address) << ident.m_value;
+        EXPECT_EQ(ident.m_address->m_depth, depth) << ident.m_value;
+        EXPECT_EQ(ident.m_address->m_slot, slot) << ident.m_value;
+    };
+    expect_address(*idents[0], 1, 0);
+    expect_address(*idents[1], 1, 1);
+    expect_address(*idents[2], 0, 0);
+    EXPECT_FALSE(idents[3]->m_address);
+    EXPECT_FALSE(idents[3]->m_builtin);
+    EXPECT_FALSE(idents[4]->m_address);
+    EXPECT_TRUE(idents[4]->m_builtin);
+}
+
+TEST(Parser, ArenaOwnsProgram)
+{
+    auto input = std::make_unique<std::string>(R"(let f = fn(x) { x + "s" }; let g = fn() { [1, 2] }; f(g);)");
+    mlang::Parser parser(std::make_unique<mlang::Lexer>(*input));
+    const auto program = parser.parse_program();
+    EXPECT_THAT(parser.get_errors(), IsEmpty());
+    input.reset();
+    EXPECT_EQ(program->to_string(), R"(let f = fn(x){(x + "s")};let g = fn(){[1, 2]};f(g))");
+    const auto stats = program->m_arena->stats();
+    EXPECT_EQ(stats.m_chunks, 1);
+    EXPECT_EQ(stats.m_nodes, 21);
+    EXPECT_EQ(stats.m_finalizers, 2);
+}
+
+TEST(Parser, FlatProgramMatchesTree)
+{
+    for (const auto* input : {
+             R"(let f = fn(x, y) { if (x < y) { return -x; } else { !y } }; f(1, 2 * 3)[0];)",
+             R"(let h = {"a": [1, 2], true: fn() { h["a"] }}; while (h) { puts("s", len(h)) })",
+             "",
+         })
+    {
+        mlang::Parser tree_parser(std::make_unique<mlang::Lexer>(input));
+        const auto program = tree_parser.parse_program();
+        mlang::Parser flat_parser(std::make_unique<mlang::Lexer>(input));
+        const auto flat = flat_parser.parse_flat_program();
+        EXPECT_THAT(flat_parser.get_errors(), IsEmpty()) << input;
+        EXPECT_EQ(flat->to_string(), program->to_string()) << input;
+        EXPECT_EQ(flat->m_kinds[flat->m_root], mlang::NodeType::Program);
+        EXPECT_EQ(flat->m_payloads.size(), flat->size());
+        EXPECT_EQ(flat->m_children.size(), flat->size());
+    }
+}
+
+TEST(Parser, InternsIdentifiersAndStrings)
+{
+    mlang::Parser first(std::make_unique<mlang::Lexer>(R"(let name = "key"; name)"));
+    mlang::Parser second(std::make_unique<mlang::Lexer>(R"(["key", name])"));
+    const auto lhs = first.parse_program();
+    const auto rhs = second.parse_program();
+    const auto& let = static_cast<mlang::LetStatement&>(*lhs->m_statements[0]);
+    const auto& array = static_cast<mlang::ArrayLiteral&>(*static_cast<mlang::ExpressionStatement&>(*rhs->m_statements[0]).m_expression);
+    const auto& key = static_cast<mlang::StringLiteral&>(*array.m_expressions[0]);
+    const auto& name = static_cast<mlang::Identifier&>(*array.m_expressions[1]);
+    EXPECT_EQ(let.m_name->m_value, name.m_value);
+    EXPECT_EQ(let.m_name->m_value.view().data(), name.m_value.view().data());
+    EXPECT_EQ(static_cast<mlang::StringLiteral&>(*let.m_value).m_value, key.m_value);
+    EXPECT_EQ(key.m_value, "key");
+    EXPECT_EQ(mlang::Atom::intern("key").hash(), std::hash<std::string_view>{}("key"));
+    EXPECT_EQ(mlang::Atom::intern(""), mlang::Atom());
+}